@@ -98,6 +98,44 @@ int fs_ext2_shutdown(void);
 #define FS_EXT2_MOUNT_READWRITE     0x00000001  /**< \brief Mount read-write */
 /** @} */
 
+/** \defgroup ext2_ioctls             ioctl Commands
+    \brief                              ioctl commands supported by fs_ext2
+    \ingroup                            vfs_ext2
+
+    These commands can be passed to fs_ioctl() on any file descriptor that is
+    open on an ext2 filesystem. They apply to the whole filesystem the file is
+    on, not just to the file itself.
+
+    @{
+*/
+/** \brief Retrieve block cache statistics.
+
+    The argument must be a pointer to a fs_ext2_cache_stats_t to fill in.
+*/
+#define FS_EXT2_IOCTL_CACHE_STATS       0x45580001
+
+/** \brief Retrieve and reset block cache statistics.
+
+    The argument may be a pointer to a fs_ext2_cache_stats_t to fill in with
+    the statistics before they are reset, or NULL.
+*/
+#define FS_EXT2_IOCTL_CACHE_STATS_RESET 0x45580002
+/** @} */
+
+/** \brief   Block cache statistics for a mounted ext2 filesystem.
+    \ingroup vfs_ext2
+
+    This structure is filled in by the FS_EXT2_IOCTL_CACHE_STATS ioctl. All of
+    the counters start at zero when the filesystem is mounted.
+*/
+typedef struct fs_ext2_cache_stats {
+    uint32_t cache_size;    /**< \brief Number of blocks in the cache */
+    uint32_t hits;          /**< \brief Block accesses satisfied by the cache */
+    uint32_t misses;        /**< \brief Block accesses read from the device */
+    uint32_t evictions;     /**< \brief Valid blocks evicted from the cache */
+    uint32_t writebacks;    /**< \brief Dirty blocks written to the device */
+} fs_ext2_cache_stats_t;
+
 /** \brief   Mount an ext2 filesystem in the VFS.
     \ingroup vfs_ext2
 
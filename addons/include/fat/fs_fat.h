@@ -73,12 +73,21 @@ int fs_fat_shutdown(void);
     not support writing, then the filesystem will not be mounted as read-write
     (for obvious reasons).
 
-    These should stay synchronized with the ones in fatfs.h.
+    These should stay synchronized with the ones in fatfs.h, except for
+    FS_FAT_MOUNT_BG_FREEMAP, which is handled by fs_fat itself.
+
+    When a filesystem is mounted read-write, a bitmap of free clusters is built
+    from the FAT so that allocating clusters does not need to search the FAT.
+    By default it is built the first time a cluster is allocated, which can
+    take a while on a large FAT32 volume. FS_FAT_MOUNT_BG_FREEMAP builds it in
+    a background thread right after mounting instead.
 
     @{
 */
 #define FS_FAT_MOUNT_READONLY       0x00000000  /**< \brief Mount read-only */
 #define FS_FAT_MOUNT_READWRITE      0x00000001  /**< \brief Mount read-write */
+#define FS_FAT_MOUNT_BG_FREEMAP     0x00000002  /**< \brief Build free cluster
+                                                     map in the background */
 /** @} */
 
 /** \brief   Mount a FAT filesystem in the VFS.
@@ -21,70 +21,71 @@
 
 static int initted = 0;
 
-/* This is basically the same as bgrad_cache from fs_iso9660 */
-static void make_mru(ext2_fs_t *fs, ext2_cache_t **cache, int block) {
-    int i;
-    ext2_cache_t *tmp;
-
-    /* Don't try it with the end block */
-    if(block < 0 || block >= fs->cache_size - 1)
-        return;
+/* Move a cache entry to the most recently used end of the LRU list. */
+static inline void make_mru(ext2_fs_t *fs, ext2_cache_t *ent) {
+    TAILQ_REMOVE(&fs->lru, ent, lentry);
+    TAILQ_INSERT_TAIL(&fs->lru, ent, lentry);
+}
 
-    /* Make a copy and scoot everything down */
-    tmp = cache[block];
+static ext2_cache_t *cache_lookup(ext2_fs_t *fs, uint32_t bl) {
+    ext2_cache_t *ent;
 
-    for(i = block; i < fs->cache_size - 1; ++i) {
-        cache[i] = cache[i + 1];
+    LIST_FOREACH(ent, &fs->bhash[bl & fs->bhash_mask], hentry) {
+        if(ent->block == bl)
+            return ent;
     }
 
-    cache[fs->cache_size - 1] = tmp;
+    return NULL;
 }
 
 /* XXXX: This needs locking! */
 uint8_t *ext2_block_read(ext2_fs_t *fs, uint32_t bl, int *err) {
-    int i;
-    uint8_t *rv;
-    ext2_cache_t **cache = fs->bcache;
-
-    /* Look through the cache from the most recently used to the least recently
-       used entry. */
-    for(i = fs->cache_size - 1; i >= 0; --i) {
-        if(cache[i]->block == bl && cache[i]->flags) {
-            rv = cache[i]->data;
-            make_mru(fs, cache, i);
-            goto out;
-        }
+    ext2_cache_t *ent;
+
+    /* See if we've already got the block in the cache. */
+    if((ent = cache_lookup(fs, bl))) {
+        ++fs->cache_stats.hits;
+        make_mru(fs, ent);
+        return ent->data;
     }
 
-    /* If we didn't get anything, did we end up with an invalid entry or do we
-       need to boot someone out? */
-    if(i < 0) {
-        i = 0;
+    ++fs->cache_stats.misses;
 
+    /* Grab the least recently used entry. Invalid entries are always kept at
+       the head of the list, so they'll get used up before anything that is
+       actually holding data gets booted out. */
+    ent = TAILQ_FIRST(&fs->lru);
+
+    if(ent->flags & EXT2_CACHE_FLAG_VALID) {
         /* Make sure that if the block is dirty, we write it back out. */
-        if(cache[0]->flags & EXT2_CACHE_FLAG_DIRTY) {
-            if(ext2_block_write_nc(fs, cache[0]->block, cache[0]->data)) {
+        if(ent->flags & EXT2_CACHE_FLAG_DIRTY) {
+            if(ext2_block_write_nc(fs, ent->block, ent->data)) {
                 /* XXXX: Uh oh... */
                 *err = EIO;
                 return NULL;
             }
+
+            ++fs->cache_stats.writebacks;
         }
+
+        LIST_REMOVE(ent, hentry);
+        ent->flags = 0;
+        ++fs->cache_stats.evictions;
     }
 
-    /* Try to read the block in question. */
-    if(ext2_block_read_nc(fs, bl, cache[i]->data)) {
+    /* Try to read the block in question. On failure, the entry is left invalid
+       at the head of the LRU list. */
+    if(ext2_block_read_nc(fs, bl, ent->data)) {
         *err = EIO;
-        cache[i]->flags = 0;            /* Mark it as invalid... */
         return NULL;
     }
 
-    cache[i]->block = bl;
-    cache[i]->flags = EXT2_CACHE_FLAG_VALID;
-    rv = cache[i]->data;
-    make_mru(fs, cache, i);
+    ent->block = bl;
+    ent->flags = EXT2_CACHE_FLAG_VALID;
+    LIST_INSERT_HEAD(&fs->bhash[bl & fs->bhash_mask], ent, hentry);
+    make_mru(fs, ent);
 
-out:
-    return rv;
+    return ent->data;
 }
 
 int ext2_block_read_nc(ext2_fs_t *fs, uint32_t block_num, uint8_t *rv) {
@@ -124,42 +125,47 @@ int ext2_block_write_nc(ext2_fs_t *fs, uint32_t block_num, const uint8_t *blk) {
 }
 
 int ext2_block_mark_dirty(ext2_fs_t *fs, uint32_t block_num) {
-    int i;
-    ext2_cache_t **cache = fs->bcache;
-
-    /* Look through the cache from the most recently used to the least recently
-       used entry. */
-    for(i = fs->cache_size - 1; i >= 0; --i) {
-        if(cache[i]->block == block_num && cache[i]->flags) {
-            cache[i]->flags |= EXT2_CACHE_FLAG_DIRTY;
-            make_mru(fs, cache, i);
-            return 0;
-        }
-    }
+    ext2_cache_t *ent;
+
+    if(!(ent = cache_lookup(fs, block_num)))
+        return -EINVAL;
 
-    return -EINVAL;
+    ent->flags |= EXT2_CACHE_FLAG_DIRTY;
+    make_mru(fs, ent);
+    return 0;
 }
 
 int ext2_block_cache_wb(ext2_fs_t *fs) {
-    int i, err;
-    ext2_cache_t **cache = fs->bcache;
+    int err;
+    ext2_cache_t *ent;
 
     /* Don't even bother if we're mounted read-only. */
     if(!(fs->mnt_flags & EXT2FS_MNT_FLAG_RW))
         return 0;
 
-    for(i = fs->cache_size - 1; i >= 0; --i) {
-        if(cache[i]->flags & EXT2_CACHE_FLAG_DIRTY) {
-            if((err = ext2_block_write_nc(fs, cache[i]->block, cache[i]->data)))
+    TAILQ_FOREACH(ent, &fs->lru, lentry) {
+        if(ent->flags & EXT2_CACHE_FLAG_DIRTY) {
+            if((err = ext2_block_write_nc(fs, ent->block, ent->data)))
                 return err;
 
-            cache[i]->flags &= ~EXT2_CACHE_FLAG_DIRTY;
+            ent->flags &= ~EXT2_CACHE_FLAG_DIRTY;
+            ++fs->cache_stats.writebacks;
         }
     }
-    
+
     return 0;
 }
 
+void ext2_block_cache_stats(ext2_fs_t *fs, ext2_cache_stats_t *st, int reset) {
+    if(st)
+        memcpy(st, &fs->cache_stats, sizeof(ext2_cache_stats_t));
+
+    if(reset) {
+        fs->cache_stats.hits = fs->cache_stats.misses = 0;
+        fs->cache_stats.evictions = fs->cache_stats.writebacks = 0;
+    }
+}
+
 uint8_t *ext2_block_alloc(ext2_fs_t *fs, uint32_t bg, uint32_t *bn, int *err) {
     uint8_t *buf, *blk;
     uint32_t index;
@@ -273,7 +279,7 @@ ext2_fs_t *ext2_fs_init(kos_blockdev_t *bd, uint32_t flags) {
 
 ext2_fs_t *ext2_fs_init_ex(kos_blockdev_t *bd, uint32_t flags, int cache_sz) {
     ext2_fs_t *rv;
-    uint32_t bc;
+    uint32_t bc, hash_sz;
     int j;
     int block_size;
 
@@ -408,43 +414,49 @@ ext2_fs_t *ext2_fs_init_ex(kos_blockdev_t *bd, uint32_t flags, int cache_sz) {
     }
 #endif /* EXT2FS_DEBUG */
 
-    /* Make space for the block cache. */
-    if(!(rv->bcache = (ext2_cache_t **)malloc(sizeof(ext2_cache_t *) *
-                                              cache_sz))) {
-        free(rv->bg);
-        free(rv);
-        bd->shutdown(bd);
-        return NULL;
-    }
+    /* Make space for the block cache. All the block data lives in one big
+       chunk of memory, rather than having each block allocated separately. */
+    if(cache_sz < 1)
+        cache_sz = 1;
 
-    for(j = 0; j < cache_sz; ++j) {
-        if(!(rv->bcache[j] = (ext2_cache_t *)malloc(sizeof(ext2_cache_t))))
-            goto out_cache;
+    for(hash_sz = 1; hash_sz < (uint32_t)cache_sz; hash_sz <<= 1) ;
+
+    if(!(rv->bcache = (ext2_cache_t *)malloc(sizeof(ext2_cache_t) *
+                                             cache_sz)))
+        goto out_bg;
+
+    if(!(rv->bcache_data = (uint8_t *)malloc(block_size * cache_sz)))
+        goto out_bcache;
+
+    if(!(rv->bhash = (struct ext2_cache_list *)
+         malloc(sizeof(struct ext2_cache_list) * hash_sz)))
+        goto out_data;
+
+    for(j = 0; j < (int)hash_sz; ++j) {
+        LIST_INIT(&rv->bhash[j]);
     }
 
-    for(j = 0; j < cache_sz; ++j) {
-        if(!(rv->bcache[j]->data = (uint8_t *)malloc(block_size)))
-            goto out_bcache;
+    TAILQ_INIT(&rv->lru);
 
-        rv->bcache[j]->flags = 0;
+    for(j = 0; j < cache_sz; ++j) {
+        rv->bcache[j].flags = 0;
+        rv->bcache[j].block = 0;
+        rv->bcache[j].data = rv->bcache_data + j * block_size;
+        TAILQ_INSERT_TAIL(&rv->lru, rv->bcache + j, lentry);
     }
 
     rv->cache_size = cache_sz;
+    rv->bhash_mask = hash_sz - 1;
+    memset(&rv->cache_stats, 0, sizeof(ext2_cache_stats_t));
+    rv->cache_stats.cache_size = cache_sz;
 
     return rv;
 
+out_data:
+    free(rv->bcache_data);
 out_bcache:
-    for(; j >= 0; --j) {
-        free(rv->bcache[j]->data);
-    }
-
-    j = cache_sz - 1;
-out_cache:
-    for(; j >= 0; --j) {
-        free(rv->bcache[j]);
-    }
-
     free(rv->bcache);
+out_bg:
     free(rv->bg);
     free(rv);
     bd->shutdown(bd);
@@ -499,16 +511,11 @@ int ext2_fs_sync(ext2_fs_t *fs) {
 }
 
 void ext2_fs_shutdown(ext2_fs_t *fs) {
-    int i;
-
     /* Sync the filesystem back to the block device, if needed. */
     ext2_fs_sync(fs);
 
-    for(i = 0; i < fs->cache_size; ++i) {
-        free(fs->bcache[i]->data);
-        free(fs->bcache[i]);
-    }
-
+    free(fs->bhash);
+    free(fs->bcache_data);
     free(fs->bcache);
     fs->dev->shutdown(fs->dev);
     free(fs->bg);
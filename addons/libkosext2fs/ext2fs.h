@@ -42,7 +42,8 @@ __BEGIN_DECLS
    ensure that more accesses can be handled by the cache, but also increases the
    latency at which data is written back to the block device itself. Setting
    this to 32 should work well enough, but if you have more memory to spare,
-   feel free to set it larger.
+   feel free to set it larger. Lookups in the cache go through a hash table, so
+   even cache sizes in the hundreds of blocks do not make each access slower.
 
    Note that this is a default value for filesystems initialized/mounted with
    ext2_fs_init(). If you wish to specify your own value that differs from this
@@ -71,8 +72,22 @@ typedef struct kos_blockdev {
 #define SYMLOOP_MAX 16
 #endif
 
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
 #endif /* EXT2_NOT_IN_KOS */
 
+/* Block cache statistics for a single filesystem. These are counted from the
+   time the filesystem is mounted (or from the last time they were reset). */
+typedef struct ext2_cache_stats {
+    uint32_t cache_size;        /* Number of blocks in the cache */
+    uint32_t hits;              /* Accesses satisfied from the cache */
+    uint32_t misses;            /* Accesses that had to go to the device */
+    uint32_t evictions;         /* Valid blocks booted out of the cache */
+    uint32_t writebacks;        /* Dirty blocks written back to the device */
+} ext2_cache_stats_t;
+
 /* Opaque ext2 filesystem type */
 struct ext2fs_struct;
 typedef struct ext2fs_struct ext2_fs_t;
@@ -108,6 +123,10 @@ int ext2_block_mark_dirty(ext2_fs_t *fs, uint32_t block_num);
    call the corresponding inode function before this one. */
 int ext2_block_cache_wb(ext2_fs_t *fs);
 
+/* Retrieve the block cache statistics for the filesystem, optionally resetting
+   the counters afterwards. */
+void ext2_block_cache_stats(ext2_fs_t *fs, ext2_cache_stats_t *st, int reset);
+
 uint8_t *ext2_block_alloc(ext2_fs_t *fs, uint32_t bg, uint32_t *bn, int *err);
 
 __END_DECLS
@@ -7,12 +7,14 @@
 #include "block.h"
 #include "superblock.h"
 
+#include <sys/queue.h>
+
 #ifndef EXT2_NOT_IN_KOS
 #include <kos/blockdev.h>
-#else
-#include "ext2fs.h"
 #endif
 
+#include "ext2fs.h"
+
 #ifndef __EXT2_EXT2INTERNAL_H
 #define __EXT2_EXT2INTERNAL_H
 
@@ -20,11 +22,21 @@
 #define EXT2_CACHE_FLAG_DIRTY   2
 
 typedef struct ext2_cache {
+    /* Hash chain entry -- only used while the entry is valid. */
+    LIST_ENTRY(ext2_cache) hentry;
+
+    /* LRU list entry. Every cache entry is always on the LRU list, with the
+       least recently used (or invalid) entries at the head. */
+    TAILQ_ENTRY(ext2_cache) lentry;
+
     uint32_t flags;
     uint32_t block;
     uint8_t *data;
 } ext2_cache_t;
 
+LIST_HEAD(ext2_cache_list, ext2_cache);
+TAILQ_HEAD(ext2_cache_queue, ext2_cache);
+
 struct ext2fs_struct {
     kos_blockdev_t *dev;
     ext2_superblock_t sb;
@@ -33,9 +45,15 @@ struct ext2fs_struct {
     uint32_t bg_count;
     ext2_bg_desc_t *bg;
 
-    ext2_cache_t **bcache;
+    ext2_cache_t *bcache;
+    uint8_t *bcache_data;
     int cache_size;
 
+    struct ext2_cache_list *bhash;
+    uint32_t bhash_mask;
+    struct ext2_cache_queue lru;
+    ext2_cache_stats_t cache_stats;
+
     uint32_t flags;
     uint32_t mnt_flags;
 };
@@ -1358,6 +1358,54 @@ static int fs_ext2_fcntl(void *h, int cmd, va_list ap) {
     return rv;
 }
 
+static int fs_ext2_ioctl(void *h, int cmd, va_list ap) {
+    file_t fd = ((file_t)h) - 1;
+    fs_ext2_cache_stats_t *arg;
+    ext2_cache_stats_t st;
+    int rv = -1;
+
+    mutex_lock(&ext2_mutex);
+
+    if(fd >= MAX_EXT2_FILES || !fh[fd].inode_num) {
+        mutex_unlock(&ext2_mutex);
+        errno = EBADF;
+        return -1;
+    }
+
+    switch(cmd) {
+        case FS_EXT2_IOCTL_CACHE_STATS:
+        case FS_EXT2_IOCTL_CACHE_STATS_RESET:
+            /* Only these take an argument, so don't go looking for one
+               until we know that's what we've got. */
+            arg = va_arg(ap, fs_ext2_cache_stats_t *);
+
+            if(!arg && cmd == FS_EXT2_IOCTL_CACHE_STATS) {
+                errno = EINVAL;
+                break;
+            }
+
+            ext2_block_cache_stats(fh[fd].fs->fs, &st,
+                                   cmd == FS_EXT2_IOCTL_CACHE_STATS_RESET);
+
+            if(arg) {
+                arg->cache_size = st.cache_size;
+                arg->hits = st.hits;
+                arg->misses = st.misses;
+                arg->evictions = st.evictions;
+                arg->writebacks = st.writebacks;
+            }
+
+            rv = 0;
+            break;
+
+        default:
+            errno = ENOTTY;
+    }
+
+    mutex_unlock(&ext2_mutex);
+    return rv;
+}
+
 static int fs_ext2_link(vfs_handler_t *vfs, const char *path1,
                         const char *path2) {
     fs_ext2_fs_t *fs = (fs_ext2_fs_t *)vfs->privdata;
@@ -1904,7 +1952,7 @@ static vfs_handler_t vh = {
     NULL,                       /* tell */
     NULL,                       /* total */
     fs_ext2_readdir,            /* readdir */
-    NULL,                       /* ioctl */
+    fs_ext2_ioctl,              /* ioctl */
     fs_ext2_rename,             /* rename */
     fs_ext2_unlink,             /* unlink */
     NULL,                       /* mmap */
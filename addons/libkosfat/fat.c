@@ -34,6 +34,36 @@ static void make_mru(fat_fs_t *fs, fat_cache_t **cache, int block) {
 }
 
 
+/* Update the free cluster bitmap, if the cluster has been scanned into it. */
+static inline void fmap_mark(fat_fs_t *fs, uint32_t cl, int used) {
+    if(!fs->fmap || cl >= fs->fmap_next)
+        return;
+
+    if(used)
+        fs->fmap[cl >> 5] |= 1U << (cl & 31);
+    else
+        fs->fmap[cl >> 5] &= ~(1U << (cl & 31));
+}
+
+/* Find the first free cluster in [from, to) in the free cluster bitmap. */
+static uint32_t fmap_find(fat_fs_t *fs, uint32_t from, uint32_t to) {
+    uint32_t i = from, bits;
+
+    while(i < to) {
+        /* Treat anything before where we started in the word as used. */
+        bits = fs->fmap[i >> 5] | ((1U << (i & 31)) - 1);
+
+        if(bits != 0xFFFFFFFF) {
+            i = (i & ~31U) + __builtin_ctz(~bits);
+            return i < to ? i : FAT_INVALID_CLUSTER;
+        }
+
+        i = (i & ~31U) + 32;
+    }
+
+    return FAT_INVALID_CLUSTER;
+}
+
 static int fat_fatblock_read_nc(fat_fs_t *fs, uint32_t bn, uint8_t *rv) {
     if(fs->sb.fat_size <= bn)
         return -EINVAL;
@@ -214,7 +244,7 @@ uint32_t fat_read_fat(fat_fs_t *fs, uint32_t cl, int *err) {
 }
 
 int fat_write_fat(fat_fs_t *fs, uint32_t cl, uint32_t val) {
-    uint32_t sn, off;
+    uint32_t sn, off, fcl = cl, used = val & 0x0FFFFFFF;
     uint8_t *blk, *blk2;
     int err;
 
@@ -308,6 +338,7 @@ int fat_write_fat(fat_fs_t *fs, uint32_t cl, uint32_t val) {
             break;
     }
 
+    fmap_mark(fs, fcl, used != 0);
     return 0;
 }
 
@@ -326,6 +357,119 @@ int fat_is_eof(fat_fs_t *fs, uint32_t cl) {
     return -1;
 }
 
+int fat_fmap_build(fat_fs_t *fs, uint32_t count) {
+    uint32_t last = fs->sb.num_clusters + 2, words, end, cl, off, per, val;
+    const uint8_t *blk;
+    int err, shift;
+
+    /* There's no point if we can't allocate anything anyway. */
+    if(!(fs->mnt_flags & FAT_MNT_FLAG_RW))
+        return -EROFS;
+
+    if(!fs->fmap) {
+        words = (last + 31) >> 5;
+
+        if(!(fs->fmap = (uint32_t *)calloc(words, sizeof(uint32_t))))
+            return -ENOMEM;
+
+        /* Clusters 0 and 1 don't exist, nor does anything past the end. */
+        fs->fmap[0] = 3;
+
+        if(last & 31)
+            fs->fmap[words - 1] |= ~((1U << (last & 31)) - 1);
+
+        fs->fmap_next = 2;
+    }
+
+    if(fs->fmap_next >= last)
+        return 1;
+
+    end = last;
+
+    if(count && count < last - fs->fmap_next)
+        end = fs->fmap_next + count;
+
+    shift = fs->sb.fs_type == FAT_FS_FAT32 ? 2 : 1;
+    per = fs->sb.bytes_per_sector >> shift;
+
+    for(cl = fs->fmap_next; cl < end;) {
+        if(fs->sb.fs_type == FAT_FS_FAT12) {
+            /* FAT12 entries straddle blocks, so don't bother being clever.
+               The FAT is tiny anyway. */
+            if((val = fat_read_fat(fs, cl, &err)) == FAT_INVALID_CLUSTER) {
+                fs->fmap_next = cl;
+                return -err;
+            }
+
+            if(val)
+                fs->fmap[cl >> 5] |= 1U << (cl & 31);
+
+            ++cl;
+            continue;
+        }
+
+        /* Do a whole FAT block at a time for FAT16 and FAT32. */
+        if(!(blk = fat_read_fatblock(fs, fs->sb.reserved_sectors + cl / per,
+                                     &err))) {
+            fs->fmap_next = cl;
+            return -err;
+        }
+
+        for(off = cl & (per - 1); off < per && cl < end; ++off, ++cl) {
+            if(shift == 2)
+                val = blk[off << 2] | (blk[(off << 2) + 1] << 8) |
+                    (blk[(off << 2) + 2] << 16) |
+                    ((blk[(off << 2) + 3] & 0x0F) << 24);
+            else
+                val = blk[off << 1] | (blk[(off << 1) + 1] << 8);
+
+            if(val)
+                fs->fmap[cl >> 5] |= 1U << (cl & 31);
+        }
+    }
+
+    fs->fmap_next = cl;
+    return cl >= last;
+}
+
+static uint32_t fmap_allocate(fat_fs_t *fs, uint32_t start, int *err) {
+    uint32_t cl, last = fs->sb.num_clusters + 2;
+    int rv;
+
+    if(start < 2 || start >= last)
+        start = 2;
+
+    /* Look from where we were told to, wrapping around if need be. */
+    if((cl = fmap_find(fs, start, last)) == FAT_INVALID_CLUSTER &&
+       (cl = fmap_find(fs, 2, start)) == FAT_INVALID_CLUSTER) {
+        *err = ENOSPC;
+        return FAT_INVALID_CLUSTER;
+    }
+
+    /* Put an end of chain marker in to allocate it. */
+    if((rv = fat_write_fat(fs, cl, 0x0FFFFFFF))) {
+        *err = rv < 0 ? -rv : rv;
+        return FAT_INVALID_CLUSTER;
+    }
+
+    fs->sb.last_alloc_cluster = cl;
+
+    /* Only FAT32 keeps a count of free clusters (in the FSInfo sector). */
+    if(fs->sb.fs_type == FAT_FS_FAT32)
+        --fs->sb.free_clusters;
+
+    return cl;
+}
+
+uint32_t fat_allocate_cluster_near(fat_fs_t *fs, uint32_t hint, int *err) {
+    /* Without the free cluster bitmap, checking around the hint would mean
+       scanning the FAT, so just do a normal allocation. */
+    if(fat_fmap_build(fs, 0) <= 0)
+        return fat_allocate_cluster(fs, err);
+
+    return fmap_allocate(fs, hint, err);
+}
+
 uint32_t fat_allocate_cluster(fat_fs_t *fs, int *err) {
     uint32_t sn, off, val;
     uint8_t *blk;
@@ -338,6 +482,11 @@ uint32_t fat_allocate_cluster(fat_fs_t *fs, int *err) {
         return FAT_INVALID_CLUSTER;
     }
 
+    /* If we have (or can build) the free cluster bitmap, use that instead of
+       scanning the FAT. */
+    if(fat_fmap_build(fs, 0) > 0)
+        return fmap_allocate(fs, fs->sb.last_alloc_cluster + 1, err);
+
     i = fs->sb.last_alloc_cluster + 1;
     last = fs->sb.num_clusters + 2;
 
@@ -373,6 +522,7 @@ retry_fat32:
 
                     fs->sb.last_alloc_cluster = i;
                     --fs->sb.free_clusters;
+                    fmap_mark(fs, i, 1);
                     return i;
                 }
 
@@ -424,6 +574,7 @@ retry_fat16:
                     fat_fatblock_mark_dirty(fs, sn);
 
                     fs->sb.last_alloc_cluster = i;
+                    fmap_mark(fs, i, 1);
                     return i;
                 }
 
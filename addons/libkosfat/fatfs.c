@@ -152,6 +152,34 @@ int fat_cluster_read_nc(fat_fs_t *fs, uint32_t cluster, uint8_t *rv) {
     return 0;
 }
 
+int fat_clusters_read_nc(fat_fs_t *fs, uint32_t cluster, uint32_t count,
+                         uint8_t *rv) {
+    uint32_t fs_per_block = fs->sb.sectors_per_cluster;
+    uint32_t cs = fs->sb.bytes_per_sector * fs_per_block;
+    fat_cache_t **cache = fs->bcache;
+    int i;
+
+    if(!count)
+        return 0;
+
+    if(fs->sb.num_clusters + 2 < cluster + count || cluster < 2)
+        return -EINVAL;
+
+    if(fs->dev->read_blocks(fs->dev, (cluster - 2) * fs_per_block +
+                            fs->sb.first_data_block, count * fs_per_block, rv))
+        return -EIO;
+
+    /* Anything in the cache may be newer than what's on the device, so copy
+       over what we just read with it. */
+    for(i = 0; i < fs->cache_size; ++i) {
+        if(cache[i]->flags && cache[i]->block >= cluster &&
+           cache[i]->block < cluster + count)
+            memcpy(rv + (cache[i]->block - cluster) * cs, cache[i]->data, cs);
+    }
+
+    return 0;
+}
+
 int fat_cluster_write_nc(fat_fs_t *fs, uint32_t cluster, const uint8_t *blk) {
     int fs_per_block = (int)fs->sb.sectors_per_cluster;
 
@@ -278,6 +306,8 @@ fat_fs_t *fat_fs_init_ex(kos_blockdev_t *bd, uint32_t flags, int cache_sz,
     }
 
     rv->dev = bd;
+    rv->fmap = NULL;
+    rv->fmap_next = 0;
     rv->mnt_flags = flags & FAT_MNT_VALID_FLAGS_MASK;
 
     if(rv->mnt_flags != flags) {
@@ -432,6 +462,7 @@ void fat_fs_shutdown(fat_fs_t *fs) {
         free(fs->fcache[i]);
     }
 
+    free(fs->fmap);
     fs->dev->shutdown(fs->dev);
     free(fs);
 }
@@ -84,6 +84,8 @@ int fat_fs_sync(fat_fs_t *fs);
 void fat_fs_shutdown(fat_fs_t *fs);
 
 int fat_cluster_read_nc(fat_fs_t *fs, uint32_t cluster, uint8_t *rv);
+int fat_clusters_read_nc(fat_fs_t *fs, uint32_t cluster, uint32_t count,
+                         uint8_t *rv);
 uint8_t *fat_cluster_read(fat_fs_t *fs, uint32_t cluster, int *err);
 uint8_t *fat_cluster_clear(fat_fs_t *fs, uint32_t cl, int *err);
 
@@ -121,6 +123,8 @@ uint32_t fat_read_fat(fat_fs_t *fs, uint32_t cl, int *err);
 int fat_write_fat(fat_fs_t *fs, uint32_t cl, uint32_t val);
 int fat_is_eof(fat_fs_t *fs, uint32_t cl);
 uint32_t fat_allocate_cluster(fat_fs_t *fs, int *err);
+uint32_t fat_allocate_cluster_near(fat_fs_t *fs, uint32_t hint, int *err);
+int fat_fmap_build(fat_fs_t *fs, uint32_t count);
 int fat_erase_chain(fat_fs_t *fs, uint32_t cluster);
 
 __END_DECLS
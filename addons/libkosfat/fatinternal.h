@@ -31,6 +31,12 @@ struct fatfs_struct {
     fat_cache_t **fcache;
     int fcache_size;
 
+    /* Free cluster bitmap. Each bit is set if the cluster is in use. Built
+       incrementally by fat_fmap_build(), clusters from fmap_next on have not
+       been scanned yet. */
+    uint32_t *fmap;
+    uint32_t fmap_next;
+
     uint32_t flags;
     uint32_t mnt_flags;
 };
@@ -2,6 +2,7 @@
 
    fs_fat.c
    Copyright (C) 2012, 2013, 2014, 2016, 2019 Lawrence Sebald
+   Copyright (C) 2026 KallistiOS Contributors
 */
 
 #include <time.h>
@@ -16,6 +17,7 @@
 
 #include <kos/fs.h>
 #include <kos/mutex.h>
+#include <kos/thread.h>
 #include <kos/dbglog.h>
 
 #include <fat/fs_fat.h>
@@ -35,12 +37,34 @@ char *strdup(const char *);
 
 #define MAX_FAT_FILES 16
 
+/* Maximum number of extents (runs of contiguous clusters) remembered for each
+   open file. Files that are more fragmented than this still work, but past the
+   last remembered extent, clusters are found by following the FAT from the
+   file's current position (or from the end of the map, when seeking). */
+#define MAX_FAT_EXTENTS 1024
+
+/* Largest number of blocks read from the block device in one go when reading
+   directly into the user's buffer. */
+#define MAX_FAT_DIRECT_BLOCKS 65536
+
+/* Number of clusters the background free cluster map builder scans each time
+   it grabs the lock. */
+#define FAT_FMAP_BG_CHUNK 4096
+
+typedef struct fat_extent {
+    uint32_t order;             /* Position of the run's first cluster */
+    uint32_t cluster;           /* First cluster of the run */
+    uint32_t count;             /* Number of clusters in the run */
+} fat_extent_t;
+
 typedef struct fs_fat_fs {
     LIST_ENTRY(fs_fat_fs) entry;
 
     vfs_handler_t *vfsh;
     fat_fs_t *fs;
     uint32_t mount_flags;
+    kthread_t *fmap_thd;
+    volatile int fmap_stop;
 } fs_fat_fs_t;
 
 LIST_HEAD(fat_list, fs_fat_fs);
@@ -60,6 +84,10 @@ static struct {
     uint32_t ptr;
     dirent_t dent;
     fs_fat_fs_t *fs;
+    fat_extent_t *extents;
+    uint32_t extent_count;
+    uint32_t extent_size;
+    uint32_t mapped;            /* Number of clusters covered by extents */
 } fh[MAX_FAT_FILES];
 
 static uint16_t longname_buf[256];
@@ -137,65 +165,246 @@ static int fat_create_entry(fat_fs_t *fs, const char *fn, uint8_t attr,
     return 0;
 }
 
-static int advance_cluster(fat_fs_t *fs, int fd, uint32_t order, int write) {
-    uint32_t clo, cl, cl2;
+static void extent_clear(int fd) {
+    free(fh[fd].extents);
+    fh[fd].extents = NULL;
+    fh[fd].extent_count = fh[fd].extent_size = fh[fd].mapped = 0;
+}
+
+/* Record that cluster cl is at position order in the file's chain. The map is
+   only ever extended at its end, so anything else is ignored. */
+static void extent_append(int fd, uint32_t order, uint32_t cl) {
+    fat_extent_t *ext;
+    uint32_t sz;
+
+    if(order != fh[fd].mapped)
+        return;
+
+    /* Does this cluster continue the last run? */
+    if(fh[fd].extent_count) {
+        ext = &fh[fd].extents[fh[fd].extent_count - 1];
+
+        if(ext->cluster + ext->count == cl) {
+            ++ext->count;
+            ++fh[fd].mapped;
+            return;
+        }
+    }
+
+    /* Nope, start a new one, making room for it if we can. */
+    if(fh[fd].extent_count == fh[fd].extent_size) {
+        if(fh[fd].extent_size >= MAX_FAT_EXTENTS)
+            return;
+
+        sz = fh[fd].extent_size ? fh[fd].extent_size << 1 : 8;
+
+        if(sz > MAX_FAT_EXTENTS)
+            sz = MAX_FAT_EXTENTS;
+
+        if(!(ext = (fat_extent_t *)realloc(fh[fd].extents,
+                                           sz * sizeof(fat_extent_t))))
+            return;
+
+        fh[fd].extents = ext;
+        fh[fd].extent_size = sz;
+    }
+
+    ext = &fh[fd].extents[fh[fd].extent_count++];
+    ext->order = order;
+    ext->cluster = cl;
+    ext->count = 1;
+    ++fh[fd].mapped;
+}
+
+/* Find the extent that covers position order in the file's chain, which must
+   be less than fh[fd].mapped. */
+static fat_extent_t *extent_find(int fd, uint32_t order) {
+    uint32_t lo, hi, mid;
+
+    lo = 0;
+    hi = fh[fd].extent_count - 1;
+
+    while(lo < hi) {
+        mid = (lo + hi + 1) >> 1;
+
+        if(fh[fd].extents[mid].order <= order)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    return &fh[fd].extents[lo];
+}
+
+/* Find the cluster at position order in the file's chain, filling in the
+   extent map as we go. Returns 0 and sets *rcl on success. If the chain ends
+   before order, returns -EDOM with *rcl and *rclo set to the last cluster in
+   the chain and its position. */
+static int extent_lookup(fat_fs_t *fs, int fd, uint32_t order, uint32_t *rcl,
+                         uint32_t *rclo) {
+    fat_extent_t *ext;
+    uint32_t cl, cl2, clo;
     int err;
 
-    cl = fh[fd].cluster;
-    clo = fh[fd].cluster_order;
+    cl = fh[fd].dentry.cluster_low | (fh[fd].dentry.cluster_high << 16);
+    clo = 0;
 
-    /* Are we moving forward or backward? */
-    if(clo > order) {
-        /* If moving backward, we have to start from the beginning of the file
-           and advance forward. */
-        clo = 0;
-        cl = fh[fd].dentry.cluster_low | (fh[fd].dentry.cluster_high << 16);
-        fh[fd].cluster = cl;
-        fh[fd].cluster_order = clo;
+    if(!fh[fd].mapped)
+        extent_append(fd, 0, cl);
+
+    if(order < fh[fd].mapped) {
+        ext = extent_find(fd, order);
+        *rcl = ext->cluster + (order - ext->order);
+        *rclo = order;
+        return 0;
+    }
+
+    /* Walk the FAT from the last cluster we know about. */
+    if(fh[fd].mapped) {
+        ext = &fh[fd].extents[fh[fd].extent_count - 1];
+        cl = ext->cluster + ext->count - 1;
+        clo = fh[fd].mapped - 1;
+    }
+
+    /* If the map is full, the file's current position may well be further
+       along the chain than the end of the map, in which case start from there
+       instead, so reading through the file doesn't mean walking the FAT from
+       the same place over and over again. */
+    if(fh[fd].cluster_order > clo && fh[fd].cluster_order <= order &&
+       fh[fd].cluster >= 2 && !fat_is_eof(fs, fh[fd].cluster)) {
+        cl = fh[fd].cluster;
+        clo = fh[fd].cluster_order;
     }
 
-    /* At this point, we're definitely moving forward, if at all... */
     while(clo < order) {
-        /* Read the FAT for the current cluster to see where we're going
-           next... */
         cl2 = fat_read_fat(fs, cl, &err);
 
         if(cl2 == FAT_INVALID_CLUSTER) {
             return -err;
         }
         else if(fat_is_eof(fs, cl2)) {
-            /* If we've hit the EOF and we're writing, we need to allocate a new
-               cluster to the file. If we're reading, then return error. */
-            if(!write) {
-                fh[fd].cluster = cl2;
-                fh[fd].cluster_order = clo;
-                fh[fd].mode &= ~0x80000000;
-                return -EDOM;
-            }
-            else {
-                /* Allocate a new cluster */
-                cl2 = fat_allocate_cluster(fs, &err);
+            *rcl = cl;
+            *rclo = clo;
+            return -EDOM;
+        }
 
-                if(cl2 == FAT_INVALID_CLUSTER) {
-                    return -err;
-                }
+        cl = cl2;
+        extent_append(fd, ++clo, cl);
+    }
 
-                /* Clear it. */
-                if(!fat_cluster_clear(fs, cl2, &err)) {
-                    fat_write_fat(fs, cl2, 0);
-                    return -err;
-                }
+    *rcl = cl;
+    *rclo = clo;
+    return 0;
+}
 
-                /* Write it to the file's FAT chain. */
-                if((err = fat_write_fat(fs, cl, cl2)) < 0) {
-                    fat_write_fat(fs, cl2, 0);
-                    return err;
-                }
-            }
-        }
+/* Get the cluster after the current one in the file's chain. Returns an end of
+   chain marker if there isn't one. */
+static uint32_t next_cluster(fat_fs_t *fs, int fd, int *err) {
+    uint32_t cl, clo;
+    int rv;
+
+    rv = extent_lookup(fs, fd, fh[fd].cluster_order + 1, &cl, &clo);
+
+    if(rv == -EDOM)
+        return 0x0FFFFFFF;
+
+    if(rv < 0) {
+        *err = -rv;
+        return FAT_INVALID_CLUSTER;
+    }
+
+    return cl;
+}
+
+/* Count how many clusters (up to max) are laid out contiguously on the disk,
+   starting with the current one. */
+static int contig_clusters(fat_fs_t *fs, int fd, uint32_t max) {
+    fat_extent_t *ext;
+    uint32_t n = 1, cl, cl2, order = fh[fd].cluster_order;
+    int err;
+
+    /* If the current cluster is in the extent map, the rest of its run is
+       already known. Runs are always as long as they can be, so the run ends
+       there unless it's the last one, which may just not have been followed
+       any further yet. */
+    if(order < fh[fd].mapped) {
+        ext = extent_find(fd, order);
+        n = ext->count - (order - ext->order);
+
+        if(n >= max)
+            return (int)max;
+
+        if(ext != &fh[fd].extents[fh[fd].extent_count - 1])
+            return (int)n;
+    }
+
+    /* Follow the chain from the end of the run one step at a time. */
+    cl = fh[fd].cluster + n - 1;
+
+    while(n < max) {
+        cl2 = fat_read_fat(fs, cl, &err);
+
+        if(cl2 == FAT_INVALID_CLUSTER)
+            return -err;
+        else if(fat_is_eof(fs, cl2))
+            break;
+
+        extent_append(fd, order + n, cl2);
+
+        if(cl2 != cl + 1)
+            break;
 
         cl = cl2;
-        ++clo;
+        ++n;
+    }
+
+    return (int)n;
+}
+
+static int advance_cluster(fat_fs_t *fs, int fd, uint32_t order, int write) {
+    uint32_t clo, cl, cl2;
+    int err;
+
+    /* Look up where we're going in the extent map, rather than following the
+       chain from wherever we happen to be. */
+    err = extent_lookup(fs, fd, order, &cl, &clo);
+
+    if(err == -EDOM) {
+        /* If we've hit the EOF and we're writing, we need to allocate new
+           clusters to the file. If we're reading, then return error. */
+        if(!write) {
+            fh[fd].cluster = 0x0FFFFFFF;
+            fh[fd].cluster_order = clo;
+            fh[fd].mode &= ~0x80000000;
+            return -EDOM;
+        }
+
+        while(clo < order) {
+            /* Allocate a new cluster */
+            cl2 = fat_allocate_cluster_near(fs, cl + 1, &err);
+
+            if(cl2 == FAT_INVALID_CLUSTER) {
+                return -err;
+            }
+
+            /* Clear it. */
+            if(!fat_cluster_clear(fs, cl2, &err)) {
+                fat_write_fat(fs, cl2, 0);
+                return -err;
+            }
+
+            /* Write it to the file's FAT chain. */
+            if((err = fat_write_fat(fs, cl, cl2)) < 0) {
+                fat_write_fat(fs, cl2, 0);
+                return err;
+            }
+
+            cl = cl2;
+            extent_append(fd, ++clo, cl);
+        }
+    }
+    else if(err < 0) {
+        return err;
     }
 
     fh[fd].cluster = cl;
@@ -331,6 +540,17 @@ static void *fs_fat_open(vfs_handler_t *vfs, const char *fn, int mode) {
             mutex_unlock(&fat_mutex);
             return NULL;
         }
+
+        /* Any other handles open on this file have a stale extent map now. */
+        for(rv = 0; rv < MAX_FAT_FILES; ++rv) {
+            if(rv != fd && fh[rv].opened && fh[rv].fs == mnt &&
+               fh[rv].dentry_cluster == fh[fd].dentry_cluster &&
+               fh[rv].dentry_offset == fh[fd].dentry_offset) {
+                extent_clear(rv);
+                fh[rv].cluster = 0x0FFFFFFF;
+                fh[rv].mode |= 0x80000000;
+            }
+        }
     }
 
     /* Fill in the rest of the handle */
@@ -342,6 +562,7 @@ created:
         (fh[fd].dentry.cluster_high << 16);
     fh[fd].cluster_order = 0;
     fh[fd].opened = 1;
+    extent_clear(fd);
 
     mutex_unlock(&fat_mutex);
     return (void *)(fd + 1);
@@ -357,6 +578,7 @@ static int fs_fat_close(void *h) {
         fh[fd].opened = 0;
         fh[fd].dentry_offset = fh[fd].dentry_cluster = 0;
         fh[fd].dentry_lcl = fh[fd].dentry_loff = 0;
+        extent_clear(fd);
     }
     else {
         rv = -1;
@@ -375,7 +597,8 @@ static ssize_t fs_fat_read(void *h, void *buf, size_t cnt) {
     uint8_t *bbuf = (uint8_t *)buf;
     ssize_t rv;
     uint64_t sz, cl;
-    int mode;
+    uint32_t max;
+    int mode, run;
 
     mutex_lock(&fat_mutex);
 
@@ -447,7 +670,7 @@ static ssize_t fs_fat_read(void *h, void *buf, size_t cnt) {
             fh[fd].ptr += bs - bo;
             cnt -= bs - bo;
             bbuf += bs - bo;
-            cl = fat_read_fat(fs, fh[fd].cluster, &errno);
+            cl = next_cluster(fs, fd, &errno);
 
             if(cl == FAT_INVALID_CLUSTER) {
                 mutex_unlock(&fat_mutex);
@@ -468,7 +691,7 @@ static ssize_t fs_fat_read(void *h, void *buf, size_t cnt) {
 
             /* Did we hit the end of the cluster? */
             if(cnt + bo == bs) {
-                cl = fat_read_fat(fs, fh[fd].cluster, &errno);
+                cl = next_cluster(fs, fd, &errno);
 
                 if(cl == FAT_INVALID_CLUSTER) {
                     mutex_unlock(&fat_mutex);
@@ -485,6 +708,49 @@ static ssize_t fs_fat_read(void *h, void *buf, size_t cnt) {
 
     /* While we still have more to read, do it. */
     while(cnt) {
+        /* If we're reading whole clusters and the buffer is aligned well enough
+           for any block device to DMA into, read as many of them as are
+           contiguous on the disk straight into the buffer. */
+        if(cnt >= bs && !((uintptr_t)bbuf & 31)) {
+            max = MAX_FAT_DIRECT_BLOCKS / fat_blocks_per_cluster(fs);
+
+            if(max > cnt / bs)
+                max = cnt / bs;
+
+            if((run = contig_clusters(fs, fd, max)) < 0) {
+                mutex_unlock(&fat_mutex);
+                errno = -run;
+                return -1;
+            }
+
+            if(fat_clusters_read_nc(fs, fh[fd].cluster, run, bbuf)) {
+                mutex_unlock(&fat_mutex);
+                errno = EIO;
+                return -1;
+            }
+
+            fh[fd].ptr += run * bs;
+            cnt -= run * bs;
+            bbuf += run * bs;
+            fh[fd].cluster += run - 1;
+            fh[fd].cluster_order += run - 1;
+            cl = next_cluster(fs, fd, &errno);
+
+            if(cl == FAT_INVALID_CLUSTER) {
+                mutex_unlock(&fat_mutex);
+                return -1;
+            }
+            else if(cnt && fat_is_eof(fs, cl)) {
+                mutex_unlock(&fat_mutex);
+                errno = EIO;
+                return -1;
+            }
+
+            fh[fd].cluster = cl;
+            ++fh[fd].cluster_order;
+            continue;
+        }
+
         if(!(block = fat_cluster_read(fs, fh[fd].cluster, &errno))) {
             mutex_unlock(&fat_mutex);
             return -1;
@@ -496,7 +762,7 @@ static ssize_t fs_fat_read(void *h, void *buf, size_t cnt) {
             fh[fd].ptr += bs;
             cnt -= bs;
             bbuf += bs;
-            cl = fat_read_fat(fs, fh[fd].cluster, &errno);
+            cl = next_cluster(fs, fd, &errno);
 
             if(cl == FAT_INVALID_CLUSTER) {
                 mutex_unlock(&fat_mutex);
@@ -517,7 +783,7 @@ static ssize_t fs_fat_read(void *h, void *buf, size_t cnt) {
 
             /* Did we hit the end of the cluster? */
             if(cnt == bs) {
-                cl = fat_read_fat(fs, fh[fd].cluster, &errno);
+                cl = next_cluster(fs, fd, &errno);
 
                 if(cl == FAT_INVALID_CLUSTER) {
                     mutex_unlock(&fat_mutex);
@@ -1354,6 +1620,34 @@ static vfs_handler_t vh = {
 
 static int initted = 0;
 
+/* Builds the free cluster map for a filesystem a bit at a time, so that the
+   first write to the filesystem doesn't have to wait for it. */
+static void *fmap_thd(void *p) {
+    fs_fat_fs_t *mnt = (fs_fat_fs_t *)p;
+    int rv = 0;
+
+    while(!rv && !mnt->fmap_stop) {
+        mutex_lock(&fat_mutex);
+        rv = fat_fmap_build(mnt->fs, FAT_FMAP_BG_CHUNK);
+        mutex_unlock(&fat_mutex);
+        thd_pass();
+    }
+
+    if(rv < 0)
+        dbglog(DBG_DEBUG, "fs_fat: couldn't build free cluster map: %s\n",
+               strerror(-rv));
+
+    return NULL;
+}
+
+static void fmap_thd_stop(fs_fat_fs_t *mnt) {
+    if(mnt->fmap_thd) {
+        mnt->fmap_stop = 1;
+        thd_join(mnt->fmap_thd, NULL);
+        mnt->fmap_thd = NULL;
+    }
+}
+
 /* These two functions borrow heavily from the same functions in fs_romdisk */
 int fs_fat_mount(const char *mp, kos_blockdev_t *dev, uint32_t flags) {
     fat_fs_t *fs;
@@ -1372,7 +1666,7 @@ int fs_fat_mount(const char *mp, kos_blockdev_t *dev, uint32_t flags) {
     mutex_lock(&fat_mutex);
 
     /* Try to initialize the filesystem */
-    if(!(fs = fat_fs_init(dev, flags))) {
+    if(!(fs = fat_fs_init(dev, flags & FAT_MNT_VALID_FLAGS_MASK))) {
         mutex_unlock(&fat_mutex);
         dbglog(DBG_DEBUG, "fs_fat: device does not contain a valid FAT FS.\n");
         return -1;
@@ -1388,6 +1682,8 @@ int fs_fat_mount(const char *mp, kos_blockdev_t *dev, uint32_t flags) {
 
     mnt->fs = fs;
     mnt->mount_flags = flags;
+    mnt->fmap_thd = NULL;
+    mnt->fmap_stop = 0;
 
     /* Create a VFS structure */
     if(!(vfsh = (vfs_handler_t *)malloc(sizeof(vfs_handler_t)))) {
@@ -1416,6 +1712,14 @@ int fs_fat_mount(const char *mp, kos_blockdev_t *dev, uint32_t flags) {
         return -1;
     }
 
+    /* Start building the free cluster map, if we've been asked to. Otherwise,
+       it'll be built the first time a cluster gets allocated. */
+    if((flags & FS_FAT_MOUNT_BG_FREEMAP) && (flags & FS_FAT_MOUNT_READWRITE)) {
+        if(!(mnt->fmap_thd = thd_create(false, fmap_thd, mnt)))
+            dbglog(DBG_DEBUG, "fs_fat: couldn't start free cluster map "
+                   "thread\n");
+    }
+
     mutex_unlock(&fat_mutex);
     return 0;
 }
@@ -1438,6 +1742,12 @@ int fs_fat_unmount(const char *mp) {
 
         /* XXXX: We should probably do something with open files... */
         nmmgr_handler_remove(&i->vfsh->nmmgr);
+
+        /* The free cluster map builder needs the lock to finish up. */
+        mutex_unlock(&fat_mutex);
+        fmap_thd_stop(i);
+        mutex_lock(&fat_mutex);
+
         fat_fs_shutdown(i->fs);
         free(i->vfsh);
         free(i);
@@ -1492,6 +1802,7 @@ int fs_fat_init(void) {
 
 int fs_fat_shutdown(void) {
     fs_fat_fs_t *i, *next;
+    int fd;
 
     if(!initted)
         return 0;
@@ -1503,6 +1814,7 @@ int fs_fat_shutdown(void) {
 
         /* XXXX: We should probably do something with open files... */
         nmmgr_handler_remove(&i->vfsh->nmmgr);
+        fmap_thd_stop(i);
         fat_fs_shutdown(i->fs);
         free(i->vfsh);
         free(i);
@@ -1510,6 +1822,9 @@ int fs_fat_shutdown(void) {
         i = next;
     }
 
+    for(fd = 0; fd < MAX_FAT_FILES; ++fd)
+        extent_clear(fd);
+
     mutex_destroy(&fat_mutex);
     initted = 0;
 
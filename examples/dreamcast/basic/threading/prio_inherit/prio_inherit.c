@@ -0,0 +1,124 @@
+/* KallistiOS ##version##
+
+   prio_inherit.c
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* This program shows priority inheritance on a mutex created with
+   MUTEX_PRIO_INHERIT. A low priority thread takes the mutex, then a high
+   priority thread blocks on it. While the high priority thread waits, the low
+   priority one runs at its priority, so that nothing in between can hold up
+   the release of the mutex. Once it unlocks the mutex, the low priority thread
+   goes back to its own priority, and the high priority thread gets the mutex
+   straight away. */
+
+#include <stdio.h>
+
+#include <kos/thread.h>
+#include <kos/mutex.h>
+#include <kos/sem.h>
+
+#define PRIO_LOW    20
+#define PRIO_HIGH   5
+
+static mutex_t mutex;
+static semaphore_t locked, go;
+
+/* What the low priority thread saw, just before and after unlocking */
+static prio_t low_before, low_after;
+static int high_got_it;
+
+static void *low_thd(void *param) {
+    (void)param;
+
+    mutex_lock(&mutex);
+    sem_signal(&locked);
+
+    /* Hold on to the mutex until the main thread has seen us get boosted. */
+    sem_wait(&go);
+
+    low_before = thd_current->prio;
+    mutex_unlock(&mutex);
+    low_after = thd_current->prio;
+
+    return NULL;
+}
+
+static void *high_thd(void *param) {
+    (void)param;
+
+    mutex_lock(&mutex);
+    high_got_it = 1;
+    mutex_unlock(&mutex);
+
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    kthread_attr_t attr = { 0 };
+    kthread_t *low, *high;
+    prio_t boosted;
+    int errors = 0;
+
+    (void)argc;
+    (void)argv;
+
+    printf("KallistiOS priority inheritance test\n");
+
+    mutex_init(&mutex, MUTEX_TYPE_NORMAL | MUTEX_PRIO_INHERIT);
+    sem_init(&locked, 0);
+    sem_init(&go, 0);
+
+    attr.prio = PRIO_LOW;
+    attr.label = "low";
+    low = thd_create_ex(&attr, low_thd, NULL);
+
+    /* Wait for the low priority thread to take the mutex. */
+    sem_wait(&locked);
+
+    /* Let the high priority thread run. It blocks on the mutex right away, so
+       by the time we get back here, the holder has been boosted. */
+    attr.prio = PRIO_HIGH;
+    attr.label = "high";
+    high = thd_create_ex(&attr, high_thd, NULL);
+    thd_pass();
+
+    boosted = low->prio;
+    printf("Holder priority while the mutex is wanted: %d (own %d)\n",
+           (int)boosted, (int)low->real_prio);
+
+    if(boosted != PRIO_HIGH) {
+        printf("Holder wasn't boosted to %d\n", PRIO_HIGH);
+        ++errors;
+    }
+
+    sem_signal(&go);
+    thd_join(high, NULL);
+    thd_join(low, NULL);
+
+    printf("Holder priority before unlocking: %d, after: %d\n",
+           (int)low_before, (int)low_after);
+
+    if(low_before != PRIO_HIGH || low_after != PRIO_LOW) {
+        printf("Holder priority wasn't restored to %d\n", PRIO_LOW);
+        ++errors;
+    }
+
+    if(!high_got_it) {
+        printf("The high priority thread never got the mutex\n");
+        ++errors;
+    }
+
+    sem_destroy(&go);
+    sem_destroy(&locked);
+    mutex_destroy(&mutex);
+
+    if(errors) {
+        printf("Test failed with %d errors\n", errors);
+        return 1;
+    }
+
+    printf("Test passed\n");
+    return 0;
+}
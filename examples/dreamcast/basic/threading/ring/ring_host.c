@@ -0,0 +1,155 @@
+/* KallistiOS ##version##
+
+   ring_host.c
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* This is the same sort of stress test as ring_test.c, but built for the host
+   with pthreads (see Makefile.nonkos), so that it can be run on a machine with
+   real parallelism and under ThreadSanitizer. One thread feeds the main thread
+   through a single-producer ring with bulk pushes and pops of odd sizes, so
+   they keep straddling the wrap point, and then several threads all push into
+   one multi-producer ring at once. The main thread checks that every element
+   comes out exactly once, and in the order each producer pushed them in. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <kos/ring.h>
+
+#ifndef COUNT
+#define COUNT       2000000
+#endif
+
+#define PRODUCERS   4
+#define SPSC_SIZE   256
+#define MPSC_SIZE   64
+
+typedef struct {
+    uint32_t id;
+    uint32_t seq;
+} elem_t;
+
+static kos_spsc_ring_t spsc;
+static uint32_t spsc_buf[SPSC_SIZE];
+
+static kos_mpsc_ring_t mpsc;
+static uint8_t mpsc_buf[KOS_MPSC_RING_BUF_SIZE(MPSC_SIZE, sizeof(elem_t))]
+    __attribute__((aligned(4)));
+
+static void *spsc_thd(void *data) {
+    uint32_t v[7], i = 0, k, n;
+
+    (void)data;
+
+    while(i < COUNT) {
+        for(k = 0; k < 7 && i + k < COUNT; ++k)
+            v[k] = i + k;
+
+        if(!(n = kos_spsc_ring_push_n(&spsc, v, k)))
+            sched_yield();
+
+        i += n;
+    }
+
+    return NULL;
+}
+
+static void *mpsc_thd(void *data) {
+    elem_t e = { (uint32_t)(uintptr_t)data, 0 };
+
+    for(e.seq = 0; e.seq < COUNT; ++e.seq) {
+        while(kos_mpsc_ring_push(&mpsc, &e))
+            sched_yield();
+    }
+
+    return NULL;
+}
+
+static int test_spsc(void) {
+    pthread_t thd;
+    uint32_t v[5], expect = 0, n, k;
+    int bad = 0;
+
+    if(kos_spsc_ring_init(&spsc, spsc_buf, SPSC_SIZE, sizeof(uint32_t))) {
+        printf("spsc: init failed\n");
+        return 1;
+    }
+
+    /* Capacities that aren't a power of two should be refused. */
+    if(kos_spsc_ring_init(&spsc, spsc_buf, SPSC_SIZE - 1,
+                          sizeof(uint32_t)) != -1) {
+        printf("spsc: init accepted a bad capacity\n");
+        ++bad;
+    }
+
+    kos_spsc_ring_init(&spsc, spsc_buf, SPSC_SIZE, sizeof(uint32_t));
+    pthread_create(&thd, NULL, spsc_thd, NULL);
+
+    while(expect < COUNT) {
+        if(!(n = kos_spsc_ring_pop_n(&spsc, v, 5)))
+            sched_yield();
+
+        for(k = 0; k < n; ++k) {
+            if(v[k] != expect++)
+                ++bad;
+        }
+    }
+
+    pthread_join(thd, NULL);
+
+    if(kos_spsc_ring_count(&spsc))
+        ++bad;
+
+    printf("spsc: %u elements, %d errors\n", COUNT, bad);
+    return bad;
+}
+
+static int test_mpsc(void) {
+    pthread_t thd[PRODUCERS];
+    uint32_t next[PRODUCERS] = { 0 };
+    uint64_t got = 0;
+    elem_t e;
+    int bad = 0;
+    uintptr_t i;
+
+    if(kos_mpsc_ring_init(&mpsc, mpsc_buf, MPSC_SIZE, sizeof(elem_t))) {
+        printf("mpsc: init failed\n");
+        return 1;
+    }
+
+    for(i = 0; i < PRODUCERS; ++i)
+        pthread_create(&thd[i], NULL, mpsc_thd, (void *)i);
+
+    while(got < (uint64_t)COUNT * PRODUCERS) {
+        if(kos_mpsc_ring_pop(&mpsc, &e)) {
+            sched_yield();
+            continue;
+        }
+
+        if(e.id >= PRODUCERS || e.seq != next[e.id]++)
+            ++bad;
+
+        ++got;
+    }
+
+    for(i = 0; i < PRODUCERS; ++i)
+        pthread_join(thd[i], NULL);
+
+    if(kos_mpsc_ring_count(&mpsc))
+        ++bad;
+
+    printf("mpsc: %u elements from %d producers, %d errors\n", COUNT,
+           PRODUCERS, bad);
+    return bad;
+}
+
+int main(void) {
+    int bad = test_spsc() + test_mpsc();
+
+    printf("%s\n", bad ? "FAIL" : "PASS");
+    return bad ? 1 : 0;
+}
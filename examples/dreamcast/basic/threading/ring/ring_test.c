@@ -0,0 +1,175 @@
+/* KallistiOS ##version##
+
+   ring_test.c
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* This program stress tests the lock-free ring buffers in kos/ring.h. The
+   vblank interrupt hands a counter to the main thread through a
+   single-producer ring, while a handful of threads and the vblank interrupt
+   all push into one multi-producer ring at once. The main thread checks that
+   every element comes out exactly once, and in the order each producer pushed
+   them in. The rings are kept small, so that they fill up and wrap around a
+   lot, and the producer threads get preempted in the middle of a push.
+
+   ring_host.c runs the same kind of test on the host, with pthreads. */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <kos/thread.h>
+#include <kos/ring.h>
+
+#include <arch/arch.h>
+#include <arch/timer.h>
+#include <dc/vblank.h>
+#include <dc/maple.h>
+#include <dc/maple/controller.h>
+
+#define PRODUCERS   4
+#define IRQ_ID      PRODUCERS
+#define RUN_TIME    5000
+#define RING_SIZE   16
+
+typedef struct {
+    uint32_t id;
+    uint32_t seq;
+} elem_t;
+
+static kos_spsc_ring_t spsc;
+static uint32_t spsc_buf[RING_SIZE];
+
+static kos_mpsc_ring_t mpsc;
+static uint32_t mpsc_buf[KOS_MPSC_RING_BUF_SIZE(RING_SIZE, sizeof(elem_t)) /
+                         sizeof(uint32_t)];
+
+static volatile int running;
+static uint32_t irq_seq, irq_spsc_seq, irq_drops, irq_spsc_drops;
+static uint32_t pushed[PRODUCERS];
+
+static void vblank(uint32_t code, void *data) {
+    elem_t e = { IRQ_ID, irq_seq };
+
+    (void)code;
+    (void)data;
+
+    if(kos_spsc_ring_push(&spsc, &irq_spsc_seq))
+        ++irq_spsc_drops;
+    else
+        ++irq_spsc_seq;
+
+    if(kos_mpsc_ring_push(&mpsc, &e))
+        ++irq_drops;
+    else
+        ++irq_seq;
+}
+
+static void *producer(void *param) {
+    elem_t e = { (uint32_t)param, 0 };
+
+    while(running) {
+        if(kos_mpsc_ring_push(&mpsc, &e))
+            thd_pass();
+        else
+            ++e.seq;
+    }
+
+    pushed[e.id] = e.seq;
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    kthread_t *thds[PRODUCERS];
+    uint32_t expect[PRODUCERS + 1] = { 0 };
+    uint32_t spsc_expect = 0, val, total = 0;
+    uint64_t end;
+    int handle, i, errors = 0;
+    elem_t e;
+
+    (void)argc;
+    (void)argv;
+
+    cont_btn_callback(0, CONT_START | CONT_A | CONT_B | CONT_X | CONT_Y,
+                      (cont_btn_callback_t)arch_exit);
+
+    printf("KallistiOS lock-free ring test\n");
+
+    kos_spsc_ring_init(&spsc, spsc_buf, RING_SIZE, sizeof(uint32_t));
+    kos_mpsc_ring_init(&mpsc, mpsc_buf, RING_SIZE, sizeof(elem_t));
+
+    running = 1;
+
+    for(i = 0; i < PRODUCERS; ++i)
+        thds[i] = thd_create(0, producer, (void *)i);
+
+    handle = vblank_handler_add(vblank, NULL);
+    end = timer_ms_gettime64() + RUN_TIME;
+
+    for(;;) {
+        if(!running && !kos_mpsc_ring_count(&mpsc) &&
+           !kos_spsc_ring_count(&spsc))
+            break;
+
+        if(running && timer_ms_gettime64() >= end) {
+            vblank_handler_remove(handle);
+            running = 0;
+
+            for(i = 0; i < PRODUCERS; ++i)
+                thd_join(thds[i], NULL);
+        }
+
+        while(!kos_spsc_ring_pop(&spsc, &val)) {
+            if(val != spsc_expect++) {
+                printf("SPSC: got %lu, expected %lu\n", (unsigned long)val,
+                       (unsigned long)spsc_expect - 1);
+                spsc_expect = val + 1;
+                ++errors;
+            }
+        }
+
+        while(!kos_mpsc_ring_pop(&mpsc, &e)) {
+            if(e.id > IRQ_ID) {
+                printf("MPSC: bad producer %lu\n", (unsigned long)e.id);
+                ++errors;
+                continue;
+            }
+
+            if(e.seq != expect[e.id]) {
+                printf("MPSC: producer %lu sent %lu, expected %lu\n",
+                       (unsigned long)e.id, (unsigned long)e.seq,
+                       (unsigned long)expect[e.id]);
+                ++errors;
+            }
+
+            expect[e.id] = e.seq + 1;
+            ++total;
+        }
+
+        thd_pass();
+    }
+
+    for(i = 0; i < PRODUCERS; ++i) {
+        printf("Thread %d: %lu pushed\n", i, (unsigned long)pushed[i]);
+
+        if(expect[i] != pushed[i])
+            ++errors;
+    }
+
+    printf("Interrupt: %lu pushed, %lu dropped (SPSC: %lu pushed, %lu "
+           "dropped)\n", (unsigned long)irq_seq, (unsigned long)irq_drops,
+           (unsigned long)irq_spsc_seq, (unsigned long)irq_spsc_drops);
+
+    if(expect[IRQ_ID] != irq_seq || spsc_expect != irq_spsc_seq)
+        ++errors;
+
+    printf("%lu elements received\n", (unsigned long)total);
+
+    if(errors) {
+        printf("Test failed with %d errors\n", errors);
+        return 1;
+    }
+
+    printf("Test passed\n");
+    return 0;
+}
@@ -0,0 +1,124 @@
+/* KallistiOS ##version##
+
+   sleepers_bench.c
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* This program measures how much CPU time goes to putting threads to sleep
+   with a timeout and waking them back up again, with 10, 100, and 1000 threads
+   doing so at once. Each of the sleeper threads just calls thd_sleep() with a
+   short timeout over and over, while the main thread spins at a lower priority
+   counting how much work it gets done. Comparing that to how much it gets done
+   with nobody else around tells us how much time the sleepers cost, and from
+   that, how much each trip through the timer queue costs. */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <kos/thread.h>
+
+#include <arch/arch.h>
+#include <arch/timer.h>
+#include <dc/maple.h>
+#include <dc/maple/controller.h>
+
+#define MAX_SLEEPERS    1000
+#define RUN_TIME        2000
+#define STACK_SIZE      4096
+
+static volatile int running;
+static unsigned int ops[MAX_SLEEPERS];
+
+static void *sleeper(void *param) {
+    unsigned int idx = (unsigned int)param;
+
+    /* Spread the timeouts out a bit, so they don't all land at once. */
+    while(running) {
+        thd_sleep(1 + (idx & 15));
+        ++ops[idx];
+    }
+
+    return NULL;
+}
+
+/* Spin for ms milliseconds, returning how many times we went around. */
+static uint64_t spin(unsigned int ms) {
+    uint64_t end = timer_ms_gettime64() + ms;
+    uint64_t iters = 0;
+
+    while(timer_ms_gettime64() < end)
+        ++iters;
+
+    return iters;
+}
+
+static int run(int count, uint64_t base) {
+    kthread_t *thds[MAX_SLEEPERS];
+    kthread_attr_t attr = {
+        .stack_size = STACK_SIZE,
+        .prio = PRIO_DEFAULT - 1,
+        .label = "sleeper"
+    };
+    uint64_t iters, total = 0;
+    double lost;
+    int i;
+
+    running = 1;
+
+    for(i = 0; i < count; ++i) {
+        ops[i] = 0;
+
+        if(!(thds[i] = thd_create_ex(&attr, sleeper, (void *)i))) {
+            printf("Couldn't create sleeper %d\n", i);
+            count = i;
+            break;
+        }
+    }
+
+    iters = spin(RUN_TIME);
+    running = 0;
+
+    for(i = 0; i < count; ++i) {
+        thd_join(thds[i], NULL);
+        total += ops[i];
+    }
+
+    if(!total) {
+        printf("%4d sleepers: no sleeps completed\n", count);
+        return -1;
+    }
+
+    /* Whatever time the spinner didn't get went to the sleepers. */
+    lost = (double)RUN_TIME * 1000.0 * (1.0 - (double)iters / (double)base);
+
+    printf("%4d sleepers: %8llu sleeps, %6.2f%% CPU, %6.2f us per sleep\n",
+           count, (unsigned long long)total,
+           100.0 * lost / (RUN_TIME * 1000.0), lost / (double)total);
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t base;
+
+    (void)argc;
+    (void)argv;
+
+    cont_btn_callback(0, CONT_START | CONT_A | CONT_B | CONT_X | CONT_Y,
+                      (cont_btn_callback_t)arch_exit);
+
+    printf("KallistiOS timed sleep benchmark\n");
+
+    /* How fast do we spin with nothing else going on? */
+    base = spin(RUN_TIME);
+    printf("Baseline: %llu iterations in %d ms\n", (unsigned long long)base,
+           RUN_TIME);
+
+    run(10, base);
+    run(100, base);
+    run(MAX_SLEEPERS, base);
+
+    printf("Done\n");
+    return 0;
+}
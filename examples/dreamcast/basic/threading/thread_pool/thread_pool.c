@@ -0,0 +1,118 @@
+/* KallistiOS ##version##
+
+   thread_pool.c
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* This program runs a batch of jobs on a thread pool that has fewer workers
+   than there are jobs, so that most of them have to wait in the pool's queue
+   for a worker to free up. Each job works out a sum on its own, and once the
+   main thread has waited for all of them to finish, it checks that every job
+   ran exactly once and came up with the right answer. */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <kos/thread.h>
+#include <kos/thread_pool.h>
+
+#define WORKER_COUNT    4
+#define JOB_COUNT       64
+#define JOB_TERMS       10000
+
+typedef struct {
+    kthread_task_t task;
+    unsigned int index;
+    unsigned int runs;
+    uint64_t result;
+} job_t;
+
+static job_t jobs[JOB_COUNT];
+static kthread_task_counter_t counter;
+
+/* Sum of (index + 1) * i for i in [0, JOB_TERMS), the long way around. Give
+   up the CPU partway through, so that the workers take turns. */
+static void job_run(void *data) {
+    job_t *job = (job_t *)data;
+    uint64_t sum = 0;
+    unsigned int i;
+
+    for(i = 0; i < JOB_TERMS; ++i) {
+        sum += (uint64_t)(job->index + 1) * i;
+
+        if(i == JOB_TERMS / 2)
+            thd_pass();
+    }
+
+    job->result = sum;
+    ++job->runs;
+}
+
+int main(int argc, char *argv[]) {
+    kthread_pool_t *pool;
+    uint64_t expected;
+    unsigned int i;
+    int errors = 0;
+
+    (void)argc;
+    (void)argv;
+
+    printf("KallistiOS thread pool test\n");
+
+    if(!(pool = thd_pool_create(WORKER_COUNT, NULL))) {
+        printf("Couldn't create the thread pool\n");
+        return 1;
+    }
+
+    thd_task_counter_init(&counter);
+
+    for(i = 0; i < JOB_COUNT; ++i) {
+        jobs[i].index = i;
+        jobs[i].task.routine = job_run;
+        jobs[i].task.data = &jobs[i];
+        jobs[i].task.counter = &counter;
+
+        if(thd_pool_submit(pool, &jobs[i].task) < 0) {
+            printf("Couldn't submit job %u\n", i);
+            ++errors;
+        }
+    }
+
+    printf("Submitted %d jobs to %d workers\n", JOB_COUNT, WORKER_COUNT);
+
+    if(thd_pool_wait(pool, &counter) < 0) {
+        printf("Couldn't wait for the jobs\n");
+        ++errors;
+    }
+
+    if(counter.count) {
+        printf("%u jobs still counted after waiting\n", counter.count);
+        ++errors;
+    }
+
+    for(i = 0; i < JOB_COUNT; ++i) {
+        expected = (uint64_t)(i + 1) * JOB_TERMS * (JOB_TERMS - 1) / 2;
+
+        if(jobs[i].runs != 1) {
+            printf("Job %u ran %u times\n", i, jobs[i].runs);
+            ++errors;
+        }
+        else if(jobs[i].result != expected) {
+            printf("Job %u got %llu, expected %llu\n", i,
+                   (unsigned long long)jobs[i].result,
+                   (unsigned long long)expected);
+            ++errors;
+        }
+    }
+
+    thd_pool_destroy(pool);
+
+    if(errors) {
+        printf("Test failed with %d errors\n", errors);
+        return 1;
+    }
+
+    printf("Test passed\n");
+    return 0;
+}
@@ -0,0 +1,310 @@
+/* KallistiOS ##version##
+
+   fatfrag.c
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* This program checks that fs_fat copes with badly fragmented files. It builds
+   a small FAT16 filesystem in RAM (so no SD card is needed), then writes two
+   files a cluster at a time, alternating between them, so that every cluster
+   of each file ends up in a fragment of its own. That's well past the number
+   of extents fs_fat keeps track of for an open file.
+
+   Both files are then read back a cluster at a time, in one big read, and by
+   seeking around, checking that the data is right. The time taken to read
+   the first and second halves of the file a cluster at a time is compared, as
+   reading shouldn't get any slower the further into the file it goes. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <malloc.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <kos/init.h>
+#include <kos/blockdev.h>
+#include <fat/fs_fat.h>
+
+#include <arch/arch.h>
+#include <arch/timer.h>
+#include <dc/maple.h>
+#include <dc/maple/controller.h>
+
+KOS_INIT_FLAGS(INIT_DEFAULT);
+
+/* An 8MiB FAT16 volume, with one 512 byte sector per cluster. */
+#define SECTOR_SIZE     512
+#define NUM_SECTORS     16384
+#define FAT_SECTORS     64
+#define ROOT_ENTRIES    512
+
+/* Number of clusters in each file. Anything over 1024 is more fragments than
+   fs_fat remembers. */
+#define FILE_CLUSTERS   3000
+
+static uint8_t *image;
+
+static int ram_init(kos_blockdev_t *d) {
+    (void)d;
+    return 0;
+}
+
+static int ram_shutdown(kos_blockdev_t *d) {
+    (void)d;
+    return 0;
+}
+
+static int ram_read(kos_blockdev_t *d, uint64_t block, size_t count,
+                    void *buf) {
+    (void)d;
+    memcpy(buf, image + block * SECTOR_SIZE, count * SECTOR_SIZE);
+    return 0;
+}
+
+static int ram_write(kos_blockdev_t *d, uint64_t block, size_t count,
+                     const void *buf) {
+    (void)d;
+    memcpy(image + block * SECTOR_SIZE, buf, count * SECTOR_SIZE);
+    return 0;
+}
+
+static uint64_t ram_count(kos_blockdev_t *d) {
+    (void)d;
+    return NUM_SECTORS;
+}
+
+static int ram_flush(kos_blockdev_t *d) {
+    (void)d;
+    return 0;
+}
+
+static kos_blockdev_t ram_dev = {
+    NULL, 9,
+    ram_init, ram_shutdown, ram_read, ram_write, ram_count, ram_flush
+};
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+/* Lay out an empty FAT16 filesystem on the RAM disk. */
+static void format_image(void) {
+    uint8_t *bs = image;
+    uint8_t *fat;
+    int i;
+
+    memset(image, 0, NUM_SECTORS * SECTOR_SIZE);
+
+    bs[0] = 0xEB;
+    bs[1] = 0x3C;
+    bs[2] = 0x90;
+    memcpy(bs + 3, "KOS     ", 8);
+    put16(bs + 11, SECTOR_SIZE);
+    bs[13] = 1;                         /* Sectors per cluster */
+    put16(bs + 14, 1);                  /* Reserved sectors */
+    bs[16] = 2;                         /* Number of FATs */
+    put16(bs + 17, ROOT_ENTRIES);
+    put16(bs + 19, NUM_SECTORS);
+    bs[21] = 0xF8;                      /* Media code */
+    put16(bs + 22, FAT_SECTORS);
+    bs[38] = 0x29;                      /* Extended boot signature */
+    memcpy(bs + 43, "FATFRAG    ", 11);
+    memcpy(bs + 54, "FAT16   ", 8);
+    bs[510] = 0x55;
+    bs[511] = 0xAA;
+
+    for(i = 0; i < 2; ++i) {
+        fat = image + (1 + i * FAT_SECTORS) * SECTOR_SIZE;
+        put16(fat, 0xFFF8);
+        put16(fat + 2, 0xFFFF);
+    }
+}
+
+/* Fill a cluster's worth of data with something that says which file and
+   cluster it belongs to. */
+static void fill(uint32_t *buf, int file, int cl) {
+    int i;
+
+    for(i = 0; i < SECTOR_SIZE / 4; ++i)
+        buf[i] = (file << 24) | (cl << 8) | i;
+}
+
+static int check(const uint32_t *buf, int file, int cl) {
+    uint32_t expect[SECTOR_SIZE / 4];
+
+    fill(expect, file, cl);
+
+    if(memcmp(buf, expect, SECTOR_SIZE)) {
+        printf("FAIL: bad data in file %d, cluster %d\n", file, cl);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int write_files(void) {
+    uint32_t buf[SECTOR_SIZE / 4];
+    int fd[2], i, j, rv = 0;
+
+    fd[0] = open("/ram/a.bin", O_WRONLY | O_CREAT | O_TRUNC);
+    fd[1] = open("/ram/b.bin", O_WRONLY | O_CREAT | O_TRUNC);
+
+    if(fd[0] < 0 || fd[1] < 0) {
+        printf("FAIL: couldn't create files\n");
+        return -1;
+    }
+
+    for(i = 0; i < FILE_CLUSTERS && !rv; ++i) {
+        for(j = 0; j < 2; ++j) {
+            fill(buf, j, i);
+
+            if(write(fd[j], buf, SECTOR_SIZE) != SECTOR_SIZE) {
+                printf("FAIL: write to file %d failed at cluster %d\n", j, i);
+                rv = -1;
+                break;
+            }
+        }
+    }
+
+    close(fd[0]);
+    close(fd[1]);
+    return rv;
+}
+
+/* Read the file a cluster at a time, timing each half of it. */
+static int read_clusters(const char *fn, int file) {
+    uint32_t buf[SECTOR_SIZE / 4];
+    uint64_t start = 0, half[2] = { 0, 0 };
+    int fd, i;
+
+    if((fd = open(fn, O_RDONLY)) < 0) {
+        printf("FAIL: couldn't open %s\n", fn);
+        return -1;
+    }
+
+    for(i = 0; i < FILE_CLUSTERS; ++i) {
+        if(i % (FILE_CLUSTERS / 2) == 0)
+            start = timer_us_gettime64();
+
+        if(read(fd, buf, SECTOR_SIZE) != SECTOR_SIZE || check(buf, file, i)) {
+            printf("FAIL: read of %s failed at cluster %d\n", fn, i);
+            close(fd);
+            return -1;
+        }
+
+        if(i % (FILE_CLUSTERS / 2) == FILE_CLUSTERS / 2 - 1)
+            half[i / (FILE_CLUSTERS / 2)] = timer_us_gettime64() - start;
+    }
+
+    close(fd);
+
+    printf("%s: first half %llu us, second half %llu us\n", fn, half[0],
+           half[1]);
+
+    if(half[1] > half[0] * 4 + 10000) {
+        printf("FAIL: reading got slower further into the file\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Read the whole file in one go, into a buffer fs_fat can read straight
+   into. */
+static int read_whole(const char *fn, int file) {
+    uint32_t *buf;
+    int fd, i, rv = 0;
+
+    if(!(buf = (uint32_t *)memalign(32, FILE_CLUSTERS * SECTOR_SIZE)))
+        return -1;
+
+    if((fd = open(fn, O_RDONLY)) < 0) {
+        printf("FAIL: couldn't open %s\n", fn);
+        free(buf);
+        return -1;
+    }
+
+    if(read(fd, buf, FILE_CLUSTERS * SECTOR_SIZE) !=
+       FILE_CLUSTERS * SECTOR_SIZE) {
+        printf("FAIL: whole file read of %s failed\n", fn);
+        rv = -1;
+    }
+
+    for(i = 0; i < FILE_CLUSTERS && !rv; ++i)
+        rv = check(buf + i * (SECTOR_SIZE / 4), file, i);
+
+    close(fd);
+    free(buf);
+    return rv;
+}
+
+/* Jump around the file, both inside and past the part fs_fat keeps a map
+   of. */
+static int read_seeks(const char *fn, int file) {
+    static const int where[] = {
+        FILE_CLUSTERS - 1, 10, 2000, 1023, 1024, 1025, 2999, 0, 1500
+    };
+    uint32_t buf[SECTOR_SIZE / 4];
+    unsigned int i;
+    int fd;
+
+    if((fd = open(fn, O_RDONLY)) < 0) {
+        printf("FAIL: couldn't open %s\n", fn);
+        return -1;
+    }
+
+    for(i = 0; i < sizeof(where) / sizeof(where[0]); ++i) {
+        if(lseek(fd, where[i] * SECTOR_SIZE, SEEK_SET) < 0 ||
+           read(fd, buf, SECTOR_SIZE) != SECTOR_SIZE ||
+           check(buf, file, where[i])) {
+            printf("FAIL: seek to cluster %d of %s failed\n", where[i], fn);
+            close(fd);
+            return -1;
+        }
+    }
+
+    close(fd);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int rv = -1;
+
+    (void)argc;
+    (void)argv;
+
+    cont_btn_callback(0, CONT_START | CONT_A | CONT_B | CONT_X | CONT_Y,
+                      (cont_btn_callback_t)arch_exit);
+
+    if(!(image = (uint8_t *)memalign(32, NUM_SECTORS * SECTOR_SIZE))) {
+        printf("FAIL: couldn't allocate RAM disk\n");
+        return 1;
+    }
+
+    format_image();
+
+    if(fs_fat_init() || fs_fat_mount("/ram", &ram_dev,
+                                     FS_FAT_MOUNT_READWRITE)) {
+        printf("FAIL: couldn't mount RAM disk\n");
+        free(image);
+        return 1;
+    }
+
+    if(!write_files() &&
+       !read_clusters("/ram/a.bin", 0) && !read_clusters("/ram/b.bin", 1) &&
+       !read_whole("/ram/a.bin", 0) && !read_whole("/ram/b.bin", 1) &&
+       !read_seeks("/ram/a.bin", 0) && !read_seeks("/ram/b.bin", 1)) {
+        printf("PASS\n");
+        rv = 0;
+    }
+
+    fs_fat_unmount("/ram");
+    fs_fat_shutdown();
+    free(image);
+
+    return rv ? 1 : 0;
+}
@@ -0,0 +1,530 @@
+/* KallistiOS ##version##
+
+   loopbench.c
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* This program benchmarks the network stack against itself, over the loopback
+   device, so that it can be run without a network adapter or anything on the
+   other end. For each of a few link conditions (set up with net_loop_set_loss()
+   and net_loop_set_delay()), it measures:
+     - UDP round trip times, bouncing datagrams off an echo thread,
+     - UDP throughput and loss, with one thread sending as fast as it can and
+       another one counting what arrives,
+     - TCP throughput, pushing a few megabytes through a connection, along with
+       the retransmission counters for it.
+   It also sends one batch of datagrams with sendmmsg() and reads it back with
+   recvmmsg(), over a clean link, to check that the batched calls work.
+   Everything is printed out at the end of each run, so results can be
+   compared from one version of the stack to the next.
+
+   The TCP data is checked as it arrives, and the program fails (returning 1)
+   if any of it is wrong or missing, if no UDP pings come back at all, or if the
+   batch doesn't come back exactly as it was sent. This
+   can also be built and run on the host, with kernel/net/host/Makefile.nonkos,
+   for use as a regression test. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <kos/net.h>
+#include <kos/thread.h>
+#include <arch/arch.h>
+#include <arch/timer.h>
+#include <dc/maple.h>
+#include <dc/maple/controller.h>
+
+KOS_INIT_FLAGS(INIT_DEFAULT | INIT_NET);
+
+#define ECHO_PORT       5000
+#define SINK_PORT       5001
+#define TCP_PORT        5002
+#define BATCH_PORT      5010
+
+#define PING_COUNT      200
+#define PING_TIMEOUT    500
+#define PING_SIZE       64
+
+#define UDP_TIME        2000
+#define UDP_SIZE        1024
+
+#define TCP_BYTES       (4 * 1024 * 1024)
+#define TCP_CHUNK       8192
+
+#define BATCH_COUNT     16
+#define BATCH_SIZE      256
+#define BATCH_TIMEOUT   500
+
+typedef struct {
+    unsigned int loss;
+    unsigned int delay;
+} link_t;
+
+static const link_t links[] = {
+    { 0, 0 },
+    { 0, 10 },
+    { 10, 0 },
+    { 50, 5 }
+};
+
+#define LINK_COUNT  (sizeof(links) / sizeof(links[0]))
+
+/* What byte goes at each offset of the TCP stream. The pattern repeats every
+   251 bytes, which doesn't divide the size of any segment, so data that ends
+   up out of order, duplicated or missing won't line up with it. */
+#define TCP_PATTERN(off)    ((uint8_t)(((off) * 7) % 251))
+
+static int errors;
+static volatile int udp_done;
+static uint32_t sink_pkts;
+static uint64_t sink_bytes;
+
+static void make_addr(struct sockaddr_in *addr, uint16_t port) {
+    memset(addr, 0, sizeof(struct sockaddr_in));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+}
+
+static int udp_socket(uint16_t port) {
+    struct sockaddr_in addr;
+    int s;
+
+    if((s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    if(port) {
+        make_addr(&addr, port);
+
+        if(bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            perror("bind");
+            close(s);
+            return -1;
+        }
+    }
+
+    return s;
+}
+
+/* Wait for something to read on s, for up to timeout milliseconds. */
+static int wait_readable(int s, int timeout) {
+    struct pollfd pfd = { s, POLLIN, 0 };
+
+    return poll(&pfd, 1, timeout) > 0;
+}
+
+static void *echo_thd(void *data) {
+    int s = (int)(intptr_t)data;
+    uint8_t buf[PING_SIZE];
+    struct sockaddr_in from;
+    socklen_t len;
+    ssize_t sz;
+
+    while(!udp_done) {
+        if(!wait_readable(s, 100))
+            continue;
+
+        len = sizeof(from);
+        sz = recvfrom(s, buf, sizeof(buf), 0, (struct sockaddr *)&from, &len);
+
+        if(sz > 0)
+            sendto(s, buf, sz, 0, (struct sockaddr *)&from, len);
+    }
+
+    return NULL;
+}
+
+static void bench_udp_rtt(void) {
+    struct sockaddr_in addr;
+    uint8_t buf[PING_SIZE];
+    uint64_t start, rtt, total = 0, min = ~0ULL, max = 0;
+    int es, s, i, got = 0;
+    kthread_t *thd;
+
+    if((es = udp_socket(ECHO_PORT)) < 0)
+        return;
+
+    if((s = udp_socket(0)) < 0) {
+        close(es);
+        return;
+    }
+
+    udp_done = 0;
+    thd = thd_create(0, echo_thd, (void *)(intptr_t)es);
+    make_addr(&addr, ECHO_PORT);
+
+    for(i = 0; i < PING_COUNT; ++i) {
+        memset(buf, 0, sizeof(buf));
+        memcpy(buf, &i, sizeof(i));
+        start = timer_us_gettime64();
+
+        sendto(s, buf, sizeof(buf), 0, (struct sockaddr *)&addr, sizeof(addr));
+
+        /* Skip anything left over from a ping that timed out earlier. */
+        while(wait_readable(s, PING_TIMEOUT)) {
+            if(recv(s, buf, sizeof(buf), 0) == sizeof(buf) &&
+               !memcmp(buf, &i, sizeof(i))) {
+                rtt = timer_us_gettime64() - start;
+                total += rtt;
+                min = rtt < min ? rtt : min;
+                max = rtt > max ? rtt : max;
+                ++got;
+                break;
+            }
+        }
+    }
+
+    udp_done = 1;
+    thd_join(thd, NULL);
+    close(s);
+    close(es);
+
+    if(got) {
+        printf("  UDP RTT:  %d/%d replies, min %" PRIu64 " us, avg %" PRIu64
+               " us, max %" PRIu64 " us\n", got, PING_COUNT, min, total / got,
+               max);
+    }
+    else {
+        printf("  UDP RTT:  no replies\n");
+        ++errors;
+    }
+}
+
+static void *sink_thd(void *data) {
+    int s = (int)(intptr_t)data;
+    uint8_t buf[UDP_SIZE];
+    ssize_t sz;
+
+    while(!udp_done) {
+        if(!wait_readable(s, 100))
+            continue;
+
+        if((sz = recv(s, buf, sizeof(buf), 0)) > 0) {
+            ++sink_pkts;
+            sink_bytes += sz;
+        }
+    }
+
+    return NULL;
+}
+
+static void bench_udp_stream(unsigned int delay) {
+    struct sockaddr_in addr;
+    uint8_t buf[UDP_SIZE];
+    uint64_t start, end, lost;
+    uint32_t sent = 0;
+    int ss, s;
+    kthread_t *thd;
+
+    if((ss = udp_socket(SINK_PORT)) < 0)
+        return;
+
+    if((s = udp_socket(0)) < 0) {
+        close(ss);
+        return;
+    }
+
+    udp_done = 0;
+    sink_pkts = 0;
+    sink_bytes = 0;
+    thd = thd_create(0, sink_thd, (void *)(intptr_t)ss);
+    make_addr(&addr, SINK_PORT);
+    memset(buf, 0xA5, sizeof(buf));
+
+    start = timer_ms_gettime64();
+    end = start + UDP_TIME;
+
+    while(timer_ms_gettime64() < end) {
+        if(sendto(s, buf, sizeof(buf), 0, (struct sockaddr *)&addr,
+                  sizeof(addr)) == sizeof(buf))
+            ++sent;
+
+        /* Give the loopback and receiving threads a chance to keep up. */
+        thd_pass();
+    }
+
+    /* Let anything still in flight arrive before we stop counting. */
+    thd_sleep(200 + delay);
+    udp_done = 1;
+    thd_join(thd, NULL);
+    close(s);
+    close(ss);
+
+    /* In tenths of a percent. This needs 64 bits, as a fast enough host can
+       send more than 4 million datagrams in one run. */
+    lost = sent ? (uint64_t)(sent - sink_pkts) * 1000 / sent : 0;
+
+    printf("  UDP flow: %" PRIu32 " sent, %" PRIu32 " received (%" PRIu64
+           ".%" PRIu64 "%% lost), %" PRIu64 " KiB/s\n", sent, sink_pkts,
+           lost / 10, lost % 10, sink_bytes * 1000 / UDP_TIME / 1024);
+}
+
+/* Bytes the TCP server got that didn't match TCP_PATTERN(), and where the
+   first one was. */
+static size_t tcp_bad, tcp_bad_off;
+
+static void *tcp_server_thd(void *data) {
+    int ls = (int)(intptr_t)data, s;
+    uint8_t *buf;
+    ssize_t sz, i;
+    size_t total = 0;
+
+    if(!(buf = (uint8_t *)malloc(TCP_CHUNK)))
+        return NULL;
+
+    if((s = accept(ls, NULL, NULL)) < 0) {
+        perror("accept");
+        free(buf);
+        return NULL;
+    }
+
+    while((sz = recv(s, buf, TCP_CHUNK, 0)) > 0) {
+        for(i = 0; i < sz; ++i) {
+            if(buf[i] != TCP_PATTERN(total + i) && !tcp_bad++)
+                tcp_bad_off = total + i;
+        }
+
+        total += sz;
+    }
+
+    close(s);
+    free(buf);
+
+    return (void *)(uintptr_t)total;
+}
+
+static void bench_tcp_stream(uint16_t port) {
+    struct sockaddr_in addr;
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    uint8_t *buf;
+    uint64_t start, ms;
+    size_t sent = 0, total;
+    void *rv = NULL;
+    ssize_t sz, i;
+    int ls, s;
+    kthread_t *thd;
+
+    /* Anything that goes wrong in here counts as a failure, until we've seen
+       all of the data arrive intact. */
+    ++errors;
+
+    if((ls = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) {
+        perror("socket");
+        return;
+    }
+
+    make_addr(&addr, port);
+
+    if(bind(ls, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+       listen(ls, 1) < 0) {
+        perror("bind/listen");
+        close(ls);
+        return;
+    }
+
+    if((s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) {
+        perror("socket");
+        close(ls);
+        return;
+    }
+
+    if(!(buf = (uint8_t *)malloc(TCP_CHUNK))) {
+        close(s);
+        close(ls);
+        return;
+    }
+
+    tcp_bad = 0;
+    memset(&info, 0, sizeof(info));
+    thd = thd_create(0, tcp_server_thd, (void *)(intptr_t)ls);
+    start = timer_ms_gettime64();
+
+    if(connect(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+    }
+    else {
+        while(sent < TCP_BYTES) {
+            sz = TCP_BYTES - sent < TCP_CHUNK ? TCP_BYTES - sent : TCP_CHUNK;
+
+            for(i = 0; i < sz; ++i)
+                buf[i] = TCP_PATTERN(sent + i);
+
+            if((sz = send(s, buf, sz, 0)) <= 0)
+                break;
+
+            sent += sz;
+        }
+
+        getsockopt(s, IPPROTO_TCP, TCP_INFO, &info, &len);
+    }
+
+    /* The stack doesn't send a FIN for shutdown(), so close the socket to let
+       the server know that's everything. */
+    close(s);
+    thd_join(thd, &rv);
+    ms = timer_ms_gettime64() - start;
+    total = (size_t)(uintptr_t)rv;
+
+    close(ls);
+    free(buf);
+
+    printf("  TCP flow: %u of %u bytes in %" PRIu64 " ms, %" PRIu64
+           " KiB/s, %" PRIu32 " timeouts, %" PRIu32 " fast retransmits, "
+           "srtt %" PRIu32 " us\n", (unsigned int)total, TCP_BYTES, ms,
+           ms ? (uint64_t)total * 1000 / ms / 1024 : 0,
+           info.tcpi_total_retrans, info.tcpi_fast_retrans, info.tcpi_rtt);
+
+    if(tcp_bad)
+        printf("  TCP flow: %u bad bytes, the first at offset %u\n",
+               (unsigned int)tcp_bad, (unsigned int)tcp_bad_off);
+    else if(total == TCP_BYTES)
+        --errors;
+}
+
+static void bench_udp_batch(void) {
+    static uint8_t bufs[BATCH_COUNT][BATCH_SIZE];
+    struct mmsghdr msgs[BATCH_COUNT];
+    struct iovec iovs[BATCH_COUNT];
+    struct sockaddr_in addr;
+    struct timespec ts;
+    uint64_t start, us;
+    int rs, s, i, j, rv, got = 0, bad = 0;
+
+    if((rs = udp_socket(BATCH_PORT)) < 0) {
+        ++errors;
+        return;
+    }
+
+    if((s = udp_socket(0)) < 0) {
+        close(rs);
+        ++errors;
+        return;
+    }
+
+    make_addr(&addr, BATCH_PORT);
+    memset(msgs, 0, sizeof(msgs));
+
+    for(i = 0; i < BATCH_COUNT; ++i) {
+        for(j = 0; j < BATCH_SIZE; ++j)
+            bufs[i][j] = (uint8_t)(i + j);
+
+        iovs[i].iov_base = bufs[i];
+        iovs[i].iov_len = BATCH_SIZE;
+        msgs[i].msg_hdr.msg_name = &addr;
+        msgs[i].msg_hdr.msg_namelen = sizeof(addr);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    start = timer_us_gettime64();
+
+    if((rv = sendmmsg(s, msgs, BATCH_COUNT, 0)) != BATCH_COUNT) {
+        printf("  Batch:    sendmmsg sent %d/%d\n", rv, BATCH_COUNT);
+        close(s);
+        close(rs);
+        ++errors;
+        return;
+    }
+
+    memset(bufs, 0, sizeof(bufs));
+
+    for(i = 0; i < BATCH_COUNT; ++i) {
+        msgs[i].msg_hdr.msg_name = NULL;
+        msgs[i].msg_hdr.msg_namelen = 0;
+    }
+
+    /* The first message might be all that's queued when recvmmsg() is called,
+       so keep going until the whole batch is in or nothing else shows up. */
+    while(got < BATCH_COUNT) {
+        ts.tv_sec = BATCH_TIMEOUT / 1000;
+        ts.tv_nsec = (BATCH_TIMEOUT % 1000) * 1000000;
+
+        if((rv = recvmmsg(rs, msgs + got, BATCH_COUNT - got, 0, &ts)) <= 0)
+            break;
+
+        got += rv;
+    }
+
+    us = timer_us_gettime64() - start;
+
+    for(i = 0; i < got; ++i) {
+        if(msgs[i].msg_len != BATCH_SIZE) {
+            ++bad;
+            continue;
+        }
+
+        for(j = 0; j < BATCH_SIZE; ++j) {
+            if(bufs[i][j] != (uint8_t)(i + j)) {
+                ++bad;
+                break;
+            }
+        }
+    }
+
+    close(s);
+    close(rs);
+
+    printf("  Batch:    %d/%d datagrams, %d bad, %" PRIu64 " us\n", got,
+           BATCH_COUNT, bad, us);
+
+    if(got != BATCH_COUNT || bad)
+        ++errors;
+}
+
+int main(int argc, char *argv[]) {
+    net_loop_stats_t st;
+    unsigned int i;
+
+    (void)argc;
+    (void)argv;
+
+    cont_btn_callback(0, CONT_START | CONT_A | CONT_B | CONT_X | CONT_Y,
+                      (cont_btn_callback_t)arch_exit);
+
+    for(i = 0; i < LINK_COUNT; ++i) {
+        printf("Link: %u.%u%% loss, %u ms delay\n", links[i].loss / 10,
+               links[i].loss % 10, links[i].delay);
+
+        net_loop_set_loss(links[i].loss);
+        net_loop_set_delay(links[i].delay);
+
+        bench_udp_rtt();
+        bench_udp_stream(links[i].delay);
+        /* The last connection may not be completely closed yet, so use a new
+           port each time. */
+        bench_tcp_stream(TCP_PORT + i);
+    }
+
+    net_loop_set_loss(0);
+    net_loop_set_delay(0);
+
+    printf("Link: clean\n");
+    bench_udp_batch();
+
+    st = net_loop_get_stats();
+    printf("Loopback: %" PRIu32 " sent, %" PRIu32 " dropped, %" PRIu32
+           " delivered\n", st.pkt_sent, st.pkt_dropped, st.pkt_recv);
+
+    if(errors) {
+        printf("Test failed with %d errors\n", errors);
+        return 1;
+    }
+
+    printf("Test passed\n");
+    return 0;
+}
@@ -13,6 +13,9 @@
 #define BACKLOG         1
 #define HTTP_PORT       80
 
+/* Size of the send and receive buffers of each connection */
+#define SOCKET_BUF_SIZE (256 * 1024)
+
 void *server_thread(void *p) {
     (void) p;
     int server_socket;
@@ -34,6 +37,12 @@ void *server_thread(void *p) {
         goto server_cleanup;
     }
 
+    /* Set the buffer sizes before listening, so accepted connections pick
+       them up and can negotiate a window scale big enough to use them. */
+    uint32_t new_buf_sz = SOCKET_BUF_SIZE;
+    setsockopt(server_socket, SOL_SOCKET, SO_SNDBUF, &new_buf_sz, sizeof(new_buf_sz));
+    setsockopt(server_socket, SOL_SOCKET, SO_RCVBUF, &new_buf_sz, sizeof(new_buf_sz));
+
     if(listen(server_socket, BACKLOG) < 0) {
         printf("server_thread: listen failed\n");
         goto server_cleanup;
@@ -55,10 +64,6 @@ void *server_thread(void *p) {
             goto server_cleanup;
         }
 
-        uint32_t new_buf_sz = 65535;
-        setsockopt(hr->socket, SOL_SOCKET, SO_SNDBUF, &new_buf_sz, sizeof(new_buf_sz));
-        setsockopt(hr->socket, SOL_SOCKET, SO_RCVBUF, &new_buf_sz, sizeof(new_buf_sz));
-
         /* Create thread for new client */
         thd_create(DETACHED_THREAD, handle_request, hr);
     }
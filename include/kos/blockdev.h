@@ -30,6 +30,7 @@ __BEGIN_DECLS
 
 #include <stdint.h>
 #include <sys/types.h>
+#include <sys/queue.h>
 
 /** \defgroup vfs_blockdev  Block Devices
     \brief                  VFS driver for accessing block devices
@@ -131,6 +132,254 @@ typedef struct kos_blockdev {
     int (*flush)(struct kos_blockdev *d);
 } kos_blockdev_t;
 
+/** \defgroup vfs_blockdev_cache  Block Device Cache
+    \brief                        Generic caching layer for block devices
+    \ingroup                      vfs_blockdev
+
+    The block device cache is a kos_blockdev_t that can be stacked on top of
+    any other block device to keep recently used blocks of the underlying device
+    in memory. Lookups are done by hashing the block number, and blocks are
+    replaced in least recently used order. This gives all filesystems the same
+    cache without each having to implement its own.
+
+    By default, writes are held in the cache and only written to the underlying
+    device when the block gets evicted or when the device is flushed. Requests
+    that are larger than the whole cache bypass it entirely.
+
+    The cache takes over the lifetime of the underlying device: calling the
+    init or shutdown functions of the cache device will call the corresponding
+    functions of the underlying device. Shutting the cache device down writes
+    back any dirty blocks and frees the cache.
+
+    @{
+*/
+
+/** \brief  Write data straight through to the underlying device.
+
+    If this flag is set, writes are passed on to the device immediately, while
+    also updating any copies of the blocks in the cache.
+*/
+#define KOS_BLOCKDEV_CACHE_WRITETHROUGH     0x00000001
+
+/** \brief  Mask of all valid cache flags. */
+#define KOS_BLOCKDEV_CACHE_VALID_FLAGS      0x00000001
+
+/** \brief  Block device cache statistics.
+
+    All counters are in units of blocks of the underlying device.
+
+    \headerfile kos/blockdev.h
+*/
+typedef struct kos_blockdev_cache_stats {
+    uint32_t capacity;      /**< \brief Number of blocks in the cache. */
+    uint32_t hits;          /**< \brief Blocks found in the cache. */
+    uint32_t misses;        /**< \brief Blocks that went to the device. */
+    uint32_t evictions;     /**< \brief Valid blocks evicted from the cache. */
+    uint32_t writebacks;    /**< \brief Dirty blocks written to the device. */
+} kos_blockdev_cache_stats_t;
+
+/** \brief  Create a caching block device on top of another block device.
+
+    This function creates a block device that caches the blocks of the given
+    device. The new device should be used in place of the underlying one for
+    everything from this point onward (for instance, pass it to
+    fs_fat_mount() or fs_ext2_mount()).
+
+    \param  dev             The block device to cache. This structure must
+                            stay valid for as long as the cache is in use.
+    \param  blocks          The size of the cache, in blocks of dev.
+    \param  flags           Bitwise OR of the KOS_BLOCKDEV_CACHE_* flags.
+    \param  rv              Used to return the cache block device.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EFAULT - dev or rv was NULL \n
+    \em     EINVAL - blocks was 0 or invalid flags were given \n
+    \em     ENOMEM - out of memory
+*/
+int kos_blockdev_cache_create(kos_blockdev_t *dev, size_t blocks,
+                              uint32_t flags, kos_blockdev_t *rv);
+
+/** \brief  Retrieve the statistics of a block device cache.
+
+    \param  d               A block device created by
+                            kos_blockdev_cache_create().
+    \param  st              Used to return the statistics. May be NULL.
+    \param  reset           If non-zero, reset the counters afterwards.
+    \retval 0               On success.
+    \retval -1              On error (d is not a cache), errno will be set.
+*/
+int kos_blockdev_cache_stats(kos_blockdev_t *d, kos_blockdev_cache_stats_t *st,
+                             int reset);
+
+/** \brief  Write back and drop everything held in a block device cache.
+
+    This is useful if the underlying device may have been changed behind the
+    back of the cache.
+
+    \param  d               A block device created by
+                            kos_blockdev_cache_create().
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+*/
+int kos_blockdev_cache_invalidate(kos_blockdev_t *d);
+
+/** @} */
+
+/** \defgroup vfs_blockdev_async  Asynchronous Block I/O
+    \brief                        Request queues for block devices
+    \ingroup                      vfs_blockdev
+
+    A block device queue lets reads and writes be submitted to a block device
+    without waiting for them to finish. Each queue has a thread of its own that
+    takes requests off of the queue in the order they were submitted and passes
+    them on to the device's read_blocks and write_blocks functions. Requests
+    that directly follow each other on the device and in memory are merged into
+    a single call to the device.
+
+    This works with any block device. Devices that wait for their transfers to
+    complete by sleeping (such as the DMA variant of the G1 ATA device) leave
+    the CPU free for the submitting thread while the transfer is in progress.
+    Devices that do their transfers with the CPU (such as the SD card device)
+    still let the submitting thread carry on, but the transfer competes with it
+    for the CPU.
+
+    @{
+*/
+
+/** \brief  Read blocks from the device into the buffer. */
+#define KOS_BLOCKDEV_REQ_READ       0
+
+/** \brief  Write blocks from the buffer onto the device. */
+#define KOS_BLOCKDEV_REQ_WRITE      1
+
+struct kos_blockdev_req;
+
+/** \brief  Block device request completion callback.
+
+    \param  req             The request that completed.
+    \param  data            The data pointer from the request.
+*/
+typedef void (*kos_blockdev_req_cb_t)(struct kos_blockdev_req *req,
+                                      void *data);
+
+/** \brief  A block device request.
+
+    Set a request up with kos_blockdev_req_init() or
+    KOS_BLOCKDEV_REQ_INITIALIZER, fill in the callback and data fields if
+    needed, and submit it with kos_blockdev_submit(). The request (and its
+    buffer) must stay valid and untouched until it has completed. Once it has,
+    it can be submitted again as it is, or with its op, block, count and buf
+    fields changed.
+
+    \headerfile kos/blockdev.h
+*/
+typedef struct kos_blockdev_req {
+    /** \cond */
+    TAILQ_ENTRY(kos_blockdev_req) entry;
+    /** \endcond */
+
+    int op;                 /**< \brief KOS_BLOCKDEV_REQ_READ or _WRITE. */
+    uint64_t block;         /**< \brief First block of the transfer. */
+    size_t count;           /**< \brief Number of blocks to transfer. */
+    void *buf;              /**< \brief Buffer to transfer from/to. */
+
+    /** \brief  Function to call when the request completes (may be NULL).
+
+        This is called from the queue's thread once the request has completed.
+        It is the last time the queue touches the request, so the callback may
+        resubmit or free it (as long as no other thread waits on it).
+    */
+    kos_blockdev_req_cb_t callback;
+    void *data;             /**< \brief Passed to the callback. */
+
+    int result;             /**< \brief 0 on success, -1 on error. */
+    int err;                /**< \brief errno value if result is -1. */
+    volatile int pending;   /**< \brief Non-zero until the request is done. */
+} kos_blockdev_req_t;
+
+/** \brief  Initializer for a block device request.
+
+    \param  req_op          KOS_BLOCKDEV_REQ_READ or KOS_BLOCKDEV_REQ_WRITE.
+    \param  first           First block of the transfer.
+    \param  nblocks         Number of blocks to transfer.
+    \param  buffer          Buffer to transfer from/to.
+*/
+#define KOS_BLOCKDEV_REQ_INITIALIZER(req_op, first, nblocks, buffer) \
+    { .op = (req_op), .block = (first), .count = (nblocks), .buf = (buffer) }
+
+/** \brief  Initialize a block device request.
+
+    This sets up a request in the same way as KOS_BLOCKDEV_REQ_INITIALIZER,
+    with no callback.
+
+    \param  req             The request to initialize.
+    \param  op              KOS_BLOCKDEV_REQ_READ or KOS_BLOCKDEV_REQ_WRITE.
+    \param  block           First block of the transfer.
+    \param  count           Number of blocks to transfer.
+    \param  buf             Buffer to transfer from/to.
+*/
+void kos_blockdev_req_init(kos_blockdev_req_t *req, int op, uint64_t block,
+                           size_t count, void *buf);
+
+/** \brief  Opaque block device queue type. */
+typedef struct kos_blockdev_queue kos_blockdev_queue_t;
+
+/** \brief  Create a request queue for a block device.
+
+    \param  dev             The block device to queue requests for. It must be
+                            initialized, and stay valid until the queue is
+                            destroyed.
+    \return                 The new queue, or NULL on error (errno will be set
+                            to EFAULT if dev is NULL, or ENOMEM).
+*/
+kos_blockdev_queue_t *kos_blockdev_queue_create(kos_blockdev_t *dev);
+
+/** \brief  Destroy a block device queue.
+
+    This waits for all requests submitted to the queue to complete before
+    destroying it. The block device is not shut down.
+
+    \param  q               The queue to destroy.
+*/
+void kos_blockdev_queue_destroy(kos_blockdev_queue_t *q);
+
+/** \brief  Submit a request to a block device queue.
+
+    \param  q               The queue to submit the request to.
+    \param  req             The request to submit.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EFAULT - q, req or the request's buffer was NULL \n
+    \em     EINVAL - the request's op or count was invalid \n
+    \em     EBUSY - the request is already pending \n
+    \em     EPIPE - the queue is being destroyed
+*/
+int kos_blockdev_submit(kos_blockdev_queue_t *q, kos_blockdev_req_t *req);
+
+/** \brief  Wait for a request to complete.
+
+    \param  req             The request to wait for.
+    \retval 0               If the request completed successfully.
+    \retval -1              If the request failed, errno will be set to the
+                            error the device reported.
+*/
+int kos_blockdev_wait(kos_blockdev_req_t *req);
+
+/** \brief  Check whether a request has completed.
+
+    \param  req             The request to check.
+    \return                 Non-zero if the request has completed.
+*/
+static inline int kos_blockdev_req_done(const kos_blockdev_req_t *req) {
+    return !req->pending;
+}
+
+/** @} */
+
 /** @} */
 
 __END_DECLS
@@ -62,6 +62,42 @@ __BEGIN_DECLS
     @{
 */
 
+/** \name    Romdisk-specific file control commands
+    \brief   Commands for zero-copy access to romdisk files.
+
+    The data of every file on a romdisk lives in memory for as long as the
+    romdisk is mounted, so it can be used directly instead of being copied out
+    with read(). This lets loaders hand romdisk data straight to DMA or store
+    queue transfers to VRAM or sound RAM without an intermediate buffer.
+
+    @{
+*/
+
+/** \brief  fcntl() command to query the memory alignment of a file's data.
+
+    fcntl(fd, ROMDISK_F_GETALIGN) returns the largest power of two (up to
+    ROMDISK_MAX_ALIGN) that the address of the start of the file's data is a
+    multiple of. Use the -a or -A options of genromfs to align files that are
+    meant to be DMAed.
+*/
+#define ROMDISK_F_GETALIGN      0x524f4401
+
+/** \brief  ioctl() command to read from a file without copying.
+
+    fs_ioctl(fd, ROMDISK_IOCTL_READPTR, &iov), where iov is a struct iovec.
+    On entry, iov.iov_len is the number of bytes to read. On return,
+    iov.iov_base points to the data at the current position in the file, and
+    iov.iov_len has been clamped to the number of bytes left in the file. The
+    file position is advanced just like read() would do. The data must not be
+    modified, and is only valid until the romdisk is unmounted.
+*/
+#define ROMDISK_IOCTL_READPTR   0x524f4402
+
+/** \brief  Maximum alignment reported by ROMDISK_F_GETALIGN. */
+#define ROMDISK_MAX_ALIGN       4096
+
+/** @} */
+
 /** \cond */
 /* Initialize the file system */
 void fs_romdisk_init(void);
@@ -378,6 +378,43 @@ typedef struct fs_socket_proto {
                             currently true in the socket. 0 if none are true.
     */
     short (*poll)(net_socket_t *s, short events);
+
+    /** \brief  Receive multiple messages on a socket created with the
+                protocol.
+
+        This function should implement the ::recvmmsg() system call for the
+        protocol (which also backs ::recvmsg()). It may be NULL, in which case
+        fs_socket calls recvfrom() once for each message instead. Protocols
+        that can hand over a batch of messages more cheaply than that (taking
+        their locks once, for instance) should implement it.
+
+        \param  s           The socket to receive on.
+        \param  msgvec      The messages to receive into.
+        \param  vlen        The number of messages in msgvec.
+        \param  flags       Flags to the function.
+        \param  timeout     How long to wait for the first message, in
+                            milliseconds, or 0 to wait for as long as it takes.
+        \retval -1          On error (set errno appropriately).
+        \retval n           The number of messages received.
+    */
+    int (*recvmmsg)(net_socket_t *s, struct mmsghdr *msgvec,
+                    unsigned int vlen, int flags, int timeout);
+
+    /** \brief  Send multiple messages on a socket created with the protocol.
+
+        This function should implement the ::sendmmsg() system call for the
+        protocol (which also backs ::sendmsg()). It may be NULL, in which case
+        fs_socket calls sendto() once for each message instead.
+
+        \param  s           The socket to send on.
+        \param  msgvec      The messages to send.
+        \param  vlen        The number of messages in msgvec.
+        \param  flags       Flags to the function.
+        \retval -1          On error (set errno appropriately).
+        \retval n           The number of messages sent.
+    */
+    int (*sendmmsg)(net_socket_t *s, struct mmsghdr *msgvec,
+                    unsigned int vlen, int flags);
 } fs_socket_proto_t;
 
 /** \brief   Initializer for the entry field in the fs_socket_proto_t struct. 
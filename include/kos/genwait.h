@@ -145,6 +145,42 @@ void genwait_check_timeouts(uint64 now);
 */
 uint64 genwait_next_timeout(void);
 
+/** \brief  Statistics for the waits with one message.
+
+    Wait statistics are kept for each distinct message (the mesg parameter to
+    genwait_wait()), which generally corresponds to the kind of object being
+    waited on, like "thd_sleep" or "mutex_lock". Messages are told apart by
+    address, not by contents. Times are in nanoseconds.
+*/
+typedef struct genwait_stats {
+    const char *mesg;       /**< \brief The wait message */
+    uint32_t waits;         /**< \brief Number of finished waits */
+    uint32_t timeouts;      /**< \brief How many of those timed out */
+    uint64_t time;          /**< \brief Total time spent waiting */
+    uint64_t max_time;      /**< \brief Longest single wait */
+} genwait_stats_t;
+
+/** \brief  Get a snapshot of the wait statistics.
+
+    Copies out the statistics for up to count wait messages.
+
+    \param  stats           Where to store the statistics.
+    \param  count           The number of entries that stats has room for.
+    \return                 The number of wait messages with statistics, which
+                            may be more than count.
+*/
+size_t genwait_get_stats(genwait_stats_t *stats, size_t count);
+
+/** \brief  Reset all wait statistics. */
+void genwait_reset_stats(void);
+
+/** \brief  Print out the wait statistics.
+
+    \param  pf              The printf-like function to print with.
+    \retval 0               On success.
+*/
+int genwait_print_stats(int (*pf)(const char *fmt, ...));
+
 /** \cond */
 /* Initialize the genwait system */
 int genwait_init(void);
@@ -0,0 +1,64 @@
+/* KallistiOS ##version##
+
+   include/kos/lock_stats.h
+   Copyright (C) 2026 KallistiOS Contributors
+*/
+
+/** \file    kos/lock_stats.h
+    \brief   Lock contention statistics.
+    \ingroup kthreads
+
+    This file defines the structure used to report contention statistics for
+    mutexes, semaphores and reader/writer semaphores. Each lock keeps its own
+    statistics, which can be read with mutex_get_stats(), sem_get_stats() and
+    rwsem_get_stats(), and cleared with the matching *_reset_stats() function.
+
+    These locks can also be told to spin for a while before blocking when they
+    are contended, with mutex_set_spin(), sem_set_spin() and rwsem_set_spin().
+    Spinning here means giving up the CPU with thd_pass() and checking the lock
+    again when we get it back, which is cheaper than going through genwait if
+    whoever holds the lock is only going to hold it for a moment. Since only
+    threads of the same or higher priority get to run when we pass, spinning
+    does not help when the holder has a lower priority than the waiter, so the
+    number of passes should be kept small. The default is not to spin at all.
+
+    \see    kos/mutex.h
+    \see    kos/sem.h
+    \see    kos/rwsem.h
+*/
+
+#ifndef __KOS_LOCK_STATS_H
+#define __KOS_LOCK_STATS_H
+
+#include <sys/cdefs.h>
+__BEGIN_DECLS
+
+#include <stdint.h>
+
+/** \brief   Lock contention statistics.
+
+    \headerfile kos/lock_stats.h
+*/
+typedef struct kos_lock_stats {
+    /** \brief  Number of times the lock was taken. */
+    uint32_t acquired;
+
+    /** \brief  Number of times the lock was busy when someone tried to take
+                it, and they had to spin or block. */
+    uint32_t contended;
+
+    /** \brief  Number of contended attempts that got the lock while spinning,
+                without having to block. */
+    uint32_t spun;
+
+    /** \brief  Total time spent spinning and blocked on the lock, in
+                nanoseconds. */
+    uint64_t wait_time;
+} kos_lock_stats_t;
+
+/** \brief   Initializer for lock statistics. */
+#define KOS_LOCK_STATS_INITIALIZER  { 0, 0, 0, 0 }
+
+__END_DECLS
+
+#endif /* __KOS_LOCK_STATS_H */
@@ -45,8 +45,26 @@
     There is a fourth type of mutex defined (MUTEX_TYPE_DEFAULT), which maps to
     the MUTEX_TYPE_NORMAL type. This is simply for alignment with POSIX.
 
+    While a thread is blocked on any mutex, the thread holding it runs at the
+    blocked thread's priority, if that is higher than its own. When it unlocks
+    a mutex, a thread goes back to the highest priority still owed to it by
+    threads blocked on other mutexes it holds (or its own, if there are none).
+
+    Any type of mutex can also be made to use full priority inheritance, by
+    adding the MUTEX_PRIO_INHERIT flag to its type in mutex_init(). The boost
+    from such a mutex is also passed along to whoever holds the mutex that the
+    holder is itself blocked on, and so on down chains of threads blocked on
+    each other. When unlocked, these mutexes are handed to the highest priority
+    thread waiting for them, rather than the one that has been waiting the
+    longest.
+
+    Each mutex also keeps contention statistics, and can be told to spin for a
+    bit before blocking with mutex_set_spin(). See kos/lock_stats.h for more
+    information on both.
+
     \author Lawrence Sebald
     \see    kos/sem.h
+    \see    kos/lock_stats.h
 */
 
 #ifndef __KOS_MUTEX_H
@@ -57,6 +75,7 @@
 __BEGIN_DECLS
 
 #include <kos/thread.h>
+#include <kos/lock_stats.h>
 
 /** \brief  Mutual exclusion lock type.
 
@@ -70,6 +89,10 @@ typedef struct kos_mutex {
     int dynamic;
     kthread_t *holder;
     int count;
+    int flags;
+    int spin;
+    int waiters;
+    kos_lock_stats_t stats;
 } mutex_t;
 
 /** \name  Mutex types
@@ -89,14 +112,24 @@ typedef struct kos_mutex {
 #define MUTEX_TYPE_DEFAULT      MUTEX_TYPE_NORMAL
 /** @} */
 
+/** \brief  Priority inheritance flag.
+
+    OR this into the type passed to mutex_init() to have the mutex use
+    priority inheritance.
+*/
+#define MUTEX_PRIO_INHERIT      0x100
+
 /** \brief  Initializer for a transient mutex. */
-#define MUTEX_INITIALIZER               { MUTEX_TYPE_NORMAL, 0, NULL, 0 }
+#define MUTEX_INITIALIZER               \
+    { MUTEX_TYPE_NORMAL, 0, NULL, 0, 0, 0, 0, KOS_LOCK_STATS_INITIALIZER }
 
 /** \brief  Initializer for a transient error-checking mutex. */
-#define ERRORCHECK_MUTEX_INITIALIZER    { MUTEX_TYPE_ERRORCHECK, 0, NULL, 0 }
+#define ERRORCHECK_MUTEX_INITIALIZER    \
+    { MUTEX_TYPE_ERRORCHECK, 0, NULL, 0, 0, 0, 0, KOS_LOCK_STATS_INITIALIZER }
 
 /** \brief  Initializer for a transient recursive mutex. */
-#define RECURSIVE_MUTEX_INITIALIZER     { MUTEX_TYPE_RECURSIVE, 0, NULL, 0 }
+#define RECURSIVE_MUTEX_INITIALIZER     \
+    { MUTEX_TYPE_RECURSIVE, 0, NULL, 0, 0, 0, 0, KOS_LOCK_STATS_INITIALIZER }
 
 /** \brief  Allocate a new mutex.
 
@@ -118,7 +151,8 @@ mutex_t *mutex_create(void) __depr("Use mutex_init or an initializer.");
     This function initializes a new mutex for use.
 
     \param  m               The mutex to initialize
-    \param  mtype           The type of the mutex to initialize it to
+    \param  mtype           The type of the mutex to initialize it to,
+                            optionally ORed with MUTEX_PRIO_INHERIT
 
     \retval 0               On success
     \retval -1              On error, errno will be set as appropriate
@@ -278,6 +312,52 @@ int mutex_unlock(mutex_t *m);
 */
 int mutex_unlock_as_thread(mutex_t *m, kthread_t *thd);
 
+/** \brief  Set how long to spin on a mutex before blocking.
+
+    When the mutex is locked by another thread, mutex_lock() and
+    mutex_lock_timed() will give up the CPU up to this many times, checking if
+    the mutex has been released each time, before blocking on it. Time spent
+    spinning counts against the timeout given to mutex_lock_timed().
+
+    Spinning does not lend the spinning thread's priority to the holder of a
+    priority inheritance mutex. Only blocking does.
+
+    \param  m               The mutex to modify
+    \param  count           The number of times to spin, or 0 to never spin
+    \retval 0               On success
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EINVAL - count is less than 0
+*/
+int mutex_set_spin(mutex_t *m, int count);
+
+/** \brief  Get the contention statistics of a mutex.
+
+    \param  m               The mutex to check
+    \param  stats           Where to store the statistics
+*/
+void mutex_get_stats(mutex_t *m, kos_lock_stats_t *stats);
+
+/** \brief  Reset the contention statistics of a mutex.
+
+    \param  m               The mutex to reset the statistics of
+*/
+void mutex_reset_stats(mutex_t *m);
+
+/** \cond INTERNAL */
+/** \brief  Recompute a thread's effective priority.
+
+    This works out the priority a thread should run at from its own priority
+    and those of the threads blocked on mutexes it holds, and passes any change
+    along to whoever holds the mutex it is blocked on. This must be called with
+    interrupts disabled.
+
+    \param  thd             The thread to update
+*/
+void mutex_pi_update(kthread_t *thd);
+/** \endcond */
+
 /** \cond */
 static inline void __mutex_scoped_cleanup(mutex_t **m) {
     if(*m)
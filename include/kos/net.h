@@ -928,6 +928,74 @@ void net_multicast_shutdown(void);
 
 /** @} */
 
+/***** net_loop.c *********************************************************/
+
+/** \defgroup networking_loop   Loopback
+    \brief                      Software Loopback Network Device
+    \ingroup                    networking
+    @{
+*/
+
+/** \brief  Loopback device statistics structure.
+
+    This structure holds some basic statistics about the loopback device, and
+    can be retrieved with the appropriate function.
+
+    \headerfile kos/net.h
+*/
+typedef struct net_loop_stats {
+    uint32  pkt_sent;               /**< \brief Packets queued for delivery */
+    uint32  pkt_dropped;            /**< \brief Packets lost or thrown away */
+    uint32  pkt_recv;               /**< \brief Packets delivered */
+} net_loop_stats_t;
+
+/** \brief  The loopback network device.
+
+    All packets sent to 127.0.0.0/8 or ::1 go through this device, which hands
+    them back to the stack from its own thread. It is not on the interface
+    list, and never becomes the default device, so nothing but loopback
+    traffic is sent through it.
+*/
+extern netif_t net_loop_if;
+
+/** \brief  Make the loopback device drop some of its packets.
+
+    This is meant for testing how protocols cope with packet loss, without
+    needing a bad network to do it on.
+
+    \param  loss            How many packets out of every 1000 to drop, on
+                            average. 0 (the default) drops nothing.
+    \retval 0               On success.
+    \retval -1              If loss is greater than 1000.
+*/
+int net_loop_set_loss(unsigned int loss);
+
+/** \brief  Make the loopback device delay its packets.
+
+    \param  delay           How long to hold on to each packet before
+                            delivering it, in milliseconds. The default is 0.
+    \retval 0               On success (no error conditions defined).
+*/
+int net_loop_set_delay(unsigned int delay);
+
+/** \brief  Retrieve statistics from the loopback device.
+
+    \return                 The loopback stats struct.
+*/
+net_loop_stats_t net_loop_get_stats(void);
+
+/** \brief  Init the loopback device.
+
+    \retval 0               On success.
+    \retval -1              If the delivery thread could not be created.
+*/
+int net_loop_init(void);
+
+/** \brief  Shutdown the loopback device. */
+void net_loop_shutdown(void);
+
+/** @} */
+
 /***** net_core.c *********************************************************/
 
 /** \brief   Interface list; note: do not manipulate directly! 
@@ -119,16 +119,89 @@ __BEGIN_DECLS
 #define FS_CD_MAX_FILES 8
 #endif
 
+/** \brief  The maximum number of sectors the cd filesystem will read ahead.
+
+    Sequential reads from a file on the cd will prefetch a window of sectors
+    that grows up to this size. Setting this to 0 disables read-ahead. Each
+    sector takes up 2048 bytes of memory.
+*/
+#ifndef FS_CD_READAHEAD_SECTORS
+#define FS_CD_READAHEAD_SECTORS 16
+#endif
+
 /** \brief  The maximum number of romdisk files that can be open at a time. */
 #ifndef FS_ROMDISK_MAX_FILES
 #define FS_ROMDISK_MAX_FILES 16
 #endif
 
+/** \brief  Build a path lookup index for each mounted romdisk.
+
+    If this is non-zero, a hash table of every file and directory in a romdisk
+    image is built when it is mounted, so opening a file does not need to walk
+    the directory lists of the image. The index takes up about 20 bytes of
+    memory per entry in the image. Set this to 0 to disable it.
+*/
+#ifndef FS_ROMDISK_INDEX
+#define FS_ROMDISK_INDEX 1
+#endif
+
 /** \brief  The maximum number of ramdisk files that can be open at a time. */
 #ifndef FS_RAMDISK_MAX_FILES
 #define FS_RAMDISK_MAX_FILES 8
 #endif
 
+/** \brief  The number of hash buckets used to match incoming UDP and TCP
+            packets to sockets.
+
+    Each of UDP and TCP has its own table, and each bucket takes up 4 bytes of
+    memory. This must be a power of two.
+*/
+#ifndef NET_DEMUX_BUCKETS
+#define NET_DEMUX_BUCKETS 128
+#endif
+
+/** \brief  The default size of the send and receive buffers of TCP sockets.
+
+    This is also the largest window a connection will advertise, unless the
+    buffers are resized with setsockopt() before connecting or listening.
+    Each connected socket has one of each. Setting this above 65535 makes use
+    of window scaling, when the other side supports it.
+*/
+#ifndef NET_TCP_DEFAULT_WINDOW
+#define NET_TCP_DEFAULT_WINDOW 32768
+#endif
+
+/** \brief  The number of buffers in the network packet buffer pool.
+
+    Received UDP datagrams and some outgoing packets are stored in buffers
+    taken from this pool, rather than being allocated with malloc. Each buffer
+    takes up a little more than NET_BUF_SIZE bytes of memory. When the pool
+    runs dry, packets are allocated from the heap until buffers are given
+    back, so this only needs to cover the number of packets usually in flight.
+*/
+#ifndef NET_BUF_COUNT
+#define NET_BUF_COUNT 32
+#endif
+
+/** \brief  The size of each buffer in the network packet buffer pool.
+
+    This should be large enough to hold a full ethernet frame and a little
+    bookkeeping. Packets that don't fit are allocated from the heap. This must
+    be a multiple of 32.
+*/
+#ifndef NET_BUF_SIZE
+#define NET_BUF_SIZE 1600
+#endif
+
+/** \brief  The number of packets the loopback network device can hold.
+
+    Packets sent to the loopback device while this many are waiting to be
+    delivered are dropped, as a real device would when its queue is full.
+*/
+#ifndef NET_LOOP_QUEUE_LEN
+#define NET_LOOP_QUEUE_LEN 64
+#endif
+
 /** \brief  The number of distinct file descriptors, including files and
             network sockets, that can be in use at a time. Decreasing this
             value can reduce memory usage.  */
@@ -0,0 +1,401 @@
+/* KallistiOS ##version##
+
+   include/kos/ring.h
+   Copyright (C) 2026 KallistiOS Contributors
+*/
+
+/** \file    kos/ring.h
+    \brief   Lock-free ring buffers.
+    \ingroup kthreads
+
+    This file contains fixed-capacity ring buffers that can be shared between
+    threads, and between threads and interrupt handlers, without any locks or
+    disabling interrupts.
+
+    Two kinds of rings are provided. A single-producer, single-consumer ring
+    (kos_spsc_ring_t) allows one context to add elements while another one
+    takes them out, which covers the common case of an interrupt handler
+    handing data off to a thread (or the other way around). A multi-producer,
+    single-consumer ring (kos_mpsc_ring_t) allows any number of contexts to add
+    elements, at the cost of an atomic compare-and-swap per element.
+
+    Both kinds copy fixed-size elements in and out of a buffer supplied by the
+    caller, whose capacity must be a power of two. The indices that producers
+    and the consumer write to are kept in separate cache lines.
+
+    Everything in here is inline, and only relies on the compiler's atomic
+    builtins, so it can also be built for the host.
+*/
+
+#ifndef __KOS_RING_H
+#define __KOS_RING_H
+
+#include <sys/cdefs.h>
+__BEGIN_DECLS
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/** \brief   Alignment used to keep ring indices in separate cache lines. */
+#ifndef KOS_RING_ALIGN
+#define KOS_RING_ALIGN  32
+#endif
+
+/** \cond */
+#define __KOS_RING_ALIGNED  __attribute__((aligned(KOS_RING_ALIGN)))
+/** \endcond */
+
+/** \defgroup ring_spsc  Single-producer rings
+    \brief               Single-producer, single-consumer ring buffers
+    \ingroup             kthreads
+
+    @{
+*/
+
+/** \brief   Single-producer, single-consumer ring buffer.
+
+    All members of this structure should be considered to be private.
+
+    \headerfile kos/ring.h
+*/
+typedef struct kos_spsc_ring {
+    /** \cond */
+    /* Written by the producer only. */
+    uint32_t head __KOS_RING_ALIGNED;
+
+    /* Written by the consumer only. */
+    uint32_t tail __KOS_RING_ALIGNED;
+
+    /* Never written after init. */
+    uint32_t mask __KOS_RING_ALIGNED;
+    size_t elem_size;
+    uint8_t *buf;
+    /** \endcond */
+} kos_spsc_ring_t;
+
+/** \brief   Buffer size needed for a single-producer ring.
+    \param  capacity        The number of elements in the ring.
+    \param  elem_size       The size of each element, in bytes.
+*/
+#define KOS_SPSC_RING_BUF_SIZE(capacity, elem_size) \
+    ((size_t)(capacity) * (size_t)(elem_size))
+
+/** \brief   Initialize a single-producer ring.
+
+    \param  r               The ring to initialize.
+    \param  buf             Storage for the elements, which must be at least
+                            KOS_SPSC_RING_BUF_SIZE(capacity, elem_size) bytes.
+    \param  capacity        The number of elements the ring can hold. This must
+                            be a power of two.
+    \param  elem_size       The size of each element, in bytes.
+
+    \retval 0               On success.
+    \retval -1              If capacity is not a power of two, or elem_size
+                            is 0.
+*/
+static inline int kos_spsc_ring_init(kos_spsc_ring_t *r, void *buf,
+                                     uint32_t capacity, size_t elem_size) {
+    if(!capacity || (capacity & (capacity - 1)) || !elem_size)
+        return -1;
+
+    r->head = 0;
+    r->tail = 0;
+    r->mask = capacity - 1;
+    r->elem_size = elem_size;
+    r->buf = (uint8_t *)buf;
+
+    return 0;
+}
+
+/** \brief   Get the number of elements in a single-producer ring.
+
+    This is only a snapshot if the other side is running concurrently.
+
+    \param  r               The ring to check.
+    \return                 The number of elements in the ring.
+*/
+static inline uint32_t kos_spsc_ring_count(const kos_spsc_ring_t *r) {
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) -
+        __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+/** \brief   Add elements to a single-producer ring.
+
+    Copies in as many of the elements as there is room for. This must only be
+    called from the producer side.
+
+    \param  r               The ring to add to.
+    \param  src             The elements to add.
+    \param  count           The number of elements to add.
+    \return                 The number of elements added.
+*/
+static inline uint32_t kos_spsc_ring_push_n(kos_spsc_ring_t *r,
+                                            const void *src, uint32_t count) {
+    uint32_t head = r->head;
+    uint32_t space = r->mask + 1 -
+        (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE));
+    uint32_t idx, first;
+
+    if(count > space)
+        count = space;
+
+    if(!count)
+        return 0;
+
+    /* Copy in up to the end of the buffer, then whatever wraps around. */
+    idx = head & r->mask;
+    first = r->mask + 1 - idx;
+
+    if(first > count)
+        first = count;
+
+    memcpy(r->buf + idx * r->elem_size, src, first * r->elem_size);
+    memcpy(r->buf, (const uint8_t *)src + first * r->elem_size,
+           (count - first) * r->elem_size);
+
+    __atomic_store_n(&r->head, head + count, __ATOMIC_RELEASE);
+    return count;
+}
+
+/** \brief   Take elements out of a single-producer ring.
+
+    Copies out as many elements as are available, up to count. This must only
+    be called from the consumer side.
+
+    \param  r               The ring to take from.
+    \param  dst             Where to store the elements.
+    \param  count           The largest number of elements to take.
+    \return                 The number of elements taken.
+*/
+static inline uint32_t kos_spsc_ring_pop_n(kos_spsc_ring_t *r, void *dst,
+                                           uint32_t count) {
+    uint32_t tail = r->tail;
+    uint32_t avail = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - tail;
+    uint32_t idx, first;
+
+    if(count > avail)
+        count = avail;
+
+    if(!count)
+        return 0;
+
+    idx = tail & r->mask;
+    first = r->mask + 1 - idx;
+
+    if(first > count)
+        first = count;
+
+    memcpy(dst, r->buf + idx * r->elem_size, first * r->elem_size);
+    memcpy((uint8_t *)dst + first * r->elem_size, r->buf,
+           (count - first) * r->elem_size);
+
+    __atomic_store_n(&r->tail, tail + count, __ATOMIC_RELEASE);
+    return count;
+}
+
+/** \brief   Add one element to a single-producer ring.
+
+    \param  r               The ring to add to.
+    \param  elem            The element to add.
+
+    \retval 0               On success.
+    \retval -1              If the ring is full.
+*/
+static inline int kos_spsc_ring_push(kos_spsc_ring_t *r, const void *elem) {
+    return kos_spsc_ring_push_n(r, elem, 1) ? 0 : -1;
+}
+
+/** \brief   Take one element out of a single-producer ring.
+
+    \param  r               The ring to take from.
+    \param  elem            Where to store the element.
+
+    \retval 0               On success.
+    \retval -1              If the ring is empty.
+*/
+static inline int kos_spsc_ring_pop(kos_spsc_ring_t *r, void *elem) {
+    return kos_spsc_ring_pop_n(r, elem, 1) ? 0 : -1;
+}
+
+/** @} */
+
+/** \defgroup ring_mpsc  Multi-producer rings
+    \brief               Multi-producer, single-consumer ring buffers
+    \ingroup             kthreads
+
+    Each slot in a multi-producer ring has a sequence number next to the
+    element, which tells the consumer when the producer that claimed the slot
+    has finished writing to it. A producer that is interrupted between the
+    two just holds up the consumer until it gets to run again; it can't block
+    other producers.
+
+    @{
+*/
+
+/** \brief   Multi-producer, single-consumer ring buffer.
+
+    All members of this structure should be considered to be private.
+
+    \headerfile kos/ring.h
+*/
+typedef struct kos_mpsc_ring {
+    /** \cond */
+    /* Claimed by producers with compare-and-swap. */
+    uint32_t head __KOS_RING_ALIGNED;
+
+    /* Written by the consumer only. */
+    uint32_t tail __KOS_RING_ALIGNED;
+
+    /* Never written after init. */
+    uint32_t mask __KOS_RING_ALIGNED;
+    size_t elem_size;
+    size_t stride;
+    uint8_t *buf;
+    /** \endcond */
+} kos_mpsc_ring_t;
+
+/** \brief   Size of one slot in a multi-producer ring.
+    \param  elem_size       The size of each element, in bytes.
+*/
+#define KOS_MPSC_RING_STRIDE(elem_size) \
+    ((sizeof(uint32_t) + (size_t)(elem_size) + 3) & ~(size_t)3)
+
+/** \brief   Buffer size needed for a multi-producer ring.
+    \param  capacity        The number of elements in the ring.
+    \param  elem_size       The size of each element, in bytes.
+*/
+#define KOS_MPSC_RING_BUF_SIZE(capacity, elem_size) \
+    ((size_t)(capacity) * KOS_MPSC_RING_STRIDE(elem_size))
+
+/** \cond */
+static inline uint32_t *__kos_mpsc_slot(const kos_mpsc_ring_t *r,
+                                        uint32_t pos) {
+    return (uint32_t *)(r->buf + (pos & r->mask) * r->stride);
+}
+/** \endcond */
+
+/** \brief   Initialize a multi-producer ring.
+
+    \param  r               The ring to initialize.
+    \param  buf             Storage for the elements, which must be 32-bit
+                            aligned and at least
+                            KOS_MPSC_RING_BUF_SIZE(capacity, elem_size) bytes.
+    \param  capacity        The number of elements the ring can hold. This must
+                            be a power of two.
+    \param  elem_size       The size of each element, in bytes.
+
+    \retval 0               On success.
+    \retval -1              If capacity is not a power of two, or elem_size
+                            is 0.
+*/
+static inline int kos_mpsc_ring_init(kos_mpsc_ring_t *r, void *buf,
+                                     uint32_t capacity, size_t elem_size) {
+    uint32_t i;
+
+    if(!capacity || (capacity & (capacity - 1)) || !elem_size)
+        return -1;
+
+    r->head = 0;
+    r->tail = 0;
+    r->mask = capacity - 1;
+    r->elem_size = elem_size;
+    r->stride = KOS_MPSC_RING_STRIDE(elem_size);
+    r->buf = (uint8_t *)buf;
+
+    /* Each slot is free to be written at the position equal to its index. */
+    for(i = 0; i < capacity; ++i)
+        *__kos_mpsc_slot(r, i) = i;
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return 0;
+}
+
+/** \brief   Add one element to a multi-producer ring.
+
+    This can be called from any number of threads and interrupt handlers at
+    once.
+
+    \param  r               The ring to add to.
+    \param  elem            The element to add.
+
+    \retval 0               On success.
+    \retval -1              If the ring is full.
+*/
+static inline int kos_mpsc_ring_push(kos_mpsc_ring_t *r, const void *elem) {
+    uint32_t pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    uint32_t *slot;
+    int32_t diff;
+
+    for(;;) {
+        slot = __kos_mpsc_slot(r, pos);
+        diff = (int32_t)(__atomic_load_n(slot, __ATOMIC_ACQUIRE) - pos);
+
+        if(diff == 0) {
+            /* The slot is free, try to claim it. On failure, pos is updated
+               to the current head. */
+            if(__atomic_compare_exchange_n(&r->head, &pos, pos + 1, 1,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if(diff < 0) {
+            /* The consumer hasn't freed up this slot yet. */
+            return -1;
+        }
+        else {
+            /* Somebody else got here first. */
+            pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    memcpy(slot + 1, elem, r->elem_size);
+    __atomic_store_n(slot, pos + 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/** \brief   Take one element out of a multi-producer ring.
+
+    This must only be called from the consumer side.
+
+    \param  r               The ring to take from.
+    \param  elem            Where to store the element.
+
+    \retval 0               On success.
+    \retval -1              If the ring is empty, or the next element is still
+                            being written.
+*/
+static inline int kos_mpsc_ring_pop(kos_mpsc_ring_t *r, void *elem) {
+    uint32_t pos = r->tail;
+    uint32_t *slot = __kos_mpsc_slot(r, pos);
+
+    if(__atomic_load_n(slot, __ATOMIC_ACQUIRE) != pos + 1)
+        return -1;
+
+    memcpy(elem, slot + 1, r->elem_size);
+
+    /* Hand the slot back to the producers for the next time around. */
+    __atomic_store_n(slot, pos + r->mask + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&r->tail, pos + 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/** \brief   Get the number of elements in a multi-producer ring.
+
+    This is only a snapshot, and includes elements that are still being
+    written.
+
+    \param  r               The ring to check.
+    \return                 The number of elements in the ring.
+*/
+static inline uint32_t kos_mpsc_ring_count(const kos_mpsc_ring_t *r) {
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) -
+        __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+/** @} */
+
+__END_DECLS
+
+#endif /* __KOS_RING_H */
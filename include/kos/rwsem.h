@@ -20,7 +20,13 @@
     a reader either (since the reader might attempt to read while the writer is
     changing data).
 
+    Each reader/writer semaphore also keeps contention statistics, covering
+    both read and write locks, and can be told to spin for a bit before
+    blocking with rwsem_set_spin(). See kos/lock_stats.h for more information
+    on both.
+
     \author Lawrence Sebald
+    \see    kos/lock_stats.h
 */
 
 #ifndef __KOS_RWSEM_H
@@ -32,6 +38,7 @@ __BEGIN_DECLS
 
 #include <stddef.h>
 #include <kos/thread.h>
+#include <kos/lock_stats.h>
 
 /** \brief  Reader/writer semaphore structure.
 
@@ -52,10 +59,17 @@ typedef struct rw_semaphore {
 
     /** \brief  Space for one reader who's trying to upgrade to a writer. */
     kthread_t *reader_waiting;
+
+    /** \brief  The number of times to spin before blocking. */
+    int spin;
+
+    /** \brief  Contention statistics. */
+    kos_lock_stats_t stats;
 } rw_semaphore_t;
 
 /** \brief  Initializer for a transient reader/writer semaphore */
-#define RWSEM_INITIALIZER   { 0, 0, NULL, NULL }
+#define RWSEM_INITIALIZER   \
+    { 0, 0, NULL, NULL, 0, KOS_LOCK_STATS_INITIALIZER }
 
 /** \brief  Allocate a reader/writer semaphore.
 
@@ -380,6 +394,37 @@ int rwsem_read_count(rw_semaphore_t *s);
 */
 int rwsem_write_locked(rw_semaphore_t *s);
 
+/** \brief  Set how long to spin on a reader/writer semaphore before blocking.
+
+    When the lock can't be taken right away, rwsem_read_lock(),
+    rwsem_write_lock() and their timed variants will give up the CPU up to this
+    many times, checking if the lock has become available each time, before
+    blocking on it. Time spent spinning counts against the timeout given to the
+    timed variants. Upgrading a read lock never spins.
+
+    \param  s       The r/w semaphore to modify.
+    \param  count   The number of times to spin, or 0 to never spin.
+    \retval 0       On success.
+    \retval -1      On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EINVAL - count is less than 0
+*/
+int rwsem_set_spin(rw_semaphore_t *s, int count);
+
+/** \brief  Get the contention statistics of a reader/writer semaphore.
+
+    \param  s       The r/w semaphore to check.
+    \param  stats   Where to store the statistics.
+*/
+void rwsem_get_stats(rw_semaphore_t *s, kos_lock_stats_t *stats);
+
+/** \brief  Reset the contention statistics of a reader/writer semaphore.
+
+    \param  s       The r/w semaphore to reset the statistics of.
+*/
+void rwsem_reset_stats(rw_semaphore_t *s);
+
 __END_DECLS
 
 #endif /* __KOS_RWSEM_H */
@@ -16,8 +16,13 @@
     predetermined number of resources available, and the semaphore maintains the
     resources.
 
+    Each semaphore also keeps contention statistics, and can be told to spin
+    for a bit before blocking with sem_set_spin(). See kos/lock_stats.h for more
+    information on both.
+
     \author Megan Potter
     \see    kos/mutex.h
+    \see    kos/lock_stats.h
 */
 
 #ifndef __KOS_SEM_H
@@ -27,6 +32,8 @@
 
 __BEGIN_DECLS
 
+#include <kos/lock_stats.h>
+
 /** \brief  Semaphore type.
 
     This structure defines a semaphore. There are no public members of this
@@ -37,11 +44,13 @@ __BEGIN_DECLS
 typedef struct semaphore {
     int initialized;    /**< \brief Are we initialized? */
     int count;          /**< \brief The semaphore count */
+    int spin;           /**< \brief Times to spin before blocking */
+    kos_lock_stats_t stats; /**< \brief Contention statistics */
 } semaphore_t;
 
 /** \brief  Initializer for a transient semaphore.
     \param  value           The initial count of the semaphore. */
-#define SEM_INITIALIZER(value) { 1, value }
+#define SEM_INITIALIZER(value) { 1, value, 0, KOS_LOCK_STATS_INITIALIZER }
 
 /** \brief  Allocate a new semaphore.
 
@@ -179,6 +188,36 @@ int sem_signal(semaphore_t *sem);
 */
 int sem_count(semaphore_t *sem);
 
+/** \brief  Set how long to spin on a semaphore before blocking.
+
+    When no resources are available, sem_wait() and sem_wait_timed() will give
+    up the CPU up to this many times, checking if one has been freed up each
+    time, before blocking on the semaphore. Time spent spinning counts against
+    the timeout given to sem_wait_timed().
+
+    \param  sem             The semaphore to modify
+    \param  count           The number of times to spin, or 0 to never spin
+    \retval 0               On success
+    \retval -1              On error, errno will be set as appropriate
+
+    \par    Error Conditions:
+    \em     EINVAL - count is less than 0
+*/
+int sem_set_spin(semaphore_t *sem, int count);
+
+/** \brief  Get the contention statistics of a semaphore.
+
+    \param  sem             The semaphore to check
+    \param  stats           Where to store the statistics
+*/
+void sem_get_stats(semaphore_t *sem, kos_lock_stats_t *stats);
+
+/** \brief  Reset the contention statistics of a semaphore.
+
+    \param  sem             The semaphore to reset the statistics of
+*/
+void sem_reset_stats(semaphore_t *sem);
+
 __END_DECLS
 
 #endif  /* __KOS_SEM_H */
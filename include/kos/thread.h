@@ -188,6 +188,9 @@ typedef __attribute__((aligned(32))) struct kthread {
     /** \brief  Static priority: 0..PRIO_MAX (higher means lower priority). */
     prio_t real_prio;
 
+    /** \brief  Priority the thread was queued with, if it is queued. */
+    prio_t rq_prio;
+
     /** \brief  Thread flags. */
     kthread_flags_t flags;
 
@@ -223,12 +226,32 @@ typedef __attribute__((aligned(32))) struct kthread {
     */
     uint64_t wait_timeout;
 
+    /** \brief  Mutex the thread is blocked on, if any.
+
+        \see    kos/mutex.h
+    */
+    struct kos_mutex *pi_wait;
+
+    /** \brief  Timer wheel slot the thread is on, if it has a timeout.
+
+        \see    kos/genwait.h
+    */
+    int wait_slot;
+
     /** \brief Per-Thread CPU Time. */
     struct {
         uint64_t scheduled; /**< \brief time when the thread became active */
         uint64_t total;     /**< \brief total running CPU time for thread */
     } cpu_time;
 
+    /** \brief Per-Thread scheduling statistics. */
+    struct {
+        uint32_t vol_switches;   /**< \brief times the thread gave up the CPU */
+        uint32_t invol_switches; /**< \brief times the thread was preempted */
+        uint64_t wait_start;     /**< \brief time when the current wait began */
+        uint64_t wait_total;     /**< \brief total time spent in genwait */
+    } sched_stats;
+
     /** \brief  Thread label.
 
         This value is used when printing out a user-readable process listing.
@@ -299,6 +322,23 @@ typedef struct kthread_attr {
     const char *label;
 } kthread_attr_t;
 
+/** \brief   Thread statistics snapshot.
+
+    This structure holds a copy of a thread's accounting information, as
+    filled in by thd_get_stats(). All times are in nanoseconds.
+
+    \headerfile kos/thread.h
+*/
+typedef struct kthread_stats {
+    tid_t tid;                  /**< \brief Kernel thread id */
+    prio_t prio;                /**< \brief Dynamic priority */
+    kthread_state_t state;      /**< \brief Process state */
+    uint64_t cpu_time;          /**< \brief Total CPU time used */
+    uint64_t wait_time;         /**< \brief Total time blocked in genwait */
+    uint32_t vol_switches;      /**< \brief Times the thread blocked or yielded */
+    uint32_t invol_switches;    /**< \brief Times the thread was preempted */
+} kthread_stats_t;
+
 /** \brief  kthread mode values
 
     \deprecated
@@ -509,7 +549,9 @@ void thd_sleep(unsigned ms);
 
     This function is used to change the priority value of a thread. If the
     thread is scheduled already, it will be rescheduled with the new priority
-    value.
+    value. If the thread has been given a higher priority by threads blocked on
+    mutexes it holds, it keeps running at that priority until they are done
+    with it.
 
     \param  thd             The thread to change the priority of.
     \param  prio            The priority value to assign to the thread.
@@ -628,6 +670,29 @@ struct _reent *thd_get_reent(kthread_t *thd);
 */
 uint64_t thd_get_cpu_time(kthread_t *thd);
 
+/** \brief       Retrieves a snapshot of the thread's scheduling statistics.
+    \relatesalso kthread_t
+
+    Copies out the thread's CPU time, the time it has spent blocked in
+    genwait_wait() (which covers sleeping, mutexes, semaphores, etc), and the
+    number of times it has been switched out, either because it blocked or
+    yielded (voluntary), or because it was preempted (involuntary). Time spent
+    in a wait that hasn't finished yet isn't counted.
+
+    \warning
+    Like thd_get_cpu_time(), this uses perf_cntr_timer_ns() internally, so
+    disabling or clearing the nanosecond timer will interfere with the times.
+
+    \param  thd             The thread to retrieve the statistics for.
+    \param  stats           Where to store the statistics.
+
+    \retval 0               On success.
+    \retval -1              If thd or stats is NULL.
+
+    \sa thd_print_stats
+*/
+int thd_get_stats(kthread_t *thd, kthread_stats_t *stats);
+
 /** \brief   Change threading modes.
 
     This function changes the current threading mode of the system.
@@ -680,6 +745,33 @@ int thd_set_hz(unsigned int hertz);
 */
 unsigned thd_get_hz(void);
 
+/** \brief   Enable or disable tickless scheduling.
+
+    Normally, the scheduler interrupt fires at the rate set by thd_set_hz(),
+    whether or not there is anything for it to do. In tickless mode, the
+    scheduler instead programs the timer for the next thing that it actually
+    needs to handle: the end of the running thread's timeslice, or the next
+    timed wait (thd_sleep(), genwait_wait() with a timeout, etc) to expire,
+    whichever comes first. While the idle thread is running, there is no
+    timeslice to end, so the timer only fires for timeouts (or at least once a
+    second). An interrupt that wakes up a thread while the system is idle gets
+    it scheduled on the next millisecond.
+
+    \param  enable          true to enable tickless mode, false to go back to
+                            a fixed scheduler frequency.
+
+    \sa thd_get_tickless(), thd_set_hz()
+*/
+void thd_set_tickless(bool enable);
+
+/** \brief   Check whether tickless scheduling is enabled.
+
+    \return                 true if tickless mode is enabled.
+
+    \sa thd_set_tickless()
+*/
+bool thd_get_tickless(void);
+
 /** \brief       Wait for a thread to exit.
     \relatesalso kthread_t
 
@@ -747,6 +839,16 @@ int thd_pslist(int (*pf)(const char *fmt, ...));
 */
 int thd_pslist_queue(int (*pf)(const char *fmt, ...));
 
+/** \brief   Print the scheduling statistics of all threads.
+
+    \param  pf              The printf-like function to print with.
+
+    \retval 0               On success.
+
+    \sa thd_get_stats, thd_pslist
+*/
+int thd_print_stats(int (*pf)(const char *fmt, ...));
+
 /** \cond INTERNAL */
 
 /** \brief  Initialize the threading system.
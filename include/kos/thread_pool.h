@@ -0,0 +1,202 @@
+/* KallistiOS ##version##
+
+   include/kos/thread_pool.h
+   Copyright (C) 2026 KallistiOS Contributors
+*/
+
+/** \file    kos/thread_pool.h
+    \brief   Thread pools with work stealing.
+    \ingroup kthreads
+
+    This file contains the thread pool API. A thread pool is a fixed set of
+    threaded workers (see kos/worker_thread.h) that run tasks submitted to the
+    pool. Each worker has its own queue of tasks: tasks submitted from one of
+    the pool's workers go on that worker's queue, and tasks submitted from
+    anywhere else are spread across all of them. A worker runs the newest
+    task on its own queue first, and when it runs out, it steals the oldest
+    task from another worker's queue.
+
+    Tasks can be grouped with a counter, which goes up when a task is submitted
+    and back down when it finishes. Waiting on a counter with thd_pool_wait()
+    gives fork-join style parallelism, and a task can be made to depend on a
+    counter, so that it isn't run until everything counted by it has finished.
+    thd_pool_parallel_for() builds on this to split a loop across the pool.
+
+    \see    kos/worker_thread.h
+*/
+
+#ifndef __KOS_THREAD_POOL_H
+#define __KOS_THREAD_POOL_H
+
+#include <sys/cdefs.h>
+__BEGIN_DECLS
+
+#include <kos/thread.h>
+#include <sys/queue.h>
+#include <stddef.h>
+
+struct kthread_pool;
+struct kthread_task;
+
+/** \struct  kthread_pool_t
+    \brief   Opaque structure describing a thread pool.
+*/
+typedef struct kthread_pool kthread_pool_t;
+
+/** \brief   Task counter.
+
+    Counts the tasks submitted with it that have not finished yet. Initialize it
+    with thd_task_counter_init() or KTHREAD_TASK_COUNTER_INITIALIZER before
+    use.
+*/
+typedef struct kthread_task_counter {
+    /** \brief  Number of unfinished tasks. */
+    volatile unsigned int count;
+
+    /** \cond */
+    /* Tasks waiting for the count to reach zero. */
+    TAILQ_HEAD(kthread_task_list, kthread_task) waiting;
+    /** \endcond */
+} kthread_task_counter_t;
+
+/** \brief   Initializer for a task counter.
+    \param  name            The name of the counter being initialized.
+*/
+#define KTHREAD_TASK_COUNTER_INITIALIZER(name) \
+    { 0, TAILQ_HEAD_INITIALIZER((name).waiting) }
+
+/** \brief   Structure describing one task for a thread pool.
+
+    The task structure is owned by the caller, and must stay valid until the
+    task has finished running. The task's routine is free to release it.
+*/
+typedef struct kthread_task {
+    /** \brief  List handle. */
+    TAILQ_ENTRY(kthread_task) entry;
+
+    /** \brief  The function to run. */
+    void (*routine)(void *data);
+
+    /** \brief  User pointer passed to the function. */
+    void *data;
+
+    /** \brief  Counter to add this task to, or NULL for none. */
+    kthread_task_counter_t *counter;
+
+    /** \brief  Counter that must reach zero before this task runs, or NULL.
+
+        This is checked when the task is submitted, so only the tasks already
+        counted by it at that point will be waited for.
+    */
+    kthread_task_counter_t *depends;
+
+    /** \cond */
+    kthread_pool_t *pool;
+    /** \endcond */
+} kthread_task_t;
+
+/** \brief   Initialize a task counter.
+    \param  counter         The counter to initialize.
+*/
+static inline void thd_task_counter_init(kthread_task_counter_t *counter) {
+    counter->count = 0;
+    TAILQ_INIT(&counter->waiting);
+}
+
+/** \brief       Create a new thread pool.
+    \relatesalso kthread_pool_t
+
+    \param  count           The number of worker threads in the pool.
+    \param  attr            A set of thread attributes for the worker threads.
+                            Passing NULL will initialize all attributes to their
+                            default values. A stack can't be passed in, since
+                            each worker needs its own.
+
+    \return                 The new thread pool on success, NULL on failure
+                            (errno is set as appropriate).
+
+    \par    Error Conditions:
+    \em     EINVAL - count is 0, or attr contains a stack \n
+    \em     ENOMEM - out of memory
+
+    \sa thd_pool_destroy
+*/
+kthread_pool_t *thd_pool_create(unsigned int count, const kthread_attr_t *attr);
+
+/** \brief       Destroy a thread pool.
+    \relatesalso kthread_pool_t
+
+    This function waits for all of the tasks that have been queued up on the
+    pool to finish, then stops the worker threads and frees the pool. There
+    must not be any tasks still waiting on a dependency.
+
+    \param  pool            The thread pool to destroy.
+*/
+void thd_pool_destroy(kthread_pool_t *pool);
+
+/** \brief       Submit a task to a thread pool.
+    \relatesalso kthread_pool_t
+
+    Queues the task to be run by one of the pool's workers, or, if its
+    dependency counter is not zero, sets it aside until it is.
+
+    \param  pool            The thread pool to run the task on.
+    \param  task            The task to run.
+
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EFAULT - pool or task is NULL \n
+    \em     EINVAL - the task has no routine
+*/
+int thd_pool_submit(kthread_pool_t *pool, kthread_task_t *task);
+
+/** \brief       Wait for all tasks on a counter to finish.
+    \relatesalso kthread_pool_t
+
+    While waiting, the calling thread runs tasks from the pool itself, so it is
+    safe to call this from inside a task.
+
+    \param  pool            The thread pool the tasks were submitted to.
+    \param  counter         The counter to wait on.
+
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EPERM - called inside an interrupt \n
+    \em     EFAULT - pool or counter is NULL
+*/
+int thd_pool_wait(kthread_pool_t *pool, kthread_task_counter_t *counter);
+
+/** \brief       Run a loop in parallel on a thread pool.
+    \relatesalso kthread_pool_t
+
+    Splits the range [0, count) into chunks of grain iterations, and calls
+    routine once for each chunk on the thread pool, returning once all of them
+    are done. The calling thread helps run the chunks.
+
+    \param  pool            The thread pool to run the loop on.
+    \param  count           The number of iterations.
+    \param  grain           The number of iterations per chunk, or 0 to pick a
+                            size based on the number of workers.
+    \param  routine         The function to call for each chunk, with the
+                            first and one past the last iteration of the chunk.
+    \param  data            User pointer passed to the function.
+
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EPERM - called inside an interrupt \n
+    \em     EFAULT - pool or routine is NULL \n
+    \em     ENOMEM - out of memory
+*/
+int thd_pool_parallel_for(kthread_pool_t *pool, size_t count, size_t grain,
+                          void (*routine)(size_t begin, size_t end, void *data),
+                          void *data);
+
+__END_DECLS
+
+#endif /* __KOS_THREAD_POOL_H */
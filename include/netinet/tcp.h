@@ -25,6 +25,8 @@
 
 __BEGIN_DECLS
 
+#include <stdint.h>
+
 /** \defgroup tcp_opts                  Options
     \brief                              TCP protocol level options
     \ingroup                            networking_tcp
@@ -46,9 +48,38 @@ __BEGIN_DECLS
 */
 
 #define TCP_NODELAY             1 /**< \brief Don't delay to coalesce. */
+#define TCP_INFO                11 /**< \brief Connection info (tcp_info). */
+#define TCP_CONGESTION          13 /**< \brief Congestion control algorithm. */
 
 /** @} */
 
+/** \brief   TCP connection information.
+    \ingroup networking_tcp
+
+    This structure is filled in by getsockopt() with the TCP_INFO option on a
+    connected TCP socket. All times are in microseconds, and all windows are in
+    bytes.
+
+    \headerfile netinet/tcp.h
+*/
+struct tcp_info {
+    uint32_t tcpi_rto;              /**< \brief Retransmission timeout */
+    uint32_t tcpi_rtt;              /**< \brief Smoothed round trip time */
+    uint32_t tcpi_rttvar;           /**< \brief Round trip time variation */
+    uint32_t tcpi_snd_mss;          /**< \brief Sender maximum segment size */
+    uint32_t tcpi_backoff;          /**< \brief Timeouts since the last ACK */
+    uint32_t tcpi_rtt_samples;      /**< \brief Round trips measured */
+    uint32_t tcpi_total_retrans;    /**< \brief Retransmission timeouts */
+    uint32_t tcpi_fast_retrans;     /**< \brief Fast retransmits */
+    uint32_t tcpi_snd_cwnd;         /**< \brief Congestion window */
+    uint32_t tcpi_snd_ssthresh;     /**< \brief Slow start threshold */
+    uint32_t tcpi_snd_wnd;          /**< \brief Peer's receive window */
+    uint32_t tcpi_rcv_wnd;          /**< \brief Our receive window */
+    uint32_t tcpi_rcv_ooopack;      /**< \brief Out-of-order segments */
+    uint8_t  tcpi_snd_wscale;       /**< \brief Peer's window scale shift */
+    uint8_t  tcpi_rcv_wscale;       /**< \brief Our window scale shift */
+};
+
 __END_DECLS
 
 #endif /* !__NETINET_TCP_H */
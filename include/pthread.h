@@ -158,6 +158,10 @@ extern "C" {
 
     /* Mutex Initialization Scheduling Attributes, P1003.1c/Draft 10, p. 128 */
 
+#define PTHREAD_PRIO_NONE    0
+#define PTHREAD_PRIO_INHERIT 1
+#define PTHREAD_PRIO_PROTECT 2
+
     int pthread_mutexattr_setprotocol(pthread_mutexattr_t *attr, int protocol);
     int pthread_mutexattr_getprotocol(const pthread_mutexattr_t *attr, int *protocol);
     int pthread_mutexattr_setprioceiling(pthread_mutexattr_t *attr, int prioceiling);
@@ -35,12 +35,12 @@ struct sched_param {
 // Missing structs we don't care about in this impl.
 /** \brief  POSIX mutex attributes.
 
-    Not implemented in KOS.
+    Only the protocol is implemented in KOS.
 
     \headerfile sys/sched.h
 */
 typedef struct {
-    // Empty
+    int protocol;   /**< \brief Priority protocol (PTHREAD_PRIO_*) */
 } pthread_mutexattr_t;
 
 /** \brief  POSIX condition variable attributes.
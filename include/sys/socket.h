@@ -87,6 +87,56 @@ struct sockaddr_storage {
     char _ss_pad2[_SS_PAD2SIZE];
 };
 
+/** \brief  Message header structure.
+
+    This structure describes a message for sendmsg() and recvmsg(), with the
+    data split across any number of buffers.
+
+    \headerfile sys/socket.h
+*/
+struct msghdr {
+    /** \brief  Address to send to, or space to store the sender's address in
+                (may be NULL). */
+    void *msg_name;
+
+    /** \brief  Length of msg_name. */
+    socklen_t msg_namelen;
+
+    /** \brief  Buffers holding the data. */
+    struct iovec *msg_iov;
+
+    /** \brief  Number of buffers in msg_iov. */
+    int msg_iovlen;
+
+    /** \brief  Ancillary data (not currently supported). */
+    void *msg_control;
+
+    /** \brief  Length of msg_control. */
+    socklen_t msg_controllen;
+
+    /** \brief  Flags on the received message. */
+    int msg_flags;
+};
+
+/** \brief  Multiple message header structure.
+
+    This structure describes one message in a call to sendmmsg() or
+    recvmmsg().
+
+    \headerfile sys/socket.h
+*/
+struct mmsghdr {
+    /** \brief  The message itself. */
+    struct msghdr msg_hdr;
+
+    /** \brief  Number of bytes sent or received for this message. */
+    unsigned int msg_len;
+};
+
+/* \cond */
+struct timespec;
+/* \endcond */
+
 /** \brief  Datagram socket type.
 
     This socket type specifies that the socket in question transmits datagrams
@@ -171,6 +221,7 @@ struct sockaddr_storage {
 #define MSG_TRUNC       0x20    /**< \brief Normal data truncated (U) */
 #define MSG_WAITALL     0x40    /**< \brief Attempt to fill read buffer */
 #define MSG_DONTWAIT    0x80    /**< \brief Make this call non-blocking (non-standard) */
+#define MSG_WAITFORONE  0x100   /**< \brief recvmmsg() doesn't block after the first message (non-standard) */
 /** @} */
 
 /** \addtogroup networking_sockets
@@ -306,6 +357,49 @@ ssize_t recv(int socket, void *buffer, size_t length, int flags);
 ssize_t recvfrom(int socket, void *buffer, size_t length, int flags,
                  struct sockaddr *address, socklen_t *address_len);
 
+/** \brief  Receive a message on a socket, scattering it into buffers.
+
+    This function receives a message from a peer, in the same way as
+    recvfrom(), but stores the data in the buffers described by
+    message->msg_iov, filling each one in turn.
+
+    \param  socket      The socket to receive on.
+    \param  message     The message header describing where to put the data
+                        and the sender's address. On return, msg_namelen is set
+                        to the length of the address, and msg_flags has
+                        MSG_TRUNC set if the datagram did not fit.
+    \param  flags       The type of message reception.
+
+    \return             On success, the length of the message in bytes. If no
+                        messages are available, and the socket has been shut
+                        down, 0. On error, -1, and sets errno as appropriate.
+*/
+ssize_t recvmsg(int socket, struct msghdr *message, int flags);
+
+/** \brief  Receive multiple messages on a socket.
+
+    This function receives up to vlen messages in one call, which is much
+    cheaper than calling recvmsg() for each of them. It waits (unless the socket
+    is non-blocking or MSG_DONTWAIT is given) for the first message, then takes
+    whatever else is already queued without waiting any further, as if
+    MSG_WAITFORONE were given.
+
+    \param  socket      The socket to receive on.
+    \param  msgvec      The messages to receive into. On return, the msg_len
+                        field of each one received is set to its length.
+    \param  vlen        The number of messages in msgvec.
+    \param  flags       The type of message reception.
+    \param  timeout     The longest time to wait for the first message, or NULL
+                        to wait for as long as it takes.
+
+    \return             On success, the number of messages received. On error,
+                        -1, and sets errno as appropriate. If an error happens
+                        after at least one message was received, the number of
+                        messages received is returned instead.
+*/
+int recvmmsg(int socket, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+             struct timespec *timeout);
+
 /** \brief  Send a message on a connected socket.
 
     This function sends messages to the peer on a connected socket.
@@ -339,6 +433,39 @@ ssize_t send(int socket, const void *message, size_t length, int flags);
 ssize_t sendto(int socket, const void *message, size_t length, int flags,
                const struct sockaddr *dest_addr, socklen_t dest_len);
 
+/** \brief  Send a message on a socket, gathering it from buffers.
+
+    This function sends a message in the same way as sendto(), with the data
+    taken from each of the buffers described by message->msg_iov in turn.
+
+    \param  socket      The socket to send on.
+    \param  message     The message header describing the data and where to
+                        send it (msg_name may be NULL on a connected socket).
+    \param  flags       The type of message transmission.
+
+    \return             On success, the number of bytes sent. On error, -1,
+                        and sets errno as appropriate.
+*/
+ssize_t sendmsg(int socket, const struct msghdr *message, int flags);
+
+/** \brief  Send multiple messages on a socket.
+
+    This function sends up to vlen messages in one call, which is much cheaper
+    than calling sendmsg() for each of them.
+
+    \param  socket      The socket to send on.
+    \param  msgvec      The messages to send. On return, the msg_len field of
+                        each one sent is set to the number of bytes sent.
+    \param  vlen        The number of messages in msgvec.
+    \param  flags       The type of message transmission.
+
+    \return             On success, the number of messages sent. On error, -1,
+                        and sets errno as appropriate. If an error happens
+                        after at least one message was sent, the number of
+                        messages sent is returned instead.
+*/
+int sendmmsg(int socket, struct mmsghdr *msgvec, unsigned int vlen, int flags);
+
 /** \brief  Shutdown socket send and receive operations.
 
     This function closes a specific socket for the set of specified operations.
@@ -31,6 +31,7 @@ ISO9660 systems, as these were used as references as well.
 #include <dc/fs_iso9660.h>
 #include <dc/cdrom.h>
 #include <dc/vblank.h>
+#include <arch/cache.h>
 
 #include <kos/thread.h>
 #include <kos/mutex.h>
@@ -241,12 +242,37 @@ static void bgrad_cache(cache_block_t **cache, int block) {
     cache[NUM_CACHE_BLOCKS - 1] = tmp;
 }
 
+/* Read sectors from the disc straight into the given buffer by DMA. The buffer
+   must be 32-byte aligned, so that invalidating it in the cache can't throw
+   away anything else sharing its cache lines. Returns 0 on success, -1 on
+   error. This may be called with the cache mutex held, so on a disc change we
+   just flag that the disc needs to be re-initialized, like the vblank handler
+   does. */
+static int iso_read_sectors(void *buf, uint32 sector, int cnt) {
+    int rv;
+
+    /* The DMA goes around the cache, so make sure nothing stale is left in it
+       to be read (or written back over the data) later. */
+    dcache_inval_range((uintptr_t)buf, cnt * 2048);
+
+    rv = cdrom_read_sectors_ex(buf, sector + 150, cnt, CDROM_READ_DMA);
+
+    if(rv != ERR_OK) {
+        if(rv == ERR_DISC_CHG || rv == ERR_NO_DISC)
+            percd_done = 0;
+
+        return -1;
+    }
+
+    return 0;
+}
+
 /* Pulls the requested sector into a cache block and returns the cache
    block index. Note that the sector in question may already be in the
    cache, in which case it just returns the containing block. */
 static void iso_break_all(void);
 static int bread_cache(cache_block_t **cache, uint32 sector) {
-    int i, j, rv;
+    int i, rv;
 
     rv = -1;
     mutex_lock(&cache_mutex);
@@ -271,15 +297,8 @@ static int bread_cache(cache_block_t **cache, uint32 sector) {
     }
 
     /* Load the requested block */
-    j = cdrom_read_sectors_ex(cache[i]->data, sector + 150, 1, CDROM_READ_DMA);
-
-    if(j < 0) {
-        //dbglog(DBG_ERROR, "fs_iso9660: can't read_sectors for %d: %d\n",
-        //  sector+150, j);
-        if(j == ERR_DISC_CHG || j == ERR_NO_DISC) {
-            init_percd();
-        }
-
+    if(iso_read_sectors(cache[i]->data, sector, 1) < 0) {
+        cache[i]->sector = (uint32)-1;
         rv = -1;
         goto bread_exit;
     }
@@ -306,10 +325,88 @@ static int biread(uint32 sector) {
     return bread_cache(icache, sector);
 }
 
+/* Read-ahead buffer for file data. This holds a window of consecutive sectors
+   that were prefetched on behalf of a file that is being read sequentially.
+   Like the block caches, it is protected by the cache mutex. It always has room
+   for at least one sector, so it can also be used to bounce direct reads. */
+#define RA_BUF_SECTORS  (FS_CD_READAHEAD_SECTORS + 1)
+
+static uint8 *ra_data;
+static uint32 ra_sector = (uint32)-1;   /* First sector in the buffer */
+static int ra_count;                    /* Number of valid sectors */
+
+static void ra_clear(void) {
+    mutex_lock(&cache_mutex);
+    ra_sector = (uint32)-1;
+    ra_count = 0;
+    mutex_unlock(&cache_mutex);
+}
+
+/* Copy part of a sector out of the read-ahead buffer, filling the buffer with
+   cnt sectors starting at the requested one if it isn't already there. */
+static int ra_read(uint32 sector, int cnt, uint8 *out, int off, int len) {
+    int rv = 0;
+
+    mutex_lock(&cache_mutex);
+
+    if(sector < ra_sector || sector >= ra_sector + ra_count) {
+        if(iso_read_sectors(ra_data, sector, cnt) < 0) {
+            ra_sector = (uint32)-1;
+            ra_count = 0;
+            rv = -1;
+            goto out;
+        }
+
+        ra_sector = sector;
+        ra_count = cnt;
+    }
+
+    memcpy(out, ra_data + (sector - ra_sector) * 2048 + off, len);
+
+out:
+    mutex_unlock(&cache_mutex);
+    return rv;
+}
+
+/* Read whole sectors into the caller's buffer. If the buffer is aligned for
+   DMA, this reads into it directly, otherwise the data is bounced through the
+   read-ahead buffer, which is left holding the last chunk read. */
+static int ra_read_direct(uint32 sector, int cnt, uint8 *out) {
+    int n, rv = 0;
+
+    if(!((uintptr_t)out & 31))
+        return iso_read_sectors(out, sector, cnt);
+
+    mutex_lock(&cache_mutex);
+
+    while(cnt > 0) {
+        n = cnt < RA_BUF_SECTORS ? cnt : RA_BUF_SECTORS;
+
+        if(iso_read_sectors(ra_data, sector, n) < 0) {
+            ra_sector = (uint32)-1;
+            ra_count = 0;
+            rv = -1;
+            break;
+        }
+
+        ra_sector = sector;
+        ra_count = n;
+        memcpy(out, ra_data, n * 2048);
+
+        out += n * 2048;
+        sector += n;
+        cnt -= n;
+    }
+
+    mutex_unlock(&cache_mutex);
+    return rv;
+}
+
 /* Clear both caches */
 static void bclear(void) {
     bclear_cache(dcache);
     bclear_cache(icache);
+    ra_clear();
 }
 
 /********************************************************************************/
@@ -578,6 +675,8 @@ static struct {
     uint32      size;           /* Length of file in bytes */
     dirent_t    dirent;         /* A static dirent to pass back to clients */
     bool        broken;         /* True if the CD has been swapped out since open */
+    uint32      ra_next;        /* Sector a sequential read would hit next */
+    int         ra_window;      /* Current read-ahead window in sectors */
 } fh[FS_CD_MAX_FILES];
 
 /* Mutex for file handles */
@@ -649,6 +748,8 @@ static void * iso_open(vfs_handler_t * vfs, const char *fn, int mode) {
     fh[fd].ptr = 0;
     fh[fd].size = iso_733(de->size);
     fh[fd].broken = false;
+    fh[fd].ra_next = fh[fd].first_extent;
+    fh[fd].ra_window = 0;
 
     return (void *)fd;
 }
@@ -667,7 +768,8 @@ static int iso_close(void * h) {
 
 /* Read from a file */
 static ssize_t iso_read(void * h, void *buf, size_t bytes) {
-    int rv, toread, thissect, c;
+    int rv, toread, thissect, cnt;
+    uint32 sector, left;
     uint8 * outbuf;
     file_t fd = (file_t)h;
 
@@ -688,46 +790,73 @@ static ssize_t iso_read(void * h, void *buf, size_t bytes) {
 
         if(toread == 0) break;
 
+        sector = fh[fd].first_extent + fh[fd].ptr / 2048;
+
+        /* Keep track of whether the file is being read sequentially. If so,
+           grow the read-ahead window, otherwise drop back to reading single
+           sectors through the cache. */
+        if(sector != fh[fd].ra_next) {
+            fh[fd].ra_window = 0;
+        }
+        else if(fh[fd].ra_window < FS_CD_READAHEAD_SECTORS) {
+            fh[fd].ra_window = fh[fd].ra_window ? fh[fd].ra_window * 2 : 2;
+
+            if(fh[fd].ra_window > FS_CD_READAHEAD_SECTORS)
+                fh[fd].ra_window = FS_CD_READAHEAD_SECTORS;
+        }
+
         /* How much more can we read in the current sector? */
         thissect = 2048 - (fh[fd].ptr % 2048);
 
-        /* If we're on a sector boundary and we have more than one
-           full sector to read, then short-circuit the cache here
-           and use the multi-sector reads from the CD unit (this
-           should theoretically be a lot faster) */
-        /* XXX This code isn't actually faster, but I'm leaving it
-           here commented out in case we could find a better use
-           for it later than speed (i.e., preventing thread context
-           switches). */
-        /* if(thissect == 2048 && toread >= 2048) {
-            // Round it off to an even sector count
-            thissect = toread / 2048;
-            toread = thissect * 2048;
-
-            printf("cdrom: short-circuit read for %d sectors\n",
-                thissect);
-
-            // Do the read
-            if(cdrom_read_sectors(outbuf,
-                fh[fd].first_extent + fh[fd].ptr/2048 + 150,
-                thissect) < 0)
-            {
-                // Something went wrong...
+        /* If we're on a sector boundary and we have at least one full sector
+           to read, then skip the cache entirely and read as many sectors as
+           we can straight into the caller's buffer. */
+        if(thissect == 2048 && toread >= 2048) {
+            cnt = toread / 2048;
+            toread = cnt * 2048;
+
+            if(ra_read_direct(sector, cnt, outbuf) < 0) {
+                errno = EIO;
                 return -1;
             }
-        } else { */
-        toread = (toread > thissect) ? thissect : toread;
-
-        /* Do the read */
-        c = bdread(fh[fd].first_extent + fh[fd].ptr / 2048);
 
-        if(c < 0) {
-            errno = EIO;
-            return -1;
+            fh[fd].ra_next = sector + cnt;
         }
+        else {
+            toread = (toread > thissect) ? thissect : toread;
+
+            if(fh[fd].ra_window > 1) {
+                /* Don't read ahead past the end of the file. */
+                left = (fh[fd].size - fh[fd].ptr + 2047 +
+                        (fh[fd].ptr % 2048)) / 2048;
+                cnt = (uint32)fh[fd].ra_window < left ? fh[fd].ra_window :
+                      (int)left;
+
+                if(ra_read(sector, cnt, outbuf, fh[fd].ptr % 2048,
+                           toread) < 0) {
+                    errno = EIO;
+                    return -1;
+                }
+            }
+            else {
+                cnt = bdread(sector);
+
+                if(cnt < 0) {
+                    errno = EIO;
+                    return -1;
+                }
+
+                memcpy(outbuf, dcache[cnt]->data + (fh[fd].ptr % 2048),
+                       toread);
+            }
 
-        memcpy(outbuf, dcache[c]->data + (fh[fd].ptr % 2048), toread);
-        /* } */
+            /* Only count the read as sequential once the end of the sector
+               has been reached. */
+            if(toread == thissect)
+                fh[fd].ra_next = sector + 1;
+            else
+                fh[fd].ra_next = sector;
+        }
 
         /* Adjust pointers */
         outbuf += toread;
@@ -1126,6 +1255,9 @@ void fs_iso9660_init(void) {
     /* Allocate cache block space, properly aligned for DMA access */
     cache_data = memalign(32, 2 * NUM_CACHE_BLOCKS * 2048);
     caches = malloc(2 * NUM_CACHE_BLOCKS * sizeof(cache_block_t));
+    ra_data = memalign(32, RA_BUF_SECTORS * 2048);
+    ra_sector = (uint32)-1;
+    ra_count = 0;
 
     for(i = 0; i < NUM_CACHE_BLOCKS; i++) {
         icache[i] = &caches[i * 2];
@@ -1154,6 +1286,7 @@ void fs_iso9660_shutdown(void) {
     /* Dealloc cache block space */
     free(cache_data);
     free(caches);
+    free(ra_data);
 
     /* Free muteces */
     mutex_destroy(&cache_mutex);
@@ -450,6 +450,53 @@ irq_handler irq_get_global_handler(void);
 
 /** @} */
 
+/** \defgroup irq_stats     Statistics
+    \brief                  Accounting of time spent handling interrupts
+
+    Each time an interrupt or exception is handled, the number of times it has
+    happened and the time spent in its handlers is added up, so that you can
+    tell how much of the CPU is going to interrupt load, and to which sources.
+
+    \note                   Times are measured with perf_cntr_timer_ns(), so
+                            they will stop adding up if the nanosecond timer
+                            of the performance counters is disturbed.
+
+    @{
+*/
+
+/** \brief  Interrupt statistics for one exception code. */
+typedef struct irq_stats {
+    irq_t code;             /**< \brief The exception code */
+    uint32_t count;         /**< \brief Number of times it was handled */
+    uint64_t time;          /**< \brief Total handler time, in nanoseconds */
+    uint64_t max_time;      /**< \brief Longest handler time, in nanoseconds */
+} irq_stats_t;
+
+/** \brief  Get the statistics for an exception code.
+
+    \param  code            The exception code to look up.
+    \param  stats           Where to store the statistics.
+
+    \retval 0               On success.
+    \retval -1              If the code is invalid.
+*/
+int irq_get_stats(irq_t code, irq_stats_t *stats);
+
+/** \brief  Reset all interrupt statistics to zero. */
+void irq_reset_stats(void);
+
+/** \brief  Print out the interrupt statistics.
+
+    Prints out the statistics of every exception code that has been handled
+    since the statistics were last reset.
+
+    \param  pf              The printf-like function to print with.
+    \retval 0               On success.
+*/
+int irq_print_stats(int (*pf)(const char *fmt, ...));
+
+/** @} */
+
 /** \cond INTERNAL */
 
 /** Initialize interrupts.
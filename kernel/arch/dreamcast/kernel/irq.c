@@ -20,6 +20,7 @@
 #include <kos/dbgio.h>
 #include <kos/thread.h>
 #include <kos/library.h>
+#include <dc/perfctr.h>
 
 /* Macros for accessing related registers. */
 #define TRA    ( *((volatile uint32_t *)(0xff000020)) ) /* TRAPA Exception Register */
@@ -47,6 +48,13 @@ static struct trapa_cb trapa_handlers[0x100];
    exception; you might get more than you bargained for, but it can be useful. */
 static struct irq_cb   global_irq_handler;
 
+/* Time spent handling each exception code */
+static struct irq_stat {
+    uint32_t count;
+    uint64_t time;
+    uint64_t max_time;
+} irq_stats[0x100];
+
 /* Default IRQ context location */
 static irq_context_t    irq_context_default;
 
@@ -204,6 +212,8 @@ static void irq_dump_regs(int code, irq_t evt) {
 volatile uint32_t jiffies = 0;
 void irq_handle_exception(int code) {
     const struct irq_cb *hnd;
+    struct irq_stat *st;
+    uint64_t start, time;
     uint32_t evt = 0;
     int handled = 0;
 
@@ -241,6 +251,8 @@ void irq_handle_exception(int code) {
        diagnostics returns if we try to do something in the int. */
     inside_int = ((code&0xf)<<16) | (evt&0xffff);
 
+    start = perf_cntr_timer_ns();
+
     /* If there's a global handler, call it */
     if(global_irq_handler.hdl) {
         global_irq_handler.hdl(evt, irq_srt_addr, global_irq_handler.data);
@@ -283,10 +295,64 @@ void irq_handle_exception(int code) {
         arch_panic("unhandled IRQ/Exception");
     }
 
+    /* Account for the time we spent in here */
+    time = perf_cntr_timer_ns() - start;
+    st = &irq_stats[(evt >> 4) & 0xff];
+    ++st->count;
+    st->time += time;
+
+    if(time > st->max_time)
+        st->max_time = time;
+
     irq_disable();
     inside_int = 0;
 }
 
+int irq_get_stats(irq_t code, irq_stats_t *stats) {
+    const struct irq_stat *st;
+
+    if(code >= 0x1000 || (code & 0x000f))
+        return -1;
+
+    irq_disable_scoped();
+
+    st = &irq_stats[code >> 4];
+    stats->code = code;
+    stats->count = st->count;
+    stats->time = st->time;
+    stats->max_time = st->max_time;
+
+    return 0;
+}
+
+void irq_reset_stats(void) {
+    irq_disable_scoped();
+    memset(irq_stats, 0, sizeof(irq_stats));
+}
+
+int irq_print_stats(int (*pf)(const char *fmt, ...)) {
+    irq_stats_t st;
+    uint64_t ns_time = perf_cntr_timer_ns();
+    unsigned int code;
+
+    pf("Interrupt statistics:\n");
+    pf("code\t     count\t    time (ns)\t\t   max (ns)\n");
+
+    for(code = 0; code < 0x1000; code += 0x10) {
+        irq_get_stats((irq_t)code, &st);
+
+        if(!st.count)
+            continue;
+
+        pf("%04x\t%10lu\t%12llu (%6.3lf%%)\t%10llu\n", code, st.count,
+           st.time, (double)st.time / (double)ns_time * 100.0, st.max_time);
+    }
+
+    pf("--end of list--\n");
+
+    return 0;
+}
+
 void irq_handle_trapa(irq_t code, irq_context_t *context, void *data) {
     const struct irq_cb *hnd, *handlers = data;
     uint32_t vec;
@@ -0,0 +1,236 @@
+/* KallistiOS ##version##
+
+   blockdev_async.c
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* This module implements request queues for block devices. Each queue has a
+   worker thread that takes requests off of the queue in submission order and
+   runs them through the device's synchronous read_blocks/write_blocks
+   functions. A run of queued requests that are contiguous both on the device
+   and in memory is handed to the device as one transfer. */
+
+#include <kos/blockdev.h>
+#include <kos/genwait.h>
+#include <kos/thread.h>
+#include <kos/worker_thread.h>
+#include <arch/irq.h>
+#include <sys/queue.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/* Largest number of blocks that will be merged into a single transfer. */
+#define MAX_MERGE_BLOCKS    1024
+
+TAILQ_HEAD(bq_list, kos_blockdev_req);
+
+struct kos_blockdev_queue {
+    kos_blockdev_t *dev;
+    kthread_worker_t *worker;
+    struct bq_list reqs;
+    int busy;
+    int closing;
+};
+
+/* Can b be done in the same transfer as a, right after it? */
+static int can_merge(kos_blockdev_queue_t *q, const kos_blockdev_req_t *a,
+                     const kos_blockdev_req_t *b) {
+    return a->op == b->op && a->block + a->count == b->block &&
+        (uint8_t *)a->buf + (a->count << q->dev->l_block_size) ==
+        (uint8_t *)b->buf;
+}
+
+static void bq_complete(kos_blockdev_req_t *req, int rv, int err) {
+    kos_blockdev_req_cb_t cb = req->callback;
+    void *data = req->data;
+    uint32_t flags;
+
+    req->result = rv;
+    req->err = rv ? err : 0;
+
+    flags = irq_disable();
+    req->pending = 0;
+    genwait_wake_all(req);
+    irq_restore(flags);
+
+    /* This is the last time we touch the request, so the callback is free to
+       do what it wants with it. */
+    if(cb)
+        cb(req, data);
+}
+
+static void bq_work(void *d) {
+    kos_blockdev_queue_t *q = (kos_blockdev_queue_t *)d;
+    struct bq_list batch;
+    kos_blockdev_req_t *req, *last, *next;
+    size_t count;
+    uint32_t flags;
+    int rv, err;
+
+    for(;;) {
+        flags = irq_disable();
+
+        if(!(req = TAILQ_FIRST(&q->reqs))) {
+            q->busy = 0;
+            genwait_wake_all(q);
+            irq_restore(flags);
+            return;
+        }
+
+        /* Pull off the first request and everything that directly follows
+           it. */
+        TAILQ_INIT(&batch);
+        TAILQ_REMOVE(&q->reqs, req, entry);
+        TAILQ_INSERT_TAIL(&batch, req, entry);
+        count = req->count;
+        last = req;
+
+        while((next = TAILQ_FIRST(&q->reqs)) && can_merge(q, last, next) &&
+              count + next->count <= MAX_MERGE_BLOCKS) {
+            TAILQ_REMOVE(&q->reqs, next, entry);
+            TAILQ_INSERT_TAIL(&batch, next, entry);
+            count += next->count;
+            last = next;
+        }
+
+        q->busy = 1;
+        irq_restore(flags);
+
+        if(req->op == KOS_BLOCKDEV_REQ_READ)
+            rv = q->dev->read_blocks(q->dev, req->block, count, req->buf);
+        else
+            rv = q->dev->write_blocks(q->dev, req->block, count, req->buf);
+
+        err = errno;
+
+        TAILQ_FOREACH_SAFE(req, &batch, entry, next) {
+            bq_complete(req, rv ? -1 : 0, err);
+        }
+    }
+}
+
+kos_blockdev_queue_t *kos_blockdev_queue_create(kos_blockdev_t *dev) {
+    kos_blockdev_queue_t *q;
+    kthread_attr_t attr = {
+        .label = "blockdev queue"
+    };
+
+    if(!dev) {
+        errno = EFAULT;
+        return NULL;
+    }
+
+    if(!(q = (kos_blockdev_queue_t *)malloc(sizeof(kos_blockdev_queue_t)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    q->dev = dev;
+    q->busy = 0;
+    q->closing = 0;
+    TAILQ_INIT(&q->reqs);
+
+    if(!(q->worker = thd_worker_create_ex(&attr, bq_work, q))) {
+        free(q);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    return q;
+}
+
+void kos_blockdev_queue_destroy(kos_blockdev_queue_t *q) {
+    uint32_t flags;
+
+    if(!q)
+        return;
+
+    flags = irq_disable();
+    q->closing = 1;
+
+    while(q->busy || !TAILQ_EMPTY(&q->reqs))
+        genwait_wait(q, "kos_blockdev_queue_destroy", 0, NULL);
+
+    irq_restore(flags);
+
+    thd_worker_destroy(q->worker);
+    free(q);
+}
+
+void kos_blockdev_req_init(kos_blockdev_req_t *req, int op, uint64_t block,
+                           size_t count, void *buf) {
+    memset(req, 0, sizeof(kos_blockdev_req_t));
+    req->op = op;
+    req->block = block;
+    req->count = count;
+    req->buf = buf;
+}
+
+int kos_blockdev_submit(kos_blockdev_queue_t *q, kos_blockdev_req_t *req) {
+    uint32_t flags;
+
+    if(!q || !req || !req->buf) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    if((req->op != KOS_BLOCKDEV_REQ_READ &&
+        req->op != KOS_BLOCKDEV_REQ_WRITE) || !req->count) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(req->op == KOS_BLOCKDEV_REQ_WRITE && !q->dev->write_blocks) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    flags = irq_disable();
+
+    if(req->pending) {
+        irq_restore(flags);
+        errno = EBUSY;
+        return -1;
+    }
+
+    if(q->closing) {
+        irq_restore(flags);
+        errno = EPIPE;
+        return -1;
+    }
+
+    req->pending = 1;
+    req->result = 0;
+    req->err = 0;
+    TAILQ_INSERT_TAIL(&q->reqs, req, entry);
+
+    /* Make sure the worker doesn't go to sleep before seeing this one. */
+    q->busy = 1;
+    thd_worker_wakeup(q->worker);
+    irq_restore(flags);
+
+    return 0;
+}
+
+int kos_blockdev_wait(kos_blockdev_req_t *req) {
+    uint32_t flags;
+
+    if(!req) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    flags = irq_disable();
+
+    while(req->pending)
+        genwait_wait(req, "kos_blockdev_wait", 0, NULL);
+
+    irq_restore(flags);
+
+    if(req->result)
+        errno = req->err;
+
+    return req->result;
+}
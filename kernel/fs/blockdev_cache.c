@@ -0,0 +1,428 @@
+/* KallistiOS ##version##
+
+   blockdev_cache.c
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* This module implements a caching block device that can be stacked on top of
+   any other kos_blockdev_t. The cache works in units of the underlying
+   device's blocks. Lookups are done through a hash table keyed on the block
+   number and replacement is done in LRU order, so the cost of each access does
+   not depend on how large the cache is. By default writes are held in the
+   cache (write-back) until the block is evicted or the device is flushed. */
+
+#include <kos/blockdev.h>
+#include <kos/mutex.h>
+#include <kos/dbglog.h>
+#include <sys/queue.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define CACHE_FLAG_VALID    0x00000001
+#define CACHE_FLAG_DIRTY    0x00000002
+
+typedef struct bc_entry {
+    LIST_ENTRY(bc_entry) hentry;    /* Hash chain, only used when valid */
+    TAILQ_ENTRY(bc_entry) lentry;   /* LRU list, LRU/invalid at the head */
+    uint64_t block;
+    uint32_t flags;
+    uint8_t *data;
+} bc_entry_t;
+
+LIST_HEAD(bc_list, bc_entry);
+TAILQ_HEAD(bc_queue, bc_entry);
+
+typedef struct bc_devdata {
+    kos_blockdev_t *dev;            /* Underlying device */
+    uint32_t flags;                 /* KOS_BLOCKDEV_CACHE_* flags */
+    size_t block_size;
+
+    bc_entry_t *entries;
+    uint8_t *data;
+    struct bc_list *hash;
+    uint32_t hash_mask;
+    struct bc_queue lru;
+
+    kos_blockdev_cache_stats_t stats;
+    mutex_t mutex;
+} bc_devdata_t;
+
+static bc_entry_t *bc_lookup(bc_devdata_t *c, uint64_t block) {
+    bc_entry_t *ent;
+
+    LIST_FOREACH(ent, &c->hash[(uint32_t)block & c->hash_mask], hentry) {
+        if(ent->block == block)
+            return ent;
+    }
+
+    return NULL;
+}
+
+static inline void bc_make_mru(bc_devdata_t *c, bc_entry_t *ent) {
+    TAILQ_REMOVE(&c->lru, ent, lentry);
+    TAILQ_INSERT_TAIL(&c->lru, ent, lentry);
+}
+
+static inline void bc_invalidate(bc_devdata_t *c, bc_entry_t *ent) {
+    LIST_REMOVE(ent, hentry);
+    ent->flags = 0;
+    TAILQ_REMOVE(&c->lru, ent, lentry);
+    TAILQ_INSERT_HEAD(&c->lru, ent, lentry);
+}
+
+static int bc_writeback(bc_devdata_t *c, bc_entry_t *ent) {
+    if(c->dev->write_blocks(c->dev, ent->block, 1, ent->data))
+        return -1;
+
+    ent->flags &= ~CACHE_FLAG_DIRTY;
+    ++c->stats.writebacks;
+    return 0;
+}
+
+/* Grab an entry for the given block, evicting the least recently used entry
+   if needed. The entry returned is in the hash table and is the most recently
+   used, but its data is not filled in. */
+static bc_entry_t *bc_claim(bc_devdata_t *c, uint64_t block) {
+    bc_entry_t *ent = TAILQ_FIRST(&c->lru);
+
+    if(ent->flags & CACHE_FLAG_VALID) {
+        if((ent->flags & CACHE_FLAG_DIRTY) && bc_writeback(c, ent))
+            return NULL;
+
+        LIST_REMOVE(ent, hentry);
+        ++c->stats.evictions;
+    }
+
+    ent->block = block;
+    ent->flags = CACHE_FLAG_VALID;
+    LIST_INSERT_HEAD(&c->hash[(uint32_t)block & c->hash_mask], ent, hentry);
+    bc_make_mru(c, ent);
+
+    return ent;
+}
+
+static int bc_flush_int(bc_devdata_t *c) {
+    bc_entry_t *ent;
+
+    TAILQ_FOREACH(ent, &c->lru, lentry) {
+        if((ent->flags & CACHE_FLAG_DIRTY) && bc_writeback(c, ent))
+            return -1;
+    }
+
+    return 0;
+}
+
+static int bc_init(kos_blockdev_t *d) {
+    bc_devdata_t *c = (bc_devdata_t *)d->dev_data;
+
+    return c->dev->init(c->dev);
+}
+
+static int bc_shutdown(kos_blockdev_t *d) {
+    bc_devdata_t *c = (bc_devdata_t *)d->dev_data;
+    int rv = 0;
+
+    mutex_lock(&c->mutex);
+
+    if(bc_flush_int(c)) {
+        dbglog(DBG_WARNING, "blockdev_cache: error writing back dirty blocks "
+               "on shutdown\n");
+        rv = -1;
+    }
+
+    mutex_unlock(&c->mutex);
+
+    if(c->dev->shutdown(c->dev))
+        rv = -1;
+
+    mutex_destroy(&c->mutex);
+    free(c->hash);
+    free(c->data);
+    free(c->entries);
+    free(c);
+    d->dev_data = NULL;
+
+    return rv;
+}
+
+static int bc_read_blocks(kos_blockdev_t *d, uint64_t block, size_t count,
+                          void *buf) {
+    bc_devdata_t *c = (bc_devdata_t *)d->dev_data;
+    uint8_t *ptr = (uint8_t *)buf;
+    bc_entry_t *ent;
+    size_t i, j, run;
+    int rv = 0;
+
+    mutex_lock(&c->mutex);
+
+    /* Big reads don't go through the cache at all, since they'd just end up
+       booting everything else out of it. Make sure anything dirty in the range
+       is written back first so we don't read stale data. */
+    if(count > c->stats.capacity) {
+        for(i = 0; i < count; ++i) {
+            ent = bc_lookup(c, block + i);
+
+            if(ent && (ent->flags & CACHE_FLAG_DIRTY) && bc_writeback(c, ent)) {
+                rv = -1;
+                goto out;
+            }
+        }
+
+        c->stats.misses += count;
+        rv = c->dev->read_blocks(c->dev, block, count, buf);
+        goto out;
+    }
+
+    i = 0;
+
+    while(i < count) {
+        if((ent = bc_lookup(c, block + i))) {
+            memcpy(ptr + i * c->block_size, ent->data, c->block_size);
+            bc_make_mru(c, ent);
+            ++c->stats.hits;
+            ++i;
+            continue;
+        }
+
+        /* Figure out how long the run of missing blocks is, and read it all in
+           with one request straight into the caller's buffer. */
+        for(run = 1; i + run < count && !bc_lookup(c, block + i + run); ++run) ;
+
+        c->stats.misses += run;
+
+        if(c->dev->read_blocks(c->dev, block + i, run,
+                               ptr + i * c->block_size)) {
+            rv = -1;
+            goto out;
+        }
+
+        for(j = 0; j < run; ++j) {
+            /* If we can't get a cache entry, the data is still in the user's
+               buffer, so there's no reason to fail the read. */
+            if(!(ent = bc_claim(c, block + i + j)))
+                break;
+
+            memcpy(ent->data, ptr + (i + j) * c->block_size, c->block_size);
+        }
+
+        i += run;
+    }
+
+out:
+    mutex_unlock(&c->mutex);
+    return rv;
+}
+
+static int bc_write_blocks(kos_blockdev_t *d, uint64_t block, size_t count,
+                           const void *buf) {
+    bc_devdata_t *c = (bc_devdata_t *)d->dev_data;
+    const uint8_t *ptr = (const uint8_t *)buf;
+    bc_entry_t *ent;
+    size_t i;
+    int rv = 0;
+
+    mutex_lock(&c->mutex);
+
+    /* Write-through mode and big writes go straight to the device. Anything
+       already cached in the range is updated so the cache stays coherent. */
+    if((c->flags & KOS_BLOCKDEV_CACHE_WRITETHROUGH) ||
+       count > c->stats.capacity) {
+        if(c->dev->write_blocks(c->dev, block, count, buf)) {
+            rv = -1;
+            goto out;
+        }
+
+        for(i = 0; i < count; ++i) {
+            if((ent = bc_lookup(c, block + i))) {
+                memcpy(ent->data, ptr + i * c->block_size, c->block_size);
+                ent->flags &= ~CACHE_FLAG_DIRTY;
+            }
+        }
+
+        goto out;
+    }
+
+    for(i = 0; i < count; ++i) {
+        if((ent = bc_lookup(c, block + i))) {
+            ++c->stats.hits;
+            bc_make_mru(c, ent);
+        }
+        else {
+            ++c->stats.misses;
+
+            if(!(ent = bc_claim(c, block + i))) {
+                rv = -1;
+                goto out;
+            }
+        }
+
+        memcpy(ent->data, ptr + i * c->block_size, c->block_size);
+        ent->flags |= CACHE_FLAG_DIRTY;
+    }
+
+out:
+    mutex_unlock(&c->mutex);
+    return rv;
+}
+
+static uint64_t bc_count_blocks(kos_blockdev_t *d) {
+    bc_devdata_t *c = (bc_devdata_t *)d->dev_data;
+
+    return c->dev->count_blocks(c->dev);
+}
+
+static int bc_flush(kos_blockdev_t *d) {
+    bc_devdata_t *c = (bc_devdata_t *)d->dev_data;
+    int rv;
+
+    mutex_lock(&c->mutex);
+    rv = bc_flush_int(c);
+    mutex_unlock(&c->mutex);
+
+    if(!rv && c->dev->flush)
+        rv = c->dev->flush(c->dev);
+
+    return rv;
+}
+
+static kos_blockdev_t cache_blockdev = {
+    NULL,                   /* dev_data */
+    0,                      /* l_block_size (filled in from the device) */
+    &bc_init,               /* init */
+    &bc_shutdown,           /* shutdown */
+    &bc_read_blocks,        /* read_blocks */
+    &bc_write_blocks,       /* write_blocks */
+    &bc_count_blocks,       /* count_blocks */
+    &bc_flush               /* flush */
+};
+
+int kos_blockdev_cache_create(kos_blockdev_t *dev, size_t blocks,
+                              uint32_t flags, kos_blockdev_t *rv) {
+    bc_devdata_t *c;
+    uint32_t hash_sz;
+    size_t i;
+
+    if(!dev || !rv) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    if(!blocks || (flags & ~KOS_BLOCKDEV_CACHE_VALID_FLAGS)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(!(c = (bc_devdata_t *)malloc(sizeof(bc_devdata_t)))) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    memset(c, 0, sizeof(bc_devdata_t));
+
+    for(hash_sz = 1; hash_sz < blocks; hash_sz <<= 1) ;
+
+    c->dev = dev;
+    c->flags = flags;
+    c->block_size = 1 << dev->l_block_size;
+    c->hash_mask = hash_sz - 1;
+    c->stats.capacity = blocks;
+
+    c->entries = (bc_entry_t *)malloc(sizeof(bc_entry_t) * blocks);
+    c->data = (uint8_t *)malloc(c->block_size * blocks);
+    c->hash = (struct bc_list *)malloc(sizeof(struct bc_list) * hash_sz);
+
+    if(!c->entries || !c->data || !c->hash) {
+        free(c->hash);
+        free(c->data);
+        free(c->entries);
+        free(c);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for(i = 0; i < hash_sz; ++i) {
+        LIST_INIT(&c->hash[i]);
+    }
+
+    TAILQ_INIT(&c->lru);
+
+    for(i = 0; i < blocks; ++i) {
+        c->entries[i].block = 0;
+        c->entries[i].flags = 0;
+        c->entries[i].data = c->data + i * c->block_size;
+        TAILQ_INSERT_TAIL(&c->lru, c->entries + i, lentry);
+    }
+
+    mutex_init(&c->mutex, MUTEX_TYPE_NORMAL);
+
+    /* Copy in the template block device and fill it in */
+    memcpy(rv, &cache_blockdev, sizeof(kos_blockdev_t));
+    rv->l_block_size = dev->l_block_size;
+    rv->dev_data = c;
+
+    /* Without a write function on the device, there's nothing to write back
+       to, so don't pretend otherwise. */
+    if(!dev->write_blocks)
+        rv->write_blocks = NULL;
+
+    return 0;
+}
+
+int kos_blockdev_cache_stats(kos_blockdev_t *d, kos_blockdev_cache_stats_t *st,
+                             int reset) {
+    bc_devdata_t *c;
+
+    if(!d || d->read_blocks != &bc_read_blocks) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    c = (bc_devdata_t *)d->dev_data;
+    mutex_lock(&c->mutex);
+
+    if(st)
+        memcpy(st, &c->stats, sizeof(kos_blockdev_cache_stats_t));
+
+    if(reset) {
+        c->stats.hits = c->stats.misses = 0;
+        c->stats.evictions = c->stats.writebacks = 0;
+    }
+
+    mutex_unlock(&c->mutex);
+    return 0;
+}
+
+int kos_blockdev_cache_invalidate(kos_blockdev_t *d) {
+    bc_devdata_t *c;
+    bc_entry_t *ent, *next;
+    int rv = 0;
+
+    if(!d || d->read_blocks != &bc_read_blocks) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    c = (bc_devdata_t *)d->dev_data;
+    mutex_lock(&c->mutex);
+
+    if(bc_flush_int(c)) {
+        rv = -1;
+    }
+    else {
+        ent = TAILQ_FIRST(&c->lru);
+
+        while(ent) {
+            next = TAILQ_NEXT(ent, lentry);
+
+            if(ent->flags & CACHE_FLAG_VALID)
+                bc_invalidate(c, ent);
+
+            ent = next;
+        }
+    }
+
+    mutex_unlock(&c->mutex);
+    return rv;
+}
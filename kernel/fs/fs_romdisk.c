@@ -21,11 +21,13 @@ on sunsite.unc.edu in /pub/Linux/system/recovery/, or as a package under Debian
 #include <kos/mutex.h>
 #include <kos/fs_romdisk.h>
 #include <kos/opts.h>
+#include <sys/uio.h>
 #include <malloc.h>
 #include <stdbool.h>
 #include <string.h>
 #include <strings.h>
 #include <stdio.h>
+#include <ctype.h>
 #include <assert.h>
 #include <errno.h>
 
@@ -71,6 +73,70 @@ static uint32 ntohl_32(const void *data) {
     return (d[0] << 24) | (d[1] << 16) | (d[2] << 8) | (d[3] << 0);
 }
 
+/********************************************************************************/
+/* Path lookup index. This maps the full path of every file and directory in
+   the image to the offset of its header, so that looking up a path doesn't
+   have to walk the linked list of every directory along the way. Each entry
+   also keeps the index of its parent directory's entry, which lets us verify
+   a hash match exactly without storing the paths themselves.
+
+   Images made with "genromfs -i" carry a prebuilt copy of the index (see the
+   comments in utils/genromfs/genromfs.c for the format), which is used in
+   place. Otherwise, the index is built when the image is mounted. */
+
+/* Maximum directory depth we'll index. Anything deeper is simply left out of
+   the index and found by walking the image instead. */
+#define RD_INDEX_MAX_DEPTH  32
+
+#define RD_INDEX_NO_PARENT  0xffffffff
+
+/* Prebuilt index in the image. The header is at the offset given in the
+   trailer, which is the last 16 bytes of the image. */
+#define RD_INDEX_MAGIC      "-kosidx-"
+#define RD_INDEX_VERSION    1
+
+typedef struct {
+    uint32  version;                /* RD_INDEX_VERSION */
+    uint32  count;                  /* Number of entries */
+    uint32  table_size;             /* Hash table size (power of two) */
+    uint32  reserved;
+} rd_index_hdr_t;
+
+typedef struct {
+    char    magic[8];               /* RD_INDEX_MAGIC */
+    uint32  offset;                 /* Offset of the rd_index_hdr_t */
+    uint32  size;                   /* Size of the whole index */
+} rd_index_trailer_t;
+
+typedef struct {
+    uint32  hash;                   /* Hash of the full path */
+    uint32  offset;                 /* Offset of the file header */
+    uint32  parent;                 /* Entry of the parent dir, if any */
+} rd_index_ent_t;
+
+typedef struct {
+    rd_index_ent_t  *ents;          /* Array of entries */
+    uint32          count;          /* Number of used entries */
+    uint32          max;            /* Number of allocated entries */
+    uint32          *table;         /* Hash table (entry number + 1) */
+    uint32          mask;           /* Hash table size - 1 */
+    uint32          limit;          /* Header offsets must be below this */
+    bool            in_image;       /* Do ents/table point into the image? */
+} rd_index_t;
+
+/* FNV-1a, over the lowercase version of the path. */
+#define RD_HASH_INIT    0x811c9dc5
+#define RD_HASH_PRIME   0x01000193
+
+static inline uint32 rd_hash_add(uint32 hash, const char *s, size_t len) {
+    while(len--) {
+        hash ^= (uint8)tolower((int)*s++);
+        hash *= RD_HASH_PRIME;
+    }
+
+    return hash;
+}
+
 /********************************************************************************/
 
 /* A list of the following */
@@ -87,6 +153,7 @@ typedef struct rd_image {
     const romdisk_hdr_t * hdr;      /* Pointer to the header */
     uint32          files;      /* Offset in the image to the files area */
     vfs_handler_t       * vfsh;     /* Our VFS mount struct */
+    rd_index_t      * index;    /* Path lookup index, if any */
 } rd_image_t;
 
 /* Global list of mounted romdisks */
@@ -169,6 +236,263 @@ static uint32_t romdisk_find_object(rd_image_t *mnt, const char *fn, size_t fnle
     return 0;
 }
 
+#if FS_ROMDISK_INDEX
+static int rd_index_add(rd_index_t *idx, uint32 hash, uint32 offset,
+                        uint32 parent) {
+    rd_index_ent_t *ents;
+
+    if(idx->count == idx->max) {
+        idx->max = idx->max ? idx->max * 2 : 64;
+
+        if(!(ents = (rd_index_ent_t *)realloc(idx->ents, idx->max *
+                                               sizeof(rd_index_ent_t))))
+            return -1;
+
+        idx->ents = ents;
+    }
+
+    idx->ents[idx->count].hash = hash;
+    idx->ents[idx->count].offset = offset;
+    idx->ents[idx->count].parent = parent;
+    ++idx->count;
+
+    return 0;
+}
+
+/* Add all of the entries in the directory starting at the given offset (and
+   all of its subdirectories) to the list of index entries. */
+static int rd_index_scan(rd_image_t *mnt, rd_index_t *idx, uint32 offset,
+                         uint32 hash, uint32 parent, int depth) {
+    const romdisk_file_t *fhdr;
+    uint32 ni, type, h, ent;
+
+    if(depth > RD_INDEX_MAX_DEPTH)
+        return 0;
+
+    while(offset) {
+        fhdr = (const romdisk_file_t *)(mnt->image + offset);
+        ni = ntohl_32(&fhdr->next_header);
+        type = ni & ROMFH_MASK;
+
+        /* Only files and directories can be found by path. Skip over the
+           . and .. entries, as they would just lead us around in circles. */
+        if((type == ROMFH_DIR || type == ROMFH_REG) &&
+           strcmp(fhdr->filename, ".") && strcmp(fhdr->filename, "..")) {
+            h = (parent == RD_INDEX_NO_PARENT) ? hash :
+                rd_hash_add(hash, "/", 1);
+            h = rd_hash_add(h, fhdr->filename, strlen(fhdr->filename));
+            ent = idx->count;
+
+            if(rd_index_add(idx, h, offset, parent))
+                return -1;
+
+            if(type == ROMFH_DIR &&
+               rd_index_scan(mnt, idx, ntohl_32(&fhdr->spec_info), h, ent,
+                             depth + 1))
+                return -1;
+        }
+
+        offset = ni & 0xfffffff0;
+    }
+
+    return 0;
+}
+
+static void rd_index_free(rd_index_t *idx) {
+    if(idx) {
+        if(!idx->in_image) {
+            free(idx->table);
+            free(idx->ents);
+        }
+
+        free(idx);
+    }
+}
+
+/* Use the index that genromfs put into the image, if there is one. This is
+   stored little-endian so that it can be used in place. */
+static rd_index_t *rd_index_load(rd_image_t *mnt) {
+    const rd_index_trailer_t *tr;
+    const rd_index_hdr_t *ih;
+    rd_index_t *idx;
+    uint32 size, off;
+
+    size = ntohl_32(&mnt->hdr->full_size);
+
+    if(size < mnt->files + sizeof(rd_index_trailer_t) ||
+       ((ptr_t)mnt->image & 3))
+        return NULL;
+
+    tr = (const rd_index_trailer_t *)(mnt->image + size -
+                                      sizeof(rd_index_trailer_t));
+
+    if(memcmp(tr->magic, RD_INDEX_MAGIC, 8))
+        return NULL;
+
+    /* Sanity check everything before trusting it. */
+    off = tr->offset;
+
+    if((off & 3) || off < mnt->files || tr->size < sizeof(rd_index_hdr_t) ||
+       tr->size > size - sizeof(rd_index_trailer_t) - off)
+        return NULL;
+
+    ih = (const rd_index_hdr_t *)(mnt->image + off);
+
+    if(ih->version != RD_INDEX_VERSION || !ih->count ||
+       ih->table_size <= ih->count || (ih->table_size & (ih->table_size - 1)) ||
+       ih->count > tr->size / sizeof(rd_index_ent_t) ||
+       ih->table_size > tr->size / sizeof(uint32) ||
+       sizeof(rd_index_hdr_t) + ih->count * sizeof(rd_index_ent_t) +
+       ih->table_size * sizeof(uint32) > tr->size)
+        return NULL;
+
+    if(!(idx = (rd_index_t *)malloc(sizeof(rd_index_t))))
+        return NULL;
+
+    idx->ents = (rd_index_ent_t *)(ih + 1);
+    idx->count = idx->max = ih->count;
+    idx->table = (uint32 *)(idx->ents + ih->count);
+    idx->mask = ih->table_size - 1;
+    idx->limit = off - sizeof(romdisk_file_t);
+    idx->in_image = true;
+
+    return idx;
+}
+
+/* Build the path index for a newly mounted image. If we can't (out of memory),
+   lookups will just walk the image like they always have. */
+static rd_index_t *rd_index_build(rd_image_t *mnt) {
+    rd_index_t *idx;
+    uint32 i, sz, slot;
+
+    if(!(idx = (rd_index_t *)malloc(sizeof(rd_index_t))))
+        return NULL;
+
+    memset(idx, 0, sizeof(rd_index_t));
+    idx->limit = 0xffffffff;
+
+    if(rd_index_scan(mnt, idx, mnt->files, RD_HASH_INIT, RD_INDEX_NO_PARENT,
+                     0) || !idx->count)
+        goto fail;
+
+    /* Keep the table at most half full. */
+    for(sz = 16; sz < idx->count * 2; sz <<= 1) ;
+
+    if(!(idx->table = (uint32 *)malloc(sz * sizeof(uint32))))
+        goto fail;
+
+    memset(idx->table, 0, sz * sizeof(uint32));
+    idx->mask = sz - 1;
+
+    /* Insert in image order, so that among entries with the same path the
+       one that a walk of the image would find first also comes first here. */
+    for(i = 0; i < idx->count; ++i) {
+        slot = idx->ents[i].hash & idx->mask;
+
+        while(idx->table[slot])
+            slot = (slot + 1) & idx->mask;
+
+        idx->table[slot] = i + 1;
+    }
+
+    return idx;
+
+fail:
+    rd_index_free(idx);
+    return NULL;
+}
+
+/* Check that the given index entry really is the path made up of the given
+   components, by comparing names while walking up the parent entries. */
+static bool rd_index_match(rd_image_t *mnt, uint32 ent, const char **comp,
+                           const size_t *clen, int ncomp) {
+    const rd_index_t *idx = mnt->index;
+    const romdisk_file_t *fhdr;
+
+    while(ncomp--) {
+        if(ent >= idx->count || idx->ents[ent].offset > idx->limit)
+            return false;
+
+        fhdr = (const romdisk_file_t *)(mnt->image + idx->ents[ent].offset);
+
+        if(strlen(fhdr->filename) != clen[ncomp] ||
+           strncasecmp(fhdr->filename, comp[ncomp], clen[ncomp]))
+            return false;
+
+        ent = idx->ents[ent].parent;
+    }
+
+    return ent == RD_INDEX_NO_PARENT;
+}
+
+/* Look up a path in the index. Returns the header offset of the object, 0 if
+   it doesn't exist, or -1 if the index can't handle the path. */
+static int64_t rd_index_find(rd_image_t *mnt, const char *fn, bool dir) {
+    const rd_index_t *idx = mnt->index;
+    const char *comp[RD_INDEX_MAX_DEPTH + 1];
+    size_t clen[RD_INDEX_MAX_DEPTH + 1];
+    const char *cur;
+    int ncomp = 0;
+    uint32 hash = RD_HASH_INIT, slot, ent, type, probes;
+
+    /* Split the path into its components, skipping empty ones. */
+    while(*fn) {
+        if(*fn == '/') {
+            ++fn;
+            continue;
+        }
+
+        if(ncomp > RD_INDEX_MAX_DEPTH)
+            return -1;
+
+        if(!(cur = strchr(fn, '/')))
+            cur = fn + strlen(fn);
+
+        comp[ncomp] = fn;
+        clen[ncomp] = cur - fn;
+
+        /* The . and .. entries aren't in the index. */
+        if(fn[0] == '.' && (clen[ncomp] == 1 ||
+                            (clen[ncomp] == 2 && fn[1] == '.')))
+            return -1;
+
+        if(ncomp)
+            hash = rd_hash_add(hash, "/", 1);
+
+        hash = rd_hash_add(hash, fn, clen[ncomp]);
+        ++ncomp;
+        fn = cur;
+    }
+
+    /* The root directory and paths with a trailing slash are left to the
+       normal lookup, which has its own rules about what they return. */
+    if(!ncomp || fn[-1] == '/')
+        return -1;
+
+    for(slot = hash & idx->mask, probes = 0;
+        idx->table[slot] && probes <= idx->mask;
+        slot = (slot + 1) & idx->mask, ++probes) {
+        ent = idx->table[slot] - 1;
+
+        if(ent >= idx->count || idx->ents[ent].offset > idx->limit)
+            break;
+
+        if(idx->ents[ent].hash != hash)
+            continue;
+
+        type = ntohl_32(mnt->image + idx->ents[ent].offset) & ROMFH_MASK;
+
+        if((type == ROMFH_DIR) != dir)
+            continue;
+
+        if(rd_index_match(mnt, ent, comp, clen, ncomp))
+            return idx->ents[ent].offset;
+    }
+
+    return 0;
+}
+#endif /* FS_ROMDISK_INDEX */
+
 /* Locate an object anywhere in the image, starting at the root, and
    expecting a fully qualified path name. This is analogous to the
    find_object_path in iso9660.
@@ -182,6 +506,13 @@ static uint32_t romdisk_find(rd_image_t *mnt, const char *fn, bool dir) {
     uint32          i;
     const romdisk_file_t    *fhdr;
 
+#if FS_ROMDISK_INDEX
+    int64_t         rv;
+
+    if(mnt->index && (rv = rd_index_find(mnt, fn, dir)) >= 0)
+        return (uint32_t)rv;
+#endif
+
     /* If the object is in a sub-tree, traverse the trees looking
        for the right directory. */
     i = mnt->files;
@@ -508,8 +839,40 @@ static int romdisk_stat(vfs_handler_t *vfs, const char *path, struct stat *st,
     return 0;
 }
 
+static int romdisk_ioctl(void *h, int cmd, va_list ap) {
+    file_t fd = (file_t)h;
+    struct iovec *iov = va_arg(ap, struct iovec *);
+
+    if(fd >= FS_ROMDISK_MAX_FILES || fh[fd].index == FH_INDEX_FREE || fh[fd].dir) {
+        errno = EBADF;
+        return -1;
+    }
+
+    switch(cmd) {
+        case ROMDISK_IOCTL_READPTR:
+            if(!iov) {
+                errno = EFAULT;
+                return -1;
+            }
+
+            /* Same as romdisk_read, just without the memcpy. */
+            if(iov->iov_len > fh[fd].size - fh[fd].ptr)
+                iov->iov_len = fh[fd].size - fh[fd].ptr;
+
+            iov->iov_base = (void *)(fh[fd].mnt->image + fh[fd].index +
+                                     fh[fd].ptr);
+            fh[fd].ptr += iov->iov_len;
+            return 0;
+
+        default:
+            errno = ENOTTY;
+            return -1;
+    }
+}
+
 static int romdisk_fcntl(void *h, int cmd, va_list ap) {
     file_t fd = (file_t)h;
+    ptr_t addr;
     int rv = -1;
 
     (void)ap;
@@ -534,6 +897,15 @@ static int romdisk_fcntl(void *h, int cmd, va_list ap) {
             rv = 0;
             break;
 
+        case ROMDISK_F_GETALIGN:
+            addr = (ptr_t)(fh[fd].mnt->image + fh[fd].index);
+            rv = (int)(addr & -addr);
+
+            if(!rv || rv > ROMDISK_MAX_ALIGN)
+                rv = ROMDISK_MAX_ALIGN;
+
+            break;
+
         default:
             errno = EINVAL;
     }
@@ -598,7 +970,7 @@ static vfs_handler_t vh = {
     romdisk_tell,
     romdisk_total,
     romdisk_readdir,
-    NULL,                       /* ioctl */
+    romdisk_ioctl,
     NULL,                       /* rename */
     romdisk_unlink,
     romdisk_mmap,
@@ -665,6 +1037,9 @@ void fs_romdisk_shutdown(void) {
         if(c->own_buffer)
             free((void *)c->image);
 
+#if FS_ROMDISK_INDEX
+        rd_index_free(c->index);
+#endif
         nmmgr_handler_remove(&c->vfsh->nmmgr);
         free(c->vfsh);
         free(c);
@@ -715,11 +1090,23 @@ int fs_romdisk_mount(const char * mountpoint, const uint8 *img, int own_buffer)
     mnt->hdr = hdr;
     mnt->files = sizeof(romdisk_hdr_t)
                  + (strlen(hdr->volume_name) / RD_VN_MAX) * RD_VN_MAX;
+    mnt->index = NULL;
+
+#if FS_ROMDISK_INDEX
+    /* Use the index from the image, or build one if there isn't any. */
+    if(!(mnt->index = rd_index_load(mnt)) &&
+       !(mnt->index = rd_index_build(mnt)))
+        dbglog(DBG_DEBUG, "fs_romdisk: couldn't build index for image at %p\n",
+               img);
+#endif
 
     /* Make a VFS struct */
     vfsh = (vfs_handler_t *)malloc(sizeof(vfs_handler_t));
 
     if(vfsh == NULL) {
+#if FS_ROMDISK_INDEX
+        rd_index_free(mnt->index);
+#endif
         free(mnt);
         errno=ENOMEM;
         return -3;
@@ -773,6 +1160,9 @@ int fs_romdisk_unmount(const char * mountpoint) {
             free((void *)n->image);
 
         /* Free the structs */
+#if FS_ROMDISK_INDEX
+        rd_index_free(n->index);
+#endif
         free(n->vfsh);
         free(n);
     }
@@ -13,6 +13,8 @@
 #include <errno.h>
 #include <string.h>
 #include <malloc.h>
+#include <poll.h>
+#include <time.h>
 #include <sys/queue.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -504,6 +506,256 @@ ssize_t sendto(int sock, const void *message, size_t length, int flags,
                                  dest_len);
 }
 
+/* Add up the lengths of the buffers in a message. */
+static ssize_t msg_iov_len(const struct msghdr *msg) {
+    size_t total = 0;
+    int i;
+
+    if(msg->msg_iovlen < 0 || msg->msg_iovlen > IOV_MAX) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    if(msg->msg_iovlen && !msg->msg_iov) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    for(i = 0; i < msg->msg_iovlen; ++i)
+        total += msg->msg_iov[i].iov_len;
+
+    return (ssize_t)total;
+}
+
+/* Receive one message through recvfrom(), for protocols that don't do
+   recvmmsg() themselves. */
+static ssize_t recv_one(net_socket_t *hnd, struct msghdr *msg, int flags) {
+    ssize_t len, rv, tmp;
+    uint8_t *buf;
+    int i;
+
+    if((len = msg_iov_len(msg)) < 0)
+        return -1;
+
+    msg->msg_flags = 0;
+
+    /* With only one buffer, there's nothing to scatter. */
+    if(msg->msg_iovlen == 1)
+        return hnd->protocol->recvfrom(hnd, msg->msg_iov[0].iov_base, len,
+                                       flags, msg->msg_name,
+                                       msg->msg_name ? &msg->msg_namelen :
+                                       NULL);
+
+    if(!(buf = (uint8_t *)malloc(len ? len : 1))) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    rv = hnd->protocol->recvfrom(hnd, buf, len, flags, msg->msg_name,
+                                 msg->msg_name ? &msg->msg_namelen : NULL);
+
+    for(i = 0, len = 0; i < msg->msg_iovlen && len < rv; ++i) {
+        tmp = msg->msg_iov[i].iov_len;
+
+        if(tmp > rv - len)
+            tmp = rv - len;
+
+        memcpy(msg->msg_iov[i].iov_base, buf + len, tmp);
+        len += tmp;
+    }
+
+    free(buf);
+    return rv;
+}
+
+/* Send one message through sendto(), for protocols that don't do sendmmsg()
+   themselves. */
+static ssize_t send_one(net_socket_t *hnd, const struct msghdr *msg,
+                        int flags) {
+    ssize_t len, rv;
+    uint8_t *buf;
+    int i;
+
+    if((len = msg_iov_len(msg)) < 0)
+        return -1;
+
+    /* With only one buffer, there's nothing to gather. */
+    if(msg->msg_iovlen == 1)
+        return hnd->protocol->sendto(hnd, msg->msg_iov[0].iov_base, len,
+                                     flags, msg->msg_name, msg->msg_namelen);
+
+    if(!(buf = (uint8_t *)malloc(len ? len : 1))) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    for(i = 0, len = 0; i < msg->msg_iovlen; ++i) {
+        memcpy(buf + len, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+        len += msg->msg_iov[i].iov_len;
+    }
+
+    rv = hnd->protocol->sendto(hnd, buf, len, flags, msg->msg_name,
+                               msg->msg_namelen);
+
+    free(buf);
+    return rv;
+}
+
+int recvmmsg(int sock, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+             struct timespec *timeout) {
+    net_socket_t *hnd;
+    struct pollfd pfd;
+    unsigned int i;
+    ssize_t rv;
+    int ms = 0;
+
+    hnd = (net_socket_t *)fs_get_handle(sock);
+
+    if(hnd == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+
+    /* Make sure this is actually a socket. */
+    if(fs_get_handler(sock) != &vh) {
+        errno = ENOTSOCK;
+        return -1;
+    }
+
+    if(!msgvec) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    if(!vlen)
+        return 0;
+
+    if(vlen > IOV_MAX)
+        vlen = IOV_MAX;
+
+    if(timeout) {
+        /* Round up to the next millisecond, so that a short timeout doesn't
+           turn into not waiting at all. Only a timeout of zero means that. */
+        ms = timeout->tv_sec * 1000 + (timeout->tv_nsec + 999999) / 1000000;
+
+        if(!ms)
+            flags |= MSG_DONTWAIT;
+    }
+
+    if(hnd->protocol->recvmmsg)
+        return hnd->protocol->recvmmsg(hnd, msgvec, vlen, flags, ms);
+
+    if(ms && !(flags & MSG_DONTWAIT)) {
+        pfd.fd = sock;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        /* Nothing has been received yet, so there's no partial count to
+           return if this fails. */
+        if((rv = poll(&pfd, 1, ms)) < 0)
+            return -1;
+
+        if(!rv) {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+
+    for(i = 0; i < vlen; ++i) {
+        if((rv = recv_one(hnd, &msgvec[i].msg_hdr, flags)) < 0)
+            return i ? (int)i : -1;
+
+        msgvec[i].msg_len = rv;
+
+        /* Don't wait around for anything after the first message. */
+        flags |= MSG_DONTWAIT;
+
+        /* A stream socket that has been shut down won't give us any more. */
+        if(!rv)
+            return i + 1;
+    }
+
+    return i;
+}
+
+ssize_t recvmsg(int sock, struct msghdr *message, int flags) {
+    struct mmsghdr msg;
+
+    if(!message) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    msg.msg_hdr = *message;
+    msg.msg_len = 0;
+
+    if(recvmmsg(sock, &msg, 1, flags, NULL) < 0)
+        return -1;
+
+    message->msg_namelen = msg.msg_hdr.msg_namelen;
+    message->msg_flags = msg.msg_hdr.msg_flags;
+    return msg.msg_len;
+}
+
+int sendmmsg(int sock, struct mmsghdr *msgvec, unsigned int vlen, int flags) {
+    net_socket_t *hnd;
+    unsigned int i;
+    ssize_t rv;
+
+    hnd = (net_socket_t *)fs_get_handle(sock);
+
+    if(hnd == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+
+    /* Make sure this is actually a socket. */
+    if(fs_get_handler(sock) != &vh) {
+        errno = ENOTSOCK;
+        return -1;
+    }
+
+    if(!msgvec) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    if(!vlen)
+        return 0;
+
+    if(vlen > IOV_MAX)
+        vlen = IOV_MAX;
+
+    if(hnd->protocol->sendmmsg)
+        return hnd->protocol->sendmmsg(hnd, msgvec, vlen, flags);
+
+    for(i = 0; i < vlen; ++i) {
+        if((rv = send_one(hnd, &msgvec[i].msg_hdr, flags)) < 0)
+            return i ? (int)i : -1;
+
+        msgvec[i].msg_len = rv;
+    }
+
+    return i;
+}
+
+ssize_t sendmsg(int sock, const struct msghdr *message, int flags) {
+    struct mmsghdr msg;
+
+    if(!message) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    msg.msg_hdr = *message;
+    msg.msg_len = 0;
+
+    if(sendmmsg(sock, &msg, 1, flags) < 0)
+        return -1;
+
+    return msg.msg_len;
+}
+
 int shutdown(int sock, int how) {
     net_socket_t *hnd;
 
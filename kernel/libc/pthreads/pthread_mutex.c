@@ -14,7 +14,9 @@
 /* Mutex Initialization Attributes, P1003.1c/Draft 10, p. 81 */
 
 int pthread_mutexattr_init(pthread_mutexattr_t *attr) {
-    (void)attr;
+    assert(attr);
+
+    attr->protocol = PTHREAD_PRIO_NONE;
     return 0;
 }
 
@@ -38,10 +40,14 @@ int pthread_mutexattr_setpshared(pthread_mutexattr_t *attr, int pshared) {
 /* Initializing and Destroying a Mutex, P1003.1c/Draft 10, p. 87 */
 
 int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr) {
-    (void)attr;
+    int type = MUTEX_TYPE_NORMAL;
+
     assert(mutex);
 
-    return mutex_init(mutex, MUTEX_TYPE_NORMAL);
+    if(attr && attr->protocol == PTHREAD_PRIO_INHERIT)
+        type |= MUTEX_PRIO_INHERIT;
+
+    return mutex_init(mutex, type);
 }
 
 int pthread_mutex_destroy(pthread_mutex_t *mutex) {
@@ -74,15 +80,28 @@ int pthread_mutex_unlock(pthread_mutex_t *mutex) {
 /* Mutex Initialization Scheduling Attributes, P1003.1c/Draft 10, p. 128 */
 
 int pthread_mutexattr_setprotocol(pthread_mutexattr_t *attr, int protocol) {
-    (void)attr;
-    (void)protocol;
-    return 0;
+    assert(attr);
+
+    switch(protocol) {
+        case PTHREAD_PRIO_NONE:
+        case PTHREAD_PRIO_INHERIT:
+            attr->protocol = protocol;
+            return 0;
+
+        case PTHREAD_PRIO_PROTECT:
+            return ENOTSUP;
+
+        default:
+            return EINVAL;
+    }
 }
 
 int pthread_mutexattr_getprotocol(const pthread_mutexattr_t *attr, int *protocol) {
-    (void)attr;
-    (void)protocol;
-    return EINVAL;
+    assert(attr);
+    assert(protocol);
+
+    *protocol = attr->protocol;
+    return 0;
 }
 
 int pthread_mutexattr_setprioceiling(pthread_mutexattr_t *attr, int prioceiling) {
@@ -0,0 +1,838 @@
+/* KallistiOS ##version##
+
+   kernel/net/host/host.c
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* This is just enough of KOS to run the network stack as a normal program on
+   the host (see Makefile.nonkos), so that it can be benchmarked and tested
+   over the loopback device without needing a Dreamcast.
+
+   Each KOS thread is a pthread, but only one of them is allowed to run at a
+   time, just like on the real thing. Whichever thread holds the "CPU" runs
+   until it blocks in genwait_wait(), sleeps, passes, or is preempted, and the
+   CPU is then handed to the other threads in the order that they asked for
+   it. Preemption can only happen when the running thread reads one of the
+   timers with interrupts enabled, which is enough to keep threads that poll
+   the clock from starving everyone else.
+
+   Everything that sleeps (mutexes, semaphores, condition variables and so on)
+   is built on genwait, the same way it is in the kernel. They don't do
+   priorities, spinning, or keep statistics, as none of that makes much sense
+   here. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include <kos/thread.h>
+#include <kos/genwait.h>
+#include <kos/mutex.h>
+#include <kos/rwsem.h>
+#include <kos/cond.h>
+#include <kos/sem.h>
+#include <kos/fs.h>
+#include <kos/nmmgr.h>
+#include <kos/dbglog.h>
+#include <kos/net.h>
+#include <arch/arch.h>
+#include <arch/irq.h>
+#include <arch/timer.h>
+#include <dc/maple/controller.h>
+
+/* How long a thread can run for before it can be preempted, in microseconds */
+#define HOST_TIMESLICE  1000
+
+/* Where file descriptors for sockets start, to keep them clear of the
+   host's own. */
+#define HOST_FD_BASE    1024
+#define HOST_FD_COUNT   256
+
+enum {
+    WAIT_NONE,
+    WAIT_BLOCKED,
+    WAIT_WOKEN,
+    WAIT_TIMEDOUT
+};
+
+struct kthread {
+    TAILQ_ENTRY(kthread) wait_list;
+    pthread_t pthd;
+    pthread_cond_t cv;
+    void *(*routine)(void *);
+    void *param;
+    void *rv;
+    bool detach;
+    irq_mask_t irq;
+    void *wait_obj;
+    int wait_state;
+    int wait_err;
+    char label[32];
+};
+
+static TAILQ_HEAD(, kthread) waiters = TAILQ_HEAD_INITIALIZER(waiters);
+
+/* Protects all of the scheduler state below. */
+static pthread_mutex_t sched_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cpu_cv = PTHREAD_COND_INITIALIZER;
+static unsigned long cpu_next, cpu_serving;
+static int cpu_waiting;
+static uint64_t cpu_since;
+
+/* Only touched by whoever has the CPU. */
+static irq_mask_t irq_state;
+static __thread kthread_t *thd_self;
+static kthread_t thd_main = { .label = "main" };
+
+/* Weak, so that programs that don't use KOS_INIT_FLAGS() still link. */
+extern const uint32_t __kos_init_flags __attribute__((weak));
+static int net_up;
+
+static uint64_t host_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Take a ticket and wait for our turn on the CPU. Called with sched_lock
+   held. */
+static void cpu_get(kthread_t *self) {
+    unsigned long ticket = cpu_next++;
+
+    ++cpu_waiting;
+
+    while(ticket != cpu_serving)
+        pthread_cond_wait(&cpu_cv, &sched_lock);
+
+    --cpu_waiting;
+    cpu_since = host_now_ns() / 1000;
+    irq_state = self->irq;
+}
+
+/* Give up the CPU to whoever is next in line. Called with sched_lock held. */
+static void cpu_put(kthread_t *self) {
+    self->irq = irq_state;
+    ++cpu_serving;
+    pthread_cond_broadcast(&cpu_cv);
+}
+
+static void host_yield(void) {
+    pthread_mutex_lock(&sched_lock);
+    cpu_put(thd_self);
+    cpu_get(thd_self);
+    pthread_mutex_unlock(&sched_lock);
+}
+
+/* Let someone else run if we've had the CPU for long enough. */
+static void host_preempt(uint64_t now_us) {
+    int yield;
+
+    if(irq_state)
+        return;
+
+    pthread_mutex_lock(&sched_lock);
+    yield = cpu_waiting && now_us - cpu_since >= HOST_TIMESLICE;
+    pthread_mutex_unlock(&sched_lock);
+
+    if(yield)
+        host_yield();
+}
+
+/* Timers */
+uint64_t timer_ns_gettime64(void) {
+    return host_now_ns();
+}
+
+uint64_t timer_us_gettime64(void) {
+    uint64_t now = host_now_ns() / 1000;
+
+    host_preempt(now);
+    return now;
+}
+
+uint64_t timer_ms_gettime64(void) {
+    uint64_t now = host_now_ns() / 1000;
+
+    host_preempt(now);
+    return now / 1000;
+}
+
+/* Interrupts */
+int irq_inside_int(void) {
+    return 0;
+}
+
+irq_mask_t irq_disable(void) {
+    irq_mask_t old = irq_state;
+
+    irq_state = 1;
+    return old;
+}
+
+void irq_enable(void) {
+    irq_state = 0;
+}
+
+void irq_restore(irq_mask_t v) {
+    irq_state = v;
+}
+
+/* Threads */
+static void *thd_trampoline(void *data) {
+    kthread_t *self = (kthread_t *)data;
+
+    thd_self = self;
+
+    pthread_mutex_lock(&sched_lock);
+    cpu_get(self);
+    pthread_mutex_unlock(&sched_lock);
+
+    self->rv = self->routine(self->param);
+
+    pthread_mutex_lock(&sched_lock);
+    cpu_put(self);
+    pthread_mutex_unlock(&sched_lock);
+
+    if(self->detach) {
+        pthread_cond_destroy(&self->cv);
+        free(self);
+    }
+
+    return NULL;
+}
+
+kthread_t *thd_create(bool detach, void *(*routine)(void *param),
+                      void *param) {
+    kthread_t *thd;
+
+    if(!(thd = (kthread_t *)calloc(1, sizeof(kthread_t)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    thd->routine = routine;
+    thd->param = param;
+    thd->detach = detach;
+    pthread_cond_init(&thd->cv, NULL);
+
+    if(pthread_create(&thd->pthd, NULL, thd_trampoline, thd)) {
+        pthread_cond_destroy(&thd->cv);
+        free(thd);
+        errno = EAGAIN;
+        return NULL;
+    }
+
+    if(detach)
+        pthread_detach(thd->pthd);
+
+    return thd;
+}
+
+int thd_join(kthread_t *thd, void **value_ptr) {
+    if(!thd || thd == thd_self || thd->detach) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&sched_lock);
+    cpu_put(thd_self);
+    pthread_mutex_unlock(&sched_lock);
+
+    pthread_join(thd->pthd, NULL);
+
+    pthread_mutex_lock(&sched_lock);
+    cpu_get(thd_self);
+    pthread_mutex_unlock(&sched_lock);
+
+    if(value_ptr)
+        *value_ptr = thd->rv;
+
+    pthread_cond_destroy(&thd->cv);
+    free(thd);
+    return 0;
+}
+
+/* There's no safe way to kill a pthread that might be holding the CPU, and the
+   stack only does this from inside an interrupt, which never happens here. */
+int thd_destroy(kthread_t *thd) {
+    (void)thd;
+    errno = EPERM;
+    return -1;
+}
+
+void thd_pass(void) {
+    host_yield();
+}
+
+void thd_sleep(unsigned ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000 };
+
+    pthread_mutex_lock(&sched_lock);
+    cpu_put(thd_self);
+    pthread_mutex_unlock(&sched_lock);
+
+    nanosleep(&ts, NULL);
+
+    pthread_mutex_lock(&sched_lock);
+    cpu_get(thd_self);
+    pthread_mutex_unlock(&sched_lock);
+}
+
+kthread_t *thd_get_current(void) {
+    return thd_self;
+}
+
+int thd_set_label(kthread_t *thd, const char *label) {
+    strncpy(thd->label, label, sizeof(thd->label) - 1);
+    return 0;
+}
+
+/* Generic wait/wake */
+int genwait_wait(void *obj, const char *mesg, int timeout,
+                 void (*callback)(void *)) {
+    kthread_t *self = thd_self;
+    struct timespec ts;
+    uint64_t end;
+    int state;
+
+    (void)mesg;
+
+    pthread_mutex_lock(&sched_lock);
+
+    self->wait_obj = obj;
+    self->wait_state = WAIT_BLOCKED;
+    self->wait_err = 0;
+    TAILQ_INSERT_TAIL(&waiters, self, wait_list);
+    cpu_put(self);
+
+    if(timeout) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        end = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec +
+              (uint64_t)timeout * 1000000ULL;
+        ts.tv_sec = end / 1000000000ULL;
+        ts.tv_nsec = end % 1000000000ULL;
+    }
+
+    while(self->wait_state == WAIT_BLOCKED) {
+        if(!timeout) {
+            pthread_cond_wait(&self->cv, &sched_lock);
+        }
+        else if(pthread_cond_timedwait(&self->cv, &sched_lock, &ts) ==
+                ETIMEDOUT && self->wait_state == WAIT_BLOCKED) {
+            TAILQ_REMOVE(&waiters, self, wait_list);
+            self->wait_state = WAIT_TIMEDOUT;
+        }
+    }
+
+    state = self->wait_state;
+    self->wait_state = WAIT_NONE;
+    self->wait_obj = NULL;
+    cpu_get(self);
+
+    pthread_mutex_unlock(&sched_lock);
+
+    if(state == WAIT_TIMEDOUT) {
+        if(callback)
+            callback(obj);
+
+        errno = EAGAIN;
+        return -1;
+    }
+
+    if(self->wait_err) {
+        errno = self->wait_err;
+        return -1;
+    }
+
+    return 0;
+}
+
+static int genwait_wake(void *obj, kthread_t *thd, int cnt, int err) {
+    kthread_t *t, *tmp;
+    int woken = 0;
+
+    pthread_mutex_lock(&sched_lock);
+
+    TAILQ_FOREACH_SAFE(t, &waiters, wait_list, tmp) {
+        if(t->wait_obj != obj || (thd && t != thd))
+            continue;
+
+        TAILQ_REMOVE(&waiters, t, wait_list);
+        t->wait_state = WAIT_WOKEN;
+        t->wait_err = err;
+        pthread_cond_signal(&t->cv);
+
+        if(++woken == cnt)
+            break;
+    }
+
+    pthread_mutex_unlock(&sched_lock);
+
+    return woken;
+}
+
+int genwait_wake_cnt(void *obj, int cnt, int err) {
+    return genwait_wake(obj, NULL, cnt, err);
+}
+
+void genwait_wake_all(void *obj) {
+    genwait_wake(obj, NULL, -1, 0);
+}
+
+void genwait_wake_one(void *obj) {
+    genwait_wake(obj, NULL, 1, 0);
+}
+
+void genwait_wake_all_err(void *obj, int err) {
+    genwait_wake(obj, NULL, -1, err);
+}
+
+void genwait_wake_one_err(void *obj, int err) {
+    genwait_wake(obj, NULL, 1, err);
+}
+
+int genwait_wake_thd(void *obj, kthread_t *thd, int err) {
+    return genwait_wake(obj, thd, 1, err);
+}
+
+/* Mutexes */
+int mutex_init(mutex_t *m, int mtype) {
+    memset(m, 0, sizeof(mutex_t));
+    m->type = mtype & ~MUTEX_PRIO_INHERIT;
+    m->flags = mtype & MUTEX_PRIO_INHERIT;
+    return 0;
+}
+
+int mutex_destroy(mutex_t *m) {
+    if(m->holder) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    return 0;
+}
+
+int mutex_lock_timed(mutex_t *m, int timeout) {
+    uint64_t end = timeout ? timer_ms_gettime64() + timeout : 0, now;
+
+    if(m->holder == thd_self) {
+        if(m->type == MUTEX_TYPE_RECURSIVE) {
+            ++m->count;
+            return 0;
+        }
+
+        errno = EDEADLK;
+        return -1;
+    }
+
+    while(m->holder) {
+        if(timeout && (now = timer_ms_gettime64()) >= end) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+
+        if(genwait_wait(m, "mutex_lock", timeout ? (int)(end - now) : 0,
+                        NULL) < 0 && errno != EAGAIN)
+            return -1;
+    }
+
+    m->holder = thd_self;
+    m->count = 1;
+    return 0;
+}
+
+int mutex_lock(mutex_t *m) {
+    return mutex_lock_timed(m, 0);
+}
+
+int mutex_lock_irqsafe(mutex_t *m) {
+    return mutex_lock_timed(m, 0);
+}
+
+int mutex_is_locked(mutex_t *m) {
+    return !!m->holder;
+}
+
+int mutex_trylock(mutex_t *m) {
+    if(m->holder && m->holder != thd_self) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return mutex_lock_timed(m, 0);
+}
+
+int mutex_unlock(mutex_t *m) {
+    if(m->holder != thd_self) {
+        errno = EPERM;
+        return -1;
+    }
+
+    if(!--m->count) {
+        m->holder = NULL;
+        genwait_wake_one(m);
+    }
+
+    return 0;
+}
+
+/* Reader/writer semaphores */
+int rwsem_init(rw_semaphore_t *s) {
+    memset(s, 0, sizeof(rw_semaphore_t));
+    return 0;
+}
+
+int rwsem_destroy(rw_semaphore_t *s) {
+    if(s->read_count || s->write_lock) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    return 0;
+}
+
+int rwsem_read_lock_timed(rw_semaphore_t *s, int timeout) {
+    while(s->write_lock) {
+        if(genwait_wait(s, "rwsem_read_lock", timeout, NULL) < 0) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+    }
+
+    ++s->read_count;
+    return 0;
+}
+
+int rwsem_read_lock(rw_semaphore_t *s) {
+    return rwsem_read_lock_timed(s, 0);
+}
+
+int rwsem_read_lock_irqsafe(rw_semaphore_t *s) {
+    return rwsem_read_lock_timed(s, 0);
+}
+
+int rwsem_write_lock_timed(rw_semaphore_t *s, int timeout) {
+    while(s->write_lock || s->read_count) {
+        if(genwait_wait(s, "rwsem_write_lock", timeout, NULL) < 0) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+    }
+
+    s->write_lock = thd_self;
+    return 0;
+}
+
+int rwsem_write_lock(rw_semaphore_t *s) {
+    return rwsem_write_lock_timed(s, 0);
+}
+
+int rwsem_write_lock_irqsafe(rw_semaphore_t *s) {
+    return rwsem_write_lock_timed(s, 0);
+}
+
+int rwsem_read_unlock(rw_semaphore_t *s) {
+    if(!s->read_count) {
+        errno = EPERM;
+        return -1;
+    }
+
+    if(!--s->read_count)
+        genwait_wake_all(s);
+
+    return 0;
+}
+
+int rwsem_write_unlock(rw_semaphore_t *s) {
+    if(s->write_lock != thd_self) {
+        errno = EPERM;
+        return -1;
+    }
+
+    s->write_lock = NULL;
+    genwait_wake_all(s);
+    return 0;
+}
+
+int rwsem_unlock(rw_semaphore_t *s) {
+    if(s->write_lock)
+        return rwsem_write_unlock(s);
+
+    return rwsem_read_unlock(s);
+}
+
+int rwsem_read_trylock(rw_semaphore_t *s) {
+    if(s->write_lock) {
+        errno = EWOULDBLOCK;
+        return -1;
+    }
+
+    ++s->read_count;
+    return 0;
+}
+
+int rwsem_write_trylock(rw_semaphore_t *s) {
+    if(s->write_lock || s->read_count) {
+        errno = EWOULDBLOCK;
+        return -1;
+    }
+
+    s->write_lock = thd_self;
+    return 0;
+}
+
+int rwsem_read_count(rw_semaphore_t *s) {
+    return s->read_count;
+}
+
+int rwsem_write_locked(rw_semaphore_t *s) {
+    return !!s->write_lock;
+}
+
+/* Condition variables */
+int cond_init(condvar_t *cv) {
+    memset(cv, 0, sizeof(condvar_t));
+    return 0;
+}
+
+int cond_destroy(condvar_t *cv) {
+    genwait_wake_all_err(cv, ENOTRECOVERABLE);
+    return 0;
+}
+
+int cond_wait_timed(condvar_t *cv, mutex_t *m, int timeout) {
+    int rv;
+
+    /* We keep the CPU between unlocking the mutex and going to sleep, so
+       there's no chance of missing a signal in between. */
+    if(mutex_unlock(m))
+        return -1;
+
+    rv = genwait_wait(cv, "cond_wait", timeout, NULL);
+    mutex_lock(m);
+
+    if(rv < 0 && errno == EAGAIN)
+        errno = ETIMEDOUT;
+
+    return rv;
+}
+
+int cond_wait(condvar_t *cv, mutex_t *m) {
+    return cond_wait_timed(cv, m, 0);
+}
+
+int cond_signal(condvar_t *cv) {
+    genwait_wake_one(cv);
+    return 0;
+}
+
+int cond_broadcast(condvar_t *cv) {
+    genwait_wake_all(cv);
+    return 0;
+}
+
+/* Semaphores */
+int sem_init(semaphore_t *sm, int count) {
+    memset(sm, 0, sizeof(semaphore_t));
+    sm->initialized = 1;
+    sm->count = count;
+    return 0;
+}
+
+int sem_destroy(semaphore_t *sem) {
+    genwait_wake_all_err(sem, ENOTRECOVERABLE);
+    sem->initialized = 0;
+    return 0;
+}
+
+int sem_wait_timed(semaphore_t *sem, int timeout) {
+    while(sem->count <= 0) {
+        if(genwait_wait(sem, "sem_wait", timeout, NULL) < 0) {
+            if(errno == EAGAIN)
+                errno = ETIMEDOUT;
+
+            return -1;
+        }
+    }
+
+    --sem->count;
+    return 0;
+}
+
+int sem_wait(semaphore_t *sem) {
+    return sem_wait_timed(sem, 0);
+}
+
+int sem_trywait(semaphore_t *sem) {
+    if(sem->count <= 0) {
+        errno = EWOULDBLOCK;
+        return -1;
+    }
+
+    --sem->count;
+    return 0;
+}
+
+int sem_signal(semaphore_t *sem) {
+    ++sem->count;
+    genwait_wake_one(sem);
+    return 0;
+}
+
+int sem_count(semaphore_t *sem) {
+    return sem->count;
+}
+
+/* File descriptors. Only sockets live in here, and anything else is passed on
+   to the host. */
+static struct {
+    vfs_handler_t *handler;
+    void *hnd;
+} fds[HOST_FD_COUNT];
+
+static int fd_index(int fd) {
+    fd -= HOST_FD_BASE;
+
+    if(fd < 0 || fd >= HOST_FD_COUNT || !fds[fd].handler)
+        return -1;
+
+    return fd;
+}
+
+file_t fs_open_handle(vfs_handler_t *vfs, void *hnd) {
+    int i;
+
+    for(i = 0; i < HOST_FD_COUNT; ++i) {
+        if(!fds[i].handler) {
+            fds[i].handler = vfs;
+            fds[i].hnd = hnd;
+            return i + HOST_FD_BASE;
+        }
+    }
+
+    errno = EMFILE;
+    return -1;
+}
+
+vfs_handler_t *fs_get_handler(file_t fd) {
+    int i = fd_index(fd);
+
+    return i < 0 ? NULL : fds[i].handler;
+}
+
+void *fs_get_handle(file_t fd) {
+    int i = fd_index(fd);
+
+    return i < 0 ? NULL : fds[i].hnd;
+}
+
+int fs_close(file_t fd) {
+    int i = fd_index(fd), rv = 0;
+    vfs_handler_t *h;
+
+    if(i < 0) {
+        errno = EBADF;
+        return -1;
+    }
+
+    h = fds[i].handler;
+
+    if(h->close)
+        rv = h->close(fds[i].hnd);
+
+    fds[i].handler = NULL;
+    fds[i].hnd = NULL;
+    return rv;
+}
+
+int fs_fcntl(file_t fd, int cmd, ...) {
+    int i = fd_index(fd), rv;
+    va_list ap;
+
+    if(i < 0 || !fds[i].handler->fcntl) {
+        errno = EBADF;
+        return -1;
+    }
+
+    va_start(ap, cmd);
+    rv = fds[i].handler->fcntl(fds[i].hnd, cmd, ap);
+    va_end(ap);
+
+    return rv;
+}
+
+int close(int fd) {
+    if(fd >= HOST_FD_BASE)
+        return fs_close(fd);
+
+    return syscall(SYS_close, fd);
+}
+
+/* The socket VFS handler registers itself with the name manager, which there
+   is no need for here. */
+int nmmgr_handler_add(nmmgr_handler_t *hnd) {
+    (void)hnd;
+    return 0;
+}
+
+int nmmgr_handler_remove(nmmgr_handler_t *hnd) {
+    (void)hnd;
+    return 0;
+}
+
+/* Debug logging */
+static int dbglog_level = DBG_INFO;
+
+void dbglog_set_level(int level) {
+    dbglog_level = level;
+}
+
+void dbglog(int level, const char *fmt, ...) {
+    va_list args;
+
+    if(level > dbglog_level)
+        return;
+
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+/* Odds and ends the examples use */
+int cont_btn_callback(uint8_t addr, uint32_t btns, cont_btn_callback_t cb) {
+    (void)addr;
+    (void)btns;
+    (void)cb;
+    return 0;
+}
+
+void arch_exit(void) {
+    exit(0);
+}
+
+/* Start up with the main thread on the CPU, and the network up if the program
+   asked for it. */
+__attribute__((constructor)) static void host_init(void) {
+    pthread_cond_init(&thd_main.cv, NULL);
+    thd_self = &thd_main;
+
+    pthread_mutex_lock(&sched_lock);
+    cpu_get(&thd_main);
+    pthread_mutex_unlock(&sched_lock);
+
+    if(&__kos_init_flags && (__kos_init_flags & INIT_NET))
+        net_up = !net_init(0);
+}
+
+__attribute__((destructor)) static void host_shutdown(void) {
+    if(net_up && thd_self == &thd_main)
+        net_shutdown();
+}
@@ -0,0 +1,24 @@
+/* KallistiOS ##version##
+
+   kernel/net/host/include/arch/arch.h
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* Host stand-in for <arch/arch.h>. */
+
+#ifndef __ARCH_ARCH_H
+#define __ARCH_ARCH_H
+
+#include <sys/cdefs.h>
+__BEGIN_DECLS
+
+#include <arch/types.h>
+
+void arch_exit(void) __attribute__((noreturn));
+
+__END_DECLS
+
+#include <kos/init.h>
+
+#endif /* __ARCH_ARCH_H */
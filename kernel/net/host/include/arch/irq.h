@@ -0,0 +1,43 @@
+/* KallistiOS ##version##
+
+   kernel/net/host/include/arch/irq.h
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* Host stand-in for <arch/irq.h>. There are no interrupts on the host, but
+   host.c only ever lets one KOS thread run at a time, and won't switch away
+   from one that has "interrupts" disabled, which is what the code using these
+   is relying on. */
+
+#ifndef __ARCH_IRQ_H
+#define __ARCH_IRQ_H
+
+#include <sys/cdefs.h>
+__BEGIN_DECLS
+
+#include <stdint.h>
+
+typedef uint32_t irq_mask_t;
+
+int irq_inside_int(void);
+irq_mask_t irq_disable(void);
+void irq_enable(void);
+void irq_restore(irq_mask_t v);
+
+/** \cond */
+static inline void __irq_scoped_cleanup(int *state) {
+    irq_restore(*state);
+}
+
+#define ___irq_disable_scoped(l) \
+    int __scoped_irq_##l __attribute__((cleanup(__irq_scoped_cleanup))) = irq_disable()
+
+#define __irq_disable_scoped(l) ___irq_disable_scoped(l)
+/** \endcond */
+
+#define irq_disable_scoped() __irq_disable_scoped(__LINE__)
+
+__END_DECLS
+
+#endif /* __ARCH_IRQ_H */
@@ -0,0 +1,24 @@
+/* KallistiOS ##version##
+
+   kernel/net/host/include/arch/timer.h
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* Host stand-in for <arch/timer.h>, using the host's monotonic clock. */
+
+#ifndef __ARCH_TIMER_H
+#define __ARCH_TIMER_H
+
+#include <sys/cdefs.h>
+__BEGIN_DECLS
+
+#include <stdint.h>
+
+uint64_t timer_ms_gettime64(void);
+uint64_t timer_us_gettime64(void);
+uint64_t timer_ns_gettime64(void);
+
+__END_DECLS
+
+#endif /* __ARCH_TIMER_H */
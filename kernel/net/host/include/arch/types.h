@@ -0,0 +1,48 @@
+/* KallistiOS ##version##
+
+   kernel/net/host/include/arch/types.h
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* Host stand-in for <arch/types.h>. The Dreamcast version uses long for the
+   32-bit types, which is 64 bits wide on most hosts, so use the fixed width
+   types instead. */
+
+#ifndef __ARCH_TYPES_H
+#define __ARCH_TYPES_H
+
+#include <sys/cdefs.h>
+__BEGIN_DECLS
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef uint64_t uint64;
+typedef uint32_t uint32;
+typedef uint16_t uint16;
+typedef uint8_t uint8;
+typedef int64_t int64;
+typedef int32_t int32;
+typedef int16_t int16;
+typedef int8_t int8;
+
+typedef volatile uint64 vuint64;
+typedef volatile uint32 vuint32;
+typedef volatile uint16 vuint16;
+typedef volatile uint8 vuint8;
+typedef volatile int64 vint64;
+typedef volatile int32 vint32;
+typedef volatile int16 vint16;
+typedef volatile int8 vint8;
+
+typedef uintptr_t ptr_t;
+
+typedef int handle_t;
+typedef handle_t tid_t;
+typedef handle_t prio_t;
+
+__END_DECLS
+
+#endif /* __ARCH_TYPES_H */
@@ -0,0 +1,15 @@
+/* KallistiOS ##version##
+
+   kernel/net/host/include/dc/maple.h
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* Host stand-in for <dc/maple.h>. There is no maple bus on the host. */
+
+#ifndef __DC_MAPLE_H
+#define __DC_MAPLE_H
+
+#include <arch/types.h>
+
+#endif /* __DC_MAPLE_H */
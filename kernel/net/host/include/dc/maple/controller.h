@@ -0,0 +1,31 @@
+/* KallistiOS ##version##
+
+   kernel/net/host/include/dc/maple/controller.h
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* Host stand-in for <dc/maple/controller.h>, so that examples which set up a
+   button callback to exit still build. The callback is never called. */
+
+#ifndef __DC_MAPLE_CONTROLLER_H
+#define __DC_MAPLE_CONTROLLER_H
+
+#include <sys/cdefs.h>
+__BEGIN_DECLS
+
+#include <stdint.h>
+
+#define CONT_B              (1 << 1)
+#define CONT_A              (1 << 2)
+#define CONT_START          (1 << 3)
+#define CONT_Y              (1 << 9)
+#define CONT_X              (1 << 10)
+
+typedef void (*cont_btn_callback_t)(uint8_t addr, uint32_t btns);
+
+int cont_btn_callback(uint8_t addr, uint32_t btns, cont_btn_callback_t cb);
+
+__END_DECLS
+
+#endif /* __DC_MAPLE_CONTROLLER_H */
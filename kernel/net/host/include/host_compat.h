@@ -0,0 +1,32 @@
+/* KallistiOS ##version##
+
+   kernel/net/host/include/host_compat.h
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* This is included ahead of everything built for the host (see
+   Makefile.nonkos). It provides the bits of newlib and its KOS additions that
+   the code expects to get from the system headers, and that glibc doesn't
+   have. */
+
+#ifndef __HOST_COMPAT_H
+#define __HOST_COMPAT_H
+
+#include <sys/types.h>
+#include <limits.h>
+
+typedef __off_t _off_t;
+typedef __off64_t _off64_t;
+typedef ssize_t _ssize_t;
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+#include <kos/cdefs.h>
+
+/* newlib's <stdio.h> brings this in through KOS's <sys/stdio.h>. */
+#include <kos/dbglog.h>
+
+#endif /* __HOST_COMPAT_H */
@@ -0,0 +1,33 @@
+/* KallistiOS ##version##
+
+   kernel/net/host/include/kos/init.h
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* Host stand-in for <kos/init.h>. The only flag that means anything here is
+   INIT_NET, which has host.c bring the network stack up before main() and
+   take it down again at exit. */
+
+#ifndef __KOS_INIT_H
+#define __KOS_INIT_H
+
+#include <sys/cdefs.h>
+__BEGIN_DECLS
+
+#include <stdint.h>
+
+#define INIT_NONE       0x00000000
+#define INIT_IRQ        0x00000001
+#define INIT_THD_PREEMPT 0x00000002
+#define INIT_NET        0x00000004
+#define INIT_DEFAULT    (INIT_IRQ | INIT_THD_PREEMPT)
+
+#define KOS_INIT_FLAGS(flags) \
+    const uint32_t __kos_init_flags = (flags)
+
+extern const uint32_t __kos_init_flags;
+
+__END_DECLS
+
+#endif /* __KOS_INIT_H */
@@ -0,0 +1,36 @@
+/* KallistiOS ##version##
+
+   kernel/net/host/include/kos/thread.h
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* Host stand-in for <kos/thread.h>. Only the parts of the threading API that
+   the network stack and its tests use are here, and they're implemented on
+   top of pthreads in host.c. */
+
+#ifndef __KOS_THREAD_H
+#define __KOS_THREAD_H
+
+#include <sys/cdefs.h>
+__BEGIN_DECLS
+
+#include <stdbool.h>
+#include <arch/types.h>
+#include <arch/irq.h>
+
+typedef struct kthread kthread_t;
+
+kthread_t *thd_create(bool detach, void *(*routine)(void *param), void *param);
+int thd_destroy(kthread_t *thd);
+void thd_pass(void);
+void thd_sleep(unsigned ms);
+kthread_t *thd_get_current(void);
+int thd_set_label(kthread_t *thd, const char *label);
+int thd_join(kthread_t *thd, void **value_ptr);
+
+#define thd_current (thd_get_current())
+
+__END_DECLS
+
+#endif /* __KOS_THREAD_H */
@@ -0,0 +1,11 @@
+/* KallistiOS ##version##
+
+   kernel/net/host/include/netinet/udp.h
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* The network stack has to be built against KOS's own socket headers rather
+   than the host's, as the structures in them don't match. */
+
+#include "../../../../../include/netinet/udp.h"
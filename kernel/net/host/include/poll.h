@@ -0,0 +1,11 @@
+/* KallistiOS ##version##
+
+   kernel/net/host/include/poll.h
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* KOS's poll flags don't have the same values as the host's, and the stack and
+   kernel/libc/koslib/poll.c have to agree with the programs using them. */
+
+#include "../../../../include/poll.h"
@@ -0,0 +1,37 @@
+/* KallistiOS ##version##
+
+   kernel/net/host/include/sys/queue.h
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+/* The host's <sys/queue.h>, plus the _SAFE iterators that newlib's has and
+   glibc's doesn't. */
+
+#ifndef __HOST_SYS_QUEUE_H
+#define __HOST_SYS_QUEUE_H
+
+#include_next <sys/queue.h>
+
+#ifndef LIST_FOREACH_SAFE
+#define LIST_FOREACH_SAFE(var, head, field, tvar)                   \
+    for((var) = LIST_FIRST((head));                                 \
+        (var) && ((tvar) = LIST_NEXT((var), field), 1);             \
+        (var) = (tvar))
+#endif
+
+#ifndef STAILQ_FOREACH_SAFE
+#define STAILQ_FOREACH_SAFE(var, head, field, tvar)                 \
+    for((var) = STAILQ_FIRST((head));                               \
+        (var) && ((tvar) = STAILQ_NEXT((var), field), 1);           \
+        (var) = (tvar))
+#endif
+
+#ifndef TAILQ_FOREACH_SAFE
+#define TAILQ_FOREACH_SAFE(var, head, field, tvar)                  \
+    for((var) = TAILQ_FIRST((head));                                \
+        (var) && ((tvar) = TAILQ_NEXT((var), field), 1);            \
+        (var) = (tvar))
+#endif
+
+#endif /* __HOST_SYS_QUEUE_H */
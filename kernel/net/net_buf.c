@@ -0,0 +1,118 @@
+/* KallistiOS ##version##
+
+   kernel/net/net_buf.c
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+#include <malloc.h>
+#include <stdlib.h>
+#include <kos/dbglog.h>
+#include <arch/irq.h>
+
+#include "net_buf.h"
+
+#if NET_BUF_SIZE & 31
+#error NET_BUF_SIZE must be a multiple of 32
+#endif
+
+/* Keep the data in each buffer on a cache line boundary, so drivers can DMA
+   straight into or out of it if they want to. */
+#define BUF_HDR_SIZE    ((sizeof(net_buf_t) + 31) & ~31)
+#define BUF_STRIDE      (BUF_HDR_SIZE + NET_BUF_SIZE)
+
+static SLIST_HEAD(net_buf_list, net_buf) free_bufs;
+static uint8_t *pool;
+static int outstanding;
+
+net_buf_t *net_buf_alloc(size_t size) {
+    net_buf_t *buf = NULL;
+
+    if(size <= NET_BUF_SIZE) {
+        irq_disable_scoped();
+
+        if((buf = SLIST_FIRST(&free_bufs))) {
+            SLIST_REMOVE_HEAD(&free_bufs, free_list);
+            ++outstanding;
+        }
+    }
+
+    if(buf) {
+        buf->size = NET_BUF_SIZE;
+    }
+    else {
+        if(!(buf = (net_buf_t *)malloc(BUF_HDR_SIZE + size)))
+            return NULL;
+
+        buf->data = (uint8_t *)buf + BUF_HDR_SIZE;
+        buf->size = size;
+        buf->heap = 1;
+    }
+
+    buf->refcnt = 1;
+    return buf;
+}
+
+void net_buf_ref(net_buf_t *buf) {
+    irq_disable_scoped();
+    ++buf->refcnt;
+}
+
+void net_buf_free(net_buf_t *buf) {
+    {
+        irq_disable_scoped();
+
+        if(--buf->refcnt)
+            return;
+
+        if(!buf->heap) {
+            SLIST_INSERT_HEAD(&free_bufs, buf, free_list);
+            --outstanding;
+            return;
+        }
+    }
+
+    free(buf);
+}
+
+int net_buf_init(void) {
+    net_buf_t *buf;
+    int i;
+
+    /* A previous shutdown may have had to leave the pool alone. */
+    if(pool)
+        return 0;
+
+    if(!(pool = (uint8_t *)memalign(32, NET_BUF_COUNT * BUF_STRIDE))) {
+        dbglog(DBG_WARNING, "net_buf: couldn't allocate buffer pool\n");
+        return -1;
+    }
+
+    SLIST_INIT(&free_bufs);
+
+    for(i = NET_BUF_COUNT - 1; i >= 0; --i) {
+        buf = (net_buf_t *)(pool + i * BUF_STRIDE);
+        buf->data = (uint8_t *)buf + BUF_HDR_SIZE;
+        buf->heap = 0;
+        SLIST_INSERT_HEAD(&free_bufs, buf, free_list);
+    }
+
+    outstanding = 0;
+    return 0;
+}
+
+void net_buf_shutdown(void) {
+    irq_disable_scoped();
+
+    /* If anything is still holding onto a buffer from the pool, we can't very
+       well free it out from under them. Just leave the pool where it is. */
+    if(outstanding) {
+        dbglog(DBG_WARNING, "net_buf: %d buffers still in use at shutdown\n",
+               outstanding);
+        return;
+    }
+
+    SLIST_INIT(&free_bufs);
+    free(pool);
+    pool = NULL;
+}
@@ -0,0 +1,53 @@
+/* KallistiOS ##version##
+
+   kernel/net/net_buf.h
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+#ifndef __LOCAL_NET_BUF_H
+#define __LOCAL_NET_BUF_H
+
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/queue.h>
+#include <kos/opts.h>
+
+/* Reference counted packet buffers. Buffers of up to NET_BUF_SIZE bytes come
+   out of a pool of NET_BUF_COUNT buffers that is set up once by net_init(), so
+   that getting one doesn't need to go through malloc. Anything bigger than
+   that (reassembled IPv4 datagrams, for instance), or anything asked for while
+   the pool is empty, is allocated on the heap instead, so callers don't have
+   to care where their buffer came from.
+
+   All of these can be called with interrupts disabled, so network drivers and
+   protocol input functions are free to use them. */
+
+typedef struct net_buf {
+    SLIST_ENTRY(net_buf) free_list;
+    uint8_t *data;
+    size_t size;
+    uint32_t refcnt;
+    int heap;
+} net_buf_t;
+
+/* Get a buffer with at least size bytes of space at buf->data, with a
+   reference count of 1. Returns NULL if there's no memory to be had. */
+net_buf_t *net_buf_alloc(size_t size);
+
+/* Take another reference to a buffer. */
+void net_buf_ref(net_buf_t *buf);
+
+/* Drop a reference to a buffer, giving it back when the last one goes. */
+void net_buf_free(net_buf_t *buf);
+
+int net_buf_init(void);
+void net_buf_shutdown(void);
+
+__END_DECLS
+
+#endif /* !__LOCAL_NET_BUF_H */
@@ -14,6 +14,7 @@
 
 #include "net_dhcp.h"
 #include "net_thd.h"
+#include "net_buf.h"
 #include "net_ipv4.h"
 #include "net_ipv6.h"
 
@@ -151,6 +152,13 @@ int net_init(uint32 ip) {
     if(net_dev_init() < 0)
         return -1;
 
+    /* Set up the packet buffer pool */
+    net_buf_init();
+
+    /* Bring up the loopback device. It never becomes the default device, but
+       traffic for 127.0.0.0/8 and ::1 is routed to it. */
+    net_loop_init();
+
     /* Initialize the network thread. */
     net_thd_init();
 
@@ -245,6 +253,12 @@ void net_shutdown(void) {
     /* Shut down the network thread */
     net_thd_shutdown();
 
+    /* Shut down the loopback device */
+    net_loop_shutdown();
+
+    /* Give back the packet buffer pool */
+    net_buf_shutdown();
+
     /* Shut down all activated network devices */
     LIST_FOREACH(cur, &net_if_list, if_list) {
         if(cur->flags & NETIF_RUNNING && cur->if_stop)
@@ -0,0 +1,90 @@
+/* KallistiOS ##version##
+
+   kernel/net/net_demux.c
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+#include <string.h>
+
+#include "net_demux.h"
+
+#if NET_DEMUX_BUCKETS & (NET_DEMUX_BUCKETS - 1)
+#error NET_DEMUX_BUCKETS must be a power of two
+#endif
+
+static unsigned int demux_hash(uint16_t lport, const struct in6_addr *raddr,
+                               uint16_t rport) {
+    const uint32_t *a = raddr->__s6_addr.__s6_addr32;
+    uint32_t h = ((uint32_t)lport << 16) | rport;
+
+    h ^= a[0] ^ a[1] ^ a[2] ^ a[3];
+    h *= 0x9E3779B1;
+
+    return (h ^ (h >> 16)) & (NET_DEMUX_BUCKETS - 1);
+}
+
+static struct net_demux_ent *demux_find(net_demux_t *tbl, uint16_t lport,
+                                        const struct in6_addr *raddr,
+                                        uint16_t rport,
+                                        int (*match)(struct net_demux_ent *,
+                                                     void *),
+                                        void *data) {
+    struct net_demux_ent *i;
+
+    LIST_FOREACH(i, &tbl->buckets[demux_hash(lport, raddr, rport)], entry) {
+        if(i->lport == lport && i->rport == rport &&
+           !memcmp(&i->raddr, raddr, sizeof(struct in6_addr)) &&
+           (!match || match(i, data)))
+            return i;
+    }
+
+    return NULL;
+}
+
+void net_demux_insert(net_demux_t *tbl, struct net_demux_ent *ent,
+                      const struct sockaddr_in6 *local,
+                      const struct sockaddr_in6 *remote) {
+    net_demux_remove(tbl, ent);
+
+    ent->lport = local->sin6_port;
+
+    /* Anything without a remote address is a wildcard, whatever the port.
+       Nothing ever comes from port 0 either, so anything with that as its
+       remote port would never be found under its own key. */
+    if(IN6_IS_ADDR_UNSPECIFIED(&remote->sin6_addr) || !remote->sin6_port) {
+        ent->raddr = in6addr_any;
+        ent->rport = 0;
+    }
+    else {
+        ent->raddr = remote->sin6_addr;
+        ent->rport = remote->sin6_port;
+    }
+
+    LIST_INSERT_HEAD(&tbl->buckets[demux_hash(ent->lport, &ent->raddr,
+                                              ent->rport)], ent, entry);
+    ent->hashed = true;
+}
+
+void net_demux_remove(net_demux_t *tbl, struct net_demux_ent *ent) {
+    (void)tbl;
+
+    if(ent->hashed) {
+        LIST_REMOVE(ent, entry);
+        ent->hashed = false;
+    }
+}
+
+struct net_demux_ent *net_demux_lookup(net_demux_t *tbl, uint16_t lport,
+                                       const struct in6_addr *raddr,
+                                       uint16_t rport,
+                                       int (*match)(struct net_demux_ent *ent,
+                                                    void *data),
+                                       void *data) {
+    struct net_demux_ent *rv;
+
+    if((rv = demux_find(tbl, lport, raddr, rport, match, data)))
+        return rv;
+
+    return demux_find(tbl, lport, &in6addr_any, 0, match, data);
+}
@@ -0,0 +1,72 @@
+/* KallistiOS ##version##
+
+   kernel/net/net_demux.h
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+#ifndef __LOCAL_NET_DEMUX_H
+#define __LOCAL_NET_DEMUX_H
+
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/queue.h>
+#include <netinet/in.h>
+#include <kos/opts.h>
+
+/* Hash table used by UDP and TCP to find the socket an incoming packet belongs
+   to. Sockets are keyed on their local port, remote address and remote port,
+   with sockets that aren't connected to anything (or have a remote port of 0)
+   going in under an unspecified remote address and a remote port of 0. Lookups try the exact
+   key first and then fall back to that wildcard key, so connected sockets
+   always win over unconnected ones on the same port. Within a bucket, the most
+   recently added socket is found first.
+
+   None of this does any locking of its own, so the protocol has to hold
+   whatever lock protects its socket list around all of these. */
+
+struct net_demux_ent {
+    LIST_ENTRY(net_demux_ent) entry;
+    struct in6_addr raddr;
+    uint16_t lport;
+    uint16_t rport;
+    bool hashed;
+};
+
+LIST_HEAD(net_demux_list, net_demux_ent);
+
+typedef struct net_demux {
+    struct net_demux_list buckets[NET_DEMUX_BUCKETS];
+} net_demux_t;
+
+/* Get the structure an entry is embedded in. */
+#define NET_DEMUX_SOCK(ent, type, field) \
+    ((type *)((uint8_t *)(ent) - offsetof(type, field)))
+
+/* Add a socket to the table, or move it to the right bucket if its addresses
+   have changed since it was added. */
+void net_demux_insert(net_demux_t *tbl, struct net_demux_ent *ent,
+                      const struct sockaddr_in6 *local,
+                      const struct sockaddr_in6 *remote);
+
+/* Take a socket out of the table, if it is in it. */
+void net_demux_remove(net_demux_t *tbl, struct net_demux_ent *ent);
+
+/* Find the socket for an incoming packet. The match function can reject
+   sockets that have the right key for other reasons (the wrong protocol, for
+   instance) by returning 0, in which case the search carries on. */
+struct net_demux_ent *net_demux_lookup(net_demux_t *tbl, uint16_t lport,
+                                       const struct in6_addr *raddr,
+                                       uint16_t rport,
+                                       int (*match)(struct net_demux_ent *ent,
+                                                    void *data),
+                                       void *data);
+
+__END_DECLS
+
+#endif /* !__LOCAL_NET_DEMUX_H */
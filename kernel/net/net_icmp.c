@@ -17,6 +17,7 @@
 #include <arpa/inet.h>
 #include "net_icmp.h"
 #include "net_ipv4.h"
+#include "net_buf.h"
 
 /*
 This file implements RFC 792, the Internet Control Message Protocol.
@@ -158,10 +159,15 @@ int net_icmp_send_echo(netif_t *net, const uint8 ipaddr[4], uint16 ident,
     icmp_hdr_t *icmp;
     int r = -1;
     uint16 sz = sizeof(icmp_hdr_t) + size + 8;
-    uint8 databuf[sz];
+    net_buf_t *buf;
+    uint8 *databuf;
     uint32 src;
     uint64 t;
 
+    if(!(buf = net_buf_alloc(sz)))
+        return -1;
+
+    databuf = buf->data;
     icmp = (icmp_hdr_t *)databuf;
 
     /* Fill in the ICMP Header */
@@ -197,6 +203,7 @@ int net_icmp_send_echo(netif_t *net, const uint8 ipaddr[4], uint16 ident,
 
     r = net_ipv4_send(net, databuf, sz, seq, 255, 1, htonl(src),
                       htonl(net_ipv4_address(ipaddr)));
+    net_buf_free(buf);
 
     return r;
 }
@@ -15,6 +15,7 @@
 #include "net_icmp6.h"
 #include "net_ipv6.h"
 #include "net_ipv4.h"   /* For net_ipv4_checksum() */
+#include "net_buf.h"
 
 #if __GNUC__ >= 9
 #pragma GCC diagnostic push
@@ -477,9 +478,11 @@ int net_icmp6_input(netif_t *net, ipv6_hdr_t *ip, const uint8 *d, size_t s) {
 int net_icmp6_send_echo(netif_t *net, const struct in6_addr *dst, uint16 ident,
                         uint16 seq, const uint8 *data, size_t size) {
     icmp6_echo_hdr_t *echo;
-    uint8 databuf[sizeof(icmp6_echo_hdr_t) + size + 8];
+    net_buf_t *buf;
+    uint8 *databuf;
     struct in6_addr src;
     uint16 cs;
+    int rv;
     uint64 t;
     uint16 sz = sizeof(icmp6_echo_hdr_t) + size + 8;
 
@@ -503,6 +506,11 @@ int net_icmp6_send_echo(netif_t *net, const struct in6_addr *dst, uint16 ident,
         return -1;
     }
 
+    if(!(buf = net_buf_alloc(sz))) {
+        return -1;
+    }
+
+    databuf = buf->data;
     echo = (icmp6_echo_hdr_t *)databuf;
 
     /* Fill in the ICMP Header */
@@ -529,7 +537,10 @@ int net_icmp6_send_echo(netif_t *net, const struct in6_addr *dst, uint16 ident,
     cs = net_ipv6_checksum_pseudo(&src, dst, sz, IPV6_HDR_ICMP);
     echo->checksum = net_ipv4_checksum(databuf, sz, cs);
 
-    return net_ipv6_send(net, databuf, sz, 0, IPV6_HDR_ICMP, &src, dst);
+    rv = net_ipv6_send(net, databuf, sz, 0, IPV6_HDR_ICMP, &src, dst);
+    net_buf_free(buf);
+
+    return rv;
 }
 
 /* Send a Neighbor Solicitation packet on the specified device */
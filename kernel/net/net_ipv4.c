@@ -99,7 +99,14 @@ int net_ipv4_send_packet(netif_t *net, ip_hdr_t *hdr, const uint8 *data,
     eth_hdr_t *ehdr;
     int err;
 
-    if(net == NULL) {
+    net_ipv4_parse_address(ntohl(hdr->dest), dest_ip);
+
+    /* Anything for a loopback address (127/8) goes to the loopback device,
+       whatever device we were asked to send it on. */
+    if(dest_ip[0] == 0x7F) {
+        net = &net_loop_if;
+    }
+    else if(net == NULL) {
         net = net_default_dev;
 
         if(!net) {
@@ -108,22 +115,7 @@ int net_ipv4_send_packet(netif_t *net, ip_hdr_t *hdr, const uint8 *data,
         }
     }
 
-    net_ipv4_parse_address(ntohl(hdr->dest), dest_ip);
-
-    /* Is this a loopback address (127/8)? */
-    if(dest_ip[0] == 0x7F) {
-        /* Put the IP header / data into our packet */
-        memcpy(pkt, hdr, 4 * (hdr->version_ihl & 0x0f));
-        memcpy(pkt + 4 * (hdr->version_ihl & 0x0f), data, size);
-
-        ++ipv4_stats.pkt_sent;
-
-        /* Send it "away" */
-        net_ipv4_input(NULL, pkt, 4 * (hdr->version_ihl & 0x0f) + size, NULL);
-
-        return 0;
-    }
-    else if(net->flags & NETIF_NOETH) {
+    if(net->flags & NETIF_NOETH) {
         /* Put the IP header / data into our packet */
         memcpy(pkt, hdr, 4 * (hdr->version_ihl & 0x0f));
         memcpy(pkt + 4 * (hdr->version_ihl & 0x0f), data, size);
@@ -59,6 +59,17 @@ static int is_in_network(netif_t *net, const struct in6_addr *ip) {
     return 0;
 }
 
+/* Pick the device a packet to dst should go out on. Loopback addresses (::1 and
+   IPv4 mapped 127/8) go to the loopback device, and everything else goes to
+   the default device, which may be NULL if there isn't one. */
+netif_t *net_ipv6_route(const struct in6_addr *dst) {
+    if(IN6_IS_ADDR_LOOPBACK(dst) ||
+       (IN6_IS_ADDR_V4MAPPED(dst) && dst->s6_addr[12] == 0x7F))
+        return &net_loop_if;
+
+    return net_default_dev;
+}
+
 /* Send a packet on the specified network adapter */
 int net_ipv6_send_packet(netif_t *net, ipv6_hdr_t *hdr, const uint8 *data,
                          size_t data_size) {
@@ -68,7 +79,11 @@ int net_ipv6_send_packet(netif_t *net, ipv6_hdr_t *hdr, const uint8 *data,
     struct in6_addr dst = hdr->dst_addr;
     eth_hdr_t *ehdr;
 
-    if(!net) {
+    /* Packets to loopback always go to the loopback device. */
+    if(IN6_IS_ADDR_LOOPBACK(&hdr->dst_addr)) {
+        net = &net_loop_if;
+    }
+    else if(!net) {
         net = net_default_dev;
 
         if(!net) {
@@ -77,18 +92,7 @@ int net_ipv6_send_packet(netif_t *net, ipv6_hdr_t *hdr, const uint8 *data,
         }
     }
 
-    /* Are we sending a packet to loopback? */
-    if(IN6_IS_ADDR_LOOPBACK(&hdr->dst_addr)) {
-        memcpy(pkt, hdr, sizeof(ipv6_hdr_t));
-        memcpy(pkt + sizeof(ipv6_hdr_t), data, data_size);
-
-        ++ipv6_stats.pkt_sent;
-
-        /* Send the packet "away" */
-        net_ipv6_input(NULL, pkt, sizeof(ipv6_hdr_t) + data_size, NULL);
-        return 0;
-    }
-    else if(net->flags & NETIF_NOETH) {
+    if(net->flags & NETIF_NOETH) {
         memcpy(pkt, hdr, sizeof(ipv6_hdr_t));
         memcpy(pkt + sizeof(ipv6_hdr_t), data, data_size);
 
@@ -284,12 +288,15 @@ int net_ipv6_init(void) {
     net_multicast_add(mac);
 
     /* Also register for the one for our link-local address' solicited nodes
-       group (which will do the same for all our other addresses too). */
-    mac[2] = 0xFF;
-    mac[3] = net_default_dev->ip6_lladdr.s6_addr[13];
-    mac[4] = net_default_dev->ip6_lladdr.s6_addr[14];
-    mac[5] = net_default_dev->ip6_lladdr.s6_addr[15];
-    net_multicast_add(mac);
+       group (which will do the same for all our other addresses too). Without
+       a network device, there's no such address, and only loopback works. */
+    if(net_default_dev) {
+        mac[2] = 0xFF;
+        mac[3] = net_default_dev->ip6_lladdr.s6_addr[13];
+        mac[4] = net_default_dev->ip6_lladdr.s6_addr[14];
+        mac[5] = net_default_dev->ip6_lladdr.s6_addr[15];
+        net_multicast_add(mac);
+    }
 
     return 0;
 }
@@ -301,11 +308,13 @@ void net_ipv6_shutdown(void) {
     net_multicast_del(mac);
 
     /* ... and our solicited nodes multicast group */
-    mac[2] = 0xFF;
-    mac[3] = net_default_dev->ip6_lladdr.s6_addr[13];
-    mac[4] = net_default_dev->ip6_lladdr.s6_addr[14];
-    mac[5] = net_default_dev->ip6_lladdr.s6_addr[15];
-    net_multicast_del(mac);
+    if(net_default_dev) {
+        mac[2] = 0xFF;
+        mac[3] = net_default_dev->ip6_lladdr.s6_addr[13];
+        mac[4] = net_default_dev->ip6_lladdr.s6_addr[14];
+        mac[5] = net_default_dev->ip6_lladdr.s6_addr[15];
+        net_multicast_del(mac);
+    }
 }
 
 #if __GNUC__ >= 9
@@ -0,0 +1,294 @@
+/* KallistiOS ##version##
+
+   kernel/net/net_loop.c
+   Copyright (C) 2026 KallistiOS Contributors
+
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <sys/queue.h>
+
+#include <kos/net.h>
+#include <kos/thread.h>
+#include <kos/sem.h>
+#include <kos/dbglog.h>
+#include <arch/irq.h>
+#include <arch/timer.h>
+
+#include "net_buf.h"
+#include "net_ipv4.h"
+#include "net_ipv6.h"
+
+/* This is a software loopback device. Anything sent to 127.0.0.0/8 or ::1 is
+   handed to it instead of going out on the wire, and it passes the packets
+   back up to the IP layer from its own thread. Doing this asynchronously
+   (rather than just calling the input function from the send path) means
+   that the protocols see loopback traffic the same way they would see traffic
+   from a real adapter, without any locks being taken twice by the same
+   thread. It can also be told to drop or delay packets, which makes it handy
+   for seeing how the stack copes with a bad link without needing one.
+
+   It is never made the default device. Loopback destinations are routed to it
+   by address, so local traffic works whether or not there's a real adapter. */
+
+struct loop_pkt {
+    STAILQ_ENTRY(loop_pkt) queue;
+    net_buf_t *buf;
+    size_t size;
+    uint64 due;
+    uint8 data[];
+};
+
+static STAILQ_HEAD(loop_queue, loop_pkt) loop_pkts;
+static int loop_queued;
+static semaphore_t loop_sem;
+static kthread_t *loop_thd;
+static int loop_done;
+
+static unsigned int loop_loss;
+static unsigned int loop_delay;
+static net_loop_stats_t loop_stats;
+
+/* State for picking which packets to lose. This is kept to ourselves, rather
+   than using rand(), so that turning on packet loss doesn't change what the
+   program itself gets out of rand(). */
+static uint32 loop_rand_state = 0x2545F491;
+
+/* xorshift32. Racing callers might both see the same value, which doesn't
+   matter for this. */
+static uint32 loop_rand(void) {
+    uint32 x = loop_rand_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    loop_rand_state = x;
+
+    return x;
+}
+
+static int loop_if_detect(netif_t *self) {
+    (void)self;
+    return 0;
+}
+
+static int loop_if_init(netif_t *self) {
+    self->flags |= NETIF_DETECTED | NETIF_INITIALIZED;
+    return 0;
+}
+
+static int loop_if_shutdown(netif_t *self) {
+    self->flags &= ~(NETIF_DETECTED | NETIF_INITIALIZED);
+    return 0;
+}
+
+static int loop_if_start(netif_t *self) {
+    self->flags |= NETIF_RUNNING;
+    return 0;
+}
+
+static int loop_if_stop(netif_t *self) {
+    self->flags &= ~NETIF_RUNNING;
+    return 0;
+}
+
+static int loop_if_tx(netif_t *self, const uint8 *data, int len, int blocking) {
+    net_buf_t *nb;
+    struct loop_pkt *pkt;
+
+    (void)blocking;
+
+    if(!(self->flags & NETIF_RUNNING))
+        return NETIF_TX_ERROR;
+
+    /* Throw away whatever we've been asked to, as if it got lost on the way. */
+    if(loop_loss && loop_rand() % 1000 < loop_loss) {
+        ++loop_stats.pkt_dropped;
+        return NETIF_TX_OK;
+    }
+
+    if(!(nb = net_buf_alloc(sizeof(struct loop_pkt) + len))) {
+        ++loop_stats.pkt_dropped;
+        return NETIF_TX_ERROR;
+    }
+
+    pkt = (struct loop_pkt *)nb->data;
+    pkt->buf = nb;
+    pkt->size = len;
+    pkt->due = timer_ms_gettime64() + loop_delay;
+    memcpy(pkt->data, data, len);
+
+    {
+        irq_disable_scoped();
+
+        /* A real adapter would run out of room eventually too. */
+        if(loop_queued >= NET_LOOP_QUEUE_LEN) {
+            ++loop_stats.pkt_dropped;
+            net_buf_free(nb);
+            return NETIF_TX_OK;
+        }
+
+        STAILQ_INSERT_TAIL(&loop_pkts, pkt, queue);
+        ++loop_queued;
+        ++loop_stats.pkt_sent;
+    }
+
+    sem_signal(&loop_sem);
+    return NETIF_TX_OK;
+}
+
+static int loop_if_tx_commit(netif_t *self) {
+    (void)self;
+    return 0;
+}
+
+static int loop_if_rx_poll(netif_t *self) {
+    (void)self;
+    return 0;
+}
+
+static int loop_if_set_flags(netif_t *self, uint32 flags_and, uint32 flags_or) {
+    self->flags = (self->flags & flags_and) | flags_or;
+    return 0;
+}
+
+static int loop_if_set_mc(netif_t *self, const uint8 *list, int count) {
+    (void)self;
+    (void)list;
+    (void)count;
+    return 0;
+}
+
+netif_t net_loop_if = {
+    .name = "lo",
+    .descr = "Software loopback",
+    .flags = NETIF_NO_FLAGS | NETIF_NOETH,
+    .ip_addr = { 127, 0, 0, 1 },
+    .netmask = { 255, 0, 0, 0 },
+    .broadcast = { 127, 255, 255, 255 },
+    .mtu = 1500,
+    .mtu6 = 1500,
+    .hop_limit = 255,
+    .if_detect = loop_if_detect,
+    .if_init = loop_if_init,
+    .if_shutdown = loop_if_shutdown,
+    .if_start = loop_if_start,
+    .if_stop = loop_if_stop,
+    .if_tx = loop_if_tx,
+    .if_tx_commit = loop_if_tx_commit,
+    .if_rx_poll = loop_if_rx_poll,
+    .if_set_flags = loop_if_set_flags,
+    .if_set_mc = loop_if_set_mc
+};
+
+static void *loop_thd_func(void *data) {
+    struct loop_pkt *pkt;
+    uint64 now;
+
+    (void)data;
+
+    for(;;) {
+        sem_wait(&loop_sem);
+
+        {
+            irq_disable_scoped();
+
+            if((pkt = STAILQ_FIRST(&loop_pkts))) {
+                STAILQ_REMOVE_HEAD(&loop_pkts, queue);
+                --loop_queued;
+            }
+        }
+
+        if(loop_done)
+            break;
+
+        if(!pkt)
+            continue;
+
+        /* Packets come out in the order they went in, so if this one isn't
+           due yet, nothing behind it is either. */
+        now = timer_ms_gettime64();
+
+        if(pkt->due > now)
+            thd_sleep((int)(pkt->due - now));
+
+        ++loop_stats.pkt_recv;
+
+        if((pkt->data[0] >> 4) == 6)
+            net_ipv6_input(&net_loop_if, pkt->data, pkt->size, NULL);
+        else
+            net_ipv4_input(&net_loop_if, pkt->data, pkt->size, NULL);
+
+        net_buf_free(pkt->buf);
+    }
+
+    /* If we were woken up to quit, we may have taken a packet off the queue
+       that won't be delivered now. */
+    if(pkt)
+        net_buf_free(pkt->buf);
+
+    return NULL;
+}
+
+int net_loop_set_loss(unsigned int loss) {
+    if(loss > 1000) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    loop_loss = loss;
+    return 0;
+}
+
+int net_loop_set_delay(unsigned int delay) {
+    loop_delay = delay;
+    return 0;
+}
+
+net_loop_stats_t net_loop_get_stats(void) {
+    return loop_stats;
+}
+
+int net_loop_init(void) {
+    STAILQ_INIT(&loop_pkts);
+    loop_queued = 0;
+    loop_done = 0;
+    sem_init(&loop_sem, 0);
+
+    if(!(loop_thd = thd_create(0, loop_thd_func, NULL))) {
+        dbglog(DBG_WARNING, "net_loop: couldn't create loopback thread\n");
+        sem_destroy(&loop_sem);
+        return -1;
+    }
+
+    thd_set_label(loop_thd, "net-loop-thd");
+
+    net_loop_if.if_init(&net_loop_if);
+    net_loop_if.if_start(&net_loop_if);
+
+    return 0;
+}
+
+void net_loop_shutdown(void) {
+    struct loop_pkt *pkt;
+
+    if(!loop_thd)
+        return;
+
+    net_loop_if.if_stop(&net_loop_if);
+    net_loop_if.if_shutdown(&net_loop_if);
+
+    loop_done = 1;
+    sem_signal(&loop_sem);
+    thd_join(loop_thd, NULL);
+    loop_thd = NULL;
+
+    while((pkt = STAILQ_FIRST(&loop_pkts))) {
+        STAILQ_REMOVE_HEAD(&loop_pkts, queue);
+        net_buf_free(pkt->buf);
+    }
+
+    loop_queued = 0;
+    sem_destroy(&loop_sem);
+}
@@ -19,6 +19,7 @@
 #include <kos/mutex.h>
 #include <kos/rwsem.h>
 #include <kos/fs_socket.h>
+#include <kos/opts.h>
 
 #include <arch/timer.h>
 
@@ -26,6 +27,7 @@
 
 #include "net_ipv4.h"
 #include "net_ipv6.h"
+#include "net_demux.h"
 #include "net_thd.h"
 
 /* Since some of this is a bit odd in its implementation, here's a few notes on
@@ -72,22 +74,32 @@
    real socket created for them until they are accept()ed.
 
    On matching sockets:
-   All new sockets (including those created by accept()) are added to the head
-   of the list. Since we cannot bind a socket to an already used port for
-   listening, that means that any fully-created sockets should appear in the
-   list in front of those created for listening to a port (and thus that are
-   only partially-created). This simplifies the procedure for finding matching
-   sockets for incoming packets, since this makes sure that the fully-created
-   socket will be found first if it exists when simply iterating through the
-   list of sockets.
+   Incoming packets are matched to sockets with a hash table (see
+   net_demux.h), keyed on the local port and the remote address and port.
+   Sockets that aren't connected (like those listening on a port) go in with a
+   wildcard remote address, which is only looked at if there isn't a socket
+   connected to where the packet came from. That way, fully-created sockets
+   (including those created by accept()) are always found in front of those
+   created for listening to a port (and thus that are only partially-created).
+   Every socket must be put back in the table whenever its local or remote
+   address changes, which is always done with the write lock held.
+
+   On out-of-order segments:
+   Segments that arrive ahead of RCV.NXT are copied straight into the receive
+   buffer at the spot they'll end up at, since the window guarantees that
+   there's room for them there. All that's kept on the side is a short list of
+   the sequence ranges that are filled in, which is also what the SACK blocks
+   we send are made from. When the gap in front of them is filled, RCV.NXT just
+   skips ahead over them. If a segment would need more ranges than there's room
+   for, it gets dropped and the other side will just have to send it again.
 
    On what's actually here:
-   I didn't bother implementing any TCP extensions beyond RFC 793. That means
-   that I just ignore things like the timestamp option and the selective
-   acknowledgement option. That also means that the window size maxes out at
-   65535. Some extensions may be implemented in the future, if I see fit to do
-   so. That all said, everything in here works just fine over IPv4 or IPv6, and
-   can be used just fine to communicate with "normal" TCP/IP implementations.
+   Beyond RFC 793, there's the RTO calculation from RFC 6298, NewReno
+   congestion control (RFC 5681 and RFC 6582), window scaling (RFC 7323), and
+   sending SACK blocks (RFC 2018). SACK blocks that the other side sends are
+   ignored, and so is the timestamp option. That all said, everything in here
+   works just fine over IPv4 or IPv6, and can be used just fine to communicate
+   with "normal" TCP/IP implementations.
 */
 
 typedef struct tcp_hdr {
@@ -111,18 +123,22 @@ struct lsock {
     uint32_t isn;
     uint32_t wnd;
     uint16_t mss;
+    int wscale;
+    int sack;
 };
 
 /* Send/receive variables... */
 struct sndrec {
     uint32_t una;
     uint32_t nxt;
+    uint32_t max;
     uint32_t wnd;
     uint32_t up;
     uint32_t wl1;
     uint32_t wl2;
     uint32_t iss;
     uint16_t mss;
+    uint8_t wscale;
 };
 
 struct rcvrec {
@@ -130,10 +146,47 @@ struct rcvrec {
     uint32_t wnd;
     uint32_t up;
     uint32_t irs;
+    uint8_t wscale;
+};
+
+/* Number of separate ranges of out-of-order data we'll hold on to, and how
+   many of them fit in a SACK option. */
+#define TCP_MAX_OOO         8
+#define TCP_MAX_SACK        4
+
+/* A range of sequence numbers past RCV.NXT that we've already received. */
+struct tcp_ooo {
+    uint32_t start;
+    uint32_t end;
+};
+
+struct tcp_sock;
+
+/* Congestion control algorithm. Each of these gets called with the socket
+   locked, after the generic parts of the ACK processing have been done, and
+   is responsible for keeping cwnd and ssthresh up to date. To add another
+   algorithm, fill one of these in and add it to tcp_ccs below. */
+struct tcp_cc {
+    const char *name;
+
+    /* Set up the congestion state for a new connection. */
+    void (*init)(struct tcp_sock *sock);
+
+    /* Called when an ACK acknowledges acked bytes of new data. */
+    void (*ack)(struct tcp_sock *sock, uint32_t acked);
+
+    /* Called for each duplicate ACK, with sock->data.dupacks already bumped.
+       This is where fast retransmit/recovery happens. */
+    void (*dupack)(struct tcp_sock *sock);
+
+    /* Called when the retransmission timer goes off, before anything is sent
+       again. */
+    void (*timeout)(struct tcp_sock *sock);
 };
 
 struct tcp_sock {
     LIST_ENTRY(tcp_sock) sock_list;
+    struct net_demux_ent demux;
     struct sockaddr_in6 local_addr;
     struct sockaddr_in6 remote_addr;
 
@@ -146,6 +199,7 @@ struct tcp_sock {
     int hop_limit;
     uint32_t rcvbuf_sz;
     uint32_t sndbuf_sz;
+    const struct tcp_cc *cc;
 
     union {
         struct {
@@ -170,6 +224,26 @@ struct tcp_sock {
             uint32_t sndbuf_acked;
             uint32_t sndbuf_tail;
             uint64_t timer;
+            uint64_t rtt_start;
+            uint32_t rtt_seq;
+            uint32_t srtt;
+            uint32_t rttvar;
+            uint32_t rto;
+            uint32_t rtt_samples;
+            int backoff;
+            int dupacks;
+            uint32_t retransmits;
+            uint32_t fast_retransmits;
+            uint32_t cwnd;
+            uint32_t ssthresh;
+            uint32_t recover;
+            uint32_t cwnd_acked;
+            int in_recovery;
+            struct tcp_ooo ooo[TCP_MAX_OOO];
+            int ooo_count;
+            uint32_t ooo_last;
+            uint32_t ooo_fin;
+            uint32_t ooo_segs;
             condvar_t send_cv;
             condvar_t recv_cv;
         } data;
@@ -179,12 +253,15 @@ struct tcp_sock {
 LIST_HEAD(tcp_sock_list, tcp_sock);
 
 static struct tcp_sock_list tcp_socks = LIST_HEAD_INITIALIZER(0);
+static net_demux_t tcp_demux;
 static rw_semaphore_t tcp_sem = RWSEM_INITIALIZER;
 static int thd_cb_id = 0;
 
-/* Default starting window size for connections. This should be big enough as a
-   starting point, in general. If you need to adjust it, you can do so... */
-#define TCP_DEFAULT_WINDOW  8192
+/* Largest send or receive buffer that can be set with setsockopt(). */
+#define TCP_MAX_BUF_SIZE    (1024 * 1024)
+
+/* Largest window scale shift allowed by RFC 7323. */
+#define TCP_MAX_WSCALE      14
 
 /* Default MSS */
 #define TCP_DEFAULT_MSS     1460
@@ -193,8 +270,22 @@ static int thd_cb_id = 0;
    to be 15 seconds, since that's what Mac OS X does. */
 #define TCP_DEFAULT_MSL     15000
 
-/* Default retransmission timeout (in milliseconds). */
-#define TCP_DEFAULT_RTTO    2000
+/* Retransmission timeout (in milliseconds) to use before we have any round
+   trip time measurements, and the bounds on it after that. RFC 6298 suggests a
+   minimum of one second, but that is far too long on a LAN, so we follow most
+   other stacks and use 200ms instead. */
+#define TCP_INITIAL_RTO     1000
+#define TCP_MIN_RTO         200
+#define TCP_MAX_RTO         60000
+
+/* How often (in milliseconds) the retransmission timers are checked. */
+#define TCP_TIMER_PERIOD    50
+
+/* The most times the retransmission timeout will be doubled in a row. */
+#define TCP_MAX_BACKOFF     8
+
+/* Number of duplicate ACKs that trigger a fast retransmit. */
+#define TCP_DUPACK_THRESH   3
 
 /* Default hop limit (or ttl for IPv4) for new sockets */
 #define TCP_DEFAULT_HOPS    64
@@ -229,10 +320,16 @@ static int thd_cb_id = 0;
 #define TCP_IFLAG_CANBEDEL      0x00000001
 #define TCP_IFLAG_QUEUEDCLOSE   0x00000002
 #define TCP_IFLAG_ACCEPTWAIT    0x00000004
+#define TCP_IFLAG_WSCALE        0x00000008
+#define TCP_IFLAG_SACK          0x00000010
+#define TCP_IFLAG_OOOFIN        0x00000020
 
 #define TCP_OPT_EOL             0
 #define TCP_OPT_NOP             1
 #define TCP_OPT_MSS             2
+#define TCP_OPT_WSCALE          3
+#define TCP_OPT_SACKOK          4
+#define TCP_OPT_SACK            5
 
 /* A few macros for comparing sequence numbers */
 #define SEQ_LT(x, y)    (((int32_t)((x) - (y))) < 0)
@@ -241,6 +338,7 @@ static int thd_cb_id = 0;
 #define SEQ_GE(x, y)    (((int32_t)((x) - (y))) >= 0)
 
 #define MAX(x, y)       ((x) > (y) ? (x) : (y))
+#define MIN(x, y)       ((x) < (y) ? (x) : (y))
 
 /* Forward declarations */
 static fs_socket_proto_t proto;
@@ -250,8 +348,19 @@ static void tcp_rst(netif_t *net, const struct in6_addr *src,
                     uint32_t ack);
 static int tcp_send_syn(struct tcp_sock *sock, int ack);
 static void tcp_send_ack(struct tcp_sock *sock);
-static void tcp_send_data(struct tcp_sock *sock, int resend);
+static void tcp_send_data(struct tcp_sock *sock, int resend, uint32_t limit);
 static void tcp_send_fin_ack(struct tcp_sock *sock);
+static void tcp_rtt_start(struct tcp_sock *sock, uint32_t seq);
+static uint32_t tcp_rto(const struct tcp_sock *sock);
+static uint8_t tcp_wscale(uint32_t bufsz);
+static const struct tcp_cc tcp_newreno;
+extern void __poll_event_trigger(int fd, short event);
+
+/* Available congestion control algorithms. The first one is the default. */
+static const struct tcp_cc *const tcp_ccs[] = {
+    &tcp_newreno,
+    NULL
+};
 
 /* Sockets interface... */
 static int net_tcp_socket(net_socket_t *hnd, int domain, int type, int proto) {
@@ -276,8 +385,9 @@ static int net_tcp_socket(net_socket_t *hnd, int domain, int type, int proto) {
     sock->domain = domain;
     sock->sock = hnd->fd;
     sock->hop_limit = TCP_DEFAULT_HOPS;
-    sock->rcvbuf_sz = TCP_DEFAULT_WINDOW;
-    sock->sndbuf_sz = TCP_DEFAULT_WINDOW;
+    sock->rcvbuf_sz = NET_TCP_DEFAULT_WINDOW;
+    sock->sndbuf_sz = NET_TCP_DEFAULT_WINDOW;
+    sock->cc = tcp_ccs[0];
 
     if(rwsem_write_lock_irqsafe(&tcp_sem)) {
         free(sock);
@@ -287,6 +397,8 @@ static int net_tcp_socket(net_socket_t *hnd, int domain, int type, int proto) {
     hnd->data = sock;
 
     LIST_INSERT_HEAD(&tcp_socks, sock, sock_list);
+    net_demux_insert(&tcp_demux, &sock->demux, &sock->local_addr,
+                     &sock->remote_addr);
     rwsem_write_unlock(&tcp_sem);
 
     return 0;
@@ -439,6 +551,7 @@ retry:
 
 ret_remove:
     LIST_REMOVE(sock, sock_list);
+    net_demux_remove(&tcp_demux, &sock->demux);
     mutex_unlock(&sock->mutex);
     mutex_destroy(&sock->mutex);
     free(sock);
@@ -514,6 +627,7 @@ static int net_tcp_accept(net_socket_t *hnd, struct sockaddr *addr,
             free(sock->listen.queue);
             cond_destroy(&sock->listen.cv);
             LIST_REMOVE(sock, sock_list);
+            net_demux_remove(&tcp_demux, &sock->demux);
             mutex_unlock(&sock->mutex);
             mutex_destroy(&sock->mutex);
             free(sock);
@@ -525,6 +639,10 @@ static int net_tcp_accept(net_socket_t *hnd, struct sockaddr *addr,
         }
     }
 
+    /* Nobody is waiting in here any more, so a close() from now on has to
+       clean up after itself. */
+    sock->intflags &= ~TCP_IFLAG_ACCEPTWAIT;
+
     /* We now have a connection to use, so, lets grab it and release the lock on
        the old socket. */
     lsock = sock->listen.queue[sock->listen.head++];
@@ -605,9 +723,11 @@ static int net_tcp_accept(net_socket_t *hnd, struct sockaddr *addr,
     sock2->state = TCP_STATE_SYN_RECEIVED;
     sock2->local_addr = lsock.local_addr;
     sock2->remote_addr = lsock.remote_addr;
+    sock2->data.net = lsock.net;
     sock2->hop_limit = sock->hop_limit;
     sock2->rcvbuf_sz = sock->rcvbuf_sz;
     sock2->sndbuf_sz = sock->sndbuf_sz;
+    sock2->cc = sock->cc;
     sock2->data.rcv.wnd = sock->rcvbuf_sz;
 
     /* Fill in the address, if they asked for it. */
@@ -705,19 +825,36 @@ static int net_tcp_accept(net_socket_t *hnd, struct sockaddr *addr,
     sock2->data.snd.nxt = sock2->data.snd.iss + 1;
     sock2->data.snd.una = sock2->data.snd.iss;
     sock2->data.snd.wnd = lsock.wnd;
-    sock2->data.snd.wl1 = sock2->data.snd.iss;
+    sock2->data.snd.wl1 = lsock.isn;
+    sock2->data.snd.max = sock2->data.snd.nxt;
     sock2->data.snd.mss = lsock.mss;
     sock2->data.rcv.nxt = lsock.isn + 1;
     sock2->data.rcv.irs = lsock.isn;
+    sock2->data.rto = TCP_INITIAL_RTO;
+
+    /* Use window scaling if the other side offered it. */
+    if(lsock.wscale >= 0) {
+        sock2->intflags |= TCP_IFLAG_WSCALE;
+        sock2->data.snd.wscale = lsock.wscale;
+        sock2->data.rcv.wscale = tcp_wscale(sock2->rcvbuf_sz);
+    }
+
+    if(lsock.sack)
+        sock2->intflags |= TCP_IFLAG_SACK;
+
+    sock2->cc->init(sock2);
 
     /* Since nothing else has a pointer to this socket, this will not fail. */
     mutex_trylock(&sock2->mutex);
 
     /* Send the <SYN,ACK> packet now, add it to the list, and clean up. */
     tcp_send_syn(sock2, 1);
+    tcp_rtt_start(sock2, sock2->data.snd.nxt);
     sock2->data.timer = timer_ms_gettime64();
     fd = sock2->sock;
     LIST_INSERT_HEAD(&tcp_socks, sock2, sock_list);
+    net_demux_insert(&tcp_demux, &sock2->demux, &sock2->local_addr,
+                     &sock2->remote_addr);
     mutex_unlock(&sock2->mutex);
 
     sock->state &= ~TCP_STATE_ACCEPTING;
@@ -869,6 +1006,9 @@ static int net_tcp_bind(net_socket_t *hnd, const struct sockaddr *addr,
         sock->local_addr.sin6_port = htons(port);
     }
 
+    net_demux_insert(&tcp_demux, &sock->demux, &sock->local_addr,
+                     &sock->remote_addr);
+
     /* Release the locks, we're done */
     mutex_unlock(&sock->mutex);
     rwsem_write_unlock(&tcp_sem);
@@ -881,17 +1021,13 @@ static int net_tcp_connect(net_socket_t *hnd, const struct sockaddr *addr,
     struct tcp_sock *sock, *iter;
     struct sockaddr_in *realaddr4;
     struct sockaddr_in6 realaddr6;
+    netif_t *net;
 
     if(addr == NULL) {
         errno = EDESTADDRREQ;
         return -1;
     }
 
-    if(!net_default_dev) {
-        errno = ENETDOWN;
-        return -1;
-    }
-
     switch(addr->sa_family) {
         case AF_INET:
 
@@ -931,6 +1067,12 @@ static int net_tcp_connect(net_socket_t *hnd, const struct sockaddr *addr,
             return -1;
     }
 
+    /* Loopback addresses can be reached even without a network adapter. */
+    if(!(net = net_ipv6_route(&realaddr6.sin6_addr))) {
+        errno = ENETDOWN;
+        return -1;
+    }
+
     if(!(sock = net_tcp_write_lock_and_get_sock(hnd, &tcp_sem)))
         return -1;
 
@@ -1001,13 +1143,15 @@ static int net_tcp_connect(net_socket_t *hnd, const struct sockaddr *addr,
         if(addr->sa_family == AF_INET) {
             sock->local_addr.sin6_addr.__s6_addr.__s6_addr16[5] = 0xFFFF;
             sock->local_addr.sin6_addr.__s6_addr.__s6_addr32[3] =
-                htonl(net_ipv4_address(net_default_dev->ip_addr));
+                htonl(net_ipv4_address(net->ip_addr));
         }
     }
 
     /* Set the remote address on the socket and go to the SYN-SENT state (this
        includes setting up all the data we need for that). */
     sock->remote_addr = realaddr6;
+    net_demux_insert(&tcp_demux, &sock->demux, &sock->local_addr,
+                     &sock->remote_addr);
 
     if(!(sock->data.rcvbuf = (uint8_t *)malloc(sock->rcvbuf_sz))) {
         errno = ENOBUFS;
@@ -1045,12 +1189,19 @@ static int net_tcp_connect(net_socket_t *hnd, const struct sockaddr *addr,
 
     sock->data.rcv.wnd = sock->rcvbuf_sz;
     sock->data.rcvbuf_head = sock->data.rcvbuf_tail = 0;
-    sock->data.net = net_default_dev;
+    sock->data.net = net;
     sock->data.snd.iss = timer_us_gettime64() >> 2;
     sock->data.snd.una = sock->data.snd.iss;
     sock->data.snd.nxt = sock->data.snd.iss + 1;
+    sock->data.snd.max = sock->data.snd.nxt;
+    sock->data.rto = TCP_INITIAL_RTO;
     sock->state = TCP_STATE_SYN_SENT;
 
+    /* Always offer to scale the window and to send SACK blocks. If the other
+       side doesn't, we'll turn them back off when the <SYN,ACK> comes in. */
+    sock->intflags |= TCP_IFLAG_WSCALE | TCP_IFLAG_SACK;
+    sock->data.rcv.wscale = tcp_wscale(sock->rcvbuf_sz);
+
     /* Send a <SYN> packet */
     if(tcp_send_syn(sock, 0) == -1) {
         rwsem_write_unlock(&tcp_sem);
@@ -1058,6 +1209,9 @@ static int net_tcp_connect(net_socket_t *hnd, const struct sockaddr *addr,
         return -1;
     }
 
+    tcp_rtt_start(sock, sock->data.snd.nxt);
+    sock->data.timer = timer_ms_gettime64();
+
     /* Release the write lock... */
     rwsem_write_unlock(&tcp_sem);
 
@@ -1275,8 +1429,10 @@ static ssize_t net_tcp_recvfrom(net_socket_t *hnd, void *buffer, size_t length,
             sock->data.rcvbuf_head = size - tmp;
     }
 
-    /* If we've got nothing left, move the pointers back to the beginning */
-    if(!sock->data.rcvbuf_cur_sz) {
+    /* If we've got nothing left, move the pointers back to the beginning.
+       Anything that came in out of order is kept relative to the tail, so
+       leave them alone if we're holding on to any of that. */
+    if(!sock->data.rcvbuf_cur_sz && !sock->data.ooo_count) {
         sock->data.rcvbuf_head = sock->data.rcvbuf_tail = 0;
     }
 
@@ -1439,7 +1595,7 @@ static ssize_t net_tcp_sendto(net_socket_t *hnd, const void *message,
     }
 
     /* Send some data! */
-    tcp_send_data(sock, 0);
+    tcp_send_data(sock, 0, 0);
 
 out:
     mutex_unlock(&sock->mutex);
@@ -1467,10 +1623,37 @@ static int net_tcp_shutdownsock(net_socket_t *hnd, int how) {
     return 0;
 }
 
+/* Does this socket have its send and receive buffers allocated yet? */
+static int tcp_has_bufs(const struct tcp_sock *sock) {
+    return (sock->state & 0x0F) != TCP_STATE_LISTEN && sock->data.rcvbuf;
+}
+
+/* Copy the used part of a ring buffer to the start of a new buffer of a
+   different size, and free the old one. */
+static uint8_t *tcp_resize_ring(uint8_t *buf, uint32_t sz, uint32_t start,
+                                uint32_t used, uint32_t newsz) {
+    uint8_t *rv;
+
+    if(!(rv = (uint8_t *)malloc(newsz)))
+        return NULL;
+
+    if(start + used <= sz) {
+        memcpy(rv, buf + start, used);
+    }
+    else {
+        memcpy(rv, buf + start, sz - start);
+        memcpy(rv + sz - start, buf, used - (sz - start));
+    }
+
+    free(buf);
+    return rv;
+}
+
 static int net_tcp_getsockopt(net_socket_t *hnd, int level, int option_name,
                               void *option_value, socklen_t *option_len) {
     int tmp;
     struct tcp_sock *sock;
+    struct tcp_info info;
 
     if(!option_value || !option_len) {
         errno = EFAULT;
@@ -1540,6 +1723,42 @@ static int net_tcp_getsockopt(net_socket_t *hnd, int level, int option_name,
                 case TCP_NODELAY:
                     tmp = 1;
                     goto copy_int;
+
+                case TCP_INFO:
+                    if(sock->state == TCP_STATE_LISTEN)
+                        goto ret_inval;
+
+                    memset(&info, 0, sizeof(info));
+                    info.tcpi_rto = tcp_rto(sock) * 1000;
+                    info.tcpi_rtt = sock->data.srtt;
+                    info.tcpi_rttvar = sock->data.rttvar;
+                    info.tcpi_snd_mss = sock->data.snd.mss;
+                    info.tcpi_backoff = sock->data.backoff;
+                    info.tcpi_rtt_samples = sock->data.rtt_samples;
+                    info.tcpi_total_retrans = sock->data.retransmits;
+                    info.tcpi_fast_retrans = sock->data.fast_retransmits;
+                    info.tcpi_snd_cwnd = sock->data.cwnd;
+                    info.tcpi_snd_ssthresh = sock->data.ssthresh;
+                    info.tcpi_snd_wnd = sock->data.snd.wnd;
+                    info.tcpi_rcv_wnd = sock->data.rcv.wnd;
+                    info.tcpi_rcv_ooopack = sock->data.ooo_segs;
+                    info.tcpi_snd_wscale = sock->data.snd.wscale;
+                    info.tcpi_rcv_wscale = sock->data.rcv.wscale;
+
+                    if(*option_len > sizeof(info))
+                        *option_len = sizeof(info);
+
+                    memcpy(option_value, &info, *option_len);
+                    goto simply_return;
+
+                case TCP_CONGESTION:
+                    tmp = strlen(sock->cc->name) + 1;
+
+                    if(*option_len > (socklen_t)tmp)
+                        *option_len = tmp;
+
+                    memcpy(option_value, sock->cc->name, *option_len);
+                    goto simply_return;
             }
 
             break;
@@ -1576,6 +1795,7 @@ static int net_tcp_setsockopt(net_socket_t *hnd, int level, int option_name,
                               const void *option_value, socklen_t option_len) {
     struct tcp_sock *sock;
     int tmp;
+    uint32_t sent;
     uint8_t *new_ptr;
 
     if(!option_value || !option_len) {
@@ -1599,17 +1819,42 @@ static int net_tcp_setsockopt(net_socket_t *hnd, int level, int option_name,
                         goto ret_inval;
 
                     tmp = *(uint32_t *)option_value;
-                    /* Receive buffer size must be in the range 256 - 65535 */
+                    /* Receive buffer size must be in the range 256 -
+                       TCP_MAX_BUF_SIZE */
                     if(tmp < 256)
                         tmp = 256;
-                    else if(tmp > 65535)
-                        tmp = 65535;
+                    else if(tmp > TCP_MAX_BUF_SIZE)
+                        tmp = TCP_MAX_BUF_SIZE;
+
+                    /* Listening and unconnected sockets don't have a buffer
+                       yet, so there's nothing more to do for them. */
+                    if(!tcp_has_bufs(sock)) {
+                        sock->rcvbuf_sz = tmp;
+                        goto ret_success;
+                    }
 
-                    new_ptr = realloc(sock->data.rcvbuf, tmp);
+                    /* Don't take back any of the window we've already
+                       advertised by shrinking the buffer. */
+                    if((uint32_t)tmp <= sock->rcvbuf_sz)
+                        goto ret_success;
+
+                    new_ptr = tcp_resize_ring(sock->data.rcvbuf,
+                                              sock->rcvbuf_sz,
+                                              sock->data.rcvbuf_head,
+                                              sock->data.rcvbuf_cur_sz, tmp);
                     if(!new_ptr)
                         goto ret_nomem;
 
                     sock->data.rcvbuf = new_ptr;
+                    sock->data.rcvbuf_head = 0;
+                    sock->data.rcvbuf_tail = sock->data.rcvbuf_cur_sz;
+
+                    /* Only the in-order data gets moved over, so forget about
+                       anything that came in out of order. The other side will
+                       send it again. */
+                    sock->data.ooo_count = 0;
+                    sock->intflags &= ~TCP_IFLAG_OOOFIN;
+                    sock->data.rcv.wnd += tmp - sock->rcvbuf_sz;
                     sock->rcvbuf_sz = tmp;
                     goto ret_success;
 
@@ -1618,19 +1863,41 @@ static int net_tcp_setsockopt(net_socket_t *hnd, int level, int option_name,
                         goto ret_inval;
 
                     tmp = *(uint32_t *)option_value;
-                    /* Send buffer size must be in the range 2048 - 65535 */
+                    /* Send buffer size must be in the range 2048 -
+                       TCP_MAX_BUF_SIZE */
                     if(tmp < 2048)
                         tmp = 2048;
-                    else if(tmp > 65535)
-                        tmp = 65535;
+                    else if(tmp > TCP_MAX_BUF_SIZE)
+                        tmp = TCP_MAX_BUF_SIZE;
 
-                    new_ptr = realloc(sock->data.sndbuf, tmp);
-                    if(!new_ptr) {
-                        goto ret_nomem;
+                    if(!tcp_has_bufs(sock)) {
+                        sock->sndbuf_sz = tmp;
+                        goto ret_success;
                     }
 
+                    /* Don't throw away anything that's still queued. */
+                    if((uint32_t)tmp < sock->data.sndbuf_cur_sz)
+                        tmp = sock->data.sndbuf_cur_sz;
+
+                    sent = sock->data.snd.nxt - sock->data.snd.una;
+
+                    if(sent > sock->data.sndbuf_cur_sz)
+                        sent = sock->data.sndbuf_cur_sz;
+
+                    new_ptr = tcp_resize_ring(sock->data.sndbuf,
+                                              sock->sndbuf_sz,
+                                              sock->data.sndbuf_acked,
+                                              sock->data.sndbuf_cur_sz, tmp);
+                    if(!new_ptr)
+                        goto ret_nomem;
+
                     sock->data.sndbuf = new_ptr;
+                    sock->data.sndbuf_acked = 0;
+                    sock->data.sndbuf_head = sent % tmp;
+                    sock->data.sndbuf_tail = sock->data.sndbuf_cur_sz % tmp;
                     sock->sndbuf_sz = tmp;
+                    __poll_event_trigger(sock->sock, POLLWRNORM | POLLWRBAND);
+                    cond_signal(&sock->data.send_cv);
                     goto ret_success;
             }
 
@@ -1707,6 +1974,30 @@ static int net_tcp_setsockopt(net_socket_t *hnd, int level, int option_name,
                         goto ret_inval;
 
                     goto ret_success;
+
+                case TCP_CONGESTION:
+                    for(tmp = 0; tcp_ccs[tmp]; ++tmp) {
+                        if(strlen(tcp_ccs[tmp]->name) ==
+                           strnlen(option_value, option_len) &&
+                           !strncmp(tcp_ccs[tmp]->name, option_value,
+                                    option_len))
+                            break;
+                    }
+
+                    if(!tcp_ccs[tmp]) {
+                        mutex_unlock(&sock->mutex);
+                        rwsem_read_unlock(&tcp_sem);
+                        errno = ENOENT;
+                        return -1;
+                    }
+
+                    sock->cc = tcp_ccs[tmp];
+
+                    /* Start the new algorithm afresh if we're connected. */
+                    if(tcp_has_bufs(sock) && sock->data.snd.mss)
+                        sock->cc->init(sock);
+
+                    goto ret_success;
             }
 
             break;
@@ -2058,11 +2349,372 @@ static void tcp_bpkt_rst(netif_t *net, const struct in6_addr *src,
                   dst, src);
 }
 
+/* Start timing a round trip, if we aren't already, which will end when
+   everything before seq has been acked. */
+static void tcp_rtt_start(struct tcp_sock *sock, uint32_t seq) {
+    if(!sock->data.rtt_start) {
+        sock->data.rtt_start = timer_us_gettime64();
+        sock->data.rtt_seq = seq;
+    }
+}
+
+/* Update the round trip time estimate and retransmission timeout with a new
+   ACK, as described in RFC 6298. Everything here is in microseconds, except
+   for the timeout itself. */
+static void tcp_rtt_update(struct tcp_sock *sock, uint32_t ack) {
+    uint32_t r, delta, rto;
+
+    if(!sock->data.rtt_start || SEQ_LT(ack, sock->data.rtt_seq))
+        return;
+
+    r = (uint32_t)(timer_us_gettime64() - sock->data.rtt_start);
+    sock->data.rtt_start = 0;
+
+    if(!sock->data.rtt_samples++) {
+        sock->data.srtt = r;
+        sock->data.rttvar = r / 2;
+    }
+    else {
+        delta = sock->data.srtt > r ? sock->data.srtt - r :
+                r - sock->data.srtt;
+        sock->data.rttvar = (3 * sock->data.rttvar + delta) / 4;
+        sock->data.srtt = (7 * sock->data.srtt + r) / 8;
+    }
+
+    rto = sock->data.srtt + MAX(TCP_TIMER_PERIOD * 1000,
+                                4 * sock->data.rttvar);
+    rto = (rto + 999) / 1000;
+
+    if(rto < TCP_MIN_RTO)
+        rto = TCP_MIN_RTO;
+    else if(rto > TCP_MAX_RTO)
+        rto = TCP_MAX_RTO;
+
+    sock->data.rto = rto;
+}
+
+/* Get the current retransmission timeout, taking backoff into account. */
+static uint32_t tcp_rto(const struct tcp_sock *sock) {
+    uint32_t rto = sock->data.rto << sock->data.backoff;
+
+    return rto > TCP_MAX_RTO ? TCP_MAX_RTO : rto;
+}
+
+/* Note that the retransmission timer went off. Whatever was being timed is
+   going to be sent again, so by Karn's algorithm it can't be used for a round
+   trip time measurement. */
+static void tcp_rtt_timeout(struct tcp_sock *sock) {
+    if(sock->data.backoff < TCP_MAX_BACKOFF)
+        ++sock->data.backoff;
+
+    sock->data.rtt_start = 0;
+    sock->data.dupacks = 0;
+    ++sock->data.retransmits;
+}
+
+/* Get the highest sequence number we've sent. This can be past SND.NXT when
+   we've gone back to retransmit after a timeout. */
+static uint32_t tcp_snd_max(const struct tcp_sock *sock) {
+    if(SEQ_GT(sock->data.snd.max, sock->data.snd.nxt))
+        return sock->data.snd.max;
+
+    return sock->data.snd.nxt;
+}
+
+/* Largest amount of data we put in one segment. */
+static uint32_t tcp_smss(const struct tcp_sock *sock) {
+    return sock->data.snd.mss - sizeof(tcp_hdr_t);
+}
+
+/* Work out the window scale we need to be able to advertise all of a receive
+   buffer of the given size. */
+static uint8_t tcp_wscale(uint32_t bufsz) {
+    uint8_t shift = 0;
+
+    while(shift < TCP_MAX_WSCALE && (bufsz >> shift) > 0xFFFF)
+        ++shift;
+
+    return shift;
+}
+
+/* Get the window to put in the header of a non-SYN segment. */
+static uint16_t tcp_adv_wnd(const struct tcp_sock *sock) {
+    uint32_t wnd = sock->data.rcv.wnd >> sock->data.rcv.wscale;
+
+    return htons(MIN(wnd, 0xFFFF));
+}
+
+/* Resend the first unacked segment, without waiting for the retransmission
+   timer. */
+static void tcp_fast_retransmit(struct tcp_sock *sock) {
+    sock->data.rtt_start = 0;
+    ++sock->data.fast_retransmits;
+    tcp_send_data(sock, 1, tcp_smss(sock));
+}
+
+/* NewReno congestion control, as described in RFC 5681 and RFC 6582. */
+static void tcp_newreno_init(struct tcp_sock *sock) {
+    uint32_t smss = tcp_smss(sock);
+
+    /* Initial window from RFC 3390. */
+    sock->data.cwnd = MIN(4 * smss, MAX(2 * smss, 4380));
+    sock->data.ssthresh = 0xFFFFFFFF;
+    sock->data.recover = sock->data.snd.iss;
+    sock->data.cwnd_acked = 0;
+    sock->data.in_recovery = 0;
+}
+
+static void tcp_newreno_ack(struct tcp_sock *sock, uint32_t acked) {
+    uint32_t smss = tcp_smss(sock);
+    uint32_t flight = sock->data.snd.nxt - sock->data.snd.una;
+
+    if(sock->data.in_recovery) {
+        if(SEQ_GE(sock->data.snd.una, sock->data.recover)) {
+            /* Full ACK, so everything that was outstanding when we noticed
+               the loss has made it. Deflate the window and carry on. */
+            sock->data.cwnd = MIN(sock->data.ssthresh, flight + smss);
+            sock->data.in_recovery = 0;
+        }
+        else {
+            /* Partial ACK, so the next hole needs filling too. */
+            tcp_fast_retransmit(sock);
+            sock->data.cwnd -= MIN(acked, sock->data.cwnd);
+
+            if(acked >= smss)
+                sock->data.cwnd += smss;
+        }
+    }
+    else if(sock->data.cwnd < sock->data.ssthresh) {
+        /* Slow start */
+        sock->data.cwnd += MIN(acked, smss);
+    }
+    else {
+        /* Congestion avoidance: one more segment per window acked. */
+        sock->data.cwnd_acked += acked;
+
+        if(sock->data.cwnd_acked >= sock->data.cwnd) {
+            sock->data.cwnd_acked -= sock->data.cwnd;
+            sock->data.cwnd += smss;
+        }
+    }
+}
+
+static void tcp_newreno_dupack(struct tcp_sock *sock) {
+    uint32_t smss = tcp_smss(sock);
+    uint32_t flight = sock->data.snd.nxt - sock->data.snd.una;
+
+    if(sock->data.in_recovery) {
+        /* Each duplicate means another segment has left the network. */
+        sock->data.cwnd += smss;
+    }
+    else if(sock->data.dupacks == TCP_DUPACK_THRESH &&
+            SEQ_GT(sock->data.snd.una, sock->data.recover)) {
+        sock->data.ssthresh = MAX(flight / 2, 2 * smss);
+        sock->data.recover = sock->data.snd.nxt;
+        sock->data.cwnd = sock->data.ssthresh + 3 * smss;
+        sock->data.in_recovery = 1;
+        tcp_fast_retransmit(sock);
+    }
+}
+
+static void tcp_newreno_timeout(struct tcp_sock *sock) {
+    uint32_t smss = tcp_smss(sock);
+    uint32_t flight = sock->data.snd.nxt - sock->data.snd.una;
+
+    /* Don't keep halving ssthresh if the same data times out again. */
+    if(!sock->data.backoff)
+        sock->data.ssthresh = MAX(flight / 2, 2 * smss);
+
+    sock->data.cwnd = smss;
+    sock->data.cwnd_acked = 0;
+    sock->data.recover = sock->data.snd.nxt;
+    sock->data.in_recovery = 0;
+}
+
+static const struct tcp_cc tcp_newreno = {
+    "newreno",
+    tcp_newreno_init,
+    tcp_newreno_ack,
+    tcp_newreno_dupack,
+    tcp_newreno_timeout
+};
+
+/* Fill in a SACK option describing the out-of-order data we have, and return
+   its length. The block with the most recently received segment goes first,
+   as RFC 2018 asks for, and the rest follow in order. */
+static int tcp_sack_opt(const struct tcp_sock *sock, uint8_t *opt) {
+    int i, n = 0, first = 0;
+    const struct tcp_ooo *blk[TCP_MAX_SACK];
+
+    for(i = 0; i < sock->data.ooo_count; ++i) {
+        if(SEQ_LE(sock->data.ooo[i].start, sock->data.ooo_last) &&
+           SEQ_LT(sock->data.ooo_last, sock->data.ooo[i].end)) {
+            first = i;
+            break;
+        }
+    }
+
+    blk[n++] = &sock->data.ooo[first];
+
+    for(i = 0; i < sock->data.ooo_count && n < TCP_MAX_SACK; ++i) {
+        if(i != first)
+            blk[n++] = &sock->data.ooo[i];
+    }
+
+    opt[0] = TCP_OPT_NOP;
+    opt[1] = TCP_OPT_NOP;
+    opt[2] = TCP_OPT_SACK;
+    opt[3] = 2 + 8 * n;
+
+    for(i = 0; i < n; ++i) {
+        opt[4 + i * 8 + 0] = blk[i]->start >> 24;
+        opt[4 + i * 8 + 1] = blk[i]->start >> 16;
+        opt[4 + i * 8 + 2] = blk[i]->start >> 8;
+        opt[4 + i * 8 + 3] = blk[i]->start;
+        opt[4 + i * 8 + 4] = blk[i]->end >> 24;
+        opt[4 + i * 8 + 5] = blk[i]->end >> 16;
+        opt[4 + i * 8 + 6] = blk[i]->end >> 8;
+        opt[4 + i * 8 + 7] = blk[i]->end;
+    }
+
+    return 4 + 8 * n;
+}
+
+/* Copy received data into the receive buffer, off bytes past RCV.NXT. */
+static void tcp_rcv_copy(struct tcp_sock *sock, uint32_t off,
+                         const uint8_t *buf, uint32_t sz) {
+    uint32_t pos = sock->data.rcvbuf_tail + off, tmp;
+
+    if(pos >= sock->rcvbuf_sz)
+        pos -= sock->rcvbuf_sz;
+
+    if(pos + sz <= sock->rcvbuf_sz) {
+        memcpy(sock->data.rcvbuf + pos, buf, sz);
+    }
+    else {
+        tmp = sock->rcvbuf_sz - pos;
+        memcpy(sock->data.rcvbuf + pos, buf, tmp);
+        memcpy(sock->data.rcvbuf, buf + tmp, sz - tmp);
+    }
+}
+
+/* Move RCV.NXT forward over data that's already in the receive buffer. */
+static void tcp_rcv_advance(struct tcp_sock *sock, uint32_t sz) {
+    sock->data.rcv.nxt += sz;
+    sock->data.rcv.wnd -= sz;
+    sock->data.rcvbuf_cur_sz += sz;
+    sock->data.rcvbuf_tail += sz;
+
+    if(sock->data.rcvbuf_tail >= sock->rcvbuf_sz)
+        sock->data.rcvbuf_tail -= sock->rcvbuf_sz;
+}
+
+/* Hold on to a segment that arrived ahead of RCV.NXT. The caller has already
+   made sure it fits in the window. Returns -1 if it had to be dropped. */
+static int tcp_ooo_add(struct tcp_sock *sock, uint32_t seq,
+                       const uint8_t *buf, uint32_t sz) {
+    struct tcp_ooo blks[TCP_MAX_OOO + 1];
+    uint32_t start = seq, end = seq + sz;
+    int i, n = 0, added = 0;
+
+    /* Work out what the list of ranges looks like with this one merged into
+       it, before touching anything. */
+    for(i = 0; i < sock->data.ooo_count; ++i) {
+        const struct tcp_ooo *o = &sock->data.ooo[i];
+
+        if(SEQ_LT(o->end, start)) {
+            blks[n++] = *o;
+        }
+        else if(SEQ_GT(o->start, end)) {
+            if(!added) {
+                blks[n].start = start;
+                blks[n++].end = end;
+                added = 1;
+            }
+
+            blks[n++] = *o;
+        }
+        else {
+            /* Overlapping or touching, so combine them. */
+            if(SEQ_LT(o->start, start))
+                start = o->start;
+
+            if(SEQ_GT(o->end, end))
+                end = o->end;
+        }
+    }
+
+    if(!added) {
+        blks[n].start = start;
+        blks[n++].end = end;
+    }
+
+    if(n > TCP_MAX_OOO)
+        return -1;
+
+    tcp_rcv_copy(sock, seq - sock->data.rcv.nxt, buf, sz);
+    memcpy(sock->data.ooo, blks, n * sizeof(struct tcp_ooo));
+    sock->data.ooo_count = n;
+    sock->data.ooo_last = seq;
+
+    return 0;
+}
+
+/* Skip RCV.NXT over any out-of-order data that is now in sequence. Returns
+   non-zero if that got us up to a FIN that came in out of order. */
+static int tcp_ooo_collapse(struct tcp_sock *sock) {
+    int i = 0;
+
+    while(i < sock->data.ooo_count &&
+          SEQ_LE(sock->data.ooo[i].start, sock->data.rcv.nxt)) {
+        if(SEQ_GT(sock->data.ooo[i].end, sock->data.rcv.nxt))
+            tcp_rcv_advance(sock, sock->data.ooo[i].end - sock->data.rcv.nxt);
+
+        ++i;
+    }
+
+    if(i) {
+        sock->data.ooo_count -= i;
+        memmove(sock->data.ooo, sock->data.ooo + i,
+                sock->data.ooo_count * sizeof(struct tcp_ooo));
+    }
+
+    if((sock->intflags & TCP_IFLAG_OOOFIN) &&
+       sock->data.rcv.nxt == sock->data.ooo_fin) {
+        sock->intflags &= ~TCP_IFLAG_OOOFIN;
+        return 1;
+    }
+
+    return 0;
+}
+
 static int tcp_send_syn(struct tcp_sock *sock, int ack) {
-    uint8_t rawpkt[sizeof(tcp_hdr_t) + 4];
+    uint8_t rawpkt[sizeof(tcp_hdr_t) + 12];
     tcp_hdr_t *hdr = (tcp_hdr_t *)rawpkt;
+    int optlen = 4;
     uint16_t cs;
 
+    /* Fill in our SYN options: the MSS, and the window scale and SACK
+       permitted options if we're using them on this connection. */
+    hdr->options[0] = TCP_OPT_MSS;
+    hdr->options[1] = 4;
+    hdr->options[2] = (TCP_DEFAULT_MSS >> 8) & 0xFF;
+    hdr->options[3] = TCP_DEFAULT_MSS & 0xFF;
+
+    if(sock->intflags & TCP_IFLAG_WSCALE) {
+        hdr->options[optlen++] = TCP_OPT_NOP;
+        hdr->options[optlen++] = TCP_OPT_WSCALE;
+        hdr->options[optlen++] = 3;
+        hdr->options[optlen++] = sock->data.rcv.wscale;
+    }
+
+    if(sock->intflags & TCP_IFLAG_SACK) {
+        hdr->options[optlen++] = TCP_OPT_NOP;
+        hdr->options[optlen++] = TCP_OPT_NOP;
+        hdr->options[optlen++] = TCP_OPT_SACKOK;
+        hdr->options[optlen++] = 2;
+    }
+
     /* Fill in the base packet */
     hdr->src_port = sock->local_addr.sin6_port;
     hdr->dst_port = sock->remote_addr.sin6_port;
@@ -2070,29 +2722,25 @@ static int tcp_send_syn(struct tcp_sock *sock, int ack) {
     hdr->ack = htonl(sock->data.rcv.nxt);
 
     if(ack) {
-        hdr->off_flags = htons(TCP_FLAG_SYN | TCP_FLAG_ACK | TCP_OFFSET(6));
+        hdr->off_flags = htons(TCP_FLAG_SYN | TCP_FLAG_ACK |
+                               TCP_OFFSET(5 + optlen / 4));
     }
     else {
-        hdr->off_flags = htons(TCP_FLAG_SYN | TCP_OFFSET(6));
+        hdr->off_flags = htons(TCP_FLAG_SYN | TCP_OFFSET(5 + optlen / 4));
     }
 
-    hdr->wnd = htons(sock->data.rcv.wnd);
+    /* The window in a SYN is never scaled. */
+    hdr->wnd = htons(MIN(sock->data.rcv.wnd, 0xFFFF));
     hdr->checksum = 0;
     hdr->urg = 0;
 
-    /* Fill in our SYN options. The only one we worry about right now is MSS. */
-    hdr->options[0] = TCP_OPT_MSS;
-    hdr->options[1] = 4;
-    hdr->options[2] = (TCP_DEFAULT_MSS >> 8) & 0xFF;
-    hdr->options[3] = TCP_DEFAULT_MSS & 0xFF;
-
     /* Calculate the real checksum */
     cs = net_ipv6_checksum_pseudo(&sock->local_addr.sin6_addr,
                                   &sock->remote_addr.sin6_addr,
-                                  sizeof(tcp_hdr_t) + 4, IPPROTO_TCP);
-    hdr->checksum = net_ipv4_checksum(rawpkt, sizeof(tcp_hdr_t) + 4, cs);
+                                  sizeof(tcp_hdr_t) + optlen, IPPROTO_TCP);
+    hdr->checksum = net_ipv4_checksum(rawpkt, sizeof(tcp_hdr_t) + optlen, cs);
 
-    return net_ipv6_send(sock->data.net, rawpkt, sizeof(tcp_hdr_t) + 4,
+    return net_ipv6_send(sock->data.net, rawpkt, sizeof(tcp_hdr_t) + optlen,
                          sock->hop_limit, IPPROTO_TCP,
                          &sock->local_addr.sin6_addr,
                          &sock->remote_addr.sin6_addr);
@@ -2109,7 +2757,7 @@ static void tcp_send_fin_ack(struct tcp_sock *sock) {
     hdr->seq = htonl(sock->data.snd.nxt);
     hdr->ack = htonl(sock->data.rcv.nxt);
     hdr->off_flags = htons(TCP_FLAG_FIN | TCP_FLAG_ACK | TCP_OFFSET(5));
-    hdr->wnd = htons(sock->data.rcv.wnd);
+    hdr->wnd = tcp_adv_wnd(sock);
     hdr->checksum = 0;
     hdr->urg = 0;
 
@@ -2125,32 +2773,44 @@ static void tcp_send_fin_ack(struct tcp_sock *sock) {
 }
 
 static void tcp_send_ack(struct tcp_sock *sock) {
-    tcp_hdr_t hdr;
+    uint8_t rawpkt[sizeof(tcp_hdr_t) + 4 + 8 * TCP_MAX_SACK];
+    tcp_hdr_t *hdr = (tcp_hdr_t *)rawpkt;
+    int optlen = 0;
     uint16_t c;
 
+    /* If we're holding on to any out-of-order data, tell the other side about
+       it with SACK blocks, if it can understand them. */
+    if((sock->intflags & TCP_IFLAG_SACK) && sock->data.ooo_count)
+        optlen = tcp_sack_opt(sock, hdr->options);
+
     /* Fill in the base packet */
-    hdr.src_port = sock->local_addr.sin6_port;
-    hdr.dst_port = sock->remote_addr.sin6_port;
-    hdr.seq = htonl(sock->data.snd.nxt);
-    hdr.ack = htonl(sock->data.rcv.nxt);
-    hdr.off_flags = htons(TCP_FLAG_ACK | TCP_OFFSET(5));
-    hdr.wnd = htons(sock->data.rcv.wnd);
-    hdr.checksum = 0;
-    hdr.urg = 0;
+    hdr->src_port = sock->local_addr.sin6_port;
+    hdr->dst_port = sock->remote_addr.sin6_port;
+    hdr->seq = htonl(sock->data.snd.nxt);
+    hdr->ack = htonl(sock->data.rcv.nxt);
+    hdr->off_flags = htons(TCP_FLAG_ACK | TCP_OFFSET(5 + optlen / 4));
+    hdr->wnd = tcp_adv_wnd(sock);
+    hdr->checksum = 0;
+    hdr->urg = 0;
 
     /* Calculate the real checksum */
     c = net_ipv6_checksum_pseudo(&sock->local_addr.sin6_addr,
                                  &sock->remote_addr.sin6_addr,
-                                 sizeof(tcp_hdr_t), IPPROTO_TCP);
-    hdr.checksum = net_ipv4_checksum((const uint8 *)&hdr, sizeof(tcp_hdr_t), c);
+                                 sizeof(tcp_hdr_t) + optlen, IPPROTO_TCP);
+    hdr->checksum = net_ipv4_checksum(rawpkt, sizeof(tcp_hdr_t) + optlen, c);
 
-    net_ipv6_send(sock->data.net, (const uint8 *)&hdr, sizeof(tcp_hdr_t),
+    net_ipv6_send(sock->data.net, rawpkt, sizeof(tcp_hdr_t) + optlen,
                   sock->hop_limit, IPPROTO_TCP, &sock->local_addr.sin6_addr,
                   &sock->remote_addr.sin6_addr);
 }
 
-static void tcp_send_data(struct tcp_sock *sock, int resend) {
+/* Send whatever data fits in the window, starting either from the first byte
+   that hasn't been sent yet, or when resend is set, from the first byte that
+   hasn't been acked. If limit isn't zero, no more than that many bytes will be
+   sent. */
+static void tcp_send_data(struct tcp_sock *sock, int resend, uint32_t limit) {
     uint32_t wnd = sock->data.snd.wnd, snd;
+    int idle = sock->data.snd.nxt == sock->data.snd.una;
     int sz = sizeof(tcp_hdr_t);
     uint8_t rawpkt[1500];
     tcp_hdr_t *hdr = (tcp_hdr_t *)rawpkt;
@@ -2161,24 +2821,42 @@ static void tcp_send_data(struct tcp_sock *sock, int resend) {
     if(!resend) {
         seq = sock->data.snd.nxt;
         unacked = sock->data.snd.nxt - sock->data.snd.una;
-        wnd -= unacked;
         head = sock->data.sndbuf_head;
+
+        /* New data has to fit in both the receiver's window and the
+           congestion window. If the receiver's window is closed and nothing
+           is in flight, probe it with a single byte. */
+        wnd = MIN(wnd, sock->data.cwnd);
+        wnd = wnd > unacked ? wnd - unacked : 0;
+
+        if(!sock->data.snd.wnd && !unacked)
+            wnd = 1;
     }
     else {
         seq = sock->data.snd.una;
         unacked = 0;
         head = sock->data.sndbuf_acked;
+
+        if(!wnd)
+            wnd = 1;
     }
 
-    if(!wnd)
-        wnd = 1;
+    if(limit && wnd > limit)
+        wnd = limit;
+
+    /* Time the first new segment we send, unless something is already being
+       timed. Anything before SND.MAX has been sent before, so it can't be
+       timed. */
+    if(!resend && sock->data.sndbuf_cur_sz - unacked &&
+       SEQ_GE(seq, tcp_snd_max(sock)))
+        tcp_rtt_start(sock, seq + 1);
 
     /* Fill in the base packet */
     hdr->src_port = sock->local_addr.sin6_port;
     hdr->dst_port = sock->remote_addr.sin6_port;
     hdr->ack = htonl(sock->data.rcv.nxt);
     hdr->off_flags = htons(TCP_FLAG_ACK | TCP_OFFSET(5));
-    hdr->wnd = htons(sock->data.rcv.wnd);
+    hdr->wnd = tcp_adv_wnd(sock);
     hdr->urg = 0;
 
     /* Put on some data if we should do so */
@@ -2226,9 +2904,20 @@ static void tcp_send_data(struct tcp_sock *sock, int resend) {
                       &sock->remote_addr.sin6_addr);
     }
 
-    sock->data.timer = timer_ms_gettime64();
-    sock->data.sndbuf_head = head;
-    sock->data.snd.nxt = seq;
+    /* Only restart the retransmission timer if it wasn't already running for
+       data we sent earlier, or if we're retransmitting. */
+    if(resend || idle)
+        sock->data.timer = timer_ms_gettime64();
+
+    /* A retransmission might have gone past what we'd already sent, if the
+       window has opened up since then. */
+    if(SEQ_GT(seq, sock->data.snd.nxt)) {
+        sock->data.sndbuf_head = head;
+        sock->data.snd.nxt = seq;
+    }
+
+    if(SEQ_GT(seq, sock->data.snd.max))
+        sock->data.snd.max = seq;
 }
 
 #define ADDR_EQUAL(a1, a2) \
@@ -2237,51 +2926,56 @@ static void tcp_send_data(struct tcp_sock *sock, int resend) {
      ((a1).__s6_addr.__s6_addr32[2] == (a2).__s6_addr.__s6_addr32[2]) && \
      ((a1).__s6_addr.__s6_addr32[3] == (a2).__s6_addr.__s6_addr32[3]))
 
+struct tcp_match {
+    const struct in6_addr *dst;
+    int domain;
+};
+
+/* Check the parts of a socket's setup that the demux table doesn't cover
+   against an incoming packet. */
+static int tcp_match(struct net_demux_ent *ent, void *data) {
+    struct tcp_sock *i = NET_DEMUX_SOCK(ent, struct tcp_sock, demux);
+    struct tcp_match *m = (struct tcp_match *)data;
+
+    /* Ignore any closed sockets */
+    if(i->state == TCP_STATE_CLOSED)
+        return 0;
+
+    /* Ignore any sockets that are IPv6 only when we have an incoming IPv4
+       packet, or any that are IPv4 only when we have an incoming IPv6
+       packet. */
+    if((m->domain == AF_INET && (i->flags & FS_SOCKET_V6ONLY)) ||
+            (m->domain == AF_INET6 && i->domain == AF_INET))
+        return 0;
+
+    /* See if it matches the local address */
+    if(!IN6_IS_ADDR_UNSPECIFIED(&i->local_addr.sin6_addr) &&
+            !ADDR_EQUAL(i->local_addr.sin6_addr, *m->dst))
+        return 0;
+
+    return 1;
+}
+
 /* Match a socket to an incoming packet. If an actual socket is returned, it is
    the caller's responsibility  to release the socket's mutex when they're done
    with it. */
 static struct tcp_sock *find_sock(const struct in6_addr *src,
                                   const struct in6_addr *dst,
                                   uint16_t sport, uint16_t dport, int domain) {
+    struct tcp_match m = { dst, domain };
+    struct net_demux_ent *ent;
     struct tcp_sock *i;
 
-    LIST_FOREACH(i, &tcp_socks, sock_list) {
-        /* Ignore any closed sockets */
-        if(i->state == TCP_STATE_CLOSED)
-            continue;
-
-        /* Ignore any sockets that are IPv6 only when we have an incoming IPv4
-           packet, or any that are IPv4 only when we have an incoming IPv6
-           packet. */
-        if((domain == AF_INET && (i->flags & FS_SOCKET_V6ONLY)) ||
-                (domain == AF_INET6 && i->domain == AF_INET))
-            continue;
-
-        /* See if the remote end matches what's in the socket */
-        if(!IN6_IS_ADDR_UNSPECIFIED(&i->remote_addr.sin6_addr) &&
-                (!ADDR_EQUAL(i->remote_addr.sin6_addr, *src) ||
-                 i->remote_addr.sin6_port != sport))
-            continue;
-
-        /* See if it matches the local end */
-        if((!IN6_IS_ADDR_UNSPECIFIED(&i->local_addr.sin6_addr) &&
-                !ADDR_EQUAL(i->local_addr.sin6_addr, *dst)) ||
-                i->local_addr.sin6_port != dport)
-            continue;
-
-        if(mutex_lock_irqsafe(&i->mutex))
-            return (struct tcp_sock *) -1;
-
-        /* Because we always add new sockets to the head of the list, this
-           should be sufficient to match the socket. See the comment at the top
-           of the file for more discussion of this, if you're interested. */
-        return i;
-    }
-
-    return NULL;
-}
+    if(!(ent = net_demux_lookup(&tcp_demux, dport, src, sport, tcp_match, &m)))
+        return NULL;
 
-extern void __poll_event_trigger(int fd, short event);
+    i = NET_DEMUX_SOCK(ent, struct tcp_sock, demux);
+
+    if(mutex_lock_irqsafe(&i->mutex))
+        return (struct tcp_sock *) -1;
+
+    return i;
+}
 
 /* This function is basically a direct implementation of the first two and a
    half steps of the SEGMENT ARRIVES event processing defined in RFC 793 on
@@ -2293,6 +2987,7 @@ static int listen_pkt(netif_t *src, const struct in6_addr *srca,
     int j = 0;
     int end_of_opts;
     uint16_t mss = 576;
+    int wscale = -1, sack = 0;
 
     (void)size;
 
@@ -2325,10 +3020,27 @@ static int listen_pkt(netif_t *src, const struct in6_addr *srca,
                 j += 4;
                 break;
 
+            case TCP_OPT_WSCALE:
+                if(j + 3 > end_of_opts || tcp->options[j + 1] != 3)
+                    return -1;
+
+                wscale = MIN(tcp->options[j + 2], TCP_MAX_WSCALE);
+                j += 3;
+                break;
+
+            case TCP_OPT_SACKOK:
+                if(j + 2 > end_of_opts || tcp->options[j + 1] != 2)
+                    return -1;
+
+                sack = 1;
+                j += 2;
+                break;
+
             default:
 
                 /* Skip unknown options */
-                if(j + 1 > end_of_opts || j + tcp->options[j + 1] > end_of_opts)
+                if(j + 1 >= end_of_opts || tcp->options[j + 1] < 2 ||
+                        j + tcp->options[j + 1] > end_of_opts)
                     return -1;
 
                 j += tcp->options[j + 1];
@@ -2349,6 +3061,8 @@ static int listen_pkt(netif_t *src, const struct in6_addr *srca,
                 s->listen.queue[j].remote_addr.sin6_port == tcp->src_port) {
             s->listen.queue[j].isn = ntohl(tcp->seq);
             s->listen.queue[j].mss = mss;
+            s->listen.queue[j].wscale = wscale;
+            s->listen.queue[j].sack = sack;
             return 0;
         }
     }
@@ -2367,6 +3081,8 @@ static int listen_pkt(netif_t *src, const struct in6_addr *srca,
     s->listen.queue[s->listen.tail].isn = ntohl(tcp->seq);
     s->listen.queue[s->listen.tail].mss = mss;
     s->listen.queue[s->listen.tail].wnd = ntohs(tcp->wnd);
+    s->listen.queue[s->listen.tail].wscale = wscale;
+    s->listen.queue[s->listen.tail].sack = sack;
     ++s->listen.count;
     ++s->listen.tail;
 
@@ -2388,7 +3104,7 @@ static int synsent_pkt(netif_t *src, const struct in6_addr *srca,
                        struct tcp_sock *s, uint16_t flags, int size) {
     uint32_t ack, seq;
     int sz = size - TCP_GET_OFFSET(flags), gotack = 0;
-    int j = 0, end_of_opts, mss = 536;
+    int j = 0, end_of_opts, mss = 536, wscale = -1, sack = 0;
 
     (void)src;
 
@@ -2445,10 +3161,28 @@ static int synsent_pkt(netif_t *src, const struct in6_addr *srca,
                     j += 4;
                     break;
 
+                case TCP_OPT_WSCALE:
+
+                    if(j + 3 > end_of_opts || tcp->options[j + 1] != 3)
+                        return -1;
+
+                    wscale = MIN(tcp->options[j + 2], TCP_MAX_WSCALE);
+                    j += 3;
+                    break;
+
+                case TCP_OPT_SACKOK:
+
+                    if(j + 2 > end_of_opts || tcp->options[j + 1] != 2)
+                        return -1;
+
+                    sack = 1;
+                    j += 2;
+                    break;
+
                 default:
 
                     /* Skip unknown options */
-                    if(j + 1 > end_of_opts ||
+                    if(j + 1 >= end_of_opts || tcp->options[j + 1] < 2 ||
                             j + tcp->options[j + 1] > end_of_opts)
                         return -1;
 
@@ -2457,10 +3191,29 @@ static int synsent_pkt(netif_t *src, const struct in6_addr *srca,
         }
 
         s->data.snd.mss = mss > 1460 ? 1460 : mss;
-        s->data.snd.wnd = htons(tcp->wnd);
+        s->data.snd.wnd = ntohs(tcp->wnd);
+        s->data.snd.wl1 = seq;
+        s->data.snd.wl2 = ack;
+
+        /* Window scaling is only used if both sides asked for it. */
+        if(wscale >= 0 && (s->intflags & TCP_IFLAG_WSCALE)) {
+            s->data.snd.wscale = wscale;
+        }
+        else {
+            s->intflags &= ~TCP_IFLAG_WSCALE;
+            s->data.rcv.wscale = 0;
+        }
+
+        /* Same goes for SACK. */
+        if(!sack)
+            s->intflags &= ~TCP_IFLAG_SACK;
+
+        s->cc->init(s);
 
         if(gotack) {
             s->data.snd.una = ack;
+            tcp_rtt_update(s, ack);
+            s->data.backoff = 0;
 
             /* If the ack covers our iss, then we've established the connection.
                Update the state and ack it. */
@@ -2487,11 +3240,10 @@ static int synsent_pkt(netif_t *src, const struct in6_addr *srca,
 static int process_pkt(netif_t *src, const struct in6_addr *srca,
                        const struct in6_addr *dsta, const tcp_hdr_t *tcp,
                        struct tcp_sock *s, uint16_t flags, size_t size) {
-    uint32_t seq, ack, up;
+    uint32_t seq, ack, up, acked, off;
     size_t sz;
-    int bad_pkt = 0, tmp, acksyn = 0;
+    int bad_pkt = 0, acksyn = 0, fin = 0;
     const uint8_t *buf = (const uint8_t *)tcp;
-    uint8_t *rb;
 
     (void)src;
 
@@ -2514,8 +3266,12 @@ static int process_pkt(netif_t *src, const struct in6_addr *srca,
                 bad_pkt = 1;
         }
         else {
+            /* Anything that starts in the window or runs into it is fine,
+               we'll trim off the bits we already have later. */
             if(!(SEQ_GE(seq, s->data.rcv.nxt) &&
-                    SEQ_LT(seq, s->data.rcv.nxt + s->data.rcv.wnd)))
+                    SEQ_LT(seq, s->data.rcv.nxt + s->data.rcv.wnd)) &&
+                    !(SEQ_LT(seq, s->data.rcv.nxt) &&
+                      SEQ_GT(seq + sz, s->data.rcv.nxt)))
                 bad_pkt = 1;
         }
     }
@@ -2582,29 +3338,70 @@ static int process_pkt(netif_t *src, const struct in6_addr *srca,
     }
 
     /* Check the ack number for validity */
-    if(SEQ_LT(s->data.snd.una, ack) && SEQ_LE(ack, s->data.snd.nxt)) {
-        s->data.sndbuf_acked += (int32_t)(ack - s->data.snd.una - acksyn);
-        s->data.sndbuf_cur_sz -= (int32_t)(ack - s->data.snd.una - acksyn);
+    if(SEQ_LT(s->data.snd.una, ack) && SEQ_LE(ack, tcp_snd_max(s))) {
+        acked = ack - s->data.snd.una - acksyn;
+        s->data.sndbuf_acked += acked;
+        s->data.sndbuf_cur_sz -= acked;
         s->data.snd.una = ack;
+
+        /* New data has been acked, so restart the retransmission timer and
+           stop backing off. */
+        tcp_rtt_update(s, ack);
+        s->data.timer = timer_ms_gettime64();
+        s->data.backoff = 0;
+        s->data.dupacks = 0;
         __poll_event_trigger(s->sock, POLLWRNORM | POLLWRBAND);
         cond_signal(&s->data.send_cv);
 
         if(s->data.sndbuf_acked >= s->sndbuf_sz)
             s->data.sndbuf_acked -= s->sndbuf_sz;
 
-        if(SEQ_LT(s->data.snd.wl1, seq) ||
-                (s->data.snd.wl1 == seq && SEQ_LE(s->data.snd.wl2, ack))) {
-            s->data.snd.wnd = ntohs(tcp->wnd);
-            s->data.snd.wl1 = seq;
-            s->data.snd.wl2 = ack;
+        /* After a retransmission timeout, this might ack data from before the
+           timeout that we hadn't gotten around to sending again yet. */
+        if(SEQ_GT(ack, s->data.snd.nxt)) {
+            s->data.snd.nxt = ack;
+            s->data.sndbuf_head = s->data.sndbuf_acked;
         }
+
+        if(acked)
+            s->cc->ack(s, acked);
     }
-    else if(SEQ_GT(ack, s->data.snd.nxt)) {
+    else if(SEQ_GT(ack, tcp_snd_max(s))) {
         /* This ACKs something we haven't sent, so try to correct the other side
            and return */
         tcp_send_ack(s);
         return 0;
     }
+    else if(ack == s->data.snd.una && ack != tcp_snd_max(s) && !sz &&
+            !(flags & TCP_FLAG_FIN) &&
+            (uint32_t)(ntohs(tcp->wnd) << s->data.snd.wscale) ==
+            s->data.snd.wnd &&
+            (s->state == TCP_STATE_ESTABLISHED ||
+             s->state == TCP_STATE_CLOSE_WAIT)) {
+        /* This is a duplicate ACK (as defined in RFC 5681), which probably
+           means the other side got something after a segment that went
+           missing. Let the congestion control algorithm decide what to do
+           about it. */
+        ++s->data.dupacks;
+        s->cc->dupack(s);
+    }
+
+    /* Update the send window, as long as this segment is newer than the one we
+       last took it from. */
+    if(SEQ_LE(s->data.snd.una, ack) &&
+            (SEQ_LT(s->data.snd.wl1, seq) ||
+             (s->data.snd.wl1 == seq && SEQ_LE(s->data.snd.wl2, ack)))) {
+        s->data.snd.wnd = ntohs(tcp->wnd) << s->data.snd.wscale;
+        s->data.snd.wl1 = seq;
+        s->data.snd.wl2 = ack;
+    }
+
+    /* Send whatever the ACK has made room for. */
+    if((s->state == TCP_STATE_ESTABLISHED ||
+            s->state == TCP_STATE_CLOSE_WAIT) &&
+            s->data.sndbuf_cur_sz > s->data.snd.nxt - s->data.snd.una) {
+        tcp_send_data(s, 0, 0);
+    }
 
     /* We need to do a bit more processing in certain states... */
     switch(s->state) {
@@ -2658,48 +3455,72 @@ static int process_pkt(netif_t *src, const struct in6_addr *srca,
 
     if(s->state == TCP_STATE_ESTABLISHED || s->state == TCP_STATE_FIN_WAIT_1 ||
             s->state == TCP_STATE_FIN_WAIT_2) {
+        /* If this is a retransmission that overlaps what we've already got,
+           throw away the part we've seen before. */
+        if(SEQ_LT(seq, s->data.rcv.nxt)) {
+            off = s->data.rcv.nxt - seq;
+            buf += off;
+            sz -= off;
+            seq = s->data.rcv.nxt;
+        }
+
+        off = seq - s->data.rcv.nxt;
+
         /* Next, check the data size versus our window. If its more than the
            window, truncate the data and copy out what we can. */
-        if(sz > s->data.rcv.wnd) {
-            sz = s->data.rcv.wnd;
+        if(off + sz > s->data.rcv.wnd) {
+            sz = s->data.rcv.wnd - off;
             bad_pkt = 1;
         }
 
-        /* Copy the data out */
-        if(sz) {
-            rb = s->data.rcvbuf + s->data.rcvbuf_tail;
-            s->data.rcv.nxt += sz;
-            s->data.rcv.wnd -= sz;
-            s->data.rcvbuf_cur_sz += sz;
+        if(off && (sz || (flags & TCP_FLAG_FIN))) {
+            /* Something in front of this segment has gone missing. Hold on to
+               what we got and ack straight away, so the other side finds out
+               about the hole as soon as possible. */
+            ++s->data.ooo_segs;
 
-            if(s->data.rcvbuf_tail + sz <= s->rcvbuf_sz) {
-                memcpy(rb, buf, sz);
-                s->data.rcvbuf_tail += sz;
+            if(sz && tcp_ooo_add(s, seq, buf, sz) < 0) {
+                bad_pkt = 1;
             }
-            else {
-                tmp = s->rcvbuf_sz - s->data.rcvbuf_tail;
-                memcpy(rb, buf, tmp);
-                sz -= tmp;
-                buf += tmp;
-                memcpy(s->data.rcvbuf, buf, sz);
-                s->data.rcvbuf_tail = sz;
+            else if(!bad_pkt && (flags & TCP_FLAG_FIN)) {
+                s->intflags |= TCP_IFLAG_OOOFIN;
+                s->data.ooo_fin = seq + sz;
             }
 
-            /* Signal any waiting thread and send an ack for what we read */
-            __poll_event_trigger(s->sock, POLLRDNORM);
-            cond_signal(&s->data.recv_cv);
             tcp_send_ack(s);
         }
+        else if(!off) {
+            fin = !bad_pkt && (flags & TCP_FLAG_FIN);
+
+            /* Copy the data out, and pick up anything that was waiting on it */
+            if(sz) {
+                tcp_rcv_copy(s, 0, buf, sz);
+                tcp_rcv_advance(s, sz);
+            }
+
+            if(tcp_ooo_collapse(s))
+                fin = 1;
+
+            /* Signal any waiting thread and send an ack for what we read */
+            if(sz) {
+                __poll_event_trigger(s->sock, POLLRDNORM);
+                cond_signal(&s->data.recv_cv);
+                tcp_send_ack(s);
+            }
+        }
     }
     else if(sz) {
         /* If we get any segment text in here, there's a problem with the other
            side... Ignore it. */
         bad_pkt = 1;
     }
+    else {
+        fin = !bad_pkt && (flags & TCP_FLAG_FIN);
+    }
 
     /* Finally, check the FIN bit. We don't try to ack it if the packet had too
-       much data. */
-    if(!bad_pkt && (flags & TCP_FLAG_FIN)) {
+       much data, or if it came in before some of the data in front of it. */
+    if(fin) {
         /* ACK the FIN */
         ++s->data.rcv.nxt;
         tcp_send_ack(s);
@@ -2858,7 +3679,8 @@ static void tcp_thd_cb(void *arg) {
                 /* If our last <SYN> was sent more than one  retransmission
                    timeout period ago and we are still in the SYN-SENT state,
                    send another one. */
-                if(i->data.timer + TCP_DEFAULT_RTTO <= timer) {
+                if(i->data.timer + tcp_rto(i) <= timer) {
+                    tcp_rtt_timeout(i);
                     tcp_send_syn(i, 0);
                     i->data.timer = timer;
                 }
@@ -2870,7 +3692,8 @@ static void tcp_thd_cb(void *arg) {
                 /* If our last <SYN,ACK> was sent more than one  retransmission
                    timeout period ago and we are still in the SYN-RECEIVED
                    state, send another one. */
-                if(i->data.timer + TCP_DEFAULT_RTTO <= timer) {
+                if(i->data.timer + tcp_rto(i) <= timer) {
+                    tcp_rtt_timeout(i);
                     tcp_send_syn(i, 1);
                     i->data.timer = timer;
                 }
@@ -2891,8 +3714,18 @@ static void tcp_thd_cb(void *arg) {
             case TCP_STATE_CLOSE_WAIT:
 
                 if(i->data.sndbuf_cur_sz &&
-                        i->data.timer + TCP_DEFAULT_RTTO <= timer) {
-                    tcp_send_data(i, 1);
+                        i->data.timer + tcp_rto(i) <= timer) {
+                    /* Go back to the first unacked byte, and send everything
+                       from there again as the congestion window opens back
+                       up. If nothing was in flight, we're just probing a
+                       closed window, which says nothing about congestion. */
+                    if(i->data.snd.nxt != i->data.snd.una)
+                        i->cc->timeout(i);
+
+                    tcp_rtt_timeout(i);
+                    i->data.snd.nxt = i->data.snd.una;
+                    i->data.sndbuf_head = i->data.sndbuf_acked;
+                    tcp_send_data(i, 0, 0);
                 }
                 else if(!i->data.sndbuf_cur_sz &&
                         (i->intflags & TCP_IFLAG_QUEUEDCLOSE)) {
@@ -2924,6 +3757,7 @@ static void tcp_thd_cb(void *arg) {
         if((i->intflags & TCP_IFLAG_CANBEDEL) &&
                 (i->state & 0x0F) == TCP_STATE_CLOSED) {
             LIST_REMOVE(i, sock_list);
+            net_demux_remove(&tcp_demux, &i->demux);
             cond_destroy(&i->data.send_cv);
             cond_destroy(&i->data.recv_cv);
             mutex_destroy(&i->mutex);
@@ -2959,11 +3793,14 @@ static fs_socket_proto_t proto = {
     net_tcp_getsockname,                /* getsockname */
     net_tcp_getpeername,                /* getpeername */
     net_tcp_fcntl,                      /* fcntl */
-    net_tcp_poll                        /* poll */
+    net_tcp_poll,                       /* poll */
+    NULL,                               /* recvmmsg */
+    NULL                                /* sendmmsg */
 };
 
 int net_tcp_init(void) {
-    if((thd_cb_id = net_thd_add_callback(tcp_thd_cb, NULL, 50)) < 0)
+    if((thd_cb_id = net_thd_add_callback(tcp_thd_cb, NULL,
+                                             TCP_TIMER_PERIOD)) < 0)
         return -1;
 
     return fs_socket_proto_add(&proto);
@@ -2990,6 +3827,7 @@ void net_tcp_shutdown(void) {
         }
         else {
             LIST_REMOVE(i, sock_list);
+            net_demux_remove(&tcp_demux, &i->demux);
             cond_destroy(&i->data.send_cv);
             cond_destroy(&i->data.recv_cv);
             mutex_destroy(&i->mutex);
@@ -18,12 +18,15 @@
 #include <sys/queue.h>
 #include <kos/fs_socket.h>
 #include <arch/irq.h>
+#include <arch/timer.h>
 #include <sys/socket.h>
 #include <netinet/udp.h>
 #include <netinet/udplite.h>
 
 #include "net_ipv4.h"
 #include "net_ipv6.h"
+#include "net_demux.h"
+#include "net_buf.h"
 
 #if __GNUC__ >= 9
 #pragma GCC diagnostic push
@@ -42,9 +45,12 @@ typedef struct {
 } udp_hdr_t;
 #undef packed
 
+/* Received packets live at the start of a packet buffer, with the data
+   following right after them. */
 struct udp_pkt {
     TAILQ_ENTRY(udp_pkt) pkt_queue;
     struct sockaddr_in6 from;
+    net_buf_t *buf;
     uint8 *data;
     uint16 datasize;
 };
@@ -56,6 +62,7 @@ TAILQ_HEAD(udp_pkt_queue, udp_pkt);
 
 struct udp_sock {
     LIST_ENTRY(udp_sock) sock_list;
+    struct net_demux_ent demux;
     struct sockaddr_in6 local_addr;
     struct sockaddr_in6 remote_addr;
 
@@ -77,13 +84,15 @@ struct udp_sock {
 LIST_HEAD(udp_sock_list, udp_sock);
 
 static struct udp_sock_list net_udp_sockets = LIST_HEAD_INITIALIZER(0);
+static net_demux_t udp_demux;
 static mutex_t udp_mutex = MUTEX_INITIALIZER;
 static net_udp_stats_t udp_stats = { 0 };
 
 static int net_udp_send_raw(netif_t *net, const struct sockaddr_in6 *src,
-                            const struct sockaddr_in6 *dst, const uint8 *data,
-                            size_t size, uint32_t flags, int hops,
-                            uint32_t iflags, int proto, uint16_t cscov);
+                            const struct sockaddr_in6 *dst,
+                            const struct iovec *iov, int iovcnt,
+                            uint32_t flags, int hops, uint32_t iflags,
+                            int proto, uint16_t cscov);
 
 static int net_udp_accept(net_socket_t *hnd, struct sockaddr *addr,
                           socklen_t *addr_len) {
@@ -202,6 +211,8 @@ static int net_udp_bind(net_socket_t *hnd, const struct sockaddr *addr,
     }
 
     udpsock->sock = hnd->fd;
+    net_demux_insert(&udp_demux, &udpsock->demux, &udpsock->local_addr,
+                     &udpsock->remote_addr);
 
     mutex_unlock(&udp_mutex);
 
@@ -285,15 +296,24 @@ static int net_udp_connect(net_socket_t *hnd, const struct sockaddr *addr,
     }
 
     /* Make sure we have a valid address to connect to */
-    if(IN6_IS_ADDR_UNSPECIFIED(&realaddr6.sin6_addr) ||
-            realaddr6.sin6_port == 0) {
+    if(IN6_IS_ADDR_UNSPECIFIED(&realaddr6.sin6_addr)) {
         mutex_unlock(&udp_mutex);
         errno = EADDRNOTAVAIL;
         return -1;
     }
 
+    /* Nothing can send to us from port 0, so a socket connected to it would
+       never see a datagram. */
+    if(realaddr6.sin6_port == 0) {
+        mutex_unlock(&udp_mutex);
+        errno = EINVAL;
+        return -1;
+    }
+
     /* "Connect" to the specified address */
     udpsock->remote_addr = realaddr6;
+    net_demux_insert(&udp_demux, &udpsock->demux, &udpsock->local_addr,
+                     &udpsock->remote_addr);
 
     mutex_unlock(&udp_mutex);
 
@@ -307,6 +327,46 @@ static int net_udp_listen(net_socket_t *hnd, int backlog) {
     return -1;
 }
 
+/* Fill in the address a packet came from, in the form the socket's user
+   expects. */
+static void net_udp_fill_addr(const struct udp_sock *udpsock,
+                              const struct udp_pkt *pkt, struct sockaddr *addr,
+                              socklen_t *addr_len) {
+    if(udpsock->domain == AF_INET) {
+        struct sockaddr_in realaddr;
+
+        memset(&realaddr, 0, sizeof(struct sockaddr_in));
+        realaddr.sin_family = AF_INET;
+        realaddr.sin_addr.s_addr =
+            pkt->from.sin6_addr.__s6_addr.__s6_addr32[3];
+        realaddr.sin_port = pkt->from.sin6_port;
+
+        if(*addr_len < sizeof(struct sockaddr_in)) {
+            memcpy(addr, &realaddr, *addr_len);
+        }
+        else {
+            memcpy(addr, &realaddr, sizeof(struct sockaddr_in));
+            *addr_len = sizeof(struct sockaddr_in);
+        }
+    }
+    else if(udpsock->domain == AF_INET6) {
+        struct sockaddr_in6 realaddr6;
+
+        memset(&realaddr6, 0, sizeof(struct sockaddr_in6));
+        realaddr6.sin6_family = AF_INET6;
+        realaddr6.sin6_addr = pkt->from.sin6_addr;
+        realaddr6.sin6_port = pkt->from.sin6_port;
+
+        if(*addr_len < sizeof(struct sockaddr_in6)) {
+            memcpy(addr, &realaddr6, *addr_len);
+        }
+        else {
+            memcpy(addr, &realaddr6, sizeof(struct sockaddr_in6));
+            *addr_len = sizeof(struct sockaddr_in6);
+        }
+    }
+}
+
 static ssize_t net_udp_recvfrom(net_socket_t *hnd, void *buffer, size_t length,
                                 int flags, struct sockaddr *addr,
                                 socklen_t *addr_len) {
@@ -359,47 +419,13 @@ static ssize_t net_udp_recvfrom(net_socket_t *hnd, void *buffer, size_t length,
         length = pkt->datasize;
     }
 
-    if(addr != NULL) {
-        if(udpsock->domain == AF_INET) {
-            struct sockaddr_in realaddr;
-
-            memset(&realaddr, 0, sizeof(struct sockaddr_in));
-            realaddr.sin_family = AF_INET;
-            realaddr.sin_addr.s_addr =
-                pkt->from.sin6_addr.__s6_addr.__s6_addr32[3];
-            realaddr.sin_port = pkt->from.sin6_port;
-
-            if(*addr_len < sizeof(struct sockaddr_in)) {
-                memcpy(addr, &realaddr, *addr_len);
-            }
-            else {
-                memcpy(addr, &realaddr, sizeof(struct sockaddr_in));
-                *addr_len = sizeof(struct sockaddr_in);
-            }
-        }
-        else if(udpsock->domain == AF_INET6) {
-            struct sockaddr_in6 realaddr6;
-
-            memset(&realaddr6, 0, sizeof(struct sockaddr_in6));
-            realaddr6.sin6_family = AF_INET6;
-            realaddr6.sin6_addr = pkt->from.sin6_addr;
-            realaddr6.sin6_port = pkt->from.sin6_port;
-
-            if(*addr_len < sizeof(struct sockaddr_in6)) {
-                memcpy(addr, &realaddr6, *addr_len);
-            }
-            else {
-                memcpy(addr, &realaddr6, sizeof(struct sockaddr_in6));
-                *addr_len = sizeof(struct sockaddr_in6);
-            }
-        }
-    }
+    if(addr != NULL)
+        net_udp_fill_addr(udpsock, pkt, addr, addr_len);
 
     /* Remove the packet if we're pulling data out of the queue. */
     if(!(flags & MSG_PEEK)) {
         TAILQ_REMOVE(&udpsock->packets, pkt, pkt_queue);
-        free(pkt->data);
-        free(pkt);
+        net_buf_free(pkt->buf);
     }
 
     mutex_unlock(&udp_mutex);
@@ -407,18 +433,17 @@ static ssize_t net_udp_recvfrom(net_socket_t *hnd, void *buffer, size_t length,
     return length;
 }
 
-static ssize_t net_udp_sendto(net_socket_t *hnd, const void *message,
-                              size_t length, int flags,
-                              const struct sockaddr *addr, socklen_t addr_len) {
+/* Receive a batch of datagrams. After waiting for the first one, whatever else
+   is already queued is handed over without letting go of the lock. */
+static int net_udp_recvmmsg(net_socket_t *hnd, struct mmsghdr *msgvec,
+                            unsigned int vlen, int flags, int timeout) {
     struct udp_sock *udpsock;
-    struct sockaddr_in *realaddr;
-    struct sockaddr_in6 realaddr6;
-    uint32_t sflags, iflags;
-    int hops, proto;
-    uint16_t cscov;
-    struct sockaddr_in6 local_addr;
-
-    (void)flags;
+    struct udp_pkt *pkt, *next;
+    struct msghdr *msg;
+    size_t len, tmp;
+    uint64_t deadline = 0;
+    unsigned int i;
+    int j;
 
     if(mutex_lock_irqsafe(&udp_mutex))
         return -1;
@@ -426,84 +451,218 @@ static ssize_t net_udp_sendto(net_socket_t *hnd, const void *message,
     udpsock = (struct udp_sock *)hnd->data;
 
     if(udpsock == NULL) {
+        mutex_unlock(&udp_mutex);
         errno = EBADF;
-        goto err;
+        return -1;
     }
 
-    if(udpsock->flags & (SHUT_WR << 24)) {
-        errno = EPIPE;
-        goto err;
+    if(udpsock->flags & (SHUT_RD << 24)) {
+        mutex_unlock(&udp_mutex);
+        return 0;
     }
 
-    if(!IN6_IS_ADDR_UNSPECIFIED(&udpsock->remote_addr.sin6_addr) &&
-       udpsock->remote_addr.sin6_port != 0) {
+    if(timeout)
+        deadline = timer_ms_gettime64() + timeout;
+
+    if(TAILQ_EMPTY(&udpsock->packets) &&
+       ((udpsock->flags & FS_SOCKET_NONBLOCK) || (flags & MSG_DONTWAIT) ||
+        irq_inside_int())) {
+        mutex_unlock(&udp_mutex);
+        errno = EWOULDBLOCK;
+        return -1;
+    }
+
+    while(TAILQ_EMPTY(&udpsock->packets)) {
+        mutex_unlock(&udp_mutex);
+
+        if(genwait_wait(udpsock, "net_udp_recvmmsg", timeout, NULL) < 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        mutex_lock(&udp_mutex);
+
+        /* If we got woken up with nothing to read, only wait for whatever is
+           left of the timeout. */
+        if(timeout && TAILQ_EMPTY(&udpsock->packets) &&
+           (timeout = (int)(deadline - timer_ms_gettime64())) <= 0) {
+            mutex_unlock(&udp_mutex);
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+
+    pkt = TAILQ_FIRST(&udpsock->packets);
+
+    for(i = 0; i < vlen && pkt; ++i, pkt = next) {
+        msg = &msgvec[i].msg_hdr;
+        next = TAILQ_NEXT(pkt, pkt_queue);
+
+        if(msg->msg_iovlen < 0 || msg->msg_iovlen > IOV_MAX) {
+            errno = EMSGSIZE;
+            break;
+        }
+
+        if(msg->msg_iovlen && !msg->msg_iov) {
+            errno = EFAULT;
+            break;
+        }
+
+        /* Scatter the datagram over the buffers, throwing away whatever
+           doesn't fit. */
+        msg->msg_flags = 0;
+
+        for(j = 0, len = 0; j < msg->msg_iovlen && len < pkt->datasize; ++j) {
+            tmp = pkt->datasize - len;
+
+            if(tmp > msg->msg_iov[j].iov_len)
+                tmp = msg->msg_iov[j].iov_len;
+
+            memcpy(msg->msg_iov[j].iov_base, pkt->data + len, tmp);
+            len += tmp;
+        }
+
+        if(len < pkt->datasize)
+            msg->msg_flags |= MSG_TRUNC;
+
+        if(msg->msg_name)
+            net_udp_fill_addr(udpsock, pkt, (struct sockaddr *)msg->msg_name,
+                              &msg->msg_namelen);
+
+        msgvec[i].msg_len = len;
+
+        /* Remove the packet if we're pulling data out of the queue. */
+        if(!(flags & MSG_PEEK)) {
+            TAILQ_REMOVE(&udpsock->packets, pkt, pkt_queue);
+            net_buf_free(pkt->buf);
+        }
+    }
+
+    mutex_unlock(&udp_mutex);
+
+    /* Only report an error if nothing got received at all. */
+    return i ? (int)i : -1;
+}
+
+/* Work out where a datagram is going, from the address given to sendto() or
+   the one the socket is connected to (in remote). */
+static int net_udp_dest(int domain, const struct sockaddr_in6 *remote,
+                        const struct sockaddr *addr, socklen_t addr_len,
+                        struct sockaddr_in6 *dst) {
+    const struct sockaddr_in *realaddr;
+
+    if(!IN6_IS_ADDR_UNSPECIFIED(&remote->sin6_addr) &&
+       remote->sin6_port != 0) {
         if(addr) {
             errno = EISCONN;
-            goto err;
+            return -1;
         }
 
-        realaddr6 = udpsock->remote_addr;
+        *dst = *remote;
     }
     else if(addr == NULL) {
         errno = EDESTADDRREQ;
-        goto err;
+        return -1;
     }
-    else if(addr->sa_family != udpsock->domain) {
+    else if(addr->sa_family != domain) {
         errno = EAFNOSUPPORT;
-        goto err;
+        return -1;
     }
-    else if(udpsock->domain == AF_INET6) {
+    else if(domain == AF_INET6) {
         if(addr_len != sizeof(struct sockaddr_in6)) {
             errno = EINVAL;
-            goto err;
+            return -1;
         }
 
-        realaddr6 = *((struct sockaddr_in6 *)addr);
+        *dst = *((const struct sockaddr_in6 *)addr);
     }
-    else if(udpsock->domain == AF_INET) {
+    else if(domain == AF_INET) {
         if(addr_len != sizeof(struct sockaddr_in)) {
             errno = EINVAL;
-            goto err;
+            return -1;
         }
 
-        realaddr = (struct sockaddr_in *)addr;
-        memset(&realaddr6, 0, sizeof(struct sockaddr_in6));
-        realaddr6.sin6_family = AF_INET6;
-        realaddr6.sin6_addr.__s6_addr.__s6_addr16[5] = 0xFFFF;
-        realaddr6.sin6_addr.__s6_addr.__s6_addr32[3] =
-            realaddr->sin_addr.s_addr;
-        realaddr6.sin6_port = realaddr->sin_port;
+        realaddr = (const struct sockaddr_in *)addr;
+        memset(dst, 0, sizeof(struct sockaddr_in6));
+        dst->sin6_family = AF_INET6;
+        dst->sin6_addr.__s6_addr.__s6_addr16[5] = 0xFFFF;
+        dst->sin6_addr.__s6_addr.__s6_addr32[3] = realaddr->sin_addr.s_addr;
+        dst->sin6_port = realaddr->sin_port;
     }
     else {
         /* Shouldn't be able to get here... */
         errno = EBADF;
-        goto err;
+        return -1;
     }
 
-    if(message == NULL) {
-        errno = EFAULT;
-        goto err;
-    }
+    return 0;
+}
 
-    if(udpsock->local_addr.sin6_port == 0) {
-        uint16 port = 1024, tmp = 0;
-        struct udp_sock *iter;
+/* Give a socket that's sending without having been bound a local port. Called
+   with udp_mutex held. */
+static void net_udp_autobind(struct udp_sock *udpsock) {
+    uint16 port = 1024, tmp = 0;
+    struct udp_sock *iter;
 
-        /* Grab the first unused port >= 1024. This is, unfortunately, O(n^2) */
-        while(tmp != port) {
-            tmp = port;
+    if(udpsock->local_addr.sin6_port != 0)
+        return;
 
-            LIST_FOREACH(iter, &net_udp_sockets, sock_list) {
-                if(iter->local_addr.sin6_port == port) {
-                    ++port;
-                    break;
-                }
+    /* Grab the first unused port >= 1024. This is, unfortunately, O(n^2) */
+    while(tmp != port) {
+        tmp = port;
+
+        LIST_FOREACH(iter, &net_udp_sockets, sock_list) {
+            if(iter->local_addr.sin6_port == port) {
+                ++port;
+                break;
             }
         }
+    }
 
-        udpsock->local_addr.sin6_port = htons(port);
+    udpsock->local_addr.sin6_port = htons(port);
+    net_demux_insert(&udp_demux, &udpsock->demux, &udpsock->local_addr,
+                     &udpsock->remote_addr);
+}
+
+static ssize_t net_udp_sendto(net_socket_t *hnd, const void *message,
+                              size_t length, int flags,
+                              const struct sockaddr *addr, socklen_t addr_len) {
+    struct udp_sock *udpsock;
+    struct sockaddr_in6 realaddr6;
+    struct iovec iov;
+    uint32_t sflags, iflags;
+    int hops, proto;
+    uint16_t cscov;
+    struct sockaddr_in6 local_addr;
+
+    (void)flags;
+
+    if(mutex_lock_irqsafe(&udp_mutex))
+        return -1;
+
+    udpsock = (struct udp_sock *)hnd->data;
+
+    if(udpsock == NULL) {
+        errno = EBADF;
+        goto err;
+    }
+
+    if(udpsock->flags & (SHUT_WR << 24)) {
+        errno = EPIPE;
+        goto err;
+    }
+
+    if(net_udp_dest(udpsock->domain, &udpsock->remote_addr, addr, addr_len,
+                    &realaddr6))
+        goto err;
+
+    if(message == NULL) {
+        errno = EFAULT;
+        goto err;
     }
 
+    net_udp_autobind(udpsock);
+
     local_addr = udpsock->local_addr;
     sflags = udpsock->flags;
     iflags = udpsock->int_flags;
@@ -512,14 +671,91 @@ static ssize_t net_udp_sendto(net_socket_t *hnd, const void *message,
     cscov = udpsock->udp_lite.send_cscov;
     mutex_unlock(&udp_mutex);
 
-    return net_udp_send_raw(NULL, &local_addr, &realaddr6,
-                            (const uint8 *)message, length, sflags, hops,
-                            iflags, proto, cscov);
+    iov.iov_base = (void *)message;
+    iov.iov_len = length;
+
+    return net_udp_send_raw(NULL, &local_addr, &realaddr6, &iov, 1, sflags,
+                            hops, iflags, proto, cscov);
 err:
     mutex_unlock(&udp_mutex);
     return -1;
 }
 
+/* Send a batch of datagrams. The socket is only locked once for the whole
+   batch, rather than once per datagram as sendto() would. */
+static int net_udp_sendmmsg(net_socket_t *hnd, struct mmsghdr *msgvec,
+                            unsigned int vlen, int flags) {
+    struct udp_sock *udpsock;
+    struct sockaddr_in6 dst, remote_addr, local_addr;
+    struct msghdr *msg;
+    uint32_t sflags, iflags;
+    int domain, hops, proto, rv;
+    uint16_t cscov;
+    unsigned int i;
+
+    (void)flags;
+
+    if(mutex_lock_irqsafe(&udp_mutex))
+        return -1;
+
+    udpsock = (struct udp_sock *)hnd->data;
+
+    if(udpsock == NULL) {
+        mutex_unlock(&udp_mutex);
+        errno = EBADF;
+        return -1;
+    }
+
+    if(udpsock->flags & (SHUT_WR << 24)) {
+        mutex_unlock(&udp_mutex);
+        errno = EPIPE;
+        return -1;
+    }
+
+    net_udp_autobind(udpsock);
+
+    domain = udpsock->domain;
+    remote_addr = udpsock->remote_addr;
+    local_addr = udpsock->local_addr;
+    sflags = udpsock->flags;
+    iflags = udpsock->int_flags;
+    hops = udpsock->hop_limit;
+    proto = udpsock->proto;
+    cscov = udpsock->udp_lite.send_cscov;
+    mutex_unlock(&udp_mutex);
+
+    for(i = 0; i < vlen; ++i) {
+        msg = &msgvec[i].msg_hdr;
+
+        if(msg->msg_iovlen < 0 || msg->msg_iovlen > IOV_MAX) {
+            errno = EMSGSIZE;
+            break;
+        }
+
+        if(msg->msg_iovlen && !msg->msg_iov) {
+            errno = EFAULT;
+            break;
+        }
+
+        if(net_udp_dest(domain, &remote_addr,
+                        (const struct sockaddr *)msg->msg_name,
+                        msg->msg_namelen, &dst))
+            break;
+
+        rv = net_udp_send_raw(NULL, &local_addr, &dst, msg->msg_iov,
+                              msg->msg_iovlen, sflags, hops, iflags, proto,
+                              cscov);
+
+        if(rv < 0)
+            break;
+
+        msgvec[i].msg_len = rv;
+    }
+
+    /* Only report an error if nothing got sent at all. */
+    return i ? (int)i : -1;
+}
+
 static int net_udp_shutdownsock(net_socket_t *hnd, int how) {
     struct udp_sock *udpsock;
 
@@ -571,6 +807,7 @@ static int net_udp_socket(net_socket_t *hnd, int domain, int type, int proto) {
 
     memset(udpsock, 0, sizeof(struct udp_sock));
     TAILQ_INIT(&udpsock->packets);
+    udpsock->sock = hnd->fd;
     udpsock->domain = domain;
     udpsock->proto = proto;
     udpsock->hop_limit = UDP_DEFAULT_HOPS;
@@ -581,6 +818,8 @@ static int net_udp_socket(net_socket_t *hnd, int domain, int type, int proto) {
     }
 
     LIST_INSERT_HEAD(&net_udp_sockets, udpsock, sock_list);
+    net_demux_insert(&udp_demux, &udpsock->demux, &udpsock->local_addr,
+                     &udpsock->remote_addr);
     hnd->data = udpsock;
     mutex_unlock(&udp_mutex);
 
@@ -608,12 +847,12 @@ static void net_udp_close(net_socket_t *hnd) {
         pkt = it;
         it = it->pkt_queue.tqe_next;
 
-        free(pkt->data);
         TAILQ_REMOVE(&udpsock->packets, pkt, pkt_queue);
-        free(pkt);
+        net_buf_free(pkt->buf);
     }
 
     LIST_REMOVE(udpsock, sock_list);
+    net_demux_remove(&udp_demux, &udpsock->demux);
 
     free(udpsock);
     mutex_unlock(&udp_mutex);
@@ -1103,13 +1342,59 @@ static short net_udp_poll(net_socket_t *hnd, short events) {
 
 extern void __poll_event_trigger(int fd, short event);
 
+/* Check the parts of a socket's setup that the demux table doesn't cover
+   against an incoming IPv4 packet. */
+static int net_udp_match4(struct net_demux_ent *ent, void *data) {
+    struct udp_sock *sock = NET_DEMUX_SOCK(ent, struct udp_sock, demux);
+
+    /* Don't even bother looking at IPv6-only sockets */
+    if(sock->domain == AF_INET6 && (sock->flags & FS_SOCKET_V6ONLY))
+        return 0;
+
+    /* Make sure we have the right protocol */
+    return sock->proto == *(int *)data;
+}
+
+/* Same as above, for an incoming IPv6 packet. */
+static int net_udp_match6(struct net_demux_ent *ent, void *data) {
+    struct udp_sock *sock = NET_DEMUX_SOCK(ent, struct udp_sock, demux);
+
+    /* Don't even bother looking at IPv4 sockets */
+    if(sock->domain == AF_INET)
+        return 0;
+
+    /* Make sure we have the right protocol */
+    return sock->proto == *(int *)data;
+}
+
+/* Copy a received datagram into a packet buffer, ready to be queued. */
+static struct udp_pkt *net_udp_pkt_alloc(const uint8 *data, size_t size) {
+    struct udp_pkt *pkt;
+    net_buf_t *buf;
+
+    if(!(buf = net_buf_alloc(sizeof(struct udp_pkt) + size)))
+        return NULL;
+
+    pkt = (struct udp_pkt *)buf->data;
+    memset(pkt, 0, sizeof(struct udp_pkt));
+
+    pkt->buf = buf;
+    pkt->data = buf->data + sizeof(struct udp_pkt);
+    pkt->datasize = size;
+    memcpy(pkt->data, data, size);
+
+    return pkt;
+}
+
 static int net_udp_input4(netif_t *src, const ip_hdr_t *ip, const uint8 *data,
                           size_t size) {
     udp_hdr_t *hdr = (udp_hdr_t *)data;
+    struct in6_addr srca;
     uint16 cs, cscov = 0;
-    int partial = 1;
+    int partial = 1, proto;
     struct udp_sock *sock;
     struct udp_pkt *pkt;
+    struct net_demux_ent *ent;
 
     (void)src;
 
@@ -1166,89 +1451,63 @@ static int net_udp_input4(netif_t *src, const ip_hdr_t *ip, const uint8 *data,
         /* If the mutex is locked, there isn't much that can be done. */
         return -1;
 
-    LIST_FOREACH(sock, &net_udp_sockets, sock_list) {
-        /* Don't even bother looking at IPv6-only sockets */
-        if(sock->domain == AF_INET6 && (sock->flags & FS_SOCKET_V6ONLY))
-            continue;
-
-        /* If the ports don't match, don't look any further */
-        if(sock->local_addr.sin6_port != hdr->dst_port)
-            continue;
-
-        /* If the socket has a remote port set and it isn't the one that this
-           packet came from, bail */
-        if(sock->remote_addr.sin6_port != 0 &&
-           sock->remote_addr.sin6_port != hdr->src_port)
-            continue;
-
-        /* If we have a address specified, and its not v4-mapped or its not the
-           address this packet came from, bail out */
-        if(!IN6_IS_ADDR_UNSPECIFIED(&sock->remote_addr.sin6_addr) &&
-           (!IN6_IS_ADDR_V4MAPPED(&sock->remote_addr.sin6_addr) ||
-            sock->remote_addr.sin6_addr.__s6_addr.__s6_addr32[3] != ip->src))
-            continue;
-
-        /* Make sure we have the right protocol */
-        if(sock->proto != ip->protocol)
-            continue;
-
-        /* If this packet is UDP-Lite, make sure the checksum coverage is valid
-           for the socket. We have to be careful here not to reject packets with
-           full coverage that just happen to be smaller than the coverage set by
-           the userspace program. Note that failing this check DOES NOT change
-           any of the statistics counters at all, by design. */
-        if((sock->int_flags & UDPSOCK_LITE_RCVCOV) && partial &&
-           cscov < sock->udp_lite.recv_cscov) {
-            /* Silently drop packets that fail the partial coverage check. */
-            mutex_unlock(&udp_mutex);
-            return 0;
-        }
-
-        if(!(pkt = (struct udp_pkt *)malloc(sizeof(struct udp_pkt)))) {
-            mutex_unlock(&udp_mutex);
-            return -1;
-        }
-
-        memset(pkt, 0, sizeof(struct udp_pkt));
-
-        pkt->datasize = size - sizeof(udp_hdr_t);
-
-        if(!(pkt->data = (uint8 *)malloc(pkt->datasize))) {
-            free(pkt);
-            mutex_unlock(&udp_mutex);
-            return -1;
-        }
-
-        pkt->from.sin6_family = AF_INET6;
-        pkt->from.sin6_addr.__s6_addr.__s6_addr16[5] = 0xFFFF;
-        pkt->from.sin6_addr.__s6_addr.__s6_addr32[3] = ip->src;
-        pkt->from.sin6_port = hdr->src_port;
+    /* Find the socket connected to where this came from, or failing that,
+       one that isn't connected to anything. */
+    memset(&srca, 0, sizeof(struct in6_addr));
+    srca.__s6_addr.__s6_addr16[5] = 0xFFFF;
+    srca.__s6_addr.__s6_addr32[3] = ip->src;
+    proto = ip->protocol;
 
-        memcpy(pkt->data, data + sizeof(udp_hdr_t), pkt->datasize);
+    if(!(ent = net_demux_lookup(&udp_demux, hdr->dst_port, &srca,
+                                hdr->src_port, net_udp_match4, &proto))) {
+        ++udp_stats.pkt_recv_no_sock;
+        mutex_unlock(&udp_mutex);
+        return -1;
+    }
 
-        TAILQ_INSERT_TAIL(&sock->packets, pkt, pkt_queue);
+    sock = NET_DEMUX_SOCK(ent, struct udp_sock, demux);
 
-        ++udp_stats.pkt_recv;
-        __poll_event_trigger(sock->sock, POLLRDNORM);
-        genwait_wake_one(sock);
+    /* If this packet is UDP-Lite, make sure the checksum coverage is valid
+       for the socket. We have to be careful here not to reject packets with
+       full coverage that just happen to be smaller than the coverage set by
+       the userspace program. Note that failing this check DOES NOT change
+       any of the statistics counters at all, by design. */
+    if((sock->int_flags & UDPSOCK_LITE_RCVCOV) && partial &&
+       cscov < sock->udp_lite.recv_cscov) {
+        /* Silently drop packets that fail the partial coverage check. */
         mutex_unlock(&udp_mutex);
-
         return 0;
     }
 
-    ++udp_stats.pkt_recv_no_sock;
+    if(!(pkt = net_udp_pkt_alloc(data + sizeof(udp_hdr_t),
+                                 size - sizeof(udp_hdr_t)))) {
+        mutex_unlock(&udp_mutex);
+        return -1;
+    }
+
+    pkt->from.sin6_family = AF_INET6;
+    pkt->from.sin6_addr.__s6_addr.__s6_addr16[5] = 0xFFFF;
+    pkt->from.sin6_addr.__s6_addr.__s6_addr32[3] = ip->src;
+    pkt->from.sin6_port = hdr->src_port;
+
+    TAILQ_INSERT_TAIL(&sock->packets, pkt, pkt_queue);
+
+    ++udp_stats.pkt_recv;
+    __poll_event_trigger(sock->sock, POLLRDNORM);
+    genwait_wake_one(sock);
     mutex_unlock(&udp_mutex);
 
-    return -1;
+    return 0;
 }
 
 static int net_udp_input6(netif_t *src, const ipv6_hdr_t *ip, const uint8 *data,
                           size_t size) {
     udp_hdr_t *hdr = (udp_hdr_t *)data;
     uint16 cs, cscov = 0;
-    int partial = 1;
+    int partial = 1, proto;
     struct udp_sock *sock;
     struct udp_pkt *pkt;
+    struct net_demux_ent *ent;
 
     (void)src;
 
@@ -1303,79 +1562,49 @@ static int net_udp_input6(netif_t *src, const ipv6_hdr_t *ip, const uint8 *data,
         /* If the mutex is locked, there isn't much that can be done. */
         return -1;
 
-    LIST_FOREACH(sock, &net_udp_sockets, sock_list) {
-        /* Don't even bother looking at IPv4 sockets */
-        if(sock->domain == AF_INET)
-            continue;
-
-        /* If the ports don't match, don't look any further */
-        if(sock->local_addr.sin6_port != hdr->dst_port)
-            continue;
-
-        /* If the socket has a remote port set and it isn't the one that this
-           packet came from, bail */
-        if(sock->remote_addr.sin6_port != 0 &&
-           sock->remote_addr.sin6_port != hdr->src_port)
-            continue;
-
-        /* If we have a address specified and it is not the address this packet
-           came from, bail out */
-        if(!IN6_IS_ADDR_UNSPECIFIED(&sock->remote_addr.sin6_addr) &&
-           memcmp(&sock->remote_addr.sin6_addr, &ip->src_addr,
-                  sizeof(struct in6_addr)))
-            continue;
-
-        /* Make sure we have the right protocol */
-        if(sock->proto != ip->next_header)
-            continue;
-
-        /* If this packet is UDP-Lite, make sure the checksum coverage is valid
-           for the socket. We have to be careful here not to reject packets with
-           full coverage that just happen to be smaller than the coverage set by
-           the userspace program. Note that failing this check DOES NOT change
-           any of the statistics counters at all, by design. */
-        if((sock->int_flags & UDPSOCK_LITE_RCVCOV) && partial &&
-           cscov < sock->udp_lite.recv_cscov) {
-            /* Silently drop packets that fail the partial coverage check. */
-            mutex_unlock(&udp_mutex);
-            return 0;
-        }
-
-        if(!(pkt = (struct udp_pkt *)malloc(sizeof(struct udp_pkt)))) {
-            mutex_unlock(&udp_mutex);
-            return -1;
-        }
-
-        memset(pkt, 0, sizeof(struct udp_pkt));
-
-        pkt->datasize = size - sizeof(udp_hdr_t);
+    /* Find the socket connected to where this came from, or failing that,
+       one that isn't connected to anything. */
+    proto = ip->next_header;
 
-        if(!(pkt->data = (uint8 *)malloc(pkt->datasize))) {
-            free(pkt);
-            mutex_unlock(&udp_mutex);
-            return -1;
-        }
-
-        pkt->from.sin6_family = AF_INET6;
-        pkt->from.sin6_addr = ip->src_addr;
-        pkt->from.sin6_port = hdr->src_port;
-
-        memcpy(pkt->data, data + sizeof(udp_hdr_t), pkt->datasize);
+    if(!(ent = net_demux_lookup(&udp_demux, hdr->dst_port, &ip->src_addr,
+                                hdr->src_port, net_udp_match6, &proto))) {
+        ++udp_stats.pkt_recv_no_sock;
+        mutex_unlock(&udp_mutex);
+        return -1;
+    }
 
-        TAILQ_INSERT_TAIL(&sock->packets, pkt, pkt_queue);
+    sock = NET_DEMUX_SOCK(ent, struct udp_sock, demux);
 
-        ++udp_stats.pkt_recv;
-        __poll_event_trigger(sock->sock, POLLRDNORM);
-        genwait_wake_one(sock);
+    /* If this packet is UDP-Lite, make sure the checksum coverage is valid
+       for the socket. We have to be careful here not to reject packets with
+       full coverage that just happen to be smaller than the coverage set by
+       the userspace program. Note that failing this check DOES NOT change
+       any of the statistics counters at all, by design. */
+    if((sock->int_flags & UDPSOCK_LITE_RCVCOV) && partial &&
+       cscov < sock->udp_lite.recv_cscov) {
+        /* Silently drop packets that fail the partial coverage check. */
         mutex_unlock(&udp_mutex);
-
         return 0;
     }
 
-    ++udp_stats.pkt_recv_no_sock;
+    if(!(pkt = net_udp_pkt_alloc(data + sizeof(udp_hdr_t),
+                                 size - sizeof(udp_hdr_t)))) {
+        mutex_unlock(&udp_mutex);
+        return -1;
+    }
+
+    pkt->from.sin6_family = AF_INET6;
+    pkt->from.sin6_addr = ip->src_addr;
+    pkt->from.sin6_port = hdr->src_port;
+
+    TAILQ_INSERT_TAIL(&sock->packets, pkt, pkt_queue);
+
+    ++udp_stats.pkt_recv;
+    __poll_event_trigger(sock->sock, POLLRDNORM);
+    genwait_wake_one(sock);
     mutex_unlock(&udp_mutex);
 
-    return -1;
+    return 0;
 }
 
 static int net_udp_input(netif_t *src, int domain, const void *hdr,
@@ -1391,21 +1620,26 @@ static int net_udp_input(netif_t *src, int domain, const void *hdr,
     return -1;
 }
 
-/* XXX */
+/* Build a datagram out of the data in iov and send it. The data is gathered
+   straight into the packet buffer, so callers don't need to put it together
+   themselves first. */
 static int net_udp_send_raw(netif_t *net, const struct sockaddr_in6 *src,
-                            const struct sockaddr_in6 *dst, const uint8 *data,
-                            size_t size, uint32_t flags, int hops,
-                            uint32_t iflags, int proto, uint16_t cscov) {
-    uint8 buf[size + sizeof(udp_hdr_t)];
-    udp_hdr_t *hdr = (udp_hdr_t *)buf;
+                            const struct sockaddr_in6 *dst,
+                            const struct iovec *iov, int iovcnt,
+                            uint32_t flags, int hops, uint32_t iflags,
+                            int proto, uint16_t cscov) {
+    net_buf_t *nb;
+    uint8 *buf;
+    udp_hdr_t *hdr;
     uint16 cs;
-    int err;
+    int err, i;
+    size_t size = 0;
     struct in6_addr srcaddr = src->sin6_addr;
 
     (void)flags;
 
     if(!net) {
-        net = net_default_dev;
+        net = net_ipv6_route(&dst->sin6_addr);
 
         if(!net) {
             errno = ENETDOWN;
@@ -1440,7 +1674,30 @@ static int net_udp_send_raw(netif_t *net, const struct sockaddr_in6 *src,
         }
     }
 
-    memcpy(buf + sizeof(udp_hdr_t), data, size);
+    for(i = 0; i < iovcnt; ++i)
+        size += iov[i].iov_len;
+
+    if(size > 65535 - sizeof(udp_hdr_t)) {
+        errno = EMSGSIZE;
+        ++udp_stats.pkt_send_failed;
+        return -1;
+    }
+
+    if(!(nb = net_buf_alloc(size + sizeof(udp_hdr_t)))) {
+        errno = ENOBUFS;
+        ++udp_stats.pkt_send_failed;
+        return -1;
+    }
+
+    buf = nb->data;
+    hdr = (udp_hdr_t *)buf;
+
+    for(i = 0, size = 0; i < iovcnt; ++i) {
+        memcpy(buf + sizeof(udp_hdr_t) + size, iov[i].iov_base,
+               iov[i].iov_len);
+        size += iov[i].iov_len;
+    }
+
     size += sizeof(udp_hdr_t);
 
     hdr->src_port = src->sin6_port;
@@ -1473,6 +1730,7 @@ static int net_udp_send_raw(netif_t *net, const struct sockaddr_in6 *src,
     /* Pass everything off to the network layer to do the rest. */
     err = net_ipv6_send(net, buf, size, hops, proto, &srcaddr,
                         &dst->sin6_addr);
+    net_buf_free(nb);
 
     if(err < 0) {
         ++udp_stats.pkt_send_failed;
@@ -1509,7 +1767,9 @@ static fs_socket_proto_t proto = {
     net_udp_getsockname,
     net_udp_getpeername,
     net_udp_fcntl,
-    net_udp_poll
+    net_udp_poll,
+    net_udp_recvmmsg,
+    net_udp_sendmmsg
 };
 
 static fs_socket_proto_t proto_lite = {
@@ -1532,7 +1792,9 @@ static fs_socket_proto_t proto_lite = {
     net_udp_getsockname,
     net_udp_getpeername,
     net_udp_fcntl,
-    net_udp_poll
+    net_udp_poll,
+    net_udp_recvmmsg,
+    net_udp_sendmmsg
 };
 
 int net_udp_init(void) {
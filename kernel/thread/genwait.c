@@ -23,6 +23,7 @@
 #include <arch/timer.h>
 #include <kos/genwait.h>
 #include <kos/sem.h>
+#include <dc/perfctr.h>
 
 /* Our sleep queues table. This is also modeled after the BSD numbers. I
    figure if they've been using it as long as they have, they must be
@@ -35,36 +36,184 @@ static TAILQ_HEAD(slpquehead, kthread) slpque[TABLESIZE];
    ready to run at a later time will be placed here. Note that this doesn't
    deal with pre-emptive timeslice context switching, only things that are
    specifically blocked for a timed event (thd_sleep, genwait_wait, etc).
-   This queue is sorted by remaining time (smallest at the front). */
-static struct ktqueue timer_queue;
 
-/* Internal function to insert a thread on the timer queue. Maintains
-   sorting order by wait time. */
+   This is a hierarchical timer wheel, so that adding and removing timeouts
+   doesn't depend on how many other threads are sleeping. Each level of the
+   wheel has 64 slots, each covering 64 times as many milliseconds as a slot
+   in the level below it. A thread goes into the lowest level where its
+   timeout shares all of the higher bits with tw_time, the time the wheel has
+   been advanced to, so slot n of level l holds the timeouts whose bits
+   6l..6l+5 are n. Anything too far out for the top level goes on the overflow
+   list, and anything at or before tw_time goes on the due list. When the
+   wheel is advanced to the start of a slot in one of the upper levels, the
+   threads in it get spread out into the levels below it. */
+#define TW_BITS         6
+#define TW_SIZE         (1 << TW_BITS)
+#define TW_LEVELS       4
+#define TW_OVERFLOW     (TW_LEVELS * TW_SIZE)
+#define TW_DUE          (TW_OVERFLOW + 1)
+
+static struct ktqueue timer_wheel[TW_DUE + 1];
+static uint64_t tw_map[TW_LEVELS];
+static uint64_t tw_time;
+static int tw_count;
+
+#define TW_SHIFT(l)     ((l) * TW_BITS)
+#define TW_GROUP(t, l)  ((int)((t) >> TW_SHIFT(l)) & (TW_SIZE - 1))
+
+/* Internal function to insert a thread on the timer queue. */
 static void tq_insert(kthread_t * thd) {
-    kthread_t * t;
+    uint64_t tm = thd->wait_timeout;
+    int l, slot = TW_OVERFLOW;
 
-    /* Search for its place; note that new threads will be placed at
-       the end of a group with the same timeout. */
-    TAILQ_FOREACH(t, &timer_queue, timerq) {
-        if(thd->wait_timeout < t->wait_timeout) {
-            TAILQ_INSERT_BEFORE(t, thd, timerq);
-            return;
+    if(tm <= tw_time) {
+        slot = TW_DUE;
+    }
+    else {
+        for(l = 0; l < TW_LEVELS; ++l) {
+            if((tm >> TW_SHIFT(l + 1)) == (tw_time >> TW_SHIFT(l + 1))) {
+                slot = l * TW_SIZE + TW_GROUP(tm, l);
+                tw_map[l] |= 1ULL << TW_GROUP(tm, l);
+                break;
+            }
         }
     }
 
-    /* Couldn't find anything scheduled later, put this at the end. */
-    TAILQ_INSERT_TAIL(&timer_queue, thd, timerq);
+    thd->wait_slot = slot;
+    TAILQ_INSERT_TAIL(&timer_wheel[slot], thd, timerq);
+    ++tw_count;
 }
 
 /* Internal function to remove a thread from the timer queue. */
 static void tq_remove(kthread_t * thd) {
-    TAILQ_REMOVE(&timer_queue, thd, timerq);
+    int slot = thd->wait_slot;
+
+    TAILQ_REMOVE(&timer_wheel[slot], thd, timerq);
+    --tw_count;
+
+    if(slot < TW_OVERFLOW && TAILQ_EMPTY(&timer_wheel[slot]))
+        tw_map[slot / TW_SIZE] &= ~(1ULL << (slot % TW_SIZE));
 }
 
-/* Returns the top thread on the timer queue (next event). If nothing is
-   queued, we'll return NULL. */
-static kthread_t * tq_next(void) {
-    return TAILQ_FIRST(&timer_queue);
+/* Find the first non-empty slot in the wheel, storing the time it starts at
+   in start. Returns -1 if the wheel is empty. */
+static int tq_first_slot(uint64_t *start) {
+    kthread_t *t;
+    uint64_t bits, tm;
+    int l, g;
+
+    /* All of the slots at or before tw_time's in each level are empty, so the
+       first slot after it in the lowest level with anything in it is next. */
+    for(l = 0; l < TW_LEVELS; ++l) {
+        g = TW_GROUP(tw_time, l);
+        bits = g == TW_SIZE - 1 ? 0 : tw_map[l] & (~0ULL << (g + 1));
+
+        if(bits) {
+            g = __builtin_ctzll(bits);
+            *start = (tw_time & ~((1ULL << TW_SHIFT(l + 1)) - 1)) |
+                ((uint64_t)g << TW_SHIFT(l));
+            return l * TW_SIZE + g;
+        }
+    }
+
+    if(TAILQ_EMPTY(&timer_wheel[TW_OVERFLOW]))
+        return -1;
+
+    /* Overflow timeouts are rare enough that a linear search is fine. */
+    tm = ~0ULL;
+
+    TAILQ_FOREACH(t, &timer_wheel[TW_OVERFLOW], timerq) {
+        if(t->wait_timeout < tm)
+            tm = t->wait_timeout;
+    }
+
+    *start = tm & ~((1ULL << TW_SHIFT(TW_LEVELS)) - 1);
+    return TW_OVERFLOW;
+}
+
+/* Advance the wheel to the next slot, as long as it starts no later than tm,
+   moving everything in it down a level (or onto the due list). Returns 0 if
+   there was nothing to do. */
+static int tq_advance(uint64_t tm) {
+    struct ktqueue tmp;
+    kthread_t *t;
+    uint64_t start;
+    int slot;
+
+    if((slot = tq_first_slot(&start)) < 0 || start > tm)
+        return 0;
+
+    tw_time = start;
+
+    TAILQ_INIT(&tmp);
+    TAILQ_CONCAT(&tmp, &timer_wheel[slot], timerq);
+
+    if(slot < TW_OVERFLOW)
+        tw_map[slot / TW_SIZE] &= ~(1ULL << (slot % TW_SIZE));
+
+    while((t = TAILQ_FIRST(&tmp))) {
+        TAILQ_REMOVE(&tmp, t, timerq);
+        --tw_count;
+        tq_insert(t);
+    }
+
+    return 1;
+}
+
+/* Returns the next thread on the timer queue whose timeout has passed by tm.
+   If there isn't one, we'll return NULL. */
+static kthread_t * tq_next(uint64_t tm) {
+    kthread_t *t;
+
+    while(!(t = TAILQ_FIRST(&timer_wheel[TW_DUE]))) {
+        if(!tq_advance(tm))
+            return NULL;
+    }
+
+    return t;
+}
+
+/* Wait statistics, hashed by the address of the wait message. If the table
+   fills up, everything else gets lumped into the last entry. */
+#define STATS_SIZE  64
+static genwait_stats_t wait_stats[STATS_SIZE + 1];
+
+static genwait_stats_t *stats_lookup(const char *mesg) {
+    unsigned int i, idx = ((ptr_t)mesg >> 2) % STATS_SIZE;
+
+    for(i = 0; i < STATS_SIZE; ++i) {
+        if(wait_stats[idx].mesg == mesg)
+            return &wait_stats[idx];
+
+        if(!wait_stats[idx].mesg) {
+            wait_stats[idx].mesg = mesg;
+            return &wait_stats[idx];
+        }
+
+        idx = (idx + 1) % STATS_SIZE;
+    }
+
+    wait_stats[STATS_SIZE].mesg = "(other)";
+    return &wait_stats[STATS_SIZE];
+}
+
+/* Account for a thread's finished wait; assumes ints are disabled. */
+static void stats_update(kthread_t * thd, int timedout) {
+    genwait_stats_t *st;
+    uint64_t time;
+
+    time = perf_cntr_timer_ns() - thd->sched_stats.wait_start;
+    thd->sched_stats.wait_total += time;
+
+    st = stats_lookup(thd->wait_msg ? thd->wait_msg : "(none)");
+    ++st->waits;
+    st->time += time;
+
+    if(timedout)
+        ++st->timeouts;
+
+    if(time > st->max_time)
+        st->max_time = time;
 }
 
 int genwait_wait(void * obj, const char * mesg, int timeout, void (*callback)(void *)) {
@@ -83,6 +232,7 @@ int genwait_wait(void * obj, const char * mesg, int timeout, void (*callback)(vo
     me->state = STATE_WAIT;
     me->wait_obj = obj;
     me->wait_msg = mesg;
+    me->sched_stats.wait_start = perf_cntr_timer_ns();
 
     if(timeout > 0) {
         /* If we have a timeout, insert us on the timer queue. */
@@ -102,8 +252,10 @@ int genwait_wait(void * obj, const char * mesg, int timeout, void (*callback)(vo
 }
 
 /* Removes a thread from its wait queue; assumes ints are disabled. */
-static void genwait_unqueue(kthread_t * thd) {
+static void genwait_unqueue(kthread_t * thd, int timedout) {
     if(thd->wait_obj) {
+        stats_update(thd, timedout);
+
         /* Remove it from the queue */
         TAILQ_REMOVE(&slpque[LOOKUP(thd->wait_obj)], thd, thdq);
 
@@ -142,7 +294,7 @@ int genwait_wake_cnt(void * obj, int cntmax, int err) {
         /* Is this thread a match? */
         if(t->wait_obj == obj) {
             /* Yes, remove it from the wait queue */
-            genwait_unqueue(t);
+            genwait_unqueue(t, 0);
 
             /* Set the wake return value */
             if(err) {
@@ -200,7 +352,7 @@ int genwait_wake_thd(void *obj, kthread_t *thd, int err) {
         /* Is this thread a match? */
         if(t->wait_obj == obj && t == thd) {
             /* Yes, remove it from the wait queue */
-            genwait_unqueue(t);
+            genwait_unqueue(t, 0);
 
             /* Set the wake return value */
             if(err) {
@@ -222,14 +374,17 @@ int genwait_wake_thd(void *obj, kthread_t *thd, int err) {
 void genwait_check_timeouts(uint64 tm) {
     kthread_t   *t;
 
-    t = tq_next();
+    /* If nothing is waiting, just catch the wheel up so that new timeouts
+       start out in the lowest levels. */
+    if(!tw_count) {
+        if(tm > tw_time)
+            tw_time = tm;
 
-    while(t) {
-        /* If the next timeout is beyond our current time, then
-           forget about it. */
-        if(t->wait_timeout > tm)
-            return;
+        return;
+    }
 
+    /* Go through everything that has timed out by now. */
+    while((t = tq_next(tm))) {
         /* Set an error code */
         t->thd_errno = EAGAIN;  /* This is fairly close */
         CONTEXT_RET(t->context) = -1;
@@ -239,22 +394,34 @@ void genwait_check_timeouts(uint64 tm) {
             t->wait_callback(t->wait_obj);
 
         /* Re-activate it */
-        genwait_unqueue(t);
-
-        /* Get the next one */
-        t = tq_next();
+        genwait_unqueue(t, 1);
     }
 }
 
 uint64 genwait_next_timeout(void) {
     kthread_t * t;
+    uint64_t start, tm;
+    int slot;
 
-    t = tq_next();
+    if((t = TAILQ_FIRST(&timer_wheel[TW_DUE])))
+        return t->wait_timeout;
 
-    if(t == NULL)
+    if((slot = tq_first_slot(&start)) < 0)
         return 0;
-    else
-        return t->wait_timeout;
+
+    /* Everything in a level 0 slot times out at the same time, otherwise we
+       have to look for the earliest one in the slot. */
+    if(slot < TW_SIZE)
+        return start;
+
+    tm = ~0ULL;
+
+    TAILQ_FOREACH(t, &timer_wheel[slot], timerq) {
+        if(t->wait_timeout < tm)
+            tm = t->wait_timeout;
+    }
+
+    return tm;
 }
 
 int genwait_init(void) {
@@ -263,7 +430,56 @@ int genwait_init(void) {
     for(i = 0; i < TABLESIZE; i++)
         TAILQ_INIT(&slpque[i]);
 
-    TAILQ_INIT(&timer_queue);
+    memset(wait_stats, 0, sizeof(wait_stats));
+
+    for(i = 0; i <= TW_DUE; i++)
+        TAILQ_INIT(&timer_wheel[i]);
+
+    memset(tw_map, 0, sizeof(tw_map));
+    tw_time = 0;
+    tw_count = 0;
+    return 0;
+}
+
+size_t genwait_get_stats(genwait_stats_t *stats, size_t count) {
+    size_t i, n = 0;
+
+    irq_disable_scoped();
+
+    for(i = 0; i <= STATS_SIZE; ++i) {
+        if(!wait_stats[i].mesg)
+            continue;
+
+        if(n < count)
+            stats[n] = wait_stats[i];
+
+        ++n;
+    }
+
+    return n;
+}
+
+void genwait_reset_stats(void) {
+    irq_disable_scoped();
+    memset(wait_stats, 0, sizeof(wait_stats));
+}
+
+int genwait_print_stats(int (*pf)(const char *fmt, ...)) {
+    genwait_stats_t st[STATS_SIZE + 1];
+    size_t i, n;
+
+    n = genwait_get_stats(st, STATS_SIZE + 1);
+
+    pf("Wait statistics:\n");
+    pf("     waits\t  timeouts\t    time (ns)\t    max (ns)\tmessage\n");
+
+    for(i = 0; i < n; ++i) {
+        pf("%10lu\t%10lu\t%12llu\t%12llu\t%s\n", st[i].waits,
+           st[i].timeouts, st[i].time, st[i].max_time, st[i].mesg);
+    }
+
+    pf("--end of list--\n");
+
     return 0;
 }
 
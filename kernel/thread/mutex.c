@@ -16,10 +16,89 @@
 
 #include <arch/irq.h>
 #include <arch/timer.h>
+#include <dc/perfctr.h>
 
 /* Thread pseudo-ptr representing an active IRQ context. */
 #define IRQ_THREAD  ((kthread_t *)0xFFFFFFFF)
 
+/* How far along a chain of blocked threads to pass priority changes. This is
+   only here to bound the time spent with interrupts disabled if something
+   deadlocks. */
+#define PI_MAX_DEPTH    16
+
+struct pi_search {
+    const mutex_t *m;
+    const kthread_t *holder;
+    kthread_t *top;
+};
+
+/* Look for the highest priority thread blocked on s->m, or on any mutex held
+   by s->holder (whether it uses priority inheritance or not). The latter
+   includes threads that are about to block, or have been woken up but haven't
+   gotten to run yet, since they still need the mutex. */
+static int pi_search_cb(kthread_t *thd, void *d) {
+    struct pi_search *s = (struct pi_search *)d;
+
+    if(!thd->pi_wait)
+        return 0;
+
+    if(!(s->m && thd->pi_wait == s->m && thd->state == STATE_WAIT) &&
+       !(s->holder && thd->pi_wait->holder == s->holder))
+        return 0;
+
+    if(!s->top || thd->prio < s->top->prio)
+        s->top = thd;
+
+    return 0;
+}
+
+static kthread_t *pi_top_waiter(const mutex_t *m, const kthread_t *holder) {
+    struct pi_search s = { m, holder, NULL };
+
+    thd_each(pi_search_cb, &s);
+    return s.top;
+}
+
+/* Change the priority a thread is running at, moving it to the right run
+   queue if it's on one. Assumes ints are disabled. */
+static void pi_set_prio(kthread_t *thd, prio_t prio) {
+    if(thd->flags & THD_QUEUED) {
+        thd_remove_from_runnable(thd);
+        thd->prio = prio;
+        thd_add_to_runnable(thd, false);
+    }
+    else {
+        thd->prio = prio;
+    }
+}
+
+/* Work out what priority a thread should be running at from its own priority
+   and those of the threads blocked on it, and pass any change along to the
+   holder of the mutex it is blocked on, if that mutex uses priority
+   inheritance. Assumes ints are disabled. */
+void mutex_pi_update(kthread_t *thd) {
+    kthread_t *top;
+    prio_t prio;
+    int depth;
+
+    for(depth = 0; thd && thd != IRQ_THREAD && depth < PI_MAX_DEPTH; ++depth) {
+        prio = thd->real_prio;
+
+        if((top = pi_top_waiter(NULL, thd)) && top->prio < prio)
+            prio = top->prio;
+
+        if(prio == thd->prio)
+            break;
+
+        pi_set_prio(thd, prio);
+
+        if(!thd->pi_wait || !(thd->pi_wait->flags & MUTEX_PRIO_INHERIT))
+            break;
+
+        thd = thd->pi_wait->holder;
+    }
+}
+
 mutex_t *mutex_create(void) {
     mutex_t *rv;
 
@@ -35,11 +114,19 @@ mutex_t *mutex_create(void) {
     rv->dynamic = 1;
     rv->holder = NULL;
     rv->count = 0;
+    rv->flags = 0;
+    rv->spin = 0;
+    rv->waiters = 0;
+    mutex_reset_stats(rv);
 
     return rv;
 }
 
 int mutex_init(mutex_t *m, int mtype) {
+    int flags = mtype & MUTEX_PRIO_INHERIT;
+
+    mtype &= ~MUTEX_PRIO_INHERIT;
+
     /* Check the type */
     if(mtype < MUTEX_TYPE_NORMAL || mtype > MUTEX_TYPE_RECURSIVE) {
         errno = EINVAL;
@@ -51,6 +138,10 @@ int mutex_init(mutex_t *m, int mtype) {
     m->dynamic = 0;
     m->holder = NULL;
     m->count = 0;
+    m->flags = flags;
+    m->spin = 0;
+    m->waiters = 0;
+    mutex_reset_stats(m);
 
     return 0;
 }
@@ -91,9 +182,64 @@ int mutex_lock_irqsafe(mutex_t *m) {
         return mutex_lock(m);
 }
 
+/* Block until we get the mutex, or the timeout expires. Assumes ints are
+   disabled. */
+static int mutex_wait(mutex_t *m, int timeout, uint64_t deadline) {
+    int rv;
+
+    for(;;) {
+        /* Lend our priority to the holder, if it needs it. Only priority
+           inheritance mutexes pass it along any further than that. */
+        thd_current->pi_wait = m;
+
+        if(m->flags & MUTEX_PRIO_INHERIT)
+            mutex_pi_update(m->holder);
+        else if(m->holder != IRQ_THREAD && m->holder->prio > thd_current->prio)
+            pi_set_prio(m->holder, thd_current->prio);
+
+        ++m->waiters;
+        rv = genwait_wait(m, timeout ? "mutex_lock_timed" : "mutex_lock",
+                          timeout, NULL);
+        --m->waiters;
+        thd_current->pi_wait = NULL;
+
+        if(rv < 0) {
+            errno = ETIMEDOUT;
+            break;
+        }
+
+        if(!m->holder) {
+            m->holder = thd_current;
+            m->count = 1;
+            break;
+        }
+
+        if(timeout) {
+            timeout = deadline - timer_ms_gettime64();
+            if(timeout <= 0) {
+                errno = ETIMEDOUT;
+                rv = -1;
+                break;
+            }
+        }
+    }
+
+    /* If we gave up, the holder doesn't need our priority anymore. Otherwise,
+       we now hold the mutex, so anyone else still waiting on it is lending us
+       theirs. Other mutexes leave the holder boosted until it unlocks. */
+    if(m->flags & MUTEX_PRIO_INHERIT) {
+        if(rv < 0)
+            mutex_pi_update(m->holder);
+        else if(m->waiters)
+            mutex_pi_update(thd_current);
+    }
+
+    return rv;
+}
+
 int mutex_lock_timed(mutex_t *m, int timeout) {
-    uint64_t deadline = 0;
-    int rv = 0;
+    uint64_t deadline = 0, start;
+    int rv = 0, spins;
 
     if((rv = irq_inside_int())) {
         dbglog(DBG_WARNING, "%s: called inside an interrupt with code: "
@@ -133,47 +279,36 @@ int mutex_lock_timed(mutex_t *m, int timeout) {
         rv = -1;
     }
     else {
+        ++m->stats.contended;
+        start = perf_cntr_timer_ns();
+
         if(timeout)
             deadline = timer_ms_gettime64() + timeout;
 
-        for(;;) {
-            /* Check whether we should boost priority. */
-            if (m->holder->prio >= thd_current->prio) {
-                m->holder->prio = thd_current->prio;
-
-                /* Reschedule if currently scheduled. */
-                if(m->holder->state == STATE_READY) {
-                    /* Thread list is sorted by priority, update the position
-                     * of the thread holding the lock */
-                    thd_remove_from_runnable(m->holder);
-                    thd_add_to_runnable(m->holder, true);
-                }
-            }
+        /* See if the holder lets go of it soon, before going to sleep. */
+        for(spins = m->spin; spins && m->count; --spins)
+            thd_pass();
 
-            rv = genwait_wait(m, timeout ? "mutex_lock_timed" : "mutex_lock",
-                              timeout, NULL);
-            if(rv < 0) {
-                errno = ETIMEDOUT;
-                break;
-            }
-
-            if(!m->holder) {
-                m->holder = thd_current;
-                m->count = 1;
-                break;
-            }
-
-            if(timeout) {
-                timeout = deadline - timer_ms_gettime64();
-                if(timeout <= 0) {
-                    errno = ETIMEDOUT;
-                    rv = -1;
-                    break;
-                }
-            }
+        if(!m->count) {
+            m->count = 1;
+            m->holder = thd_current;
+            ++m->stats.spun;
         }
+        else if(m->spin && timeout &&
+                (timeout = deadline - timer_ms_gettime64()) <= 0) {
+            errno = ETIMEDOUT;
+            rv = -1;
+        }
+        else {
+            rv = mutex_wait(m, timeout, deadline);
+        }
+
+        m->stats.wait_time += perf_cntr_timer_ns() - start;
     }
 
+    if(!rv)
+        ++m->stats.acquired;
+
     return rv;
 }
 
@@ -226,14 +361,18 @@ int mutex_trylock(mutex_t *m) {
             break;
     }
 
+    ++m->stats.acquired;
     return 0;
 }
 
 static int mutex_unlock_common(mutex_t *m, kthread_t *thd) {
+    kthread_t *holder;
     int wakeup = 0;
 
     irq_disable_scoped();
 
+    holder = m->holder;
+
     switch(m->type) {
         case MUTEX_TYPE_NORMAL:
         case MUTEX_TYPE_OLDNORMAL:
@@ -272,11 +411,22 @@ static int mutex_unlock_common(mutex_t *m, kthread_t *thd) {
 
     /* If we need to wake up a thread, do so. */
     if(wakeup) {
-        /* Restore real priority in case we were dynamically boosted. */
-        if (thd != IRQ_THREAD)
-            thd->prio = thd->real_prio;
-
-        genwait_wake_one(m);
+        /* If we were boosted, drop back to whatever priority we're still owed
+           by anyone blocked on other mutexes we hold. A thread that was never
+           boosted isn't owed anything, so there's nothing to look for. */
+        if(holder && holder != IRQ_THREAD && holder->prio != holder->real_prio)
+            mutex_pi_update(holder);
+
+        if(m->waiters && (m->flags & MUTEX_PRIO_INHERIT)) {
+            /* Hand it to the highest priority waiter. */
+            kthread_t *top = pi_top_waiter(m, NULL);
+
+            if(top)
+                genwait_wake_thd(m, top, 0);
+        }
+        else if(m->waiters) {
+            genwait_wake_one(m);
+        }
     }
 
     return 0;
@@ -302,3 +452,23 @@ int mutex_unlock_as_thread(mutex_t *m, kthread_t *thd) {
 
     return mutex_unlock_common(m, thd);
 }
+
+int mutex_set_spin(mutex_t *m, int count) {
+    if(count < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    m->spin = count;
+    return 0;
+}
+
+void mutex_get_stats(mutex_t *m, kos_lock_stats_t *stats) {
+    irq_disable_scoped();
+    *stats = m->stats;
+}
+
+void mutex_reset_stats(mutex_t *m) {
+    irq_disable_scoped();
+    m->stats = (kos_lock_stats_t)KOS_LOCK_STATS_INITIALIZER;
+}
@@ -8,11 +8,15 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <errno.h>
 
 #include <kos/rwsem.h>
 #include <kos/genwait.h>
 
+#include <arch/timer.h>
+#include <dc/perfctr.h>
+
 /* Allocate a new reader/writer semaphore */
 rw_semaphore_t *rwsem_create(void) {
     rw_semaphore_t *s;
@@ -29,6 +33,8 @@ rw_semaphore_t *rwsem_create(void) {
     s->read_count = 0;
     s->write_lock = NULL;
     s->reader_waiting = NULL;
+    s->spin = 0;
+    rwsem_reset_stats(s);
 
     return s;
 }
@@ -38,6 +44,8 @@ int rwsem_init(rw_semaphore_t *s) {
     s->read_count = 0;
     s->write_lock = NULL;
     s->reader_waiting = NULL;
+    s->spin = 0;
+    rwsem_reset_stats(s);
 
     return 0;
 }
@@ -59,9 +67,37 @@ int rwsem_destroy(rw_semaphore_t *s) {
     return rv;
 }
 
+/* Block until the lock can be taken for reading or writing, or the timeout
+   expires. Assumes ints are disabled. */
+static int rwsem_wait(rw_semaphore_t *s, bool write, int timeout,
+                      uint64_t deadline, const char *mesg) {
+    for(;;) {
+        if(genwait_wait(write ? (void *)&s->write_lock : (void *)s, mesg,
+                        timeout, NULL) < 0) {
+            if(errno == EAGAIN)
+                errno = ETIMEDOUT;
+
+            return -1;
+        }
+
+        /* Somebody spinning on the lock may have gotten in ahead of us. */
+        if(!s->write_lock && (!write || !s->read_count))
+            return 0;
+
+        if(timeout) {
+            timeout = deadline - timer_ms_gettime64();
+            if(timeout <= 0) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+        }
+    }
+}
+
 /* Lock a reader/writer semaphore for reading */
 int rwsem_read_lock_timed(rw_semaphore_t *s, int timeout) {
-    int rv = 0;
+    uint64_t deadline = 0, start;
+    int rv = 0, spins;
 
     if((rv = irq_inside_int())) {
         dbglog(DBG_WARNING, "%s: called inside an interrupt with code: "
@@ -84,20 +120,39 @@ int rwsem_read_lock_timed(rw_semaphore_t *s, int timeout) {
         ++s->read_count;
     }
     else {
-        /* Block until the write lock is not held any more */
-        rv = genwait_wait(s, timeout ? "rwsem_read_lock_timed" :
-                          "rwsem_read_lock", timeout, NULL);
+        ++s->stats.contended;
+        start = perf_cntr_timer_ns();
+
+        if(timeout)
+            deadline = timer_ms_gettime64() + timeout;
 
-        if(rv < 0) {
+        /* See if the writer is done soon, before going to sleep. */
+        for(spins = s->spin; spins && s->write_lock; --spins)
+            thd_pass();
+
+        if(!s->write_lock) {
+            ++s->stats.spun;
+        }
+        else if(s->spin && timeout &&
+                (timeout = deadline - timer_ms_gettime64()) <= 0) {
+            errno = ETIMEDOUT;
             rv = -1;
-            if(errno == EAGAIN)
-                errno = ETIMEDOUT;
         }
         else {
-            ++s->read_count;
+            /* Block until the write lock is not held any more */
+            rv = rwsem_wait(s, false, timeout, deadline, timeout ?
+                            "rwsem_read_lock_timed" : "rwsem_read_lock");
         }
+
+        if(!rv)
+            ++s->read_count;
+
+        s->stats.wait_time += perf_cntr_timer_ns() - start;
     }
 
+    if(!rv)
+        ++s->stats.acquired;
+
     return rv;
 }
 
@@ -114,7 +169,8 @@ int rwsem_read_lock_irqsafe(rw_semaphore_t *s) {
 
 /* Lock a reader/writer semaphore for writing */
 int rwsem_write_lock_timed(rw_semaphore_t *s, int timeout) {
-    int rv = 0;
+    uint64_t deadline = 0, start;
+    int rv = 0, spins;
 
     if(irq_inside_int()) {
         dbglog(DBG_WARNING, "rwsem_write_lock_timed: called inside "
@@ -136,21 +192,40 @@ int rwsem_write_lock_timed(rw_semaphore_t *s, int timeout) {
         s->write_lock = thd_current;
     }
     else {
-        /* Block until the write lock is not held and there are no readers
-           inside their critical sections */
-        rv = genwait_wait(&s->write_lock, timeout ? "rwsem_write_lock_timed" :
-                          "rwsem_write_lock", timeout, NULL);
+        ++s->stats.contended;
+        start = perf_cntr_timer_ns();
+
+        if(timeout)
+            deadline = timer_ms_gettime64() + timeout;
 
-        if(rv < 0) {
+        /* See if everyone else is done soon, before going to sleep. */
+        for(spins = s->spin; spins && (s->write_lock || s->read_count); --spins)
+            thd_pass();
+
+        if(!s->write_lock && !s->read_count) {
+            ++s->stats.spun;
+        }
+        else if(s->spin && timeout &&
+                (timeout = deadline - timer_ms_gettime64()) <= 0) {
+            errno = ETIMEDOUT;
             rv = -1;
-            if(errno == EAGAIN)
-                errno = ETIMEDOUT;
         }
         else {
-            s->write_lock = thd_current;
+            /* Block until the write lock is not held and there are no readers
+               inside their critical sections */
+            rv = rwsem_wait(s, true, timeout, deadline, timeout ?
+                            "rwsem_write_lock_timed" : "rwsem_write_lock");
         }
+
+        if(!rv)
+            s->write_lock = thd_current;
+
+        s->stats.wait_time += perf_cntr_timer_ns() - start;
     }
 
+    if(!rv)
+        ++s->stats.acquired;
+
     return rv;
 }
 
@@ -241,6 +316,7 @@ int rwsem_read_trylock(rw_semaphore_t *s) {
     }
 
     ++s->read_count;
+    ++s->stats.acquired;
     return 0;
 }
 
@@ -256,11 +332,13 @@ int rwsem_write_trylock(rw_semaphore_t *s) {
     }
 
     s->write_lock = thd_current;
+    ++s->stats.acquired;
     return 0;
 }
 
 /* "Upgrade" a read lock to a write lock. */
 int rwsem_read_upgrade_timed(rw_semaphore_t *s, int timeout) {
+    uint64_t deadline = 0;
     int rv;
 
     if(irq_inside_int()) {
@@ -289,19 +367,43 @@ int rwsem_read_upgrade_timed(rw_semaphore_t *s, int timeout) {
 
         --s->read_count;
         s->reader_waiting = thd_current;
-        rv = genwait_wait(&s->write_lock, timeout ?
-                          "rwsem_read_upgrade_timed" : "rwsem_read_upgrade",
-                          timeout, NULL);
 
-        if(rv < 0) {
-            /* The only way we can error out is if there are still readers
-               with the lock, so we can safely re-grab the lock here. */
-            ++s->read_count;
+        if(timeout)
+            deadline = timer_ms_gettime64() + timeout;
 
-            if(errno == EAGAIN)
-                errno = ETIMEDOUT;
+        for(;;) {
+            rv = genwait_wait(&s->write_lock, timeout ?
+                              "rwsem_read_upgrade_timed" :
+                              "rwsem_read_upgrade", timeout, NULL);
 
-            return -1;
+            /* Somebody spinning on the lock may have gotten in ahead of us
+               after the last reader woke us up. */
+            if(rv >= 0 && !s->write_lock && !s->read_count)
+                break;
+
+            if(rv >= 0 && timeout &&
+               (timeout = deadline - timer_ms_gettime64()) <= 0)
+                rv = -1;
+
+            if(rv < 0) {
+                if(s->reader_waiting == thd_current)
+                    s->reader_waiting = NULL;
+
+                /* Take our read lock back. If a writer got in ahead of us,
+                   that means waiting for it to be done. */
+                if(s->write_lock)
+                    rwsem_wait(s, false, 0, 0, "rwsem_read_upgrade_timed");
+
+                ++s->read_count;
+                errno = ETIMEDOUT;
+                return -1;
+            }
+
+            /* Go back to waiting for the last reader to leave, unless someone
+               else started upgrading in the meantime, in which case we just
+               wait like any other writer. */
+            if(!s->reader_waiting)
+                s->reader_waiting = thd_current;
         }
 
         s->write_lock = thd_current;
@@ -311,6 +413,7 @@ int rwsem_read_upgrade_timed(rw_semaphore_t *s, int timeout) {
         s->write_lock = thd_current;
     }
 
+    ++s->stats.acquired;
     return 0;
 }
 
@@ -334,6 +437,7 @@ int rwsem_read_tryupgrade(rw_semaphore_t *s) {
 
     s->read_count = 0;
     s->write_lock = thd_current;
+    ++s->stats.acquired;
 
     return 0;
 }
@@ -347,3 +451,23 @@ int rwsem_read_count(rw_semaphore_t *s) {
 int rwsem_write_locked(rw_semaphore_t *s) {
     return !!s->write_lock;
 }
+
+int rwsem_set_spin(rw_semaphore_t *s, int count) {
+    if(count < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    s->spin = count;
+    return 0;
+}
+
+void rwsem_get_stats(rw_semaphore_t *s, kos_lock_stats_t *stats) {
+    irq_disable_scoped();
+    *stats = s->stats;
+}
+
+void rwsem_reset_stats(rw_semaphore_t *s) {
+    irq_disable_scoped();
+    s->stats = (kos_lock_stats_t)KOS_LOCK_STATS_INITIALIZER;
+}
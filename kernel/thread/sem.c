@@ -19,6 +19,9 @@
 #include <kos/sem.h>
 #include <kos/genwait.h>
 
+#include <arch/timer.h>
+#include <dc/perfctr.h>
+
 /**************************************/
 
 /* Allocate a new semaphore; the semaphore will be assigned
@@ -43,6 +46,8 @@ semaphore_t *sem_create(int value) {
 
     sm->count = value;
     sm->initialized = 2;
+    sm->spin = 0;
+    sem_reset_stats(sm);
 
     return sm;
 }
@@ -60,6 +65,8 @@ int sem_init(semaphore_t *sm, int count) {
 
     sm->count = count;
     sm->initialized = 1;
+    sm->spin = 0;
+    sem_reset_stats(sm);
     return 0;
 }
 
@@ -82,7 +89,8 @@ int sem_destroy(semaphore_t *sm) {
 
 /* Wait on a semaphore, with timeout (in milliseconds) */
 int sem_wait_timed(semaphore_t *sem, int timeout) {
-    int rv = 0;
+    uint64_t deadline = 0, start;
+    int rv = 0, spins;
 
     /* Make sure we're not inside an interrupt */
     if((rv = irq_inside_int())) {
@@ -111,21 +119,47 @@ int sem_wait_timed(semaphore_t *sem, int timeout) {
         sem->count--;
     }
     else {
-        /* Block us until we're signaled */
-        sem->count--;
-        rv = genwait_wait(sem, timeout ? "sem_wait_timed" : "sem_wait", timeout,
-                          NULL);
+        ++sem->stats.contended;
+        start = perf_cntr_timer_ns();
 
-        /* Did we fail to get the lock? */
-        if(rv < 0) {
-            rv = -1;
-            ++sem->count;
+        if(timeout)
+            deadline = timer_ms_gettime64() + timeout;
+
+        /* See if somebody signals it soon, before going to sleep. */
+        for(spins = sem->spin; spins && sem->count <= 0; --spins)
+            thd_pass();
 
-            if(errno == EAGAIN)
-                errno = ETIMEDOUT;
+        if(sem->count > 0) {
+            sem->count--;
+            ++sem->stats.spun;
+        }
+        else if(sem->spin && timeout &&
+                (timeout = deadline - timer_ms_gettime64()) <= 0) {
+            errno = ETIMEDOUT;
+            rv = -1;
+        }
+        else {
+            /* Block us until we're signaled */
+            sem->count--;
+            rv = genwait_wait(sem, timeout ? "sem_wait_timed" : "sem_wait",
+                              timeout, NULL);
+
+            /* Did we fail to get the lock? */
+            if(rv < 0) {
+                rv = -1;
+                ++sem->count;
+
+                if(errno == EAGAIN)
+                    errno = ETIMEDOUT;
+            }
         }
+
+        sem->stats.wait_time += perf_cntr_timer_ns() - start;
     }
 
+    if(!rv)
+        ++sem->stats.acquired;
+
     return rv;
 }
 
@@ -147,6 +181,7 @@ int sem_trywait(semaphore_t *sm) {
     /* Is there enough count left? */
     else if(sm->count > 0) {
         sm->count--;
+        ++sm->stats.acquired;
     }
     else {
         rv = -1;
@@ -186,3 +221,23 @@ int sem_count(semaphore_t *sm) {
     /* Look for the semaphore */
     return sm->count;
 }
+
+int sem_set_spin(semaphore_t *sm, int count) {
+    if(count < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    sm->spin = count;
+    return 0;
+}
+
+void sem_get_stats(semaphore_t *sm, kos_lock_stats_t *stats) {
+    irq_disable_scoped();
+    *stats = sm->stats;
+}
+
+void sem_reset_stats(semaphore_t *sm) {
+    irq_disable_scoped();
+    sm->stats = (kos_lock_stats_t)KOS_LOCK_STATS_INITIALIZER;
+}
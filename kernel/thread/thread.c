@@ -21,6 +21,7 @@
 #include <kos/thread.h>
 #include <kos/dbgio.h>
 #include <kos/sem.h>
+#include <kos/mutex.h>
 #include <kos/rwsem.h>
 #include <kos/cond.h>
 #include <kos/genwait.h>
@@ -62,17 +63,34 @@ static alignas(8) uint8_t thd_idle_stack[64];
 /* Scheduler timer interrupt frequency (Hertz) */
 static unsigned int thd_sched_ms = 1000 / THD_SCHED_HZ;
 
+/* Tickless mode. If set, the scheduler timer is programmed for the next
+   event instead of firing every thd_sched_ms. thd_idle_kick is set when the
+   timer has been moved up because a thread became runnable while idle. */
+static bool thd_tickless = false;
+static bool thd_idle_kick = false;
+
+/* Longest we'll let the scheduler timer go in tickless mode. */
+#define THD_TICKLESS_MAX_MS     1000
+
 /* Thread list. This includes all threads except dead ones. */
 static struct ktlist thd_list;
 
 /* Run queue. This is more like on a standard time sharing system than the
-   previous versions. The top element of this priority queue should be the
-   thread that is ready to run next. When a thread is scheduled, it will be
-   removed from this queue. When it's de-scheduled, it will be re-inserted
-   by its priority value at the end of its priority group. Note that right
-   now this condition is being broken because sleeping threads are on the
-   same queue. We deal with those in thd_switch below. */
-static struct ktqueue run_queue;
+   previous versions. Threads are kept in a small, fixed number of queues, each
+   covering a range of priorities: every level below RUNQ_DIRECT gets a queue to
+   itself, since that's where nearly every thread lives, and above that each
+   power of two shares one. Each queue is kept sorted by priority, and threads
+   with the same priority are run round-robin: when a thread is scheduled, it
+   will be removed from its queue, and when it's de-scheduled, it will be
+   re-inserted after the last one with the same priority. A bitmap tracks which
+   queues have threads in them, so that finding the highest priority thread
+   doesn't depend on how many threads there are, and queueing a thread only
+   has to step over the others in its queue with a different priority. */
+#define RUNQ_DIRECT     16
+#define RUNQ_BUCKETS    32
+
+static struct ktqueue run_queue[RUNQ_BUCKETS];
+static uint32_t run_map;
 
 /* The currently executing thread. This thread should not be on any queues. */
 kthread_t *thd_current = NULL;
@@ -89,6 +107,30 @@ static size_t thd_count = 0;
 /* The idle task */
 static kthread_t *thd_idle_thd = NULL;
 
+/*****************************************************************************/
+/* Run queue bitmap */
+
+/* Which queue threads with priority p go on. PRIO_MAX lands in bucket 24. */
+static inline unsigned int runq_bucket(prio_t p) {
+    if(p < RUNQ_DIRECT)
+        return p;
+
+    return RUNQ_DIRECT + (31 - __builtin_clz(p)) - 4;
+}
+
+/* Find the first bucket at or after from with any threads queued in it, or
+   -1 if there aren't any. */
+static inline int runq_find(unsigned int from) {
+    uint32_t bits;
+
+    if(from >= RUNQ_BUCKETS)
+        return -1;
+
+    bits = run_map & (0xFFFFFFFF << from);
+
+    return bits ? __builtin_ctz(bits) : -1;
+}
+
 /*****************************************************************************/
 /* Debug */
 
@@ -159,24 +201,52 @@ int thd_pslist(int (*pf)(const char *fmt, ...)) {
     return 0;
 }
 
+int thd_print_stats(int (*pf)(const char *fmt, ...)) {
+    kthread_stats_t st;
+    uint64_t ns_time;
+    kthread_t *cur;
+
+    pf("Thread statistics:\n");
+    pf("tid\t    cpu_time\t\t     wait_time\t   vol\t invol\tname\n");
+
+    ns_time = perf_cntr_timer_ns();
+
+    LIST_FOREACH(cur, &thd_list, t_list) {
+        thd_get_stats(cur, &st);
+
+        pf("%d\t", st.tid);
+        pf("%12llu (%6.3lf%%)  ",
+            st.cpu_time, (double)st.cpu_time / (double)ns_time * 100.0);
+        pf("%12llu  ", st.wait_time);
+        pf("%6lu\t%6lu\t", st.vol_switches, st.invol_switches);
+        pf("%s\n", cur->label);
+    }
+    pf("--end of list--\n");
+
+    return 0;
+}
+
 int thd_pslist_queue(int (*pf)(const char *fmt, ...)) {
     kthread_t *cur;
+    int p;
 
     pf("Queued threads:\n");
     pf("addr\t\ttid\tprio\tflags\twait_timeout\tstate     name\n");
-    TAILQ_FOREACH(cur, &run_queue, thdq) {
-        pf("%08lx\t", CONTEXT_PC(cur->context));
-        pf("%d\t", cur->tid);
+    for(p = runq_find(0); p >= 0; p = runq_find(p + 1)) {
+        TAILQ_FOREACH(cur, &run_queue[p], thdq) {
+            pf("%08lx\t", CONTEXT_PC(cur->context));
+            pf("%d\t", cur->tid);
 
-        if(cur->prio == PRIO_MAX)
-            pf("MAX\t");
-        else
-            pf("%d\t", cur->prio);
+            if(cur->prio == PRIO_MAX)
+                pf("MAX\t");
+            else
+                pf("%d\t", cur->prio);
 
-        pf("%08lx\t", cur->flags);
-        pf("%ld\t\t", (uint32_t)cur->wait_timeout);
-        pf("%10s", thd_state_to_str(cur));
-        pf("%s\n", cur->label);
+            pf("%08lx\t", cur->flags);
+            pf("%ld\t\t", (uint32_t)cur->wait_timeout);
+            pf("%10s", thd_state_to_str(cur));
+            pf("%s\n", cur->label);
+        }
     }
 
     return 0;
@@ -305,60 +375,121 @@ void thd_exit(void *rv) {
 /*****************************************************************************/
 /* Thread creation and deletion */
 
-/* Enqueue a process in the runnable queue; adds it right after the
-   process group of the same priority (front_of_line==0) or
-   right before the process group of the same priority (front_of_line!=0).
-   See thd_schedule for why this is helpful. */
+/* Enqueue a process in the runnable queue; adds it at the end of the queue
+   for its priority (front_of_line==0) or at the front of it
+   (front_of_line!=0). See thd_schedule for why this is helpful. */
 void thd_add_to_runnable(kthread_t *t, bool front_of_line) {
-    kthread_t *i;
-    int done;
+    struct ktqueue *q;
+    kthread_t *cur;
+    unsigned int b;
+    prio_t p;
 
     if(t->flags & THD_QUEUED)
         return;
 
-    done = 0;
+    /* Remember which queue it went on, in case the priority gets changed
+       while it's queued. */
+    p = t->prio;
 
-    if(!front_of_line) {
-        /* Look for a thread of lower priority and insert
-           before it. If there is nothing on the run queue, we'll
-           fall through to the bottom. */
-        TAILQ_FOREACH(i, &run_queue, thdq) {
-            if(i->prio > t->prio) {
-                TAILQ_INSERT_BEFORE(i, t, thdq);
-                done = 1;
+    if(p < 0)
+        p = 0;
+    else if(p > PRIO_MAX)
+        p = PRIO_MAX;
+
+    t->rq_prio = p;
+    b = runq_bucket(p);
+    q = &run_queue[b];
+
+    /* Keep the queue sorted by priority. Usually everything in it has the
+       same priority, so this stops at the first thread it looks at. */
+    if(front_of_line) {
+        TAILQ_FOREACH(cur, q, thdq) {
+            if(cur->rq_prio >= p)
                 break;
-            }
         }
+
+        if(cur)
+            TAILQ_INSERT_BEFORE(cur, t, thdq);
+        else
+            TAILQ_INSERT_TAIL(q, t, thdq);
     }
     else {
-        /* Look for a thread of the same or lower priority and
-           insert before it. If there is nothing on the run queue,
-           we'll fall through to the bottom. */
-        TAILQ_FOREACH(i, &run_queue, thdq) {
-            if(i->prio >= t->prio) {
-                TAILQ_INSERT_BEFORE(i, t, thdq);
-                done = 1;
+        TAILQ_FOREACH_REVERSE(cur, q, ktqueue, thdq) {
+            if(cur->rq_prio <= p)
                 break;
-            }
         }
-    }
 
-    /* Didn't find one, put it at the end */
-    if(!done)
-        TAILQ_INSERT_TAIL(&run_queue, t, thdq);
+        if(cur)
+            TAILQ_INSERT_AFTER(q, cur, t, thdq);
+        else
+            TAILQ_INSERT_HEAD(q, t, thdq);
+    }
 
+    run_map |= 1U << b;
     t->flags |= THD_QUEUED;
+
+    /* If we're idle in tickless mode, nothing may wake up the scheduler for
+       a while, so have it come around on the next millisecond. */
+    if(thd_tickless && thd_current == thd_idle_thd && !thd_idle_kick &&
+       irq_inside_int()) {
+        thd_idle_kick = true;
+        timer_primary_wakeup(1);
+    }
 }
 
 /* Removes a thread from the runnable queue, if it's there. */
 int thd_remove_from_runnable(kthread_t *thd) {
+    unsigned int b;
+
     if(!(thd->flags & THD_QUEUED)) return 0;
 
     thd->flags &= ~THD_QUEUED;
-    TAILQ_REMOVE(&run_queue, thd, thdq);
+    b = runq_bucket(thd->rq_prio);
+    TAILQ_REMOVE(&run_queue[b], thd, thdq);
+
+    if(TAILQ_EMPTY(&run_queue[b]))
+        run_map &= ~(1U << b);
+
     return 0;
 }
 
+/* Program the scheduler timer for the next thing that needs it in tickless
+   mode: the end of the current thread's timeslice, or the next timeout. */
+static void thd_timer_rearm(uint64_t now) {
+    uint64_t next = 0, tm;
+
+    thd_idle_kick = false;
+
+    /* The idle thread doesn't need a timeslice. */
+    if(thd_current != thd_idle_thd)
+        next = now + thd_sched_ms;
+
+    tm = genwait_next_timeout();
+
+    if(tm && (!next || tm < next))
+        next = tm;
+
+    if(!next || next > now + THD_TICKLESS_MAX_MS)
+        next = now + THD_TICKLESS_MAX_MS;
+
+    timer_primary_wakeup(next > now ? (uint32_t)(next - now) : 1);
+}
+
+/* Find the highest priority thread on the run queue that is ready to run. */
+static kthread_t *thd_next_runnable(void) {
+    kthread_t *thd;
+    int p;
+
+    for(p = runq_find(0); p >= 0; p = runq_find(p + 1)) {
+        TAILQ_FOREACH(thd, &run_queue[p], thdq) {
+            if(thd->state == STATE_READY)
+                return thd;
+        }
+    }
+
+    return NULL;
+}
+
 /* Creates and initializes the static TLS segment for a thread,
    composed of a Thread Control Block (TCB), followed by .TDATA,
    followed by .TBSS, very carefully ensuring alignment of each
@@ -626,15 +757,39 @@ int thd_set_prio(kthread_t *thd, prio_t prio) {
     if((prio < 0) || (prio > PRIO_MAX))
         return -2;
 
-    /* Set the new priority */
-    thd->prio = prio;
+    irq_disable_scoped();
+
+    /* Only change the thread's own priority. It may be running at a higher
+       one on behalf of threads blocked on mutexes it holds, so work out what
+       it should be running at now, which also moves it to the right run queue
+       if it's on one. */
     thd->real_prio = prio;
+    mutex_pi_update(thd);
+
     return 0;
 }
 
 /*****************************************************************************/
 /* Scheduling routines */
 
+/* Set by thd_choose_new(), when the current thread is giving up the CPU on its
+   own rather than being preempted. */
+static bool thd_switch_voluntary = false;
+
+/* Count a switch away from the current thread to thd. */
+static void thd_count_switch(kthread_t *thd) {
+    if(thd != thd_current) {
+        /* If the thread didn't block or die, it was preempted, unless it
+           asked to pass. */
+        if(thd_current->state == STATE_READY && !thd_switch_voluntary)
+            ++thd_current->sched_stats.invol_switches;
+        else
+            ++thd_current->sched_stats.vol_switches;
+    }
+
+    thd_switch_voluntary = false;
+}
+
 static void thd_update_cpu_time(kthread_t *thd) {
     const uint64_t ns = perf_cntr_timer_ns();
 
@@ -686,11 +841,7 @@ void thd_schedule(bool front_of_line, uint64_t now) {
     /* Search downwards through the run queue for a runnable thread; if
        we don't find a normal runnable thread, the idle process will
        always be there at the bottom. */
-    TAILQ_FOREACH(thd, &run_queue, thdq) {
-        /* Is it runnable? If not, keep going */
-        if(thd->state == STATE_READY)
-            break;
-    }
+    thd = thd_next_runnable();
 
     /* If we didn't already re-enqueue the thread and we are supposed to do so,
        do it now. */
@@ -714,6 +865,7 @@ void thd_schedule(bool front_of_line, uint64_t now) {
        run queue and switch to it. */
     thd_remove_from_runnable(thd);
 
+    thd_count_switch(thd);
     thd_update_cpu_time(thd);
 
     thd_current = thd;
@@ -729,6 +881,9 @@ void thd_schedule(bool front_of_line, uint64_t now) {
         }
     }
 
+    if(thd_tickless)
+        thd_timer_rearm(now);
+
     irq_set_context(&thd_current->context);
 }
 
@@ -760,11 +915,16 @@ void thd_schedule_next(kthread_t *thd) {
 
     thd_remove_from_runnable(thd);
 
+    thd_count_switch(thd);
     thd_update_cpu_time(thd);
 
     thd_current = thd;
     _impure_ptr = &thd->thd_reent;
     thd_current->state = STATE_RUNNING;
+
+    if(thd_tickless)
+        thd_timer_rearm(timer_ms_gettime64());
+
     irq_set_context(&thd_current->context);
 }
 
@@ -774,7 +934,9 @@ irq_context_t *thd_choose_new(void) {
 
     //printf("thd_choose_new() woken at %d\n", (uint32_t)now);
 
-    /* Do any re-scheduling */
+    /* Do any re-scheduling. We only get here when the current thread has
+       blocked or passed. */
+    thd_switch_voluntary = true;
     thd_schedule(0, now);
 
     /* Return the new IRQ context back to the caller */
@@ -786,7 +948,8 @@ irq_context_t *thd_choose_new(void) {
 /* Timer function. Check to see if we were woken because of a timeout event
    or because of a preempt. For timeouts, just go take care of it and sleep
    again until our next context switch (if any). For pre-empts, re-schedule
-   threads, swap out contexts, and sleep. */
+   threads, swap out contexts, and sleep. In tickless mode, thd_schedule has
+   already set up the next wakeup. */
 static void thd_timer_hnd(irq_context_t *context) {
     /* Get the system time */
     uint64_t now = timer_ms_gettime64();
@@ -796,7 +959,9 @@ static void thd_timer_hnd(irq_context_t *context) {
     //printf("timer woke at %d\n", (uint32_t)now);
 
     thd_schedule(0, now);
-    timer_primary_wakeup(thd_sched_ms);
+
+    if(!thd_tickless)
+        timer_primary_wakeup(thd_sched_ms);
 }
 
 /*****************************************************************************/
@@ -973,6 +1138,23 @@ uint64_t thd_get_cpu_time(kthread_t *thd) {
     return thd->cpu_time.total;
 }
 
+int thd_get_stats(kthread_t *thd, kthread_stats_t *stats) {
+    if(!thd || !stats)
+        return -1;
+
+    irq_disable_scoped();
+
+    stats->tid = thd->tid;
+    stats->prio = thd->prio;
+    stats->state = thd->state;
+    stats->cpu_time = thd_get_cpu_time(thd);
+    stats->wait_time = thd->sched_stats.wait_total;
+    stats->vol_switches = thd->sched_stats.vol_switches;
+    stats->invol_switches = thd->sched_stats.invol_switches;
+
+    return 0;
+}
+
 /*****************************************************************************/
 
 /* Change threading modes */
@@ -1000,6 +1182,27 @@ int thd_set_hz(unsigned int hertz) {
     return 0;
 }
 
+void thd_set_tickless(bool enable) {
+    irq_disable_scoped();
+
+    if(thd_tickless == enable)
+        return;
+
+    thd_tickless = enable;
+
+    /* If the scheduler is running, switch over to the new timing now. */
+    if(thd_mode != THD_MODE_NONE) {
+        if(enable)
+            thd_timer_rearm(timer_ms_gettime64());
+        else
+            timer_primary_wakeup(thd_sched_ms);
+    }
+}
+
+bool thd_get_tickless(void) {
+    return thd_tickless;
+}
+
 /* Delete a TLS key. Note that currently this doesn't prevent you from reusing
    the key after deletion. This seems ok, as the pthreads standard states that
    using the key after deletion results in "undefined behavior".
@@ -1065,6 +1268,7 @@ int thd_init(void) {
     };
 
     kthread_t *kern;
+    int i;
 
     /* Make sure we're not already running */
     if(thd_mode != THD_MODE_NONE)
@@ -1080,7 +1284,10 @@ int thd_init(void) {
     LIST_INIT(&thd_list);
 
     /* Initialize the run queue */
-    TAILQ_INIT(&run_queue);
+    for(i = 0; i < RUNQ_BUCKETS; ++i)
+        TAILQ_INIT(&run_queue[i]);
+
+    run_map = 0;
 
     /* Start off with no "current" thread */
     thd_current = NULL;
@@ -0,0 +1,344 @@
+/* KallistiOS ##version##
+
+   thread_pool.c
+   Copyright (C) 2026 KallistiOS Contributors
+*/
+
+/* This module implements thread pools on top of threaded workers. Each worker
+   has its own task queue, used as a deque: the worker pushes and pops tasks at
+   the tail, while other workers (and threads waiting on a counter) steal from
+   the head. */
+
+#include <arch/irq.h>
+#include <kos/genwait.h>
+#include <kos/thread.h>
+#include <kos/thread_pool.h>
+#include <kos/worker_thread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/queue.h>
+
+/* Chunks per worker for thd_pool_parallel_for() with no grain given. */
+#define PFOR_CHUNKS_PER_WORKER  4
+
+struct pool_worker {
+    kthread_pool_t *pool;
+    kthread_worker_t *worker;
+    kthread_t *thd;
+    struct kthread_task_list tasks;
+    bool busy;
+};
+
+struct kthread_pool {
+    unsigned int count;
+    unsigned int next;
+    unsigned int pending;
+    struct pool_worker workers[];
+};
+
+struct pfor_chunk {
+    kthread_task_t task;
+    size_t begin, end;
+    void (*routine)(size_t begin, size_t end, void *data);
+    void *data;
+};
+
+/* Find the worker that the current thread is, if any. */
+static struct pool_worker *pool_self(kthread_pool_t *pool) {
+    unsigned int i;
+
+    for(i = 0; i < pool->count; ++i) {
+        if(pool->workers[i].thd == thd_current)
+            return &pool->workers[i];
+    }
+
+    return NULL;
+}
+
+/* Take a task to run: the newest one on our own queue, or else the oldest one
+   on somebody else's. Assumes ints are disabled. */
+static kthread_task_t *pool_take(kthread_pool_t *pool, struct pool_worker *self) {
+    kthread_task_t *task;
+    unsigned int i, start;
+
+    if(self && (task = TAILQ_LAST(&self->tasks, kthread_task_list))) {
+        TAILQ_REMOVE(&self->tasks, task, entry);
+        return task;
+    }
+
+    start = self ? (unsigned int)(self - pool->workers) + 1 : 0;
+
+    for(i = 0; i < pool->count; ++i) {
+        struct pool_worker *w = &pool->workers[(start + i) % pool->count];
+
+        if((task = TAILQ_FIRST(&w->tasks))) {
+            TAILQ_REMOVE(&w->tasks, task, entry);
+            return task;
+        }
+    }
+
+    return NULL;
+}
+
+/* Put a task on a queue and get a worker going on it. Assumes ints are
+   disabled. */
+static void pool_queue(kthread_pool_t *pool, kthread_task_t *task) {
+    struct pool_worker *w;
+    unsigned int i;
+
+    if(!(w = pool_self(pool)))
+        w = &pool->workers[pool->next++ % pool->count];
+
+    TAILQ_INSERT_TAIL(&w->tasks, task, entry);
+    ++pool->pending;
+
+    /* If that worker is already busy, see if anyone else is free to steal
+       it instead. */
+    for(i = 0; w->busy && i < pool->count; ++i) {
+        if(!pool->workers[i].busy)
+            w = &pool->workers[i];
+    }
+
+    thd_worker_wakeup(w->worker);
+}
+
+/* A counter has reached zero, so release everything waiting on it. Assumes
+   ints are disabled. */
+static void counter_release(kthread_task_counter_t *counter) {
+    kthread_task_t *task;
+
+    while((task = TAILQ_FIRST(&counter->waiting))) {
+        TAILQ_REMOVE(&counter->waiting, task, entry);
+        pool_queue(task->pool, task);
+    }
+
+    genwait_wake_all(counter);
+}
+
+static void pool_run(kthread_pool_t *pool, kthread_task_t *task) {
+    /* The task may be freed by its routine, so grab what we need first. */
+    kthread_task_counter_t *counter = task->counter;
+
+    task->routine(task->data);
+
+    irq_disable_scoped();
+
+    if(!--pool->pending)
+        genwait_wake_all(pool);
+
+    if(counter && !--counter->count)
+        counter_release(counter);
+}
+
+static void pool_work(void *d) {
+    struct pool_worker *self = (struct pool_worker *)d;
+    kthread_task_t *task;
+    uint32_t flags;
+
+    for(;;) {
+        flags = irq_disable();
+
+        if(!(task = pool_take(self->pool, self))) {
+            self->busy = false;
+            irq_restore(flags);
+            return;
+        }
+
+        self->busy = true;
+        irq_restore(flags);
+
+        pool_run(self->pool, task);
+    }
+}
+
+kthread_pool_t *thd_pool_create(unsigned int count, const kthread_attr_t *attr) {
+    kthread_pool_t *pool;
+    kthread_attr_t real_attr = { 0 };
+    unsigned int i;
+
+    if(attr)
+        real_attr = *attr;
+
+    if(!count || real_attr.stack_ptr) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if(!real_attr.label)
+        real_attr.label = "thread pool";
+
+    pool = malloc(sizeof(kthread_pool_t) + count * sizeof(struct pool_worker));
+    if(!pool) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    pool->count = count;
+    pool->next = 0;
+    pool->pending = 0;
+
+    for(i = 0; i < count; ++i) {
+        struct pool_worker *w = &pool->workers[i];
+
+        w->pool = pool;
+        w->busy = false;
+        TAILQ_INIT(&w->tasks);
+
+        if(!(w->worker = thd_worker_create_ex(&real_attr, pool_work, w))) {
+            while(i--)
+                thd_worker_destroy(pool->workers[i].worker);
+
+            free(pool);
+            errno = ENOMEM;
+            return NULL;
+        }
+
+        w->thd = thd_worker_get_thread(w->worker);
+    }
+
+    return pool;
+}
+
+void thd_pool_destroy(kthread_pool_t *pool) {
+    uint32_t flags;
+    unsigned int i;
+
+    if(!pool)
+        return;
+
+    flags = irq_disable();
+
+    while(pool->pending)
+        genwait_wait(pool, "thd_pool_destroy", 0, NULL);
+
+    irq_restore(flags);
+
+    for(i = 0; i < pool->count; ++i)
+        thd_worker_destroy(pool->workers[i].worker);
+
+    free(pool);
+}
+
+int thd_pool_submit(kthread_pool_t *pool, kthread_task_t *task) {
+    if(!pool || !task) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    if(!task->routine) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    irq_disable_scoped();
+
+    task->pool = pool;
+
+    if(task->counter)
+        ++task->counter->count;
+
+    if(task->depends && task->depends->count)
+        TAILQ_INSERT_TAIL(&task->depends->waiting, task, entry);
+    else
+        pool_queue(pool, task);
+
+    return 0;
+}
+
+int thd_pool_wait(kthread_pool_t *pool, kthread_task_counter_t *counter) {
+    kthread_task_t *task;
+    uint32_t flags;
+
+    if(irq_inside_int()) {
+        errno = EPERM;
+        return -1;
+    }
+
+    if(!pool || !counter) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    flags = irq_disable();
+
+    while(counter->count) {
+        /* Rather than just sitting here, help out if there's anything to do. */
+        if((task = pool_take(pool, pool_self(pool)))) {
+            irq_restore(flags);
+            pool_run(pool, task);
+            flags = irq_disable();
+        }
+        else {
+            genwait_wait(counter, "thd_pool_wait", 0, NULL);
+        }
+    }
+
+    irq_restore(flags);
+
+    return 0;
+}
+
+static void pfor_run(void *d) {
+    struct pfor_chunk *chunk = (struct pfor_chunk *)d;
+
+    chunk->routine(chunk->begin, chunk->end, chunk->data);
+}
+
+int thd_pool_parallel_for(kthread_pool_t *pool, size_t count, size_t grain,
+                          void (*routine)(size_t begin, size_t end, void *data),
+                          void *data) {
+    kthread_task_counter_t counter;
+    struct pfor_chunk *chunks;
+    size_t i, nchunks;
+
+    if(irq_inside_int()) {
+        errno = EPERM;
+        return -1;
+    }
+
+    if(!pool || !routine) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    if(!count)
+        return 0;
+
+    if(!grain) {
+        grain = count / (pool->count * PFOR_CHUNKS_PER_WORKER);
+
+        if(!grain)
+            grain = 1;
+    }
+
+    nchunks = (count + grain - 1) / grain;
+
+    if(!(chunks = malloc(nchunks * sizeof(struct pfor_chunk)))) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    thd_task_counter_init(&counter);
+
+    for(i = 0; i < nchunks; ++i) {
+        chunks[i].begin = i * grain;
+        chunks[i].end = chunks[i].begin + grain;
+        if(chunks[i].end > count)
+            chunks[i].end = count;
+        chunks[i].routine = routine;
+        chunks[i].data = data;
+
+        chunks[i].task.routine = pfor_run;
+        chunks[i].task.data = &chunks[i];
+        chunks[i].task.counter = &counter;
+        chunks[i].task.depends = NULL;
+
+        thd_pool_submit(pool, &chunks[i].task);
+    }
+
+    thd_pool_wait(pool, &counter);
+    free(chunks);
+
+    return 0;
+}
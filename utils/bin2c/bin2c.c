@@ -30,7 +30,8 @@ void convert(char *ifn, char *ofn, char *prefix) {
     fprintf(o, "const int %s_size = %d;\n", prefix, left);
 
     fprintf(o, "#ifdef __cplusplus\nextern \"C\"\n#endif\n");
-    fprintf(o, "const unsigned char %s_data[%d] =", prefix, left);
+    fprintf(o, "const unsigned char %s_data[%d] __attribute__((aligned(32))) =",
+            prefix, left);
     fprintf(o, "{\n\t");
 
     lc = 0;
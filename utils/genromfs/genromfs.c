@@ -20,6 +20,7 @@
  *                      (Florian Schulze, Brian Peek)
  *     13 Aug 2020              Mingw build fixes
  *                      (Hayden Kowalchuk)
+ *     16 Oct 2026              KOS path lookup index (-i)
  */
 
 /*
@@ -56,6 +57,8 @@
  * -A N,/name force named file(s) (shell globbing applied against the filenames)
  *       to be aligned on N bytes boundary
  * In both cases, N must be a power of two.
+ * -i    append a path lookup index for the KallistiOS romdisk driver (see
+ *       below); the image stays a valid romfs image either way
  */
 
 /*
@@ -68,6 +71,7 @@
 #endif
 
 #include <stdio.h>  /* Userland pieces of the ANSI C standard I/O package  */
+#include <ctype.h>
 #include <stdlib.h> /* Userland prototypes of the ANSI C std lib functions */
 #include <stdint.h>
 #include <string.h> /* Userland prototypes of the string handling funcs    */
@@ -140,6 +144,46 @@ struct filenode {
     unsigned int pad;
 };
 
+/*
+ * KOS path lookup index
+ *
+ * With -i, a hash table of the path of every directory and regular file
+ * (other than . and .. and hard links) is placed after the last file in the
+ * image, and counted in the image size in the romfs header. The romfs code
+ * in other kernels never looks at it. Unlike the rest of romfs, all of the
+ * index is stored little-endian, so the KOS romdisk driver can use it in
+ * place. It looks like this:
+ *
+ *   header:  u32 version (1), u32 entry count, u32 table size, u32 zero
+ *   entries: u32 path hash, u32 header offset, u32 parent entry (or ~0)
+ *   table:   u32 entry number + 1 (0 for an empty slot), linear probing
+ *
+ * The last 16 bytes of the image (as given by the size in the romfs header)
+ * are a trailer: "-kosidx-", u32 index offset, u32 index size.
+ *
+ * The path hash is 32-bit FNV-1a over the lowercased path relative to the
+ * root of the image, with components separated by a single '/'. This must
+ * match rd_hash_add() in kernel/fs/fs_romdisk.c.
+ */
+#define KOSIDX_MAGIC        "-kosidx-"
+#define KOSIDX_VERSION      1
+#define KOSIDX_NO_PARENT    0xffffffff
+#define KOSIDX_HASH_INIT    0x811c9dc5
+#define KOSIDX_HASH_PRIME   0x01000193
+
+struct kosidx_ent {
+    uint32_t hash;
+    uint32_t offset;
+    uint32_t parent;
+};
+
+struct kosidx {
+    struct kosidx_ent *ents;
+    uint32_t count;
+    uint32_t max;
+    uint32_t tsize;
+};
+
 struct aligns {
     struct aligns *next;
     int align;
@@ -447,7 +491,128 @@ int dumpnode(struct filenode *node, FILE *f) {
     return 0;
 }
 
-int dumpall(struct filenode *node, int lastoff, FILE *f) {
+uint32_t kosidx_hash(uint32_t hash, const char *s, size_t len) {
+    while(len--) {
+        hash ^= (unsigned char)tolower((unsigned char)*s++);
+        hash *= KOSIDX_HASH_PRIME;
+    }
+
+    return hash;
+}
+
+/* The index is laid out in image order, which is the order the KOS driver
+   would come across the entries in while walking the directories. */
+void kosidx_scan(struct kosidx *idx, struct filenode *dir, uint32_t hash,
+                 uint32_t parent) {
+    struct filenode *p;
+    uint32_t h;
+
+    for(p = dir->dirlist.head; p->next; p = p->next) {
+        if(p->orig_link || !strcmp(p->name, ".") || !strcmp(p->name, ".."))
+            continue;
+
+        if(!S_ISDIR(p->modes) && !S_ISREG(p->modes))
+            continue;
+
+        h = hash;
+
+        if(parent != KOSIDX_NO_PARENT)
+            h = kosidx_hash(h, "/", 1);
+
+        h = kosidx_hash(h, p->name, strlen(p->name));
+
+        if(idx->count == idx->max) {
+            idx->max = idx->max ? idx->max * 2 : 64;
+            idx->ents = realloc(idx->ents, idx->max * sizeof(*idx->ents));
+
+            if(!idx->ents) {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+        }
+
+        idx->ents[idx->count].hash = h;
+        idx->ents[idx->count].offset = p->offset;
+        idx->ents[idx->count].parent = parent;
+        ++idx->count;
+
+        if(S_ISDIR(p->modes))
+            kosidx_scan(idx, p, h, idx->count - 1);
+    }
+}
+
+int kosidx_size(struct kosidx *idx) {
+    return 16 + idx->count * 12 + idx->tsize * 4;
+}
+
+void kosidx_build(struct kosidx *idx, struct filenode *root) {
+    memset(idx, 0, sizeof(*idx));
+    kosidx_scan(idx, root, KOSIDX_HASH_INIT, KOSIDX_NO_PARENT);
+
+    /* Keep the table at most half full, so that lookups stay short. */
+    for(idx->tsize = 16; idx->tsize < idx->count * 2; idx->tsize <<= 1)
+        ;
+}
+
+void put_le32(unsigned char *p, uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+void dumpkosidx(struct kosidx *idx, int idxoff, FILE *f) {
+    unsigned char buf[16];
+    uint32_t *table, i, slot;
+
+    table = calloc(idx->tsize, sizeof(uint32_t));
+
+    if(!table) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    for(i = 0; i < idx->count; ++i) {
+        slot = idx->ents[i].hash & (idx->tsize - 1);
+
+        while(table[slot])
+            slot = (slot + 1) & (idx->tsize - 1);
+
+        table[slot] = i + 1;
+    }
+
+    put_le32(buf, KOSIDX_VERSION);
+    put_le32(buf + 4, idx->count);
+    put_le32(buf + 8, idx->tsize);
+    put_le32(buf + 12, 0);
+    dumpdata(buf, 16, f);
+
+    for(i = 0; i < idx->count; ++i) {
+        put_le32(buf, idx->ents[i].hash);
+        put_le32(buf + 4, idx->ents[i].offset);
+        put_le32(buf + 8, idx->ents[i].parent);
+        dumpdata(buf, 12, f);
+    }
+
+    for(i = 0; i < idx->tsize; ++i) {
+        put_le32(buf, table[i]);
+        dumpdata(buf, 4, f);
+    }
+
+    /* The index itself is a multiple of 4 bytes; pad it out to 16. */
+    if(kosidx_size(idx) & 15)
+        dumpzero(16 - (kosidx_size(idx) & 15), f);
+
+    memcpy(buf, KOSIDX_MAGIC, 8);
+    put_le32(buf + 8, idxoff);
+    put_le32(buf + 12, kosidx_size(idx));
+    dumpdata(buf, 16, f);
+
+    free(table);
+}
+
+int dumpall(struct filenode *node, int lastoff, struct kosidx *idx,
+            int idxoff, FILE *f) {
     struct romfh ri;
     struct filenode *p;
 
@@ -465,6 +630,9 @@ int dumpall(struct filenode *node, int lastoff, FILE *f) {
         p = p->next;
     }
 
+    if(idx)
+        dumpkosidx(idx, idxoff, f);
+
     /* Align the whole bunch to ROMBSIZE boundary */
     if(lastoff & 1023)
         dumpzero(1024 - (lastoff & 1023), f);
@@ -791,6 +959,7 @@ void showhelp(const char *argv0) {
     printf("  -a ALIGN               Align regular file data to ALIGN bytes\n");
     printf("  -A ALIGN,PATTERN       Align all objects matching pattern to at least ALIGN bytes\n");
     printf("  -x PATTERN             Exclude all objects matching pattern\n");
+    printf("  -i                     Add a path lookup index for the KOS romdisk driver\n");
     printf("  -h                     Show this help\n");
     printf("\n");
     printf("Report bugs to chexum@shadow.banki.hu\n");
@@ -802,6 +971,9 @@ int main(int argc, char *argv[]) {
     char *outf = NULL;
     char *volname = NULL;
     int verbose = 0;
+    int index = 0;
+    struct kosidx idx;
+    int idxoff = 0;
     char buf[256];
     struct filenode *root;
     struct stat sb;
@@ -812,7 +984,7 @@ int main(int argc, char *argv[]) {
     struct excludes *pe, *pe2;
     FILE *f;
 
-    while((c = getopt(argc, argv, "V:vd:f:ha:A:x:")) != EOF) {
+    while((c = getopt(argc, argv, "V:vd:f:ha:A:x:i")) != EOF) {
         switch(c) {
             case 'd':
                 dir = optarg;
@@ -826,6 +998,9 @@ int main(int argc, char *argv[]) {
             case 'v':
                 verbose = 1;
                 break;
+            case 'i':
+                index = 1;
+                break;
             case 'h':
                 showhelp(argv[0]);
                 exit(0);
@@ -921,7 +1096,19 @@ int main(int argc, char *argv[]) {
     if(verbose)
         shownode(0, root, stderr);
 
-    if(dumpall(root, lastoff, f)) {
+    if(index) {
+        /* The index (plus its trailer) goes right after the last file, and
+           is included in the size of the image. */
+        kosidx_build(&idx, root);
+        idxoff = lastoff;
+        lastoff += ALIGNUP16(kosidx_size(&idx)) + 16;
+
+        if(verbose)
+            fprintf(stderr, "index: %u entries, %u slots, at 0x%x\n",
+                    idx.count, idx.tsize, idxoff);
+    }
+
+    if(dumpall(root, lastoff, index ? &idx : NULL, idxoff, f)) {
         fprintf(stderr, "Error while dumping!\n");
         return 1;
     }